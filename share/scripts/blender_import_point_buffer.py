@@ -6,8 +6,14 @@ def read_point_cloud(context, filepath):
     print("running read_some_data...")
     f = open(filepath, 'rb')
     
-    point_count = int(struct.unpack("f", f.read(4))[0])
-    f.read(4) # anim
+    magic = f.read(4)
+    if magic == b"GVPC":
+        # Version 2 header: see PointCloud.h
+        version, point_count, frame_count, chunk_count, attributes, _, data_offset = struct.unpack("<IQQQIIQ", f.read(44))
+        f.seek(data_offset)
+    else:
+        point_count = int(struct.unpack("f", magic)[0])
+        f.read(4) # anim
     print("Loading {} points...".format(point_count))
     points = [(0.,0.,0.)]*point_count
     for i in range(point_count):
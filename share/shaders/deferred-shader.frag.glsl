@@ -33,8 +33,8 @@ uniform sampler2D uColormap;
 uniform bool uHasColormap = false;
 
 #include "include/light.inc.glsl"
+#include "include/uniform/lights.inc.glsl"
 
-uniform PointLight light[3];
 uniform float lightPowerScale = 1.0;
 
 // Global switches
@@ -83,7 +83,7 @@ void pbrShading(const in GFragment fragment, out OutputFragment out_fragment)
 			float shadowBias = shadowBiasFromNormal(light[k], fragment.normal);
 			shadowBias = 0.0001; // hardcoded hack
 			//shadowBias = 0.00005;
-			shadow = shadowAt(light[k], fragment.ws_coord, uShadowMapBias);
+			shadow = shadowAt(light[k], uShadowMaps[k], uRichShadowMaps[k], fragment.ws_coord, uShadowMapBias);
 			shadow = clamp(shadow, 0.0, 1.0);
 			//shadow *= .8;
 		}
@@ -188,7 +188,7 @@ void main() {
 
 	/*/ Minimap Shadow Depth
 	if (gl_FragCoord.x < 256 && gl_FragCoord.y < 256) {
-		float depth = texelFetch(light[0].shadowMap, ivec2(gl_FragCoord.xy * 4.0), 0).r;
+		float depth = texelFetch(uShadowMaps[0], ivec2(gl_FragCoord.xy * 4.0), 0).r;
 		out_fragment.radiance = vec4(vec3(pow(1. - depth, 0.1)), 1.0);
 	}
 	//*/
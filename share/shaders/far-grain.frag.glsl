@@ -24,7 +24,7 @@ uniform bool uShowSampleCount;
 
 uniform sampler2D uDepthTexture;
 
-uniform bool uDebugRenderType = false;
+#include "include/uniform/grain.inc.glsl"
 uniform vec3 uDebugRenderColor = vec3(32.0/255.0, 64.0/255.0, 161.0/255.0);
 
 #include "include/uniform/camera.inc.glsl"
@@ -42,7 +42,7 @@ out FragmentData {
 #include "include/raytracing.inc.glsl"
 #include "include/gbuffer2.inc.glsl"
 #include "include/impostor.inc.glsl"
-uniform SphericalImpostor uImpostor[3];
+#include "include/uniform/impostors.inc.glsl"
 
 uniform bool uUseShellCulling = true;
 uniform sampler2D uDepthTexture;
@@ -116,12 +116,12 @@ void main() {
 
 	// base color
 	if (uImpostor[0].hasBaseColorMap) {
-		int level = textureQueryLevels(uImpostor[0].baseColorTexture);
+		int level = textureQueryLevels(uImpostorMaps[0].baseColorTexture);
 		mat4 colors = mat4(
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.x)), level - 1),
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.y)), level - 1),
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.z)), level - 1),
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.w)), level - 1)
+			texelFetch(uImpostorMaps[0].baseColorTexture, ivec3(0, 0, int(i.x)), level - 1),
+			texelFetch(uImpostorMaps[0].baseColorTexture, ivec3(0, 0, int(i.y)), level - 1),
+			texelFetch(uImpostorMaps[0].baseColorTexture, ivec3(0, 0, int(i.z)), level - 1),
+			texelFetch(uImpostorMaps[0].baseColorTexture, ivec3(0, 0, int(i.w)), level - 1)
 		);
 		vec4 c = colors * vec4(vec2(calpha.x, alpha.x) * calpha.y, vec2(calpha.x, alpha.x) * alpha.y);
 		outData.baseColor = c.rgb;// * 1.8;
@@ -131,12 +131,12 @@ void main() {
 
 	// metallic/roughness
 	if (uImpostor[0].hasMetallicRoughnessMap) {
-		int level = textureQueryLevels(uImpostor[0].metallicRoughnessTexture);
+		int level = textureQueryLevels(uImpostorMaps[0].metallicRoughnessTexture);
 		mat4 colors = mat4(
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.x)), level - 1),
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.y)), level - 1),
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.z)), level - 1),
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.w)), level - 1)
+			texelFetch(uImpostorMaps[0].metallicRoughnessTexture, ivec3(0, 0, int(i.x)), level - 1),
+			texelFetch(uImpostorMaps[0].metallicRoughnessTexture, ivec3(0, 0, int(i.y)), level - 1),
+			texelFetch(uImpostorMaps[0].metallicRoughnessTexture, ivec3(0, 0, int(i.z)), level - 1),
+			texelFetch(uImpostorMaps[0].metallicRoughnessTexture, ivec3(0, 0, int(i.w)), level - 1)
 		);
 		vec4 c = colors * vec4(vec2(calpha.x, alpha.x) * calpha.y, vec2(calpha.x, alpha.x) * alpha.y);
 		outData.metallic = c.x;
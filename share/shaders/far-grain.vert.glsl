@@ -11,14 +11,12 @@
 ///////////////////////////////////////////////////////////////////////////////
 #else // PASS_BLIT_TO_MAIN_FBO
 
+// With quantized positions, the buffer holds normalized 16 bit coordinates
+// relative to the chunk of the point, i.e. (t, 0) with t in [0,1]^3
 layout (location = 0) in vec4 position;
 
-struct PointCloundVboEntry {
-    vec4 position;
-};
-layout(std430, binding = 0) restrict readonly buffer pointsSsbo {
-    PointCloundVboEntry pointVertexAttributes[];
-};
+#define POINTS_BINDING 0
+#include "include/points.inc.glsl"
 layout (std430, binding = 1) restrict readonly buffer pointElementsSsbo {
     uint pointElements[];
 };
@@ -33,7 +31,7 @@ out VertexData {
 uniform mat4 modelMatrix;
 uniform mat4 viewModelMatrix;
 
-uniform float uGrainRadius = 0.005;
+#include "include/uniform/grain.inc.glsl"
 
 uniform uint uFrameCount;
 uniform uint uPointCount;
@@ -58,7 +56,9 @@ void main() {
 
 	vec3 p =
 		uUsePointElements
-		? pointVertexAttributes[animPointId].position.xyz
+		? fetchPointPosition(animPointId)
+		: uQuantizedPositions
+		? dequantizePointPosition(position.xyz, uint(gl_VertexID))
 		: position.xyz;
 
 #ifdef PROCEDURAL_ANIM0
@@ -0,0 +1,31 @@
+// Requires "../include/anim.inc.glsl" and "../include/points.inc.glsl", as
+// well as uPointCount, uFrameCount, uTime and uFps uniforms.
+
+#ifdef CHUNK_CULLING
+// Visible chunks, listed by grain/cull-chunks.comp.glsl, which also sets the
+// indirect dispatch size of per grain steps to uGroupsPerChunk groups per chunk.
+layout(std430, binding = 4) restrict readonly buffer chunkCullingSsbo {
+	uvec4 chunkCullingHeader;
+	uint visibleChunks[];
+};
+uniform uint uGroupsPerChunk;
+
+/**
+ * Element (point index within the current frame) processed by the current
+ * invocation of work group workGroup, or uPointCount if there is none.
+ */
+uint getElement(uint workGroup) {
+	uint chunk = visibleChunks[workGroup / uGroupsPerChunk];
+	uint offsetInChunk = (workGroup % uGroupsPerChunk) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+	uint frameStart = AnimationFrame(uFrameCount, uTime, uFps) * uPointCount;
+	uint pointId = chunk * uPointChunkSize + offsetInChunk;
+	if (offsetInChunk >= uPointChunkSize || pointId < frameStart || pointId >= frameStart + uPointCount) {
+		return uPointCount; // out of range
+	}
+	return pointId - frameStart;
+}
+#else // CHUNK_CULLING
+uint getElement(uint workGroup) {
+	return workGroup * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+}
+#endif // CHUNK_CULLING
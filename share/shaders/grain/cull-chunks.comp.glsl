@@ -0,0 +1,73 @@
+#version 450 core
+#include "sys:defines"
+
+// First level of PointCloudSplitter's culling: test bounding boxes of the
+// point chunks of the current frame and list the visible ones, together
+// with the indirect dispatch command of per grain steps.
+
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// Must match PointCloudSplitter::ChunkCullingHeader
+layout(std430, binding = 4) restrict buffer chunkCullingSsbo {
+	// Reset to (0, 1, 1, 0) before the dispatch
+	uint dispatchGroupCountX;
+	uint dispatchGroupCountY;
+	uint dispatchGroupCountZ;
+	uint visibleChunkCount;
+	uint visibleChunks[];
+};
+
+uniform uint uPointCount; // points per frame
+uniform uint uFrameCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+uniform uint uGroupsPerChunk; // work groups of per grain steps needed for a chunk
+
+#include "../include/uniform/grain.inc.glsl"
+
+uniform mat4 modelMatrix;
+uniform mat4 viewModelMatrix;
+#include "../include/uniform/camera.inc.glsl"
+
+#define POINTS_BINDING 3
+#include "../include/points.inc.glsl"
+#include "../include/anim.inc.glsl"
+#include "../include/frustum.inc.glsl"
+#include "hzb-culling.inc.glsl"
+
+uniform bool uEnableFrustumCulling = true;
+uniform bool uEnableOcclusionCulling = true;
+uniform bool uUseBbox = false;
+uniform vec3 uBboxMin;
+uniform vec3 uBboxMax;
+
+void main() {
+	// Chunks overlapping the current frame
+	uint frameStart = AnimationFrame(uFrameCount, uTime, uFps) * uPointCount;
+	uint firstChunk = frameStart / uPointChunkSize;
+	uint lastChunk = (frameStart + uPointCount - 1) / uPointChunkSize;
+	uint chunk = firstChunk + gl_GlobalInvocationID.x;
+	if (chunk > lastChunk) return;
+
+	vec3 aabbMin = pointChunks[chunk].aabbMin.xyz;
+	vec3 aabbMax = pointChunks[chunk].aabbMax.xyz;
+
+	// Same unexplained margin as in discriminate()
+	float fac = 4.0;
+	vec3 center_cs = (viewModelMatrix * vec4(0.5 * (aabbMin + aabbMax), 1.0)).xyz;
+	float radius = 0.5 * length(aabbMax - aabbMin) + fac * uGrainRadius;
+	if (uEnableFrustumCulling && SphereFrustumCulling(projectionMatrix, center_cs, radius)) {
+		return;
+	}
+
+	if (uEnableOcclusionCulling && uOcclusionCulling == cOcclusionCullingHzb && HzbSphereOcclusionCulling(uHzb, center_cs, radius)) {
+		return;
+	}
+
+	if (uUseBbox && (any(lessThan(aabbMax, uBboxMin)) || any(greaterThan(aabbMin, uBboxMax)))) {
+		return;
+	}
+
+	visibleChunks[atomicAdd(visibleChunkCount, 1)] = chunk;
+	atomicAdd(dispatchGroupCountX, uGroupsPerChunk);
+}
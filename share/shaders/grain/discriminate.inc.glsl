@@ -1,6 +1,7 @@
 // require camera.inc.glsl
 
 #include "../include/frustum.inc.glsl"
+#include "hzb-culling.inc.glsl"
 
 // Must match PointCloudSplitter::RenderModel
 const uint cRenderModelInstance = 0;
@@ -11,8 +12,11 @@ const uint cRenderModelNone = 3;
 uniform bool uEnableOcclusionCulling = true;
 uniform bool uEnableFrustumCulling = true;
 
+// Set by PointCloudSplitter from either distances or radii on screen
+#ifndef PER_VIEW_LOD_LIMITS
 uniform float uInstanceLimit = 1.05; // distance beyond which we switch from instances to impostors
 uniform float uImpostorLimit = 10.0; // distance beyond which we switch from impostors to points
+#endif // PER_VIEW_LOD_LIMITS
 
 uniform bool uUseBbox = false;
 uniform vec3 uBboxMin;
@@ -36,6 +40,8 @@ bool isInOcclusionCone(vec3 position_cs, vec3 otherGrain_cs, float innerRadius,
 /**
  * Choses the most appropriate model to render the point at model position
  * 'position', which may be no model at all if culling tests don't pass.
+ * Occlusion is tested against either occlusionMap or hzb, depending on
+ * uOcclusionCulling.
  * return one of cRenderModel* constants
  */
 uint discriminate(
@@ -43,7 +49,8 @@ uint discriminate(
 	float outerRadius,
 	float innerRadius,
 	float outerOverInnerRadius,
-	sampler2D occlusionMap)
+	sampler2D occlusionMap,
+	sampler2D hzb)
 {
 	vec4 position_cs = viewModelMatrix * vec4(position, 1.0);
 
@@ -52,6 +59,7 @@ uint discriminate(
 
 	/////////////////////////////////////////
 	// Distance-based discrimination
+	// (w = 1, so limits are compared with d^2 + 1, see PointCloudSplitter::lodDistanceLimits())
 	uint model = cRenderModelNone;
 	float l2 = dot(position_cs, position_cs);
 	if (l2 < impostorLimit2) {
@@ -82,7 +90,12 @@ uint discriminate(
 
 	/////////////////////////////////////////
 	// Occlusion culling
-	if (uEnableOcclusionCulling) {
+	if (uEnableOcclusionCulling && uOcclusionCulling == cOcclusionCullingHzb) {
+		if (HzbSphereOcclusionCulling(hzb, position_cs.xyz, outerRadius)) {
+			return cRenderModelNone;
+		}
+	}
+	else if (uEnableOcclusionCulling) {
 		vec4 position_ps = projectionMatrix * vec4(position_cs.xyz, 1.0);
 		vec2 fragCoord = resolution.xy * (position_ps.xy / position_ps.w * 0.5 + 0.5);
 
@@ -112,4 +125,12 @@ uint discriminate(
 	return model;
 }
 
-
+uint discriminate(
+	vec3 position,
+	float outerRadius,
+	float innerRadius,
+	float outerOverInnerRadius,
+	sampler2D occlusionMap)
+{
+	return discriminate(position, outerRadius, innerRadius, outerOverInnerRadius, occlusionMap, uHzb);
+}
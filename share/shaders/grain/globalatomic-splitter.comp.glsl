@@ -5,13 +5,10 @@
 // Matches enums in PointCloudSplitter.h
 #pragma variant RENDER_TYPE_FORGET RENDER_TYPE_CACHE RENDER_TYPE_PRECOMPUTE
 #pragma variant STEP_PRECOMPUTE STEP_RESET STEP_COUNT STEP_OFFSET STEP_WRITE
+#pragma opt CHUNK_CULLING
 
 layout (local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
 
-struct PointCloundVboEntry {
-	vec4 position;
-};
-
 struct Counter {
 	uint count;
 	uint offset;
@@ -32,6 +29,14 @@ layout (std430, binding = 2) restrict writeonly buffer elementBufferSsbo {
 
 #include "../include/anim.inc.glsl"
 
+#define POINTS_BINDING 3
+#include "../include/points.inc.glsl"
+
+#if defined(STEP_RESET) || defined(STEP_OFFSET)
+#undef CHUNK_CULLING // these steps are not dispatched on chunks
+#endif
+#include "chunk-culling.inc.glsl"
+
 /**
  * getRenderType(): Get the index of the model to use for a given element.
  * Several options to investigate:
@@ -59,9 +64,7 @@ uint getRenderType(uint element) {
 #else // RENDER_TYPE_PRECOMPUTE
 
 uniform sampler2D uOcclusionMap;
-uniform float uGrainRadius;
-uniform float uGrainInnerRadiusRatio;
-uniform float uOuterOverInnerRadius; // 1./uGrainInnerRadiusRatio
+#include "../include/uniform/grain.inc.glsl"
 
 uniform mat4 modelMatrix;
 uniform mat4 viewModelMatrix;
@@ -75,13 +78,9 @@ layout(std430, binding = 1) restrict writeonly buffer renderTypeSsbo {
 };
 #endif // RENDER_TYPE_CACHE
 
-layout(std430, binding = 3) restrict readonly buffer pointSsbo {
-	PointCloundVboEntry point[];
-};
-
 uint getRenderType(uint element) {
 	uint pointId = AnimatedPointId2(element, uFrameCount, uPointCount, uTime, uFps);
-	vec3 position = point[pointId].position.xyz;
+	vec3 position = fetchPointPosition(pointId);
 	float innerRadius = uGrainRadius * uGrainInnerRadiusRatio;
 	uint type = discriminate(position, uGrainRadius, innerRadius, uOuterOverInnerRadius, uOcclusionMap);
 #ifdef RENDER_TYPE_CACHE
@@ -94,7 +93,7 @@ uint getRenderType(uint element) {
 #endif // RENDER_TYPE_PRECOMPUTE
 
 void main() {
-	uint i = gl_GlobalInvocationID.x;
+	uint i = getElement(gl_WorkGroupID.x);
 	if (i >= uPointCount) return;
 	uint type, beforeIncrement;
 
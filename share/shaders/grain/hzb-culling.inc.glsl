@@ -0,0 +1,66 @@
+#pragma once
+// Hierarchical-Z occlusion test, used when PointCloudSplitter's occlusionCulling
+// property is Hzb instead of the point splat occlusion map.
+// require camera.inc.glsl
+
+// Must match PointCloudSplitter::OcclusionCulling
+const int cOcclusionCullingPointSplat = 0;
+const int cOcclusionCullingHzb = 1;
+
+uniform int uOcclusionCulling = cOcclusionCullingPointSplat;
+
+// Max depth pyramid of the occluders (see hzb-occluders.vert.glsl), whose
+// level 0 covers the whole viewport at a possibly lower resolution.
+uniform sampler2D uHzb;
+
+/**
+ * Return true if the sphere of radius 'radius' centered at 'center_cs' (in
+ * camera space) is entirely behind the occluders of the pyramid 'hzb'. The level of the pyramid is
+ * chosen such that the screen rectangle of the sphere falls within a single
+ * texel, so that the test is a single fetch.
+ */
+bool HzbSphereOcclusionCulling(sampler2D hzb, vec3 center_cs, float radius) {
+	// Screen rectangle and closest depth of the bounding cube of the sphere,
+	// which are conservative as long as it is entirely in front of the camera.
+	vec2 ndcMin = vec2(1e9);
+	vec2 ndcMax = vec2(-1e9);
+	float ndcDepth = 1.0;
+	for (int k = 0; k < 8; ++k) {
+		vec3 corner_cs = center_cs + radius * vec3(
+			(k & 1) != 0 ? 1.0 : -1.0,
+			(k & 2) != 0 ? 1.0 : -1.0,
+			(k & 4) != 0 ? 1.0 : -1.0
+		);
+		vec4 corner_ps = projectionMatrix * vec4(corner_cs, 1.0);
+		if (corner_ps.w <= 0.0) return false;
+		vec3 corner_ndc = corner_ps.xyz / corner_ps.w;
+		ndcMin = min(ndcMin, corner_ndc.xy);
+		ndcMax = max(ndcMax, corner_ndc.xy);
+		ndcDepth = min(ndcDepth, corner_ndc.z);
+	}
+	if (ndcDepth < -1.0) return false; // crosses the near plane
+	float depth = ndcDepth * 0.5 + 0.5;
+
+	ivec2 size = textureSize(hzb, 0);
+	vec2 rectMin = clamp(ndcMin * 0.5 + 0.5, 0.0, 1.0) * vec2(size);
+	vec2 rectMax = clamp(ndcMax * 0.5 + 0.5, 0.0, 1.0) * vec2(size);
+	ivec2 texelMin = ivec2(rectMin);
+	ivec2 texelMax = min(ivec2(rectMax), size - 1);
+
+	// A rectangle of extent e fits within one or two texels of the level
+	// ceil(log2(e)), so at most one more level may be needed.
+	vec2 extent = rectMax - rectMin;
+	int levelCount = textureQueryLevels(hzb);
+	int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+	while (level < levelCount && any(notEqual(texelMin >> level, texelMax >> level))) {
+		++level;
+	}
+	if (level >= levelCount) return false;
+
+	// Texels beyond the last one of odd sized levels are not reduced into
+	// the next level, so the pyramid says nothing about them.
+	ivec2 texel = texelMin >> level;
+	if (any(greaterThanEqual(texel, textureSize(hzb, level)))) return false;
+
+	return depth > texelFetch(hzb, texel, level).r;
+}
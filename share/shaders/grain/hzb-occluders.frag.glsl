@@ -0,0 +1,9 @@
+#version 450 core
+#include "sys:defines"
+
+void main() {
+	// Round sprites, so that they do not cover more than the inner sphere
+	if (length(gl_PointCoord - vec2(0.5)) > 0.5) {
+		discard;
+	}
+}
@@ -0,0 +1,42 @@
+#version 450 core
+#include "sys:defines"
+
+// Occluders of PointCloudSplitter's Hzb occlusion culling: the grains that
+// the previous split sent to Instance and Impostor models, drawn with the
+// current camera as depth only disks of their inner radius, at their center
+// depth. Anything behind such a disk is hidden by the inner sphere.
+
+#define POINTS_BINDING 1
+#include "../include/points.inc.glsl"
+
+// Element buffer of the previous split, drawn using its draw commands
+layout (std430, binding = 2) restrict readonly buffer elementBufferSsbo {
+	uint elementBuffer[];
+};
+
+#include "../include/uniform/grain.inc.glsl"
+uniform float uHzbResolutionScale = 0.5;
+
+uniform uint uFrameCount;
+uniform uint uPointCount;
+uniform float uTime;
+uniform float uFps = 25.0;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewModelMatrix;
+#include "../include/uniform/camera.inc.glsl"
+
+#include "../include/anim.inc.glsl"
+
+void main() {
+	// Elements of the previous split may come from another animation frame
+	uint element = elementBuffer[gl_VertexID] % uPointCount;
+	uint pointId = AnimatedPointId2(element, uFrameCount, uPointCount, uTime, uFps);
+
+	vec4 position_cs = viewModelMatrix * vec4(fetchPointPosition(pointId), 1.0);
+	gl_Position = projectionMatrix * position_cs;
+	// Diameter in pixels of the pyramid's level 0 (unlike SpriteSize(), never
+	// larger than the disk, so that occlusion stays conservative)
+	float innerRadius = uGrainRadius * uGrainInnerRadiusRatio;
+	gl_PointSize = projectionMatrix[1][1] * resolution.y * innerRadius / gl_Position.w * uHzbResolutionScale;
+}
@@ -0,0 +1,54 @@
+#version 450 core
+#include "sys:defines"
+
+// Keep the grains that a split sent to Instance and Impostor models as the
+// occluders of the next Hzb pyramid of the same camera (see
+// PointCloudSplitter::saveHzbOccluders()), since the element buffer of the
+// splitter is overwritten by the splits of other views in the meantime.
+
+layout (local_size_x = 128, local_size_y = 1, local_size_z = 1) in;
+
+struct Counter {
+	uint count;
+	uint offset;
+};
+
+struct DrawArraysIndirectCommand {
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+// Must match PointCloudSplitter::RenderModel (see discriminate.inc.glsl)
+const uint cRenderModelInstance = 0;
+const uint cRenderModelImpostor = 1;
+
+layout(std430, binding = 0) restrict readonly buffer countersSsbo {
+	Counter counters[];
+};
+layout(std430, binding = 1) restrict readonly buffer elementBufferSsbo {
+	uint elementBuffer[];
+};
+// Instance elements followed by Impostor elements, at most uPointCount
+layout(std430, binding = 2) restrict writeonly buffer occludersSsbo {
+	uint occluders[];
+};
+layout(std430, binding = 3) restrict writeonly buffer drawCommandSsbo {
+	DrawArraysIndirectCommand drawCommand;
+};
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	Counter instances = counters[cRenderModelInstance];
+	Counter impostors = counters[cRenderModelImpostor];
+	if (i == 0) {
+		drawCommand = DrawArraysIndirectCommand(instances.count + impostors.count, 1, 0, 0);
+	}
+	if (i < instances.count) {
+		occluders[i] = elementBuffer[instances.offset + i];
+	}
+	if (i < impostors.count) {
+		occluders[instances.count + i] = elementBuffer[impostors.offset + i];
+	}
+}
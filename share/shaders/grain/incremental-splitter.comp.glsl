@@ -0,0 +1,328 @@
+#version 450 core
+#include "sys:defines"
+#include "sys:settings"
+
+// Incremental alternative to the other splitters, meant for static clouds:
+// the classification of each chunk of points is kept from one frame to the
+// next, and only chunks whose classification may have changed are processed
+// again. Chunks are processed in "slots", slot k holding the k-th chunk
+// overlapping the current frame.
+//   STEP_CHUNKS: compare the state of each chunk with the one it had when it
+//                was last classified, and list the dirty ones
+//   STEP_CLASSIFY: one work group per dirty chunk, classify its grains and sort
+//                  them by model in the chunk's own region of chunkElements
+//   STEP_SCAN: single work group, offset of each chunk within each model
+//   STEP_GATHER: one work group per slot, copy chunk regions to the element buffer
+// All steps but the first are dispatched indirectly, on no work group at all
+// when no chunk is dirty.
+#pragma variant STEP_CHUNKS STEP_CLASSIFY STEP_SCAN STEP_GATHER
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 128
+#endif
+
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
+
+struct Counter {
+	uint count;
+	uint offset;
+};
+
+const uint cNoChunk = 0xffffffff;
+
+// Must match PointCloudSplitter::IncrementalChunkState
+struct ChunkState {
+	vec4 screen; // xy: projected center, z: projected radius, in pixels
+	uint chunk; // index of the chunk in the point buffer, or cNoChunk
+	uint signature; // frustum and distance bands, see chunkSignature()
+	uint _pad0;
+	uint _pad1;
+	uvec4 counts; // number of grains of each model
+	uvec4 offsets; // offsets of the chunk within each model, set by STEP_SCAN
+};
+
+uniform uint uPointCount; // points per frame
+uniform uint uFrameCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+uniform uint uMaxChunkCount;
+uniform bool uForceRefresh = false;
+uniform float uIncrementalTolerance = 0.5;
+
+uniform sampler2D uOcclusionMap;
+#include "../include/uniform/grain.inc.glsl"
+
+uniform mat4 modelMatrix;
+uniform mat4 viewModelMatrix;
+#include "../include/uniform/camera.inc.glsl"
+
+#include "discriminate.inc.glsl"
+#include "../include/utils.inc.glsl"
+#include "../include/sprite.inc.glsl"
+
+layout(std430, binding = 0) restrict buffer countersSsbo {
+	Counter counters[];
+};
+// Must match PointCloudSplitter::IncrementalHeader
+layout(std430, binding = 1) restrict buffer incrementalSsbo {
+	// Reset to (0, 1, 1, 0) before STEP_CHUNKS
+	uvec4 classifyDispatch;
+	uvec4 scanDispatch;
+	uvec4 gatherDispatch;
+	ChunkState chunkStates[];
+};
+layout (std430, binding = 2) restrict writeonly buffer elementBufferSsbo {
+	uint elementBuffer[];
+};
+layout(std430, binding = 4) restrict buffer dirtyChunksSsbo {
+	uint dirtyChunks[]; // slots
+};
+// uPointChunkSize elements per slot, followed by as many temporary (model, rank) pairs
+layout(std430, binding = 6) restrict buffer chunkElementsSsbo {
+	uint chunkElements[];
+};
+
+#include "../include/anim.inc.glsl"
+
+#define POINTS_BINDING 3
+#include "../include/points.inc.glsl"
+
+uint frameStart() {
+	return AnimationFrame(uFrameCount, uTime, uFps) * uPointCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+#if defined(STEP_CHUNKS)
+
+const uint cFrustumOutside = 0;
+const uint cFrustumIntersecting = 1;
+const uint cFrustumInside = 2;
+
+// Model chosen by discriminate() before culling, for a given squared distance
+uint distanceBand(float l2) {
+	if (l2 < uImpostorLimit * uImpostorLimit) {
+		return l2 < uInstanceLimit * uInstanceLimit ? cRenderModelInstance : cRenderModelImpostor;
+	} else {
+		return cRenderModelPoint;
+	}
+}
+
+/**
+ * Bound the result of the frustum test of discriminate() for all grains of
+ * a sphere. Planes are not normalized, like in SphereFrustumCulling().
+ */
+uint frustumState(vec3 center_cs, float radius) {
+	if (!uEnableFrustumCulling) return cFrustumInside;
+	vec4 planes[6];
+	ExtractFrustumPlanes(projectionMatrix, planes);
+	float margin = 4.0 * uGrainRadius; // same as in discriminate()
+	uint state = cFrustumInside;
+	for (int i = 0; i < 5; i++) {
+		float dist = dot(vec4(center_cs, 1.0), planes[i]);
+		float spread = radius * length(planes[i].xyz);
+		if (dist + spread < -margin) return cFrustumOutside;
+		if (dist - spread < -margin) state = cFrustumIntersecting;
+	}
+	return state;
+}
+
+/**
+ * Everything the classification of the grains of a chunk depends on, apart
+ * from the exact camera position.
+ */
+uint chunkSignature(vec3 center_cs, float radius) {
+	uint frustum = frustumState(center_cs, radius);
+	// discriminate() measures the distance with position_cs.w = 1
+	float d = length(center_cs);
+	float minDistance = max(0.0, d - radius);
+	float maxDistance = d + radius;
+	uint minBand = distanceBand(minDistance * minDistance + 1.0);
+	uint maxBand = distanceBand(maxDistance * maxDistance + 1.0);
+	return frustum | (minBand << 2) | (maxBand << 4);
+}
+
+void main() {
+	uint slot = gl_GlobalInvocationID.x;
+	if (slot >= uMaxChunkCount) return;
+
+	uint firstChunk = frameStart() / uPointChunkSize;
+	uint lastChunk = (frameStart() + uPointCount - 1) / uPointChunkSize;
+	uint chunk = firstChunk + slot;
+	ChunkState state = chunkStates[slot];
+
+	if (chunk > lastChunk) {
+		// Slot not used by the current frame
+		if (state.chunk != cNoChunk || uForceRefresh) {
+			chunkStates[slot].chunk = cNoChunk;
+			chunkStates[slot].counts = uvec4(0);
+			scanDispatch.x = 1;
+			gatherDispatch.x = uMaxChunkCount;
+		}
+		return;
+	}
+
+	vec3 aabbMin = pointChunks[chunk].aabbMin.xyz;
+	vec3 aabbMax = pointChunks[chunk].aabbMax.xyz;
+	vec3 center_cs = (viewModelMatrix * vec4(0.5 * (aabbMin + aabbMax), 1.0)).xyz;
+	float radius = 0.5 * length(aabbMax - aabbMin);
+	uint signature = chunkSignature(center_cs, radius);
+
+	// The classification of grains of a chunk is uniform if it is entirely
+	// culled, or if it is entirely visible, within a single distance band and
+	// not subject to occlusion. Otherwise, it depends on the exact view and
+	// must be updated whenever the chunk moves on screen. Occlusion is not
+	// assumed to be uniform, because grains behind other ones may be revealed
+	// by any motion, so with occlusion culling all visible chunks are
+	// classified again while the camera orbits (see user manual).
+	uint frustum = signature & 3;
+	bool isUniform =
+		frustum == cFrustumOutside
+		|| (frustum == cFrustumInside && (signature >> 2 & 3) == (signature >> 4 & 3) && !uEnableOcclusionCulling);
+
+	vec4 screen = vec4(0.0);
+	bool touchesCameraPlane = !isOrthographic(projectionMatrix) && center_cs.z > -radius;
+	if (!touchesCameraPlane) {
+		vec4 center_ps = projectionMatrix * vec4(center_cs, 1.0);
+		screen.xy = resolution.xy * (center_ps.xy / center_ps.w * 0.5 + 0.5);
+		screen.z = 0.5 * SpriteSize(radius, center_ps);
+	}
+	bool hasMoved =
+		touchesCameraPlane
+		|| distance(screen.xy, state.screen.xy) > uIncrementalTolerance
+		|| abs(screen.z - state.screen.z) > uIncrementalTolerance;
+
+	bool isDirty =
+		uForceRefresh
+		|| state.chunk != chunk
+		|| state.signature != signature
+		|| (!isUniform && hasMoved);
+	if (!isDirty) return;
+
+	chunkStates[slot].screen = screen;
+	chunkStates[slot].chunk = chunk;
+	chunkStates[slot].signature = signature;
+	scanDispatch.x = 1;
+	gatherDispatch.x = uMaxChunkCount;
+
+	if (frustum == cFrustumOutside) {
+		// No need to look at individual grains
+		uint begin = max(chunk * uPointChunkSize, frameStart());
+		uint end = min((chunk + 1) * uPointChunkSize, frameStart() + uPointCount);
+		chunkStates[slot].counts = uvec4(0, 0, 0, end - begin);
+	} else {
+		dirtyChunks[atomicAdd(classifyDispatch.x, 1)] = slot;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(STEP_CLASSIFY)
+
+shared uint sCounts[4];
+shared uint sOffsets[4];
+
+void main() {
+	uint slot = dirtyChunks[gl_WorkGroupID.x];
+	uint chunk = chunkStates[slot].chunk;
+	uint begin = max(chunk * uPointChunkSize, frameStart());
+	uint end = min((chunk + 1) * uPointChunkSize, frameStart() + uPointCount);
+	uint regionStart = slot * uPointChunkSize;
+	uint rankStart = uMaxChunkCount * uPointChunkSize + regionStart;
+
+	if (gl_LocalInvocationIndex < 4) {
+		sCounts[gl_LocalInvocationIndex] = 0;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// 1. Classify and rank within the chunk
+	float innerRadius = uGrainRadius * uGrainInnerRadiusRatio;
+	for (uint pointId = begin + gl_LocalInvocationIndex; pointId < end; pointId += LOCAL_SIZE_X) {
+		vec3 position = fetchPointPosition(pointId);
+		uint model = discriminate(position, uGrainRadius, innerRadius, uOuterOverInnerRadius, uOcclusionMap);
+		uint rank = atomicAdd(sCounts[model], 1);
+		chunkElements[rankStart + pointId - begin] = (model << 30) | rank;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0) {
+		uint offset = 0;
+		for (uint m = 0; m < 4; ++m) {
+			sOffsets[m] = offset;
+			offset += sCounts[m];
+		}
+		chunkStates[slot].counts = uvec4(sCounts[0], sCounts[1], sCounts[2], sCounts[3]);
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// 2. Sort by model within the chunk's region (discarding None)
+	for (uint pointId = begin + gl_LocalInvocationIndex; pointId < end; pointId += LOCAL_SIZE_X) {
+		uint packed = chunkElements[rankStart + pointId - begin];
+		uint model = packed >> 30;
+		if (model != cRenderModelNone) {
+			chunkElements[regionStart + sOffsets[model] + (packed & 0x3fffffff)] = pointId;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(STEP_SCAN)
+
+shared uvec4 sSums[LOCAL_SIZE_X];
+
+void main() {
+	// Each invocation handles a contiguous range of slots
+	uint slotsPerInvocation = (uMaxChunkCount + LOCAL_SIZE_X - 1) / LOCAL_SIZE_X;
+	uint begin = min(gl_LocalInvocationIndex * slotsPerInvocation, uMaxChunkCount);
+	uint end = min(begin + slotsPerInvocation, uMaxChunkCount);
+
+	uvec4 sum = uvec4(0);
+	for (uint slot = begin; slot < end; ++slot) {
+		sum += chunkStates[slot].counts;
+	}
+	sSums[gl_LocalInvocationIndex] = sum;
+	memoryBarrierShared();
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0) {
+		uvec4 total = uvec4(0);
+		for (uint i = 0; i < LOCAL_SIZE_X; ++i) {
+			uvec4 s = sSums[i];
+			sSums[i] = total;
+			total += s;
+		}
+		uint offset = 0;
+		for (uint m = 0; m < 4; ++m) {
+			counters[m] = Counter(total[m], offset);
+			offset += total[m];
+		}
+	}
+	memoryBarrierShared();
+	barrier();
+
+	uvec4 offsets = sSums[gl_LocalInvocationIndex];
+	for (uint slot = begin; slot < end; ++slot) {
+		chunkStates[slot].offsets = offsets;
+		offsets += chunkStates[slot].counts;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(STEP_GATHER)
+
+void main() {
+	uint slot = gl_WorkGroupID.x;
+	uvec4 counts = chunkStates[slot].counts;
+	uvec4 offsets = chunkStates[slot].offsets;
+	uint source = slot * uPointChunkSize;
+	for (uint m = 0; m < cRenderModelNone; ++m) {
+		uint destination = counters[m].offset + offsets[m];
+		for (uint k = gl_LocalInvocationIndex; k < counts[m]; k += LOCAL_SIZE_X) {
+			elementBuffer[destination + k] = chunkElements[source + k];
+		}
+		source += counts[m];
+	}
+}
+
+#endif // STEP
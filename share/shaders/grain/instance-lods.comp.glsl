@@ -0,0 +1,157 @@
+#version 450 core
+#include "sys:defines"
+
+// Sub-classify the grains drawn by InstanceGrainRenderer by their projected
+// radius, and sort them by level of detail of the MeshData mesh so that a
+// single glMultiDrawElementsIndirect draws all of them. Same steps as
+// globalatomic-splitter.comp.glsl, counting in the instanceCount field of
+// the draw commands.
+
+// Matches InstanceGrainRenderer::LodStepShaderVariant
+#pragma variant STEP_RESET STEP_COUNT STEP_OFFSET STEP_WRITE
+
+layout (local_size_x = 128, local_size_y = 1, local_size_z = 1) in;
+
+struct DrawArraysIndirectCommand {
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+struct DrawElementsIndirectCommand {
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	uint baseVertex;
+	uint baseInstance;
+};
+
+// Must match InstanceGrainRenderer::LodBuffer
+layout(std430, binding = 2) restrict buffer lodSsbo {
+	uint dispatchGroupCountX; // indirect dispatch of the count and write steps
+	uint dispatchGroupCountY;
+	uint dispatchGroupCountZ;
+	uint instanceCount; // instances to sub-classify, copied from the source
+	uint instanceOffset;
+	DrawElementsIndirectCommand lodCommands[];
+};
+
+uniform uint uLodCount;
+uniform uint uLodCapacity; // size of the lod element buffer
+
+uniform bool uUsePointElements = true;
+layout (std430, binding = 1) restrict readonly buffer pointElementsSsbo {
+	uint pointElements[];
+};
+
+#if defined(STEP_RESET)
+// Either the instanced draw command of point data, or uniforms if it only
+// has CPU side counts
+uniform bool uUseSourceCommand = false;
+uniform uint uSourceCommand; // index in sourceCommands
+uniform uint uInstanceCount;
+uniform uint uInstanceOffset;
+layout (std430, binding = 3) restrict readonly buffer sourceCommandsSsbo {
+	DrawArraysIndirectCommand sourceCommands[];
+};
+#endif // STEP_RESET
+
+#if defined(STEP_WRITE)
+layout (std430, binding = 4) restrict writeonly buffer lodElementsSsbo {
+	uint lodElements[];
+};
+#endif // STEP_WRITE
+
+uniform float uLod1PixelRadius;
+uniform float uLod2PixelRadius;
+#include "../include/uniform/grain.inc.glsl"
+
+uniform uint uFrameCount;
+uniform uint uPointCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+uniform bool uUseAnimation = true;
+
+uniform mat4 viewModelMatrix;
+#include "../include/uniform/camera.inc.glsl"
+
+#define POINTS_BINDING 0
+#include "../include/points.inc.glsl"
+#include "../include/anim.inc.glsl"
+#include "../include/utils.inc.glsl"
+#include "../include/sprite.inc.glsl"
+
+/**
+ * Element of the i-th instance, as expected by instance-grain.vert.glsl
+ */
+uint getElement(uint i) {
+	return uUsePointElements ? pointElements[instanceOffset + i] : instanceOffset + i;
+}
+
+/**
+ * Level of detail of an element, from the radius in pixels of its grain
+ */
+uint getLod(uint element) {
+	uint pointId =
+		uUseAnimation
+		? AnimatedPointId2(element, uFrameCount, uPointCount, uTime, uFps)
+		: element;
+	vec4 center_cs = viewModelMatrix * vec4(fetchPointPosition(pointId), 1.0);
+	float pixelRadius = 0.5 * SpriteSize(uGrainRadius, projectionMatrix * center_cs);
+	uint lod = pixelRadius < uLod2PixelRadius ? 2 : (pixelRadius < uLod1PixelRadius ? 1 : 0);
+	return min(lod, uLodCount - 1);
+}
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	uint lod;
+
+///////////////////////////////////////////////////////////////////////////////
+#if defined(STEP_RESET)
+// Fetch the source range and reset counters (shader invoked only once at this step)
+	if (i > 0) return;
+	uint count = uInstanceCount;
+	uint offset = uInstanceOffset;
+	if (uUseSourceCommand) {
+		count = sourceCommands[uSourceCommand].instanceCount;
+		offset = sourceCommands[uSourceCommand].baseInstance;
+	}
+	instanceCount = min(count, uLodCapacity);
+	instanceOffset = offset;
+	dispatchGroupCountX = (instanceCount + gl_WorkGroupSize.x - 1) / gl_WorkGroupSize.x;
+	dispatchGroupCountY = 1;
+	dispatchGroupCountZ = 1;
+	for (lod = 0 ; lod < uLodCount ; ++lod) {
+		lodCommands[lod].instanceCount = 0;
+	}
+
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(STEP_COUNT)
+// Count elements of each level of detail
+	if (i >= instanceCount) return;
+	lod = getLod(getElement(i));
+	atomicAdd(lodCommands[lod].instanceCount, 1);
+
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(STEP_OFFSET)
+// Compute offsets (shader invoked only once at this step)
+	if (i > 0) return;
+	lodCommands[0].baseInstance = 0;
+	for (lod = 0 ; lod < uLodCount - 1 ; ++lod) {
+		lodCommands[lod + 1].baseInstance = lodCommands[lod].baseInstance + lodCommands[lod].instanceCount;
+		lodCommands[lod].instanceCount = 0;
+	}
+	lodCommands[uLodCount - 1].instanceCount = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(STEP_WRITE)
+// Finally write to the lod element buffer, which gives instance attributes
+	if (i >= instanceCount) return;
+	uint element = getElement(i);
+	lod = getLod(element);
+	uint beforeIncrement = atomicAdd(lodCommands[lod].instanceCount, 1);
+	lodElements[lodCommands[lod].baseInstance + beforeIncrement] = element;
+
+#endif // STEP
+}
@@ -0,0 +1,180 @@
+#version 450 core
+#include "sys:defines"
+#include "sys:settings"
+
+// Batched variant of prefixsum-splitter.comp.glsl, used by
+// PointCloudSplitter::onPreRenderViews(): each grain is fetched once and
+// classified against all the views of the frame (viewport cameras and shadow
+// map cameras). Each view has its own counters and its own 2*uPointCount
+// range of the element buffer, in which models are laid out as in
+// prefixsum-splitter.comp.glsl.
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 128
+#endif
+
+// Must match PointCloudSplitter::s_maxBatchedViews
+#ifndef MAX_VIEWS
+#define MAX_VIEWS 4
+#endif
+
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
+
+struct Counter {
+	uint count;
+	uint offset;
+};
+
+uniform uint uPointCount; // number of elements to draw a priori, ie points per frame
+uniform uint uFrameCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+
+#include "../include/uniform/grain.inc.glsl"
+
+uniform mat4 modelMatrix;
+
+uniform uint uViewCount;
+uniform mat4 uViewModelMatrices[MAX_VIEWS];
+uniform mat4 uProjectionMatrices[MAX_VIEWS];
+uniform vec2 uResolutions[MAX_VIEWS];
+uniform vec2 uLodLimits[MAX_VIEWS]; // instance and impostor distance limits
+uniform sampler2D uOcclusionMaps[MAX_VIEWS];
+uniform sampler2D uHzbs[MAX_VIEWS];
+
+// Stand for viewModelMatrix, the Camera block and the distance limits that
+// discriminate() reads, set to the view being classified.
+mat4 viewModelMatrix;
+mat4 projectionMatrix;
+vec2 resolution;
+#define PER_VIEW_LOD_LIMITS
+float uInstanceLimit;
+float uImpostorLimit;
+
+#include "discriminate.inc.glsl"
+
+// Cleared before the dispatch, cRenderModelCount per view
+layout(std430, binding = 0) restrict writeonly buffer countersSsbo {
+	Counter counters[];
+};
+// Cleared before the dispatch
+layout(std430, binding = 1) coherent restrict buffer scanSsbo {
+	uint workGroupTicket;
+	uint descriptors[]; // cSlotCount per work group, flag | value
+};
+layout (std430, binding = 2) restrict writeonly buffer elementBufferSsbo {
+	uint elementBuffer[];
+};
+
+#include "../include/anim.inc.glsl"
+
+#define POINTS_BINDING 3
+#include "../include/points.inc.glsl"
+
+const uint cRenderModelCount = 4;
+
+// Models that are actually written, which happen to be the first ones
+const uint cStreamCount = 3;
+// One look-back slot per view and stream
+const uint cSlotCount = MAX_VIEWS * cStreamCount;
+
+const uint cFlagAggregate = 1u << 30; // value is the count of the work group only
+const uint cFlagPrefix = 2u << 30; // value is the inclusive prefix of the work group
+const uint cValueMask = cFlagAggregate - 1u;
+
+shared uint sWorkGroup;
+shared uint sLocalCount[cSlotCount];
+shared uint sGroupOffset[cSlotCount];
+
+void main() {
+	// See prefixsum-splitter.comp.glsl for why tickets are used
+	if (gl_LocalInvocationIndex == 0) {
+		sWorkGroup = atomicAdd(workGroupTicket, 1);
+	}
+	if (gl_LocalInvocationIndex < cSlotCount) {
+		sLocalCount[gl_LocalInvocationIndex] = 0;
+	}
+	memoryBarrierShared();
+	barrier();
+	uint workGroup = sWorkGroup;
+
+	// 1. Classify against each view and rank within the work group
+	uint i = workGroup * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+	uint pointId = 0;
+	uint models[MAX_VIEWS];
+	uint localRanks[MAX_VIEWS];
+	for (uint v = 0; v < MAX_VIEWS; ++v) {
+		models[v] = cRenderModelNone;
+		localRanks[v] = 0;
+	}
+	if (i < uPointCount) {
+		pointId = AnimatedPointId2(i, uFrameCount, uPointCount, uTime, uFps);
+		vec3 position = fetchPointPosition(pointId);
+		float innerRadius = uGrainRadius * uGrainInnerRadiusRatio;
+		for (uint v = 0; v < uViewCount; ++v) {
+			viewModelMatrix = uViewModelMatrices[v];
+			projectionMatrix = uProjectionMatrices[v];
+			resolution = uResolutions[v];
+			uInstanceLimit = uLodLimits[v].x;
+			uImpostorLimit = uLodLimits[v].y;
+			uint model = discriminate(position, uGrainRadius, innerRadius, uOuterOverInnerRadius, uOcclusionMaps[v], uHzbs[v]);
+			models[v] = model;
+			if (model < cStreamCount) {
+				localRanks[v] = atomicAdd(sLocalCount[v * cStreamCount + model], 1);
+			}
+		}
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// 2. Decoupled look-back, one invocation per view and stream
+	uint s = gl_LocalInvocationIndex;
+	if (s < uViewCount * cStreamCount) {
+		uint aggregate = sLocalCount[s];
+		uint exclusivePrefix = 0;
+		if (workGroup == 0) {
+			atomicExchange(descriptors[s], cFlagPrefix | aggregate);
+		} else {
+			atomicExchange(descriptors[workGroup * cSlotCount + s], cFlagAggregate | aggregate);
+			int predecessor = int(workGroup) - 1;
+			while (predecessor >= 0) {
+				uint descriptor = atomicAdd(descriptors[predecessor * cSlotCount + s], 0);
+				if ((descriptor & ~cValueMask) == 0) continue; // not published yet
+				exclusivePrefix += descriptor & cValueMask;
+				if ((descriptor & cFlagPrefix) != 0) break;
+				--predecessor;
+			}
+			atomicExchange(descriptors[workGroup * cSlotCount + s], cFlagPrefix | (exclusivePrefix + aggregate));
+		}
+		sGroupOffset[s] = exclusivePrefix;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// 3. Compaction, in the range of each view
+	for (uint v = 0; v < uViewCount; ++v) {
+		uint base = v * 2 * uPointCount;
+		uint model = models[v];
+		uint rank = model < cStreamCount ? sGroupOffset[v * cStreamCount + model] + localRanks[v] : 0;
+		if (model == cRenderModelInstance) {
+			elementBuffer[base + rank] = pointId;
+		} else if (model == cRenderModelImpostor) {
+			elementBuffer[base + uPointCount + rank] = pointId;
+		} else if (model == cRenderModelPoint) {
+			elementBuffer[base + uPointCount - 1 - rank] = pointId;
+		}
+	}
+
+	// 4. The last work group knows the total counts
+	if (workGroup == gl_NumWorkGroups.x - 1 && gl_LocalInvocationIndex < uViewCount) {
+		uint v = gl_LocalInvocationIndex;
+		uint base = v * 2 * uPointCount;
+		uint instanceCount = sGroupOffset[v * cStreamCount + cRenderModelInstance] + sLocalCount[v * cStreamCount + cRenderModelInstance];
+		uint impostorCount = sGroupOffset[v * cStreamCount + cRenderModelImpostor] + sLocalCount[v * cStreamCount + cRenderModelImpostor];
+		uint pointCount = sGroupOffset[v * cStreamCount + cRenderModelPoint] + sLocalCount[v * cStreamCount + cRenderModelPoint];
+		counters[v * cRenderModelCount + cRenderModelInstance] = Counter(instanceCount, base);
+		counters[v * cRenderModelCount + cRenderModelImpostor] = Counter(impostorCount, base + uPointCount);
+		counters[v * cRenderModelCount + cRenderModelPoint] = Counter(pointCount, base + uPointCount - pointCount);
+		counters[v * cRenderModelCount + cRenderModelNone] = Counter(uPointCount - instanceCount - impostorCount - pointCount, base);
+	}
+}
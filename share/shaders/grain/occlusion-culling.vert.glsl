@@ -1,21 +1,15 @@
 #version 450 core
 #include "sys:defines"
 
-struct PointCloundVboEntry {
-	vec4 position;
-};
-layout(std430, binding = 1) restrict readonly buffer points {
-	PointCloundVboEntry vbo[];
-};
+#define POINTS_BINDING 1
+#include "../include/points.inc.glsl"
 
 out Geometry {
 	vec4 position_cs;
 	float radius;
 } geo;
 
-uniform float uOuterOverInnerRadius = 1.0 / 0.5;
-uniform float uGrainRadius;
-uniform float uGrainInnerRadiusRatio;
+#include "../include/uniform/grain.inc.glsl"
 uniform float uOccluderMapSpriteScale = 0.2;
 
 uniform uint uFrameCount;
@@ -34,7 +28,7 @@ uniform mat4 viewModelMatrix;
 void main() {
 	uint pointId = AnimatedPointId2(gl_VertexID, uFrameCount, uPointCount, uTime, uFps);
 
-	vec4 position_ms = vec4(vbo[pointId].position.xyz, 1.0);
+	vec4 position_ms = vec4(fetchPointPosition(pointId), 1.0);
 	geo.position_cs = viewModelMatrix * position_ms;
 	geo.radius = uGrainRadius * uGrainInnerRadiusRatio; // inner radius
 	gl_Position = projectionMatrix * geo.position_cs;
@@ -0,0 +1,148 @@
+#version 450 core
+#include "sys:defines"
+#include "sys:settings"
+
+// Single pass alternative to globalatomic-splitter.comp.glsl: each grain is
+// classified once, counted with shared atomics within its work group, and
+// work group offsets are obtained by a decoupled look-back scan (Merrill &
+// Garland 2016, "Single-pass Parallel Prefix Scan with Decoupled Look-back").
+//
+// Since the total count of each model is only known at the end of the pass,
+// models are written in separate streams of the 2*uPointCount element buffer:
+//   Instance grows up from 0,
+//   Point grows down from uPointCount,
+//   Impostor grows up from uPointCount.
+
+#pragma opt CHUNK_CULLING
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 128
+#endif
+
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
+
+struct Counter {
+	uint count;
+	uint offset;
+};
+
+uniform uint uPointCount; // number of elements to draw a priori, ie points per frame
+uniform uint uFrameCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+
+uniform sampler2D uOcclusionMap;
+#include "../include/uniform/grain.inc.glsl"
+
+uniform mat4 modelMatrix;
+uniform mat4 viewModelMatrix;
+#include "../include/uniform/camera.inc.glsl"
+
+#include "discriminate.inc.glsl"
+
+// Cleared before the dispatch
+layout(std430, binding = 0) restrict writeonly buffer countersSsbo {
+	Counter counters[];
+};
+// Cleared before the dispatch
+layout(std430, binding = 1) coherent restrict buffer scanSsbo {
+	uint workGroupTicket;
+	uint descriptors[]; // cStreamCount per work group, flag | value
+};
+layout (std430, binding = 2) restrict writeonly buffer elementBufferSsbo {
+	uint elementBuffer[];
+};
+
+#include "../include/anim.inc.glsl"
+
+#define POINTS_BINDING 3
+#include "../include/points.inc.glsl"
+
+#include "chunk-culling.inc.glsl"
+
+// Models that are actually written, which happen to be the first ones
+const uint cStreamCount = 3;
+
+const uint cFlagAggregate = 1u << 30; // value is the count of the work group only
+const uint cFlagPrefix = 2u << 30; // value is the inclusive prefix of the work group
+const uint cValueMask = cFlagAggregate - 1u;
+
+shared uint sWorkGroup;
+shared uint sLocalCount[cStreamCount];
+shared uint sGroupOffset[cStreamCount];
+
+void main() {
+	// Work groups are numbered in their launch order rather than using
+	// gl_WorkGroupID, so that the predecessors a work group waits for in the
+	// look-back have been scheduled.
+	if (gl_LocalInvocationIndex == 0) {
+		sWorkGroup = atomicAdd(workGroupTicket, 1);
+	}
+	if (gl_LocalInvocationIndex < cStreamCount) {
+		sLocalCount[gl_LocalInvocationIndex] = 0;
+	}
+	memoryBarrierShared();
+	barrier();
+	uint workGroup = sWorkGroup;
+
+	// 1. Classify and rank within the work group
+	uint i = getElement(workGroup);
+	uint model = cRenderModelNone;
+	uint pointId = 0;
+	uint localRank = 0;
+	if (i < uPointCount) {
+		pointId = AnimatedPointId2(i, uFrameCount, uPointCount, uTime, uFps);
+		vec3 position = fetchPointPosition(pointId);
+		float innerRadius = uGrainRadius * uGrainInnerRadiusRatio;
+		model = discriminate(position, uGrainRadius, innerRadius, uOuterOverInnerRadius, uOcclusionMap);
+		if (model < cStreamCount) {
+			localRank = atomicAdd(sLocalCount[model], 1);
+		}
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// 2. Decoupled look-back, one invocation per stream
+	uint s = gl_LocalInvocationIndex;
+	if (s < cStreamCount) {
+		uint aggregate = sLocalCount[s];
+		uint exclusivePrefix = 0;
+		if (workGroup == 0) {
+			atomicExchange(descriptors[s], cFlagPrefix | aggregate);
+		} else {
+			atomicExchange(descriptors[workGroup * cStreamCount + s], cFlagAggregate | aggregate);
+			int predecessor = int(workGroup) - 1;
+			while (predecessor >= 0) {
+				uint descriptor = atomicAdd(descriptors[predecessor * cStreamCount + s], 0);
+				if ((descriptor & ~cValueMask) == 0) continue; // not published yet
+				exclusivePrefix += descriptor & cValueMask;
+				if ((descriptor & cFlagPrefix) != 0) break;
+				--predecessor;
+			}
+			atomicExchange(descriptors[workGroup * cStreamCount + s], cFlagPrefix | (exclusivePrefix + aggregate));
+		}
+		sGroupOffset[s] = exclusivePrefix;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// 3. Compaction
+	if (model == cRenderModelInstance) {
+		elementBuffer[sGroupOffset[cRenderModelInstance] + localRank] = pointId;
+	} else if (model == cRenderModelImpostor) {
+		elementBuffer[uPointCount + sGroupOffset[cRenderModelImpostor] + localRank] = pointId;
+	} else if (model == cRenderModelPoint) {
+		elementBuffer[uPointCount - 1 - (sGroupOffset[cRenderModelPoint] + localRank)] = pointId;
+	}
+
+	// 4. The last work group knows the total counts
+	if (workGroup == gl_NumWorkGroups.x - 1 && gl_LocalInvocationIndex == 0) {
+		uint instanceCount = sGroupOffset[cRenderModelInstance] + sLocalCount[cRenderModelInstance];
+		uint impostorCount = sGroupOffset[cRenderModelImpostor] + sLocalCount[cRenderModelImpostor];
+		uint pointCount = sGroupOffset[cRenderModelPoint] + sLocalCount[cRenderModelPoint];
+		counters[cRenderModelInstance] = Counter(instanceCount, 0);
+		counters[cRenderModelImpostor] = Counter(impostorCount, uPointCount);
+		counters[cRenderModelPoint] = Counter(pointCount, uPointCount - pointCount);
+		counters[cRenderModelNone] = Counter(uPointCount - instanceCount - impostorCount - pointCount, 0);
+	}
+}
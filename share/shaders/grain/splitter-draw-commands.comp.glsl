@@ -0,0 +1,40 @@
+#version 450 core
+#include "sys:defines"
+
+// Turn the counters of PointCloudSplitter into indirect draw commands, so
+// that renderers never need to read them back on the CPU.
+// Must match PointCloudSplitter::DrawArraysIndirectCommand
+
+layout (local_size_x = 4, local_size_y = 1, local_size_z = 1) in;
+
+struct Counter {
+	uint count;
+	uint offset;
+};
+
+struct DrawArraysIndirectCommand {
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+uniform uint uRenderModelCount;
+
+layout(std430, binding = 0) restrict readonly buffer countersSsbo {
+	Counter counters[];
+};
+
+// Two commands per render model: one drawing its points, and one drawing
+// one instance per point whose vertex count is left for renderers to fill.
+layout(std430, binding = 1) restrict writeonly buffer drawCommandsSsbo {
+	DrawArraysIndirectCommand drawCommands[];
+};
+
+void main() {
+	uint model = gl_GlobalInvocationID.x;
+	if (model >= uRenderModelCount) return;
+	Counter counter = counters[model];
+	drawCommands[2 * model + 0] = DrawArraysIndirectCommand(counter.count, 1, counter.offset, 0);
+	drawCommands[2 * model + 1] = DrawArraysIndirectCommand(0, counter.count, 0, counter.offset);
+}
@@ -13,7 +13,7 @@
 //#define MIXEDHIT_SAMPLING
 //#define SPHEREHIT_SAMPLING
 
-uniform bool uDebugRenderType = false;
+#include "include/uniform/grain.inc.glsl"
 uniform vec3 uDebugRenderColor = vec3(150.0/255.0, 231.0/255.0, 12.0/255.0);
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -91,8 +91,7 @@ uniform mat4 viewModelMatrix;
 #include "include/depth.inc.glsl"
 #include "grain/procedural-color.inc.glsl"
 
-uniform SphericalImpostor uImpostor[3];
-uniform float uGrainInnerRadiusRatio;
+#include "include/uniform/impostors.inc.glsl"
 
 uniform float uHitSphereCorrectionFactor = .65;
 
@@ -108,31 +107,31 @@ uniform int uSamplingMode = 0; // 0: PLANEHIT_SAMPLING 1: SPHEREHIT_SAMPLING 2:
 /**
  * Sample an impostor with different strategies depending on options
  */
-GFragment SampleImpostor(const in SphericalImpostor impostor, const in Ray ray_gs, float radius) {
+GFragment SampleImpostor(const in SphericalImpostor impostor, const in SphericalImpostorMaps maps, const in Ray ray_gs, float radius) {
 #ifdef NO_INTERPOLATION
 #  ifdef PRECOMPUTE_IN_VERTEX
-	return aux_IntersectRaySphericalGBillboardNoInterp(impostor, ray_gs, radius, geo.i.x);
+	return aux_IntersectRaySphericalGBillboardNoInterp(impostor, maps, ray_gs, radius, geo.i.x);
 #  else // PRECOMPUTE_IN_VERTEX
-	return IntersectRaySphericalGBillboardNoInterp(impostor, ray_gs, radius);
+	return IntersectRaySphericalGBillboardNoInterp(impostor, maps, ray_gs, radius);
 #  endif // PRECOMPUTE_IN_VERTEX
 #else // NO_INTERPOLATION
 #  ifdef PRECOMPUTE_IN_VERTEX
 	switch (uSamplingMode) {
 	case 0: // PLANEHIT_SAMPLING
-		return aux_IntersectRaySphericalGBillboard(impostor, ray_gs, radius, geo.i, geo.alpha);
+		return aux_IntersectRaySphericalGBillboard(impostor, maps, ray_gs, radius, geo.i, geo.alpha);
 	case 1: // SPHEREHIT_SAMPLING
-		return aux_IntersectRaySphericalGBillboard_SphereHit(impostor, ray_gs, radius, uHitSphereCorrectionFactor, geo.i, geo.alpha);
+		return aux_IntersectRaySphericalGBillboard_SphereHit(impostor, maps, ray_gs, radius, uHitSphereCorrectionFactor, geo.i, geo.alpha);
 	case 2: // MIXEDHIT_SAMPLING
-		return aux_IntersectRaySphericalGBillboard_MixedHit(impostor, ray_gs, radius, uHitSphereCorrectionFactor, geo.i, geo.alpha);
+		return aux_IntersectRaySphericalGBillboard_MixedHit(impostor, maps, ray_gs, radius, uHitSphereCorrectionFactor, geo.i, geo.alpha);
 	}
 #  else // PRECOMPUTE_IN_VERTEX
 	switch (uSamplingMode) {
 	case 0: // PLANEHIT_SAMPLING
-		return IntersectRaySphericalGBillboard(impostor, ray_gs, radius);
+		return IntersectRaySphericalGBillboard(impostor, maps, ray_gs, radius);
 	case 1: // SPHEREHIT_SAMPLING
-		return IntersectRaySphericalGBillboard_SphereHit(impostor, ray_gs, radius, uHitSphereCorrectionFactor);
+		return IntersectRaySphericalGBillboard_SphereHit(impostor, maps, ray_gs, radius, uHitSphereCorrectionFactor);
 	case 2: // MIXEDHIT_SAMPLING
-		return IntersectRaySphericalGBillboard_MixedHit(impostor, ray_gs, radius, uHitSphereCorrectionFactor);
+		return IntersectRaySphericalGBillboard_MixedHit(impostor, maps, ray_gs, radius, uHitSphereCorrectionFactor);
 	}
 #  endif // PRECOMPUTE_IN_VERTEX
 #endif // NO_INTERPOLATION
@@ -185,7 +184,7 @@ void main() {
 		fragment = IntersectRayCube(ray_ws, geo.position_ws, geo.radius);
 		break;
 	default: // IMPOSTOR
-		fragment = SampleImpostor(uImpostor[0], ray_gs, geo.radius);
+		fragment = SampleImpostor(uImpostor[0], uImpostorMaps[0], ray_gs, geo.radius);
 		mat3 ws_from_gs_rot = transpose(mat3(geo.gs_from_ws));
 		fragment.normal = ws_from_gs_rot * fragment.normal;
 		break;
@@ -15,12 +15,8 @@
 layout(points) in;
 layout(points, max_vertices = 1) out;
 
-struct PointCloundVboEntry {
-    vec4 position;
-};
-layout(std430, binding = 0) restrict readonly buffer pointsSsbo {
-    PointCloundVboEntry pointVertexAttributes[];
-};
+#define POINTS_BINDING 0
+#include "include/points.inc.glsl"
 layout (std430, binding = 1) restrict readonly buffer pointElementsSsbo {
     uint pointElements[];
 };
@@ -52,7 +48,7 @@ uniform mat4 viewModelMatrix;
 uniform bool uUseAnimation = true;
 uniform bool uUsePointElements = true;
 
-uniform float uGrainRadius;
+#include "include/uniform/grain.inc.glsl"
 
 uniform sampler2D uOcclusionMap;
 uniform bool uUseOcclusionMap = false;
@@ -71,7 +67,7 @@ uniform bool uPrerenderSurface = false;
 #include "include/gbuffer2.inc.glsl"
 #include "include/impostor.inc.glsl"
 #include "include/zbuffer.inc.glsl"
-uniform SphericalImpostor uImpostor[3];
+#include "include/uniform/impostors.inc.glsl"
 #endif // PRECOMPUTE_IN_VERTEX
 
 void main() {
@@ -85,7 +81,7 @@ void main() {
         ? AnimatedPointId2(geo.id, uFrameCount, uPointCount, uTime, uFps)
         : geo.id;
 
-	vec3 p = pointVertexAttributes[animPointId].position.xyz;
+	vec3 p = fetchPointPosition(animPointId);
 
     geo.radius = uGrainRadius;
 
@@ -12,3 +12,7 @@ uint AnimatedPointId2(uint pointId, uint frameCount, uint pointCount, float time
 	return pointId + pointCount * frame;
 }
 
+// Frame currently displayed, such that AnimatedPointId2(i, ...) = i + pointCount * AnimationFrame(...)
+uint AnimationFrame(uint frameCount, float time, float fps) {
+	return uint(time * fps) % max(1, frameCount);
+}
@@ -13,21 +13,27 @@ layout(std430, binding = 4) restrict readonly buffer impostorViewMatricesSsbo {
 
 uniform float uGrainScale = 1.0;
 
+// Parameters of an atlas, see include/uniform/impostors.inc.glsl
+// Must match ImpostorAtlasMaterial::UboData (std140)
 struct SphericalImpostor {
-	sampler2DArray normalAlphaTexture;
-	sampler2DArray baseColorTexture;
-	sampler2DArray metallicRoughnessTexture;
-	sampler2DArray lean1Texture;
-	sampler2DArray lean2Texture;
-	uint viewCount; // number of precomputed views
 	vec3 baseColor;
 	float metallic;
 	float roughness;
+	uint viewCount; // number of precomputed views
 	bool hasBaseColorMap;
 	bool hasMetallicRoughnessMap;
 	bool hasLeanMapping;
 };
 
+// Textures of an atlas, which cannot be part of a uniform block
+struct SphericalImpostorMaps {
+	sampler2DArray normalAlphaTexture;
+	sampler2DArray baseColorTexture;
+	sampler2DArray metallicRoughnessTexture;
+	sampler2DArray lean1Texture;
+	sampler2DArray lean2Texture;
+};
+
 struct SphericalImpostorHit {
 	vec3 position;
 	vec3 textureCoords;
@@ -168,7 +174,7 @@ SphericalImpostorHit IntersectRayBillboard_MixedHit(Ray ray, uint i, float radiu
 /**
  * Sample the billboard textures to return a GFragment
  */
-GFragment SampleBillboard(SphericalImpostor impostor, SphericalImpostorHit hit) {
+GFragment SampleBillboard(SphericalImpostor impostor, SphericalImpostorMaps maps, SphericalImpostorHit hit) {
 	// If invalid hit, return transparent fragment
 	if (hit.textureCoords.x <= 0 || hit.textureCoords.x >= 1 || hit.textureCoords.y <= 0 || hit.textureCoords.y >= 1) {
 		GFragment g;
@@ -179,17 +185,17 @@ GFragment SampleBillboard(SphericalImpostor impostor, SphericalImpostorHit hit)
 	vec3 uvw = vec3((hit.textureCoords.xy - 0.5) * uGrainScale + 0.5, hit.textureCoords.z);
 
 	// Otherwise, sample textures
-	vec4 normalAlpha = texture(impostor.normalAlphaTexture, uvw);
+	vec4 normalAlpha = texture(maps.normalAlphaTexture, uvw);
 	//vec4 lean1 = vec4(0.0);
 	//vec4 lean2 = vec4(0.0);
 	vec4 baseColor = vec4(0.0);
 	vec2 metallicRoughnes = vec2(impostor.metallic, impostor.roughness);
 	if (normalAlpha.a > 0) {
-		baseColor = texture(impostor.baseColorTexture, uvw);
-		//lean1 = texture(impostor.lean1Texture, uvw);
-		//lean2 = texture(impostor.lean2Texture, uvw);
+		baseColor = texture(maps.baseColorTexture, uvw);
+		//lean1 = texture(maps.lean1Texture, uvw);
+		//lean2 = texture(maps.lean2Texture, uvw);
 		if (impostor.hasMetallicRoughnessMap) {
-			metallicRoughnes = texture(impostor.metallicRoughnessTexture, uvw).xy;
+			metallicRoughnes = texture(maps.metallicRoughnessTexture, uvw).xy;
 		}
 	}
 
@@ -210,12 +216,12 @@ GFragment SampleBillboard(SphericalImpostor impostor, SphericalImpostorHit hit)
  * Sample a Spherical G-impostor of radius radius and located at world position p
  * (Argl, stupid code duplication incoming)
  */
-GFragment aux_IntersectRaySphericalGBillboard(SphericalImpostor impostor, Ray ray, float radius, uvec4 i, vec2 alpha) {
+GFragment aux_IntersectRaySphericalGBillboard(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius, uvec4 i, vec2 alpha) {
 	uint n = impostor.viewCount;
-	GFragment g1 = SampleBillboard(impostor, IntersectRayBillboard(ray, i.x, radius, n));
-	GFragment g2 = SampleBillboard(impostor, IntersectRayBillboard(ray, i.y, radius, n));
-	GFragment g3 = SampleBillboard(impostor, IntersectRayBillboard(ray, i.z, radius, n));
-	GFragment g4 = SampleBillboard(impostor, IntersectRayBillboard(ray, i.w, radius, n));
+	GFragment g1 = SampleBillboard(impostor, maps, IntersectRayBillboard(ray, i.x, radius, n));
+	GFragment g2 = SampleBillboard(impostor, maps, IntersectRayBillboard(ray, i.y, radius, n));
+	GFragment g3 = SampleBillboard(impostor, maps, IntersectRayBillboard(ray, i.z, radius, n));
+	GFragment g4 = SampleBillboard(impostor, maps, IntersectRayBillboard(ray, i.w, radius, n));
 	
 	return LerpGFragment(
 		LerpGFragment(g1, g2, alpha.x),
@@ -223,12 +229,12 @@ GFragment aux_IntersectRaySphericalGBillboard(SphericalImpostor impostor, Ray ra
 		alpha.y
 	);
 }
-GFragment aux_IntersectRaySphericalGBillboard_SphereHit(SphericalImpostor impostor, Ray ray, float radius, float hitSphereCorrectionFactor, uvec4 i, vec2 alpha) {
+GFragment aux_IntersectRaySphericalGBillboard_SphereHit(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius, float hitSphereCorrectionFactor, uvec4 i, vec2 alpha) {
 	uint n = impostor.viewCount;
-	GFragment g1 = SampleBillboard(impostor, IntersectRayBillboard_SphereHit(ray, i.x, radius, n, hitSphereCorrectionFactor));
-	GFragment g2 = SampleBillboard(impostor, IntersectRayBillboard_SphereHit(ray, i.y, radius, n, hitSphereCorrectionFactor));
-	GFragment g3 = SampleBillboard(impostor, IntersectRayBillboard_SphereHit(ray, i.z, radius, n, hitSphereCorrectionFactor));
-	GFragment g4 = SampleBillboard(impostor, IntersectRayBillboard_SphereHit(ray, i.w, radius, n, hitSphereCorrectionFactor));
+	GFragment g1 = SampleBillboard(impostor, maps, IntersectRayBillboard_SphereHit(ray, i.x, radius, n, hitSphereCorrectionFactor));
+	GFragment g2 = SampleBillboard(impostor, maps, IntersectRayBillboard_SphereHit(ray, i.y, radius, n, hitSphereCorrectionFactor));
+	GFragment g3 = SampleBillboard(impostor, maps, IntersectRayBillboard_SphereHit(ray, i.z, radius, n, hitSphereCorrectionFactor));
+	GFragment g4 = SampleBillboard(impostor, maps, IntersectRayBillboard_SphereHit(ray, i.w, radius, n, hitSphereCorrectionFactor));
 	
 	return LerpGFragment(
 		LerpGFragment(g1, g2, alpha.x),
@@ -236,12 +242,12 @@ GFragment aux_IntersectRaySphericalGBillboard_SphereHit(SphericalImpostor impost
 		alpha.y
 	);
 }
-GFragment aux_IntersectRaySphericalGBillboard_MixedHit(SphericalImpostor impostor, Ray ray, float radius, float hitSphereCorrectionFactor, uvec4 i, vec2 alpha) {
+GFragment aux_IntersectRaySphericalGBillboard_MixedHit(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius, float hitSphereCorrectionFactor, uvec4 i, vec2 alpha) {
 	uint n = impostor.viewCount;
-	GFragment g1 = SampleBillboard(impostor, IntersectRayBillboard_MixedHit(ray, i.x, radius, n, hitSphereCorrectionFactor));
-	GFragment g2 = SampleBillboard(impostor, IntersectRayBillboard_MixedHit(ray, i.y, radius, n, hitSphereCorrectionFactor));
-	GFragment g3 = SampleBillboard(impostor, IntersectRayBillboard_MixedHit(ray, i.z, radius, n, hitSphereCorrectionFactor));
-	GFragment g4 = SampleBillboard(impostor, IntersectRayBillboard_MixedHit(ray, i.w, radius, n, hitSphereCorrectionFactor));
+	GFragment g1 = SampleBillboard(impostor, maps, IntersectRayBillboard_MixedHit(ray, i.x, radius, n, hitSphereCorrectionFactor));
+	GFragment g2 = SampleBillboard(impostor, maps, IntersectRayBillboard_MixedHit(ray, i.y, radius, n, hitSphereCorrectionFactor));
+	GFragment g3 = SampleBillboard(impostor, maps, IntersectRayBillboard_MixedHit(ray, i.z, radius, n, hitSphereCorrectionFactor));
+	GFragment g4 = SampleBillboard(impostor, maps, IntersectRayBillboard_MixedHit(ray, i.w, radius, n, hitSphereCorrectionFactor));
 	
 	return LerpGFragment(
 		LerpGFragment(g1, g2, alpha.x),
@@ -252,37 +258,37 @@ GFragment aux_IntersectRaySphericalGBillboard_MixedHit(SphericalImpostor imposto
 /**
  * Sample a Spherical G-impostor of radius radius and located at world position p
  */
-GFragment IntersectRaySphericalGBillboard(SphericalImpostor impostor, Ray ray, float radius) {
+GFragment IntersectRaySphericalGBillboard(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius) {
 	uvec4 i;
 	vec2 alpha;
 	DirectionToViewIndices(-ray.direction, impostor.viewCount, i, alpha);
-	return aux_IntersectRaySphericalGBillboard(impostor, ray, radius, i, alpha);
+	return aux_IntersectRaySphericalGBillboard(impostor, maps, ray, radius, i, alpha);
 }
-GFragment IntersectRaySphericalGBillboard_SphereHit(SphericalImpostor impostor, Ray ray, float radius, float hitSphereCorrectionFactor) {
+GFragment IntersectRaySphericalGBillboard_SphereHit(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius, float hitSphereCorrectionFactor) {
 	uvec4 i;
 	vec2 alpha;
 	DirectionToViewIndices(-ray.direction, impostor.viewCount, i, alpha);
-	return aux_IntersectRaySphericalGBillboard_SphereHit(impostor, ray, radius, hitSphereCorrectionFactor, i, alpha);
+	return aux_IntersectRaySphericalGBillboard_SphereHit(impostor, maps, ray, radius, hitSphereCorrectionFactor, i, alpha);
 }
-GFragment IntersectRaySphericalGBillboard_MixedHit(SphericalImpostor impostor, Ray ray, float radius, float hitSphereCorrectionFactor) {
+GFragment IntersectRaySphericalGBillboard_MixedHit(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius, float hitSphereCorrectionFactor) {
 	uvec4 i;
 	vec2 alpha;
 	DirectionToViewIndices(-ray.direction, impostor.viewCount, i, alpha);
-	return aux_IntersectRaySphericalGBillboard_MixedHit(impostor, ray, radius, hitSphereCorrectionFactor, i, alpha);
+	return aux_IntersectRaySphericalGBillboard_MixedHit(impostor, maps, ray, radius, hitSphereCorrectionFactor, i, alpha);
 }
 
 /**
  * Same as IntersectRaySphericalGBillboard wthout interpolation
  */
- GFragment aux_IntersectRaySphericalGBillboardNoInterp(SphericalImpostor impostor, Ray ray, float radius, uint i) {
+ GFragment aux_IntersectRaySphericalGBillboardNoInterp(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius, uint i) {
 	uint n = impostor.viewCount;
-	GFragment g = SampleBillboard(impostor, IntersectRayBillboard(ray, i, radius, n));
+	GFragment g = SampleBillboard(impostor, maps, IntersectRayBillboard(ray, i, radius, n));
 	return g;
 }
-GFragment IntersectRaySphericalGBillboardNoInterp(SphericalImpostor impostor, Ray ray, float radius) {
+GFragment IntersectRaySphericalGBillboardNoInterp(SphericalImpostor impostor, SphericalImpostorMaps maps, Ray ray, float radius) {
 	uint n = impostor.viewCount;
 	uint i = DirectionToViewIndex(-ray.direction, n);
-	return aux_IntersectRaySphericalGBillboardNoInterp(impostor, ray, radius, i);
+	return aux_IntersectRaySphericalGBillboardNoInterp(impostor, maps, ray, radius, i);
 }
 
 /**
@@ -1,14 +1,15 @@
 //////////////////////////////////////////////////////
 // Light related functions
 
+// Shadow maps are not part of the struct, so that it can live in a uniform
+// block (see include/uniform/lights.inc.glsl). Members are ordered to match
+// std140 layout of World::LightUbo.
 struct PointLight {
-	sampler2D shadowMap;
-	sampler2D richShadowMap;
+	mat4 matrix;
 	vec3 position_ws;
-	vec3 color;
 	int isRich;
+	vec3 color;
 	int hasShadowMap;
-	mat4 matrix;
 };
 
 
@@ -21,19 +22,19 @@ float shadowBiasFromNormal(const in PointLight light, const in vec3 normal) {
 }
 
 
-vec4 richLightTest(const in PointLight light, vec3 position_ws, vec3 position_cs, float shadowBias) {
+vec4 richLightTest(const in PointLight light, sampler2D shadowMap, sampler2D richShadowMap, vec3 position_ws, vec3 position_cs, float shadowBias) {
 	vec4 shadowCoord = light.matrix * vec4(position_ws, 1.0);
 	shadowCoord = shadowCoord / shadowCoord.w * 0.5 + 0.5;
 
-	float shadowLimitDepth = texture(light.shadowMap, shadowCoord.xy).r;
+	float shadowLimitDepth = texture(shadowMap, shadowCoord.xy).r;
 	//shadow += d < shadowCoord.z - shadowBias ? 1.0 : 0.0;
 
-	vec2 s = vec2(textureSize(light.richShadowMap, 0));
+	vec2 s = vec2(textureSize(richShadowMap, 0));
 	vec2 roundedShadowCoord = round(shadowCoord.xy * s) / s;
 
 	vec3 shadowLimitTexelCenter = vec3(roundedShadowCoord, shadowLimitDepth);
 
-	vec3 normal = normalize(texture(light.richShadowMap, shadowCoord.xy).xyz);
+	vec3 normal = normalize(texture(richShadowMap, shadowCoord.xy).xyz);
 	if (normal.z > 0) {
 		//normal = -normal;  // point toward camera
 	}
@@ -45,7 +46,7 @@ vec4 richLightTest(const in PointLight light, vec3 position_ws, vec3 position_cs
 	//vec2 dv = (shadowCoord.xy - roundedShadowCoord.xy) * grad;
 	//return vec4(grad * 400.0, 0.0, 1.0);
 
-	float d0 = texture(light.shadowMap, roundedShadowCoord).r;
+	float d0 = texture(shadowMap, roundedShadowCoord).r;
 	float d = d0 + dot(dv, normal.xy);
 
 	//return vec4(normal.xy * 0.5 + 0.5, 0.0, 0.0);
@@ -61,19 +62,19 @@ vec4 richLightTest(const in PointLight light, vec3 position_ws, vec3 position_cs
 }
 
 
-float richShadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
+float richShadowAt(const in PointLight light, sampler2D shadowMap, sampler2D richShadowMap, vec3 position_ws, float shadowBias) {
 	vec4 shadowCoord = light.matrix * vec4(position_ws, 1.0);
 	shadowCoord = shadowCoord / shadowCoord.w * 0.5 + 0.5;
 
-	float shadowLimitDepth = texture(light.shadowMap, shadowCoord.xy).r;
+	float shadowLimitDepth = texture(shadowMap, shadowCoord.xy).r;
 	//shadow += d < shadowCoord.z - shadowBias ? 1.0 : 0.0;
 
-	vec2 s = vec2(textureSize(light.richShadowMap, 0));
+	vec2 s = vec2(textureSize(richShadowMap, 0));
 	vec2 roundedShadowCoord = round(shadowCoord.xy * s) / s;
 
 	vec3 shadowLimitTexelCenter = vec3(roundedShadowCoord, shadowLimitDepth);
 
-	vec3 normal = normalize(texture(light.richShadowMap, shadowCoord.xy).xyz);
+	vec3 normal = normalize(texture(richShadowMap, shadowCoord.xy).xyz);
 	if (normal.z > 0) {
 		normal = -normal;  // point toward camera
 	}
@@ -84,13 +85,13 @@ float richShadowAt(const in PointLight light, vec3 position_ws, float shadowBias
 }
 
 
-float shadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
+float shadowAt(const in PointLight light, sampler2D shadowMap, sampler2D richShadowMap, vec3 position_ws, float shadowBias) {
 	if (light.hasShadowMap == 0) {
 		return 0.0;
 	}
 
 	if (light.isRich == 1) {
-		return richShadowAt(light, position_ws, shadowBias);
+		return richShadowAt(light, shadowMap, richShadowMap, position_ws, shadowBias);
 	}
 
 	float shadow = 0.0;
@@ -102,12 +103,12 @@ float shadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
 	shadowCoord = shadowCoord * 0.5 + 0.5;
 
 	// PCF
-	vec2 texelSize = 1.0 / textureSize(light.shadowMap, 0);
+	vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
 	vec2 dcoord;
 	for(int x = -1; x <= 1; ++x) {
 		for(int y = -1; y <= 1; ++y) {
 			dcoord = vec2(x, y) * texelSize;
-			float d = texture(light.shadowMap, shadowCoord.xy + dcoord).r;
+			float d = texture(shadowMap, shadowCoord.xy + dcoord).r;
 			shadow += d < shadowCoord.z - shadowBias ? 1.0 : 0.0;
 		}
 	}
@@ -0,0 +1,57 @@
+// Requires POINTS_BINDING to be defined to the SSBO binding of the point buffer.
+// Chunk bounds are always bound at POINT_CHUNKS_BINDING.
+// Matches the layouts written by PointCloudDataBehavior.
+
+#ifndef POINT_CHUNKS_BINDING
+#define POINT_CHUNKS_BINDING 5
+#endif
+
+struct PointCloundVboEntry {
+	vec4 position;
+};
+layout(std430, binding = POINTS_BINDING) restrict readonly buffer pointsSsbo {
+	PointCloundVboEntry pointVertexAttributes[];
+};
+
+/**
+ * Quantized alternative layout of the very same buffer: 16 bits per
+ * coordinate, relative to the bounding box of the chunk the point belongs
+ * to, packed as (x | y << 16, z).
+ */
+layout(std430, binding = POINTS_BINDING) restrict readonly buffer quantizedPointsSsbo {
+	uvec2 quantizedPoints[];
+};
+
+struct PointChunk {
+	vec4 aabbMin;
+	vec4 aabbMax;
+};
+layout(std430, binding = POINT_CHUNKS_BINDING) restrict readonly buffer pointChunksSsbo {
+	PointChunk pointChunks[];
+};
+
+uniform bool uQuantizedPositions = false;
+uniform uint uPointChunkSize = 4096;
+
+/**
+ * Position of a quantized point, given its coordinates relative to its chunk
+ * in [0,1], as seen by the position vertex attribute of quantized buffers
+ */
+vec3 dequantizePointPosition(vec3 t, uint pointId) {
+	PointChunk chunk = pointChunks[pointId / uPointChunkSize];
+	return mix(chunk.aabbMin.xyz, chunk.aabbMax.xyz, t);
+}
+
+/**
+ * Position of a point, given its index in the whole buffer (i.e. after
+ * animation, see AnimatedPointId2())
+ */
+vec3 fetchPointPosition(uint pointId) {
+	if (uQuantizedPositions) {
+		uvec2 q = quantizedPoints[pointId];
+		vec3 t = vec3(q.x & 0xffff, q.x >> 16, q.y & 0xffff) / 65535.0;
+		return dequantizePointPosition(t, pointId);
+	} else {
+		return pointVertexAttributes[pointId].position.xyz;
+	}
+}
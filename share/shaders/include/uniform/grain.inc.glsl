@@ -0,0 +1,8 @@
+// Set by GrainBehavior::bindProperties()
+// Must match GrainBehavior::GrainUbo
+layout (std140) uniform Grain {
+    float uGrainRadius;
+    float uGrainInnerRadiusRatio;
+    float uOuterOverInnerRadius; // 1./uGrainInnerRadiusRatio
+    bool uDebugRenderType;
+};
@@ -0,0 +1,6 @@
+// Set by GrainBehavior::bindAtlases(), requires include/impostor.inc.glsl
+// Must match GrainBehavior::s_maxAtlases
+layout (std140) uniform Impostors {
+    SphericalImpostor uImpostor[3];
+};
+uniform SphericalImpostorMaps uImpostorMaps[3];
@@ -0,0 +1,7 @@
+// Set by World::bindLights(), requires include/light.inc.glsl
+// Must match World::LightsUbo, World::s_shadowMapUnit and World::s_richShadowMapUnit
+layout (std140) uniform Lights {
+    PointLight light[3];
+};
+layout (binding = 10) uniform sampler2D uShadowMaps[3];
+layout (binding = 13) uniform sampler2D uRichShadowMaps[3];
@@ -20,7 +20,7 @@ uniform StandardMaterial uMaterial[3];
 
 uniform float uNormalMapping = 5.0;
 
-uniform bool uDebugRenderType = false;
+#include "include/uniform/grain.inc.glsl"
 uniform vec3 uDebugRenderColor = vec3(172.0/255.0, 23.0/255.0, 1.0/255.0);
 
 #include "include/random.inc.glsl"
@@ -6,16 +6,14 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 uv;
 layout (location = 3) in uint materialId;
 layout (location = 4) in vec3 tangent;
+// Per instance element, either from the element buffer of point data or
+// sorted by level of detail (see grain/instance-lods.comp.glsl). Being an
+// instanced attribute, it is offset by the baseInstance of draw commands,
+// unlike gl_InstanceID.
+layout (location = 5) in uint instanceElement;
 
-struct PointCloundVboEntry {
-    vec4 position;
-};
-layout(std430, binding = 0) restrict readonly buffer pointsSsbo {
-    PointCloundVboEntry pointVertexAttributes[];
-};
-layout (std430, binding = 1) restrict readonly buffer pointElementsSsbo {
-    uint pointElements[];
-};
+#define POINTS_BINDING 0
+#include "include/points.inc.glsl"
 
 out VertexData {
     vec3 normal_ws;
@@ -32,7 +30,7 @@ uniform mat4 viewModelMatrix;
 
 #pragma variant PROCEDURAL_BASECOLOR
 
-uniform float uGrainRadius = 0.005;
+#include "include/uniform/grain.inc.glsl"
 uniform float uGrainMeshScale = 4.5;
 
 uniform uint uFrameCount;
@@ -41,7 +39,8 @@ uniform float uFps = 25.0;
 uniform float uTime;
 
 uniform bool uUseAnimation = true;
-uniform bool uUsePointElements = true;
+uniform bool uUseElementAttribute = true;
+uniform uint uInstanceOffset = 0; // first point when there is no element attribute
 
 #include "include/random.inc.glsl"
 #include "include/anim.inc.glsl"
@@ -49,16 +48,16 @@ uniform bool uUsePointElements = true;
 
 void main() {
     uint pointId =
-        uUsePointElements
-        ? pointElements[gl_InstanceID]
-        : gl_InstanceID;
+        uUseElementAttribute
+        ? instanceElement
+        : uInstanceOffset + uint(gl_InstanceID);
 
     uint animPointId =
         uUseAnimation
         ? AnimatedPointId2(pointId, uFrameCount, uPointCount, uTime, uFps)
         : pointId;
 
-    vec3 grainCenter_ws = (modelMatrix * vec4(pointVertexAttributes[animPointId].position.xyz, 1.0)).xyz;
+    vec3 grainCenter_ws = (modelMatrix * vec4(fetchPointPosition(animPointId), 1.0)).xyz;
 
     pointId = animPointId%20; // WTF?
     mat3 ws_from_gs = transpose(mat3(randomGrainMatrix(int(pointId), grainCenter_ws)));
@@ -30,6 +30,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <rapidjson/document.h> // rapidjson::Value
 
@@ -86,6 +87,13 @@ public:
 	virtual void update(float time) {}
 	virtual void update(float time, int frame) { update(time); }
 
+	/**
+	 * Called once per frame before any call to onPreRender(), with all the
+	 * views that the object is about to be pre-rendered for, so that view
+	 * dependent work can be batched.
+	 */
+	virtual void onPreRenderViews(const std::vector<PreRenderView>& views, const World& world) {}
+
 	/**
 	 * Called just before rendering.
 	 */
@@ -103,6 +111,13 @@ public:
 	 */
 	virtual void onPostRender(float time, int frame) {}
 
+	/**
+	 * Called once after the scene is loaded, to add to the ShaderPool every
+	 * shader variant this behavior may switch to, so that they get compiled
+	 * in the background rather than when first needed.
+	 */
+	virtual void precompileShaders() {}
+
 	/**
 	 * Called when it is needed to reload shaders.
 	 * TODO: shader loading and reloading should be handled by some Shader Pool object
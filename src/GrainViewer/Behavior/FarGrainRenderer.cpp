@@ -49,15 +49,6 @@
 
 #include <magic_enum.hpp>
 
-const std::vector<std::string> FarGrainRenderer::s_shaderVariantDefines = {
-	"SHELL_CULLING",
-	"PASS_DEPTH",
-	"PASS_EPSILON_DEPTH",
-	"PASS_BLIT_TO_MAIN_FBO",
-	"NO_DISCARD_IN_PASS_EPSILON_DEPTH",
-	"PSEUDO_LEAN",
-};
-
 //-----------------------------------------------------------------------------
 // Behavior implementation
 
@@ -77,6 +68,7 @@ void FarGrainRenderer::start()
 	m_transform = getComponent<TransformBehavior>();
 	m_grain = getComponent<GrainBehavior>();
 	m_pointData = BehaviorRegistry::getPointCloudDataComponent(*this, PointCloudSplitter::RenderModel::Point);
+	m_shaders.setBaseShader(m_shaderName);
 
 	if (!m_colormapTextureName.empty()) {
 		m_colormapTexture = ResourceManager::loadTexture(m_colormapTextureName);
@@ -112,19 +104,17 @@ void FarGrainRenderer::render(const Camera& camera, const World& world, RenderTy
 //-----------------------------------------------------------------------------
 // private members
 
-void FarGrainRenderer::draw(const IPointCloudData& pointData) const
+void FarGrainRenderer::draw(const IPointCloudData& pointData, const ShaderProgram& shader) const
 {
 	glBindVertexArray(pointData.vao());
+	pointData.bindPoints(shader, 0);
 	if (auto ebo = pointData.ebo()) {
 		//glVertexArrayElementBuffer(pointData.vao(), ebo->name());
 		//glDrawElements(GL_POINTS, pointData.pointCount(), GL_UNSIGNED_INT, 0);
 		// could not find a way to offset in element buffer, so fall back to ssbo for indexed vertex arrays
-		pointData.vbo().bindSsbo(0);
 		ebo->bindSsbo(1);
-		glDrawArrays(GL_POINTS, pointData.pointOffset(), pointData.pointCount());
-	} else {
-		glDrawArrays(GL_POINTS, pointData.pointOffset(), pointData.pointCount());
 	}
+	pointData.drawPoints();
 	glBindVertexArray(0);
 }
 
@@ -155,10 +145,10 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 
 	// 1. Render depth buffer with an offset of epsilon
 	if (props.useShellCulling) {
-		ShaderVariantFlagSet flags = ShaderPassEpsilonDepth | ShaderOptionShellCulling;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-		ShaderProgram& shader = *getShader(flags);
+		ShaderVariantFlagSet flags = { PASS_EPSILON_DEPTH, SHELL_CULLING };
+		if (props.noDiscard) flags |= NO_DISCARD_IN_PASS_EPSILON_DEPTH;
+		if (props.pseudoLean) flags |= PSEUDO_LEAN;
+		ShaderProgram& shader = *m_shaders.get(flags);
 
 		glDepthMask(GL_TRUE);
 		glEnable(GL_DEPTH_TEST);
@@ -167,7 +157,7 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 		setCommonUniforms(shader, camera);
 
 		shader.use();
-		draw(pointData);
+		draw(pointData, shader);
 	}
 
 	// 2. Clear color buffers
@@ -179,11 +169,11 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 
 	// 3. Render points cumulatively
 	{
-		ShaderVariantFlagSet flags = 0;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-		if (props.useShellCulling) flags |= ShaderOptionShellCulling;
-		ShaderProgram& shader = *getShader(flags);
+		ShaderVariantFlagSet flags;
+		if (props.noDiscard) flags |= NO_DISCARD_IN_PASS_EPSILON_DEPTH;
+		if (props.pseudoLean) flags |= PSEUDO_LEAN;
+		if (props.useShellCulling) flags |= SHELL_CULLING;
+		ShaderProgram& shader = *m_shaders.get(flags);
 
 		if (props.useShellCulling) {
 			glDepthMask(GL_FALSE);
@@ -200,9 +190,7 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 		GLint o = setCommonUniforms(shader, camera);
 
 		if (auto grain = m_grain.lock()) {
-			for (size_t k = 0; k < grain->atlases().size(); ++k) {
-				o = grain->atlases()[k].setUniforms(shader, MAKE_STR("uImpostor[" << k << "]."), o);
-			}
+			o = grain->bindAtlases(shader, o);
 		}
 
 		if (props.useShellCulling && (props.shellDepthFalloff || props.useEarlyDepthTest)) {
@@ -212,15 +200,15 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 		}
 
 		shader.use();
-		draw(pointData);
+		draw(pointData, shader);
 	}
 
 	// 4. Blit extra fbo to gbuffer
 	if (props.useShellCulling) {
-		ShaderVariantFlagSet flags = ShaderPassBlitToMainFbo | ShaderOptionShellCulling;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-		ShaderProgram& shader = *getShader(flags);
+		ShaderVariantFlagSet flags = { PASS_BLIT_TO_MAIN_FBO, SHELL_CULLING };
+		if (props.noDiscard) flags |= NO_DISCARD_IN_PASS_EPSILON_DEPTH;
+		if (props.pseudoLean) flags |= PSEUDO_LEAN;
+		ShaderProgram& shader = *m_shaders.get(flags);
 
 		scoppedFramebufferOverride.restore();
 		
@@ -253,11 +241,11 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 void FarGrainRenderer::renderToShadowMap(const IPointCloudData& pointData, const Camera& camera, const World& world) const
 {
 	const Properties& props = properties();
-	ShaderVariantFlagSet flags = ShaderPassDepth;
-	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-	if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-	if (props.useShellCulling) flags |= ShaderOptionShellCulling;
-	ShaderProgram& shader = *getShader(flags);
+	ShaderVariantFlagSet flags = PASS_DEPTH;
+	if (props.noDiscard) flags |= NO_DISCARD_IN_PASS_EPSILON_DEPTH;
+	if (props.pseudoLean) flags |= PSEUDO_LEAN;
+	if (props.useShellCulling) flags |= SHELL_CULLING;
+	ShaderProgram& shader = *m_shaders.get(flags);
 
 	glEnable(GL_PROGRAM_POINT_SIZE);
 	glDepthMask(GL_TRUE);
@@ -266,7 +254,7 @@ void FarGrainRenderer::renderToShadowMap(const IPointCloudData& pointData, const
 	setCommonUniforms(shader, camera);
 
 	shader.use();
-	draw(pointData);
+	draw(pointData, shader);
 }
 
 glm::mat4 FarGrainRenderer::modelMatrix() const {
@@ -287,7 +275,7 @@ GLint FarGrainRenderer::setCommonUniforms(const ShaderProgram & shader, const Ca
 
 	autoSetUniforms(shader, m_properties);
 	if (auto grain = m_grain.lock()) {
-		autoSetUniforms(shader, grain->properties());
+		grain->bindProperties(shader);
 		shader.setUniform("uEpsilon", m_properties.epsilonFactor * grain->properties().grainRadius);
 	} else {
 		shader.setUniform("uEpsilon", m_properties.epsilonFactor * m_properties.radius);
@@ -314,25 +302,12 @@ void FarGrainRenderer::bindDepthTexture(ShaderProgram & shader, GLuint textureUn
 	shader.setUniform("uDepthTexture", static_cast<GLint>(textureUnit));
 }
 
-std::shared_ptr<ShaderProgram> FarGrainRenderer::getShader(ShaderVariantFlagSet flags) const
+void FarGrainRenderer::precompileShaders()
 {
-	if (m_shaders.empty()) {
-		m_shaders.resize(_ShaderVariantFlagsCount);
-	}
-
-	if (!m_shaders[flags]) {
-		// Lazy loading of shader variants
-		int nFlags = ilog2(_ShaderVariantFlagsCount);
-		std::string variantName = m_shaderName + "_ShaderVariantFlags_" + bitname(flags, nFlags);
-		std::vector<std::string> defines;
-		for (int f = 0; f < nFlags; ++f) {
-			if ((flags & (1 << f)) != 0) {
-				defines.push_back(s_shaderVariantDefines[f]);
-			}
-		}
-		DEBUG_LOG << "loading variant " << variantName;
-		ShaderPool::AddShaderVariant(variantName, m_shaderName, defines);
-		m_shaders[flags] = ShaderPool::GetShader(variantName);
-	}
-	return m_shaders[flags];
+	// Passes other than the main one and the shadow map only exist with shell culling
+	m_shaders.precompile([](ShaderVariantFlagSet flags) {
+		int passCount = flags.test(PASS_DEPTH) + flags.test(PASS_EPSILON_DEPTH) + flags.test(PASS_BLIT_TO_MAIN_FBO);
+		bool isMainOrDepth = !flags.test(PASS_EPSILON_DEPTH) && !flags.test(PASS_BLIT_TO_MAIN_FBO);
+		return passCount <= 1 && (isMainOrDepth || flags.test(SHELL_CULLING));
+	});
 }
@@ -30,6 +30,7 @@
 #pragma once
 
 #include "Behavior.h"
+#include "ShaderVariantTable.h"
 #include "utils/ReflectionAttributes.h"
 
 #include <refl.hpp>
@@ -53,6 +54,7 @@ public:
 	bool deserialize(const rapidjson::Value & json) override;
 	void start() override;
 	void update(float time, int frame) override;
+	void precompileShaders() override;
 	void render(const Camera & camera, const World & world, RenderType target) const override;
 
 public:
@@ -90,29 +92,25 @@ public:
 	const Properties & properties() const { return m_properties; }
 
 private:
-	// When adding flag, don't forget to add the corresponding define in the
-	// definition of s_shaderVariantDefines in cpp file.
+	// These must match defines in the shader (magic_enum reflexion is used to set defines)
 	// TODO: distinguish stages from options
-	enum ShaderVariantFlags {
-		ShaderOptionShellCulling = 1 << 0,
-		ShaderPassDepth = 1 << 1,
-		ShaderPassEpsilonDepth = 1 << 2,
-		ShaderPassBlitToMainFbo = 1 << 3,
-		ShaderOptionNoDiscard = 1 << 4,
-		ShaderOptionPseudoLean = 1 << 5,
-		_ShaderVariantFlagsCount = 1 << 6,
+	enum ShaderVariantFlag {
+		SHELL_CULLING,
+		PASS_DEPTH,
+		PASS_EPSILON_DEPTH,
+		PASS_BLIT_TO_MAIN_FBO,
+		NO_DISCARD_IN_PASS_EPSILON_DEPTH,
+		PSEUDO_LEAN,
 	};
-	typedef int ShaderVariantFlagSet;
-	static const std::vector<std::string> s_shaderVariantDefines;
+	typedef ShaderVariantFlags<ShaderVariantFlag> ShaderVariantFlagSet;
 
 private:
-	void draw(const IPointCloudData& pointData) const;
+	void draw(const IPointCloudData& pointData, const ShaderProgram& shader) const;
 	void renderToGBuffer(const IPointCloudData& pointData, const Camera& camera, const World& world) const;
 	void renderToShadowMap(const IPointCloudData& pointData, const Camera& camera, const World& world) const;
 	glm::mat4 modelMatrix() const;
 	GLint setCommonUniforms(const ShaderProgram & shader, const Camera & camera, GLint nextTextureUnit = 0) const;
 	void bindDepthTexture(ShaderProgram & shader, GLuint textureUnit = 7) const;
-	std::shared_ptr<ShaderProgram> getShader(ShaderVariantFlagSet flags = 0) const;
 
 public:
 	std::string m_shaderName = "FarGrain";
@@ -120,7 +118,7 @@ public:
 	Properties m_properties;
 
 	// One shader by combination of flags
-	mutable std::vector<std::shared_ptr<ShaderProgram>> m_shaders; // mutable for lazy loading, do NOT use this directly, rather use getShader()
+	ShaderVariantTable<ShaderVariantFlagSet> m_shaders;
 	std::weak_ptr<TransformBehavior> m_transform;
 	std::weak_ptr<GrainBehavior> m_grain;
 	std::weak_ptr<IPointCloudData> m_pointData;
@@ -30,13 +30,85 @@
 #include "GrainBehavior.h"
 #include "TransformBehavior.h"
 #include "ShaderPool.h"
+#include "ShaderProgram.h"
+#include "Logger.h"
 
 #include "utils/jsonutils.h"
 #include "utils/behaviorutils.h"
 
+#include <algorithm>
+
 bool GrainBehavior::deserialize(const rapidjson::Value & json)
 {
 	autoDeserialize(json, m_properties);
 	jrArray(json, "atlases", m_atlases);
+	if (m_atlases.size() > s_maxAtlases) {
+		WARN_LOG << "Only the first " << s_maxAtlases << " impostor atlases are used by shaders";
+	}
 	return true;
 }
+
+void GrainBehavior::start()
+{
+	if (!m_grainUbo) {
+		glCreateBuffers(1, &m_grainUbo);
+		glNamedBufferStorage(m_grainUbo, static_cast<GLsizeiptr>(sizeof(GrainUbo)), NULL, GL_DYNAMIC_STORAGE_BIT);
+	}
+	if (!m_impostorsUbo) {
+		glCreateBuffers(1, &m_impostorsUbo);
+		glNamedBufferStorage(m_impostorsUbo, static_cast<GLsizeiptr>(sizeof(ImpostorsUbo)), NULL, GL_DYNAMIC_STORAGE_BIT);
+	}
+	updateUbos();
+}
+
+void GrainBehavior::update(float time)
+{
+	updateUbos();
+}
+
+void GrainBehavior::onDestroy()
+{
+	glDeleteBuffers(1, &m_grainUbo);
+	glDeleteBuffers(1, &m_impostorsUbo);
+	m_grainUbo = 0;
+	m_impostorsUbo = 0;
+}
+
+void GrainBehavior::bindProperties(const ShaderProgram& shader) const
+{
+	shader.bindUniformBlock("Grain", m_grainUbo, s_grainUboBinding);
+}
+
+GLint GrainBehavior::bindAtlases(const ShaderProgram& shader, GLint nextTextureUnit) const
+{
+	shader.bindUniformBlock("Impostors", m_impostorsUbo, s_impostorsUboBinding);
+	GLint o = nextTextureUnit;
+	size_t n = std::min(m_atlases.size(), s_maxAtlases);
+	for (size_t k = 0; k < n; ++k) {
+		o = m_atlases[k].bindTextures(shader, ImpostorAtlasMaterial::UniformNames::mapsArray(k), o);
+	}
+	return o;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Private methods
+///////////////////////////////////////////////////////////////////////////////
+
+void GrainBehavior::updateUbos()
+{
+	if (!m_grainUbo || !m_impostorsUbo) return;
+
+	GrainUbo grain;
+	grain.grainRadius = m_properties.grainRadius;
+	grain.grainInnerRadiusRatio = m_properties.grainInnerRadiusRatio;
+	grain.outerOverInnerRadius = 1.0f / m_properties.grainInnerRadiusRatio;
+	grain.debugRenderType = m_properties.debugRenderType ? 1 : 0;
+	glNamedBufferSubData(m_grainUbo, 0, static_cast<GLsizeiptr>(sizeof(GrainUbo)), &grain);
+
+	ImpostorsUbo impostors = {}; // missing atlases have no view
+	size_t n = std::min(m_atlases.size(), s_maxAtlases);
+	for (size_t k = 0; k < n; ++k) {
+		impostors.impostor[k] = m_atlases[k].uboData();
+	}
+	glNamedBufferSubData(m_impostorsUbo, 0, static_cast<GLsizeiptr>(sizeof(ImpostorsUbo)), &impostors);
+}
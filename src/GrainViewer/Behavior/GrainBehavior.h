@@ -47,11 +47,35 @@ class TransformBehavior;
  * Behavior holding sagrainnd properties that are common to all grain renderers.
  */
 class GrainBehavior : public Behavior {
+public:
+	// Must match the size of the uImpostor arrays in shaders/include/uniform/impostors.inc.glsl
+	static constexpr size_t s_maxAtlases = 3;
+	// Uniform buffer bindings, after the ones of Camera (1) and World lights (2)
+	static constexpr GLuint s_grainUboBinding = 3;
+	static constexpr GLuint s_impostorsUboBinding = 4;
+
 public:
 	// Behavior implementation
 	bool deserialize(const rapidjson::Value & json) override;
+	void start() override;
+	void update(float time) override;
+	void onDestroy() override;
 	const std::vector<ImpostorAtlasMaterial> & atlases() const { return m_atlases; }
 
+	/**
+	 * Bind the "Grain" uniform block of shaders/include/uniform/grain.inc.glsl,
+	 * updated once per frame by update().
+	 */
+	void bindProperties(const ShaderProgram & shader) const;
+
+	/**
+	 * Bind the "Impostors" uniform block of shaders/include/uniform/impostors.inc.glsl,
+	 * updated once per frame by update(), and the textures of the atlases
+	 * from nextTextureUnit on.
+	 * @return the next available texture unit
+	 */
+	GLint bindAtlases(const ShaderProgram & shader, GLint nextTextureUnit) const;
+
 public:
 	// Properties (serialized and displayed in UI)
 	struct Properties {
@@ -66,9 +90,26 @@ public:
 	Properties & properties() { return m_properties; }
 	const Properties& properties() const { return m_properties; }
 
+private:
+	void updateUbos();
+
+private:
+	// Memory layout on GPU, matches shaders/include/uniform/grain.inc.glsl
+	struct GrainUbo {
+		GLfloat grainRadius;
+		GLfloat grainInnerRadiusRatio;
+		GLfloat outerOverInnerRadius;
+		GLuint debugRenderType;
+	};
+	struct ImpostorsUbo {
+		ImpostorAtlasMaterial::UboData impostor[s_maxAtlases];
+	};
+
 private:
 	Properties m_properties;
 	std::vector<ImpostorAtlasMaterial> m_atlases;
+	GLuint m_grainUbo = 0;
+	GLuint m_impostorsUbo = 0;
 };
 
 #define _ ReflectionAttributes::
@@ -42,15 +42,6 @@
 
 //-----------------------------------------------------------------------------
 
-const std::vector<std::string> ImpostorGrainRenderer::s_shaderVariantDefines = {
-	"NO_DISCARD",
-	"PASS_SHADOW_MAP",
-	"PASS_BLIT_TO_MAIN_FBO",
-	"NO_INTERPOLATION",
-	"PRECOMPUTE_IMPOSTOR_VIEW_MATRICES",
-	"PRECOMPUTE_IN_VERTEX",
-};
-
 bool ImpostorGrainRenderer::deserialize(const rapidjson::Value & json)
 {
 	jrOption(json, "shader", m_shaderName, m_shaderName);
@@ -71,6 +62,7 @@ void ImpostorGrainRenderer::start()
 	m_grain = getComponent<GrainBehavior>();
 	m_pointData = BehaviorRegistry::getPointCloudDataComponent(*this, PointCloudSplitter::RenderModel::Impostor);
 	m_splitter = getComponent<PointCloudSplitter>();
+	m_shaders.setBaseShader(m_shaderName);
 }
 
 void ImpostorGrainRenderer::update(float time, int frame)
@@ -121,13 +113,13 @@ void ImpostorGrainRenderer::render(const Camera& camera, const World& world, Ren
 		}
 
 		// Get shader
-		ShaderVariantFlagSet flags = 0;
-		if (target == RenderType::ShadowMap) flags |= ShaderPassShadow;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
-		if (props.precomputeInVertex) flags |= ShaderOptionPrecomputeInVertex;
-		if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
-		const ShaderProgram& shader = *getShader(flags);
+		ShaderVariantFlagSet flags;
+		if (target == RenderType::ShadowMap) flags |= PASS_SHADOW_MAP;
+		if (props.noDiscard) flags |= NO_DISCARD;
+		if (props.precomputeViewMatrices) flags |= PRECOMPUTE_IMPOSTOR_VIEW_MATRICES;
+		if (props.precomputeInVertex) flags |= PRECOMPUTE_IN_VERTEX;
+		if (props.interpolationMode == InterpolationMode::None) flags |= NO_INTERPOLATION;
+		const ShaderProgram& shader = *m_shaders.get(flags);
 
 		setCommonUniforms(shader, camera);
 		shader.setUniform("uPrerenderSurfaceStep", 0);
@@ -150,13 +142,13 @@ void ImpostorGrainRenderer::render(const Camera& camera, const World& world, Ren
 		glDisable(GL_BLEND);
 
 		// Get shader
-		ShaderVariantFlagSet flags = ShaderPassBlitToMainFbo;
-		if (target == RenderType::ShadowMap) flags |= ShaderPassShadow;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
-		if (props.precomputeInVertex) flags |= ShaderOptionPrecomputeInVertex;
-		if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
-		const ShaderProgram& shader = *getShader(flags);
+		ShaderVariantFlagSet flags = PASS_BLIT_TO_MAIN_FBO;
+		if (target == RenderType::ShadowMap) flags |= PASS_SHADOW_MAP;
+		if (props.noDiscard) flags |= NO_DISCARD;
+		if (props.precomputeViewMatrices) flags |= PRECOMPUTE_IMPOSTOR_VIEW_MATRICES;
+		if (props.precomputeInVertex) flags |= PRECOMPUTE_IN_VERTEX;
+		if (props.interpolationMode == InterpolationMode::None) flags |= NO_INTERPOLATION;
+		const ShaderProgram& shader = *m_shaders.get(flags);
 
 		// Set uniforms
 
@@ -185,15 +177,15 @@ void ImpostorGrainRenderer::draw(const IPointCloudData& pointData, const ShaderP
 	// Draw call
 	shader.use();
 	glBindVertexArray(pointData.vao());
+	pointData.bindPoints(shader, 0);
 	if (auto ebo = pointData.ebo()) {
-		pointData.vbo().bindSsbo(0);
 		ebo->bindSsbo(1);
 		shader.setUniform("uUsePointElements", true);
 	}
 	else {
 		shader.setUniform("uUsePointElements", false);
 	}
-	glDrawArrays(GL_POINTS, pointData.pointOffset(), pointData.pointCount());
+	pointData.drawPoints();
 	glBindVertexArray(0);
 }
 
@@ -209,7 +201,7 @@ void ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const
 
 	autoSetUniforms(shader, properties());
 	if (auto grain = m_grain.lock()) {
-		autoSetUniforms(shader, grain->properties());
+		grain->bindProperties(shader);
 	}
 
 	auto pointData = m_pointData.lock();
@@ -225,9 +217,7 @@ void ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const
 	}
 
 	if (auto grain = m_grain.lock()) {
-		for (size_t k = 0; k < grain->atlases().size(); ++k) {
-			o = grain->atlases()[k].setUniforms(shader, MAKE_STR("uImpostor[" << k << "]."), o);
-		}
+		o = grain->bindAtlases(shader, o);
 	}
 
 	if (props.precomputeViewMatrices) {
@@ -280,26 +270,9 @@ glm::mat4 ImpostorGrainRenderer::modelMatrix() const
 	}
 }
 
-std::shared_ptr<ShaderProgram> ImpostorGrainRenderer::getShader(ShaderVariantFlagSet flags) const
+void ImpostorGrainRenderer::precompileShaders()
 {
-	constexpr int nFlags = static_cast<int>(magic_enum::enum_count<ShaderVariantFlag>());
-	if (m_shaders.empty()) {
-		m_shaders.resize(1 << nFlags);
-	}
-
-	if (!m_shaders[flags]) {
-		// Lazy loading of shader variants
-		std::string variantName = m_shaderName + "_ShaderVariantFlags_" + bitname(flags, nFlags);
-		std::vector<std::string> defines;
-		for (int f = 0; f < nFlags; ++f) {
-			if ((flags & (1 << f)) != 0) {
-				defines.push_back(s_shaderVariantDefines[f]);
-			}
-		}
-		DEBUG_LOG << "loading variant " << variantName;
-		ShaderPool::AddShaderVariant(variantName, m_shaderName, defines);
-		m_shaders[flags] = ShaderPool::GetShader(variantName);
-	}
-	return m_shaders[flags];
+	// Every combination of flags can be reached from the UI
+	m_shaders.precompile();
 }
 
@@ -35,6 +35,7 @@
 #include "GlBuffer.h"
 #include "Filtering.h"
 #include "ImpostorAtlasMaterial.h"
+#include "ShaderVariantTable.h"
 
 #include <refl.hpp>
 #include <glm/glm.hpp>
@@ -53,6 +54,7 @@ public:
 	bool deserialize(const rapidjson::Value & json) override;
 	void start() override;
 	void update(float time, int frame) override;
+	void precompileShaders() override;
 	void render(const Camera& camera, const World& world, RenderType target) const override;
 
 public:
@@ -88,32 +90,29 @@ public:
 	const Properties& properties() const { return m_properties; }
 
 private:
-	// When adding flag, don't forget to add the corresponding define in the
-	// definition of s_shaderVariantDefines in cpp file.
+	// These must match defines in the shader (magic_enum reflexion is used to set defines)
 	// TODO: distinguish stages from options
 	enum ShaderVariantFlag {
-		ShaderOptionNoDiscard = 1 << 0,
-		ShaderPassShadow = 1 << 1,
-		ShaderPassBlitToMainFbo = 1 << 2,
-		ShaderOptionNoInterpolation = 1 << 3,
-		ShaderOptionPrecomputeViewMatrices = 1 << 4,
-		ShaderOptionPrecomputeInVertex = 1 << 5,
+		NO_DISCARD,
+		PASS_SHADOW_MAP,
+		PASS_BLIT_TO_MAIN_FBO,
+		NO_INTERPOLATION,
+		PRECOMPUTE_IMPOSTOR_VIEW_MATRICES,
+		PRECOMPUTE_IN_VERTEX,
 	};
-	typedef int ShaderVariantFlagSet;
-	static const std::vector<std::string> s_shaderVariantDefines;
+	typedef ShaderVariantFlags<ShaderVariantFlag> ShaderVariantFlagSet;
 
 private:
 	void draw(const IPointCloudData& pointData, const ShaderProgram& shader) const;
 	void setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const;
 	void precomputeViewMatrices();
 	glm::mat4 modelMatrix() const;
-	std::shared_ptr<ShaderProgram> getShader(ShaderVariantFlagSet flags) const;
 
 private:
 	Properties m_properties;
 
 	std::string m_shaderName = "ImpostorGrain";
-	mutable std::vector<std::shared_ptr<ShaderProgram>> m_shaders;
+	ShaderVariantTable<ShaderVariantFlagSet> m_shaders;
 
 	std::weak_ptr<TransformBehavior> m_transform;
 	std::weak_ptr<GrainBehavior> m_grain;
@@ -36,6 +36,8 @@
 #include "ResourceManager.h"
 #include "BehaviorRegistry.h"
 #include "GlobalTimer.h"
+#include "GlBuffer.h"
+#include "bufferFillers.h"
 
 #include "utils/jsonutils.h"
 #include "utils/behaviorutils.h"
@@ -60,6 +62,27 @@ void InstanceGrainRenderer::start()
 	m_pointData = BehaviorRegistry::getPointCloudDataComponent(*this, PointCloudSplitter::RenderModel::Instance);
 
 	m_shader = ShaderPool::GetShader(m_shaderName);
+	m_lodShaders.setBaseShader(m_lodShaderName);
+}
+
+void InstanceGrainRenderer::onDestroy()
+{
+	if (m_lodVao != 0) {
+		glDeleteVertexArrays(1, &m_lodVao);
+		m_lodVao = 0;
+	}
+	if (m_elementVao != 0) {
+		glDeleteVertexArrays(1, &m_elementVao);
+		m_elementVao = 0;
+	}
+}
+
+void InstanceGrainRenderer::precompileShaders()
+{
+	auto mesh = m_mesh.lock();
+	if (mesh && mesh->lodCount() > 1) {
+		m_lodShaders.precompile();
+	}
 }
 
 void InstanceGrainRenderer::update(float time, int frame)
@@ -73,7 +96,14 @@ void InstanceGrainRenderer::render(const Camera& camera, const World& world, Ren
 
 	auto mesh = m_mesh.lock();
 	auto pointData = m_pointData.lock();
-	if (!mesh || !pointData || pointData->pointCount() == 0) return;
+	if (!mesh || !pointData) return;
+	// Without a draw command buffer, the point count is known on the CPU
+	if (!pointData->drawCommandBuffer() && pointData->pointCount() == 0) return;
+
+	bool useLods = properties().useMeshLods && mesh->lodCount() > 1;
+	if (useLods) {
+		splitLods(camera, *pointData, *mesh);
+	}
 
 	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_BLEND);
@@ -87,7 +117,7 @@ void InstanceGrainRenderer::render(const Camera& camera, const World& world, Ren
 
 	autoSetUniforms(shader, properties());
 	if (auto grain = m_grain.lock()) {
-		autoSetUniforms(shader, grain->properties());
+		grain->bindProperties(shader);
 	}
 
 	shader.setUniform("uPointCount", static_cast<GLuint>(pointData->pointCount()));
@@ -103,21 +133,69 @@ void InstanceGrainRenderer::render(const Camera& camera, const World& world, Ren
 	int n = static_cast<int>(std::max(mesh->materials().size(), m_materials.size()));
 	for (int i = 0; i < n; ++i) {
 		const StandardMaterial& mat = i < m_materials.size() ? m_materials[i] : mesh->materials()[i];
-		o = mat.setUniforms(*m_shader, MAKE_STR("uMaterial[" << i << "]."), o);
+		o = mat.setUniforms(*m_shader, StandardMaterial::UniformNames::materialArray(i), o);
 	}
 
 	shader.use();
 
-	glBindVertexArray(mesh->vao());
-	pointData->vbo().bindSsbo(0);
-	if (auto pointElements = pointData->ebo()) {
-		pointElements->bindSsbo(1);
-		shader.setUniform("uUsePointElements", true);
+	pointData->bindPoints(shader, 0);
+	std::shared_ptr<GlBuffer> pointElements = pointData->ebo();
+	shader.setUniform("uUseElementAttribute", useLods || pointElements != nullptr);
+	shader.setUniform("uInstanceOffset", static_cast<GLuint>(0));
+	if (!useLods && pointElements) {
+		// Point elements are fed as an instanced attribute too, because the
+		// range of point data is given by baseInstance (e.g. for the views
+		// after the first one of a batched split).
+		if (m_elementVao == 0) {
+			glCreateVertexArrays(1, &m_elementVao);
+			mesh->enableAttributes(m_elementVao);
+			glEnableVertexArrayAttrib(m_elementVao, s_elementAttribute);
+			glVertexArrayAttribBinding(m_elementVao, s_elementAttribute, s_elementAttribute);
+			glVertexArrayAttribIFormat(m_elementVao, s_elementAttribute, 1, GL_UNSIGNED_INT, 0);
+			glVertexArrayBindingDivisor(m_elementVao, s_elementAttribute, 1);
+		}
+		// The splitter may reallocate its element buffer
+		glVertexArrayVertexBuffer(m_elementVao, s_elementAttribute, pointElements->name(), 0, sizeof(GLuint));
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+	GLuint vao = pointElements ? m_elementVao : mesh->vao();
+
+	if (useLods) {
+		// One draw per level of detail, whose baseInstance offsets the lod elements attribute
+		glBindVertexArray(m_lodVao);
+		GLsizei lodCount = static_cast<GLsizei>(std::min(mesh->lodCount(), s_maxLodCount));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_lodBuffer->name());
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(sizeof(LodHeader)), lodCount, sizeof(DrawElementsIndirectCommand));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else if (const GlBuffer* commands = pointData->drawCommandBuffer()) {
+		glBindVertexArray(vao);
+		const MeshDataBehavior::Lod& lod = mesh->lod(0);
+		if (!m_drawCommand) {
+			m_drawCommand = std::make_unique<GlBuffer>(GL_DRAW_INDIRECT_BUFFER);
+			m_drawCommand->addBlock<DrawElementsIndirectCommand>(1);
+			m_drawCommand->alloc(GL_DYNAMIC_STORAGE_BIT);
+			m_drawCommand->finalize();
+			DrawElementsIndirectCommand command = { static_cast<GLuint>(lod.indexCount), 0, lod.firstIndex, static_cast<GLuint>(lod.baseVertex), 0 };
+			glNamedBufferSubData(m_drawCommand->name(), 0, sizeof(DrawElementsIndirectCommand), &command);
+		}
+		// Index range from the mesh, instances from point data (without reading it back)
+		GLintptr source = pointData->instancedDrawCommandOffset();
+		glCopyNamedBufferSubData(commands->name(), m_drawCommand->name(), source + offsetof(DrawArraysIndirectCommand, instanceCount), offsetof(DrawElementsIndirectCommand, instanceCount), sizeof(GLuint));
+		glCopyNamedBufferSubData(commands->name(), m_drawCommand->name(), source + offsetof(DrawArraysIndirectCommand, baseInstance), offsetof(DrawElementsIndirectCommand, baseInstance), sizeof(GLuint));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawCommand->name());
+		glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	}
 	else {
-		shader.setUniform("uUsePointElements", false);
+		const MeshDataBehavior::Lod& lod = mesh->lod(0);
+		GLuint offset = static_cast<GLuint>(pointData->pointOffset());
+		if (!pointElements) {
+			shader.setUniform("uInstanceOffset", offset);
+		}
+		glBindVertexArray(vao);
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, lod.indices(), pointData->pointCount(), lod.baseVertex, pointElements ? offset : 0);
 	}
-	glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, mesh->pointCount(), pointData->pointCount(), pointData->pointOffset());
 
 	glBindVertexArray(0);
 }
@@ -134,3 +212,93 @@ glm::mat4 InstanceGrainRenderer::modelMatrix() const
 	}
 }
 
+void InstanceGrainRenderer::splitLods(const Camera& camera, const IPointCloudData& pointData, const MeshDataBehavior& mesh) const
+{
+	GLuint lodCount = static_cast<GLuint>(std::min(mesh.lodCount(), s_maxLodCount));
+	std::shared_ptr<GlBuffer> pointElements = pointData.ebo();
+	const GlBuffer* sourceCommands = pointData.drawCommandBuffer();
+
+	// There cannot be more instances than elements in point data
+	GLuint capacity = static_cast<GLuint>(pointData.pointCount());
+	if (pointElements) {
+		GLint64 byteSize = 0;
+		glGetNamedBufferParameteri64v(pointElements->name(), GL_BUFFER_SIZE, &byteSize);
+		capacity = static_cast<GLuint>(byteSize / sizeof(GLuint));
+	}
+
+	if (!m_lodBuffer) {
+		// Only instance counts and offsets change afterwards
+		std::vector<DrawElementsIndirectCommand> commands(s_maxLodCount, DrawElementsIndirectCommand{ 0, 0, 0, 0, 0 });
+		for (GLuint i = 0; i < lodCount; ++i) {
+			const MeshDataBehavior::Lod& lod = mesh.lod(static_cast<int>(i));
+			commands[i].count = static_cast<GLuint>(lod.indexCount);
+			commands[i].firstIndex = lod.firstIndex;
+			commands[i].baseVertex = static_cast<GLuint>(lod.baseVertex);
+		}
+		m_lodBuffer = std::make_unique<GlBuffer>(GL_DRAW_INDIRECT_BUFFER);
+		m_lodBuffer->addBlock<LodHeader>(1);
+		m_lodBuffer->addBlock<DrawElementsIndirectCommand>(s_maxLodCount);
+		m_lodBuffer->alloc(GL_DYNAMIC_STORAGE_BIT);
+		glNamedBufferSubData(m_lodBuffer->name(), m_lodBuffer->blockByteOffset(1), commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+		m_lodBuffer->finalize();
+
+		glCreateVertexArrays(1, &m_lodVao);
+		mesh.enableAttributes(m_lodVao);
+		glEnableVertexArrayAttrib(m_lodVao, s_elementAttribute);
+		glVertexArrayAttribBinding(m_lodVao, s_elementAttribute, s_elementAttribute);
+		glVertexArrayAttribIFormat(m_lodVao, s_elementAttribute, 1, GL_UNSIGNED_INT, 0);
+		glVertexArrayBindingDivisor(m_lodVao, s_elementAttribute, 1);
+	}
+
+	if (!m_lodElements || capacity > m_lodCapacity) {
+		m_lodCapacity = std::max(capacity, static_cast<GLuint>(1));
+		m_lodElements = std::make_unique<GlBuffer>(GL_ARRAY_BUFFER);
+		m_lodElements->addBlock<GLuint>(m_lodCapacity);
+		m_lodElements->alloc(0);
+		m_lodElements->finalize();
+		glVertexArrayVertexBuffer(m_lodVao, s_elementAttribute, m_lodElements->name(), 0, sizeof(GLuint));
+	}
+
+	if (pointElements) {
+		pointElements->bindSsbo(1);
+	}
+	m_lodBuffer->bindSsbo(2);
+	if (sourceCommands) {
+		sourceCommands->bindSsbo(3);
+	}
+	m_lodElements->bindSsbo(4);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_lodBuffer->name());
+
+	glm::mat4 viewModelMatrix = camera.viewMatrix() * modelMatrix();
+	constexpr LodStepShaderVariant lastStep = lastValue<LodStepShaderVariant>();
+	for (int i = 0; i <= static_cast<int>(lastStep); ++i) {
+		LodStepShaderVariant step = static_cast<LodStepShaderVariant>(i);
+		const ShaderProgram& shader = *m_lodShaders.get(step);
+		shader.bindUniformBlock("Camera", camera.ubo());
+		shader.setUniform("viewModelMatrix", viewModelMatrix);
+		autoSetUniforms(shader, properties());
+		if (auto grain = m_grain.lock()) {
+			grain->bindProperties(shader);
+		}
+		shader.setUniform("uPointCount", static_cast<GLuint>(pointData.pointCount()));
+		shader.setUniform("uFrameCount", static_cast<GLuint>(pointData.frameCount()));
+		shader.setUniform("uTime", static_cast<GLfloat>(m_time));
+		shader.setUniform("uLodCount", lodCount);
+		shader.setUniform("uLodCapacity", m_lodCapacity);
+		shader.setUniform("uUsePointElements", pointElements != nullptr);
+		shader.setUniform("uUseSourceCommand", sourceCommands != nullptr);
+		shader.setUniform("uSourceCommand", static_cast<GLuint>(pointData.instancedDrawCommandOffset() / sizeof(DrawArraysIndirectCommand)));
+		shader.setUniform("uInstanceCount", static_cast<GLuint>(pointData.pointCount()));
+		shader.setUniform("uInstanceOffset", static_cast<GLuint>(pointData.pointOffset()));
+		pointData.bindPoints(shader, 0);
+		shader.use();
+		if (step == LodStepShaderVariant::STEP_RESET || step == LodStepShaderVariant::STEP_OFFSET) {
+			glDispatchCompute(1, 1, 1);
+		}
+		else {
+			glDispatchComputeIndirect(0);
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
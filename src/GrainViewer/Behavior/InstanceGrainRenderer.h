@@ -34,6 +34,7 @@
 #include "GlTexture.h"
 #include "utils/ReflectionAttributes.h"
 #include "StandardMaterial.h"
+#include "ShaderVariantTable.h"
 
 #include <refl.hpp>
 #include <glm/glm.hpp>
@@ -44,6 +45,7 @@ class TransformBehavior;
 class GrainBehavior;
 class MeshDataBehavior;
 class IPointCloudData;
+class GlBuffer;
 
 /**
  * Render points from an IPointCloudData component by instancing the mesh from a MeshData component .
@@ -54,6 +56,8 @@ public:
 	// Behavior implementation
 	bool deserialize(const rapidjson::Value & json) override;
 	void start() override;
+	void onDestroy() override;
+	void precompileShaders() override;
 	void update(float time, int frame) override;
 	void render(const Camera& camera, const World& world, RenderType target) const override;
 
@@ -62,6 +66,11 @@ public:
 	struct Properties {
 		// Correct scale of the MeshData mesh when using it as instance.
 		float grainMeshScale = 1.0f;
+		// Draw smaller grains with the lower levels of detail of the MeshData mesh, if it has some
+		bool useMeshLods = true;
+		// Radius in pixels below which grains are drawn with LOD1, resp. LOD2
+		float lod1PixelRadius = 24.0f;
+		float lod2PixelRadius = 8.0f;
 	};
 	Properties & properties() { return m_properties; }
 	const Properties& properties() const { return m_properties; }
@@ -69,6 +78,34 @@ public:
 private:
 	glm::mat4 modelMatrix() const;
 
+	/**
+	 * Sort the instances of point data by level of detail of the mesh into
+	 * m_lodElements and write the draw command of each level in m_lodBuffer,
+	 * without reading anything back.
+	 */
+	void splitLods(const Camera& camera, const IPointCloudData& pointData, const MeshDataBehavior& mesh) const;
+
+	// Must match defines in grain/instance-lods.comp.glsl
+	enum class LodStepShaderVariant {
+		STEP_RESET,
+		STEP_COUNT,
+		STEP_OFFSET,
+		STEP_WRITE,
+	};
+
+	// Must match lodSsbo in grain/instance-lods.comp.glsl, where it is
+	// followed by one DrawElementsIndirectCommand per level of detail.
+	struct LodHeader {
+		GLuint dispatchGroupCount[3]; // indirect dispatch command of per instance steps
+		GLuint instanceCount;
+		GLuint instanceOffset;
+	};
+	static constexpr int s_maxLodCount = 3;
+	// Instanced vertex attribute fed with the element of each instance (from
+	// m_lodElements or from the element buffer of point data), after the ones
+	// of MeshData. Unlike gl_InstanceID, it is offset by baseInstance.
+	static constexpr GLuint s_elementAttribute = 5;
+
 private:
 	Properties m_properties;
 
@@ -83,12 +120,28 @@ private:
 	std::unique_ptr<GlTexture> m_colormapTexture;
 	std::vector<StandardMaterial> m_materials; // may be emtpy, in which case materials from MeshData are used
 
+	// Indirect draw command completed on the GPU from the one of point data, if any (lazily allocated)
+	mutable std::unique_ptr<GlBuffer> m_drawCommand;
+
+	std::string m_lodShaderName = "InstanceGrainLods";
+	ShaderVariantTable<LodStepShaderVariant> m_lodShaders;
+	// Lazily allocated, the element buffer grows with the element buffer of point data
+	mutable std::unique_ptr<GlBuffer> m_lodBuffer;
+	mutable std::unique_ptr<GlBuffer> m_lodElements;
+	mutable GLuint m_lodCapacity = 0;
+	mutable GLuint m_lodVao = 0;
+	// MeshData attributes and the element buffer of point data
+	mutable GLuint m_elementVao = 0;
+
 	float m_time;
 };
 
 #define _ ReflectionAttributes::
 REFL_TYPE(InstanceGrainRenderer::Properties)
 REFL_FIELD(grainMeshScale, _ Range(0.0f, 5.0f))
+REFL_FIELD(useMeshLods)
+REFL_FIELD(lod1PixelRadius, _ Range(0.0f, 100.0f))
+REFL_FIELD(lod2PixelRadius, _ Range(0.0f, 100.0f))
 REFL_END
 #undef _
 
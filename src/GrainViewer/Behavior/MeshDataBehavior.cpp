@@ -30,6 +30,7 @@
 #include "MeshDataBehavior.h"
 #include "TransformBehavior.h"
 #include "bufferFillers.h"
+#include "MeshCache.h"
 #include "ResourceManager.h"
 #include "utils/fileutils.h"
 #include "utils/jsonutils.h"
@@ -44,14 +45,15 @@ namespace fs = std::filesystem;
 // Accessors
 ///////////////////////////////////////////////////////////////////////////////
 
-GLsizei MeshDataBehavior::pointCount() const
+GLuint MeshDataBehavior::vao() const
 {
-	return m_pointCount;
+	return m_vao;
 }
 
-GLuint MeshDataBehavior::vao() const
+void MeshDataBehavior::enableAttributes(GLuint vao) const
 {
-	return m_vao;
+	m_vertexBuffer->enableAttributes(vao);
+	glVertexArrayElementBuffer(vao, m_indexBuffer->name());
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -66,63 +68,105 @@ bool MeshDataBehavior::deserialize(const rapidjson::Value & json)
 	}
 	m_filename = ResourceManager::resolveResourcePath(m_filename);
 
+	jrArray(json, "lodFilenames", m_lodFilenames);
+	for (auto& lodFilename : m_lodFilenames) {
+		lodFilename = ResourceManager::resolveResourcePath(lodFilename);
+	}
+
 	jrOption(json, "computeBoundingSphere", m_computeBoundingSphere, m_computeBoundingSphere);
 	jrOption(json, "offset", m_offset, m_offset);
+	jrOption(json, "useCache", m_useCache, m_useCache);
 
 	return true;
 }
 
 void MeshDataBehavior::start()
 {
-	// 1. Initialize members
+	// 1. Load welded and reordered meshes, from cache files when possible
+
+	std::vector<std::string> filenames = { m_filename };
+	filenames.insert(filenames.end(), m_lodFilenames.begin(), m_lodFilenames.end());
+	std::vector<MeshCache> meshes(filenames.size());
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		// Like a missing OBJ file, a failed load leaves an empty level of
+		// detail, so that renderers still get valid buffers
+		if (!meshes[i].load(filenames[i], m_offset, m_useCache)) {
+			ERR_LOG << "Could not load mesh " << filenames[i];
+		}
+	}
 
-	m_mesh = std::make_unique<Mesh>(m_filename);
 	m_vertexBuffer = std::make_unique<GlBuffer>(GL_ARRAY_BUFFER);
-
-	// 2. Move data from Mesh object to GlBuffer (in VRAM)
-
-	m_pointCount = 0;
-	for (auto s : m_mesh->shapes()) {
-		m_pointCount += static_cast<GLsizei>(s.mesh.indices.size());
+	m_indexBuffer = std::make_unique<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+
+	// 2. Move data to GlBuffer (in VRAM)
+
+	// LODs one after the other, with indices relative to their base vertex
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	m_lods.resize(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		m_lods[i] = Lod{
+			static_cast<GLsizei>(meshes[i].indexCount()),
+			static_cast<GLuint>(indexCount),
+			static_cast<GLint>(vertexCount)
+		};
+		vertexCount += meshes[i].vertexCount();
+		indexCount += meshes[i].indexCount();
 	}
 
-	// Build VBO
-	m_vertexBuffer->addBlock<PointAttributes>(m_pointCount);
+	// Build VBO and EBO, uploaded straight from cache file mappings if any
+	m_vertexBuffer->addBlock<PointAttributes>(vertexCount);
 	m_vertexBuffer->addBlockAttribute(0, 3);  // position
 	m_vertexBuffer->addBlockAttribute(0, 3);  // normal
 	m_vertexBuffer->addBlockAttribute(0, 2);  // uv
 	m_vertexBuffer->addBlockAttribute(0, 1);  // materialId
 	m_vertexBuffer->addBlockAttribute(0, 3);  // tangent
-	m_vertexBuffer->alloc();
+	m_vertexBuffer->alloc(GL_DYNAMIC_STORAGE_BIT);
+
+	m_indexBuffer->addBlock<GLuint>(indexCount);
+	m_indexBuffer->alloc(GL_DYNAMIC_STORAGE_BIT);
+	m_indexBuffer->finalize();
 
-	BufferFiller filler(*m_mesh);
-	filler.setGlobalOffset(m_offset);
-	m_vertexBuffer->fillBlock<PointAttributes>(0, [filler](PointAttributes* attr, size_t count) { filler.fill(attr, count); });
-	//m_vertexBuffer->fillBlock(0, filler.fill);
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		const Lod& lod = m_lods[i];
+		glNamedBufferSubData(m_vertexBuffer->name(), lod.baseVertex * sizeof(PointAttributes), meshes[i].vertexCount() * sizeof(PointAttributes), meshes[i].vertices());
+		glNamedBufferSubData(m_indexBuffer->name(), lod.firstIndex * sizeof(GLuint), meshes[i].indexCount() * sizeof(GLuint), meshes[i].indices());
+	}
 
 	// Build VAO
 	glCreateVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
 	m_vertexBuffer->bind();
-	m_vertexBuffer->enableAttributes(m_vao);
+	enableAttributes(m_vao);
 	glBindVertexArray(0);
 
-	m_vertexBuffer->finalize();
+	// m_vertexBuffer is not finalized, its layout is needed by enableAttributes()
 
 	// 3. Compute optional statistics
 	if (m_computeBoundingSphere) {
-		computeBoundingSphere();
+		computeBoundingSphere(meshes[0]);
 	}
 
 	// 4. Get materials
 	std::string textureRoot = fs::absolute(filename()).parent_path().string();
-	m_materials.resize(m_mesh->materials().size());
+	const std::vector<tinyobj::material_t>& materials = meshes[0].materials();
+	m_materials.resize(materials.size());
 	for (int i = 0; i < m_materials.size(); ++i) {
-		m_materials[i].fromTinyObj(m_mesh->materials()[i], textureRoot);
+		m_materials[i].fromTinyObj(materials[i], textureRoot);
+	}
+	// Material ids of all LODs index these materials
+	for (size_t i = 1; i < meshes.size(); ++i) {
+		const auto& lodMaterials = meshes[i].materials();
+		bool isSame = lodMaterials.size() == materials.size();
+		for (size_t j = 0; isSame && j < materials.size(); ++j) {
+			isSame = lodMaterials[j].name == materials[j].name;
+		}
+		if (!isSame) {
+			WARN_LOG << "Materials of LOD mesh " << filenames[i] << " differ from those of " << filenames[0] << ", which are used for all LODs";
+		}
 	}
 
-	// 5. Free mesh from RAM now that it is in VRAM
-	m_mesh.reset();
+	// 5. Meshes are freed from RAM (or unmapped) now that they are in VRAM
 }
 
 void MeshDataBehavior::onDestroy()
@@ -130,7 +174,7 @@ void MeshDataBehavior::onDestroy()
 	glDeleteVertexArrays(1, &m_vao);
 }
 
-void MeshDataBehavior::computeBoundingSphere()
+void MeshDataBehavior::computeBoundingSphere(const MeshCache& mesh)
 {
 	// This is an approximation, but reasonable enough.
 
@@ -139,30 +183,25 @@ void MeshDataBehavior::computeBoundingSphere()
 		matrix = transform->modelMatrix();
 	}
 
+	// Welded vertices all belong to some triangle, and already include m_offset
+	const PointAttributes* vertices = mesh.vertices();
+
 	// 1. Compute AABB
 	glm::vec3 bb_min(+99999.9f);
 	glm::vec3 bb_max(-99999.9f);
 
-	const std::vector<float> & v = m_mesh->attrib().vertices;
-	for (auto s : m_mesh->shapes()) {
-		const auto & indices = s.mesh.indices;
-		for (size_t i = 0; i < indices.size(); ++i) {
-			glm::vec3 P0 = glm::make_vec3(&v[3 * indices[i].vertex_index]);
-			glm::vec3 P = matrix * glm::vec4(P0 + m_offset, 1.0);
-			bb_min = glm::min(bb_min, P);
-			bb_max = glm::max(bb_max, P);
-		}
+	for (size_t i = 0; i < mesh.vertexCount(); ++i) {
+		glm::vec3 P = matrix * glm::vec4(glm::make_vec3(vertices[i].position), 1.0);
+		bb_min = glm::min(bb_min, P);
+		bb_max = glm::max(bb_max, P);
 	}
 
 	// 2. Get radius
 	m_boundingSphereCenter = (bb_min + bb_max) / 2.0f;
 	m_boundingSphereRadius = 0.0f;
 
-	for (auto s : m_mesh->shapes()) {
-		const auto & indices = s.mesh.indices;
-		for (size_t i = 0; i < indices.size(); ++i) {
-			glm::vec3 P = matrix * glm::vec4(glm::make_vec3(&v[3 * indices[i].vertex_index]), 1.0);
-			m_boundingSphereRadius = glm::max(m_boundingSphereRadius, glm::length(P - m_boundingSphereCenter));
-		}
+	for (size_t i = 0; i < mesh.vertexCount(); ++i) {
+		glm::vec3 P = matrix * glm::vec4(glm::make_vec3(vertices[i].position), 1.0);
+		m_boundingSphereRadius = glm::max(m_boundingSphereRadius, glm::length(P - m_boundingSphereCenter));
 	}
 }
@@ -32,13 +32,15 @@
 #include <OpenGL>
 
 #include "Behavior.h"
-#include "Mesh.h"
 #include "GlBuffer.h"
 #include "StandardMaterial.h"
 
 #include <glm/glm.hpp>
 
 #include <memory>
+#include <cstdint>
+
+class MeshCache;
 
 /**
  * Load mesh from OBJ file to video memory
@@ -46,10 +48,28 @@
 class MeshDataBehavior : public Behavior {
 public:
 	// Accessors
-	GLsizei pointCount() const;
 	GLuint vao() const;
 	const std::vector<StandardMaterial>& materials() const { return m_materials; }
 
+	// Levels of detail, LOD0 being the mesh from filename(). They are stored
+	// one after the other in the vertex and element buffers of vao(), as
+	// welded triangle lists, to be drawn with glDrawElementsBaseVertex.
+	struct Lod {
+		GLsizei indexCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		// Offset of the first index, as expected by glDrawElements*()
+		const void* indices() const { return reinterpret_cast<const void*>(static_cast<uintptr_t>(firstIndex) * sizeof(GLuint)); }
+	};
+	int lodCount() const { return static_cast<int>(m_lods.size()); }
+	const Lod& lod(int i) const { return m_lods[i]; }
+
+	/**
+	 * Set up the vertex attributes and the element buffer of vao() in another
+	 * vao, for renderers that need to add their own attributes.
+	 */
+	void enableAttributes(GLuint vao) const;
+
 	// Available only if m_computeBoundingSphere was true upon start
 	bool hasBoundingSphere() const { return m_computeBoundingSphere;  }
 	const glm::vec3 & boundingSphereCenter() const { return m_boundingSphereCenter; }
@@ -67,20 +87,22 @@ public:
 
 private:
 	// this take into account a potential TransformBehavior attached to the object
-	void computeBoundingSphere();
+	void computeBoundingSphere(const MeshCache& mesh);
 
 private:
 	std::string m_filename = "";
-	std::unique_ptr<Mesh> m_mesh;
+	std::vector<std::string> m_lodFilenames; // LOD1, LOD2, etc.
+	bool m_useCache = true; // see MeshCache
 
 	bool m_computeBoundingSphere = false;
 	glm::vec3 m_boundingSphereCenter;
 	float m_boundingSphereRadius;
 	glm::vec3 m_offset = glm::vec3(0);
 
-	GLsizei m_pointCount;
 	std::unique_ptr<GlBuffer> m_vertexBuffer;
-	GLuint m_vao;
+	std::unique_ptr<GlBuffer> m_indexBuffer;
+	std::vector<Lod> m_lods;
+	GLuint m_vao = 0;
 	std::vector<StandardMaterial> m_materials;
 };
 
@@ -75,13 +75,14 @@ void MeshRenderer::render(const Camera& camera, const World& world, RenderType t
 		int n = static_cast<int>(std::max(mesh->materials().size(), m_materials.size()));
 		for (int i = 0 ; i < n ; ++i) {
 			const StandardMaterial& mat = i < m_materials.size() ? m_materials[i] : mesh->materials()[i];
-			o = mat.setUniforms(*m_shader, MAKE_STR("uMaterial[" << i << "]."), o);
+			o = mat.setUniforms(*m_shader, StandardMaterial::UniformNames::materialArray(i), o);
 		}
 
 		autoSetUniforms(*m_shader, properties());
 
+		const MeshDataBehavior::Lod& lod = mesh->lod(0);
 		glBindVertexArray(mesh->vao());
-		glDrawArrays(GL_TRIANGLES, 0, mesh->pointCount());
+		glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, lod.indices(), lod.baseVertex);
 		glBindVertexArray(0);
 	}
 }
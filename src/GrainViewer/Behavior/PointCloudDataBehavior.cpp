@@ -30,36 +30,60 @@
 #include "PointCloudDataBehavior.h"
 #include "PointCloud.h"
 #include "ResourceManager.h"
+#include "GlStreamingBuffer.h"
+#include "PointCloudStream.h"
 
 #include "utils/strutils.h"
+#include "utils/jsonutils.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <limits>
+
+PointCloudDataBehavior::PointCloudDataBehavior() = default;
+PointCloudDataBehavior::~PointCloudDataBehavior() = default;
+
 //-----------------------------------------------------------------------------
 // Accessors
 
 GLsizei PointCloudDataBehavior::pointCount() const
 {
-	return m_pointCount;
+	return m_stream ? m_stream->pointCount() : m_pointCount;
 }
 
 GLsizei PointCloudDataBehavior::frameCount() const
 {
-	return m_frameCount;
+	return m_stream ? 1 : m_frameCount;
 }
 
 const GlBuffer & PointCloudDataBehavior::data() const
 {
-	return *m_pointBuffer;
+	return vbo();
 }
 
 GLuint PointCloudDataBehavior::vao() const
 {
-	return m_vao;
+	return m_stream ? m_stream->vao() : m_vao;
 }
 
 const GlBuffer & PointCloudDataBehavior::vbo() const
 {
-	return *m_pointBuffer;
+	return m_stream ? m_stream->vbo() : *m_pointBuffer;
+}
+
+const GlBuffer* PointCloudDataBehavior::chunkBuffer() const
+{
+	return m_chunkBuffer.get();
+}
+
+GLuint PointCloudDataBehavior::chunkSize() const
+{
+	return static_cast<GLuint>(m_chunkSize);
+}
+
+bool PointCloudDataBehavior::isQuantized() const
+{
+	return m_quantize;
 }
 
 //-----------------------------------------------------------------------------
@@ -98,6 +122,17 @@ bool PointCloudDataBehavior::deserialize(const rapidjson::Value & json)
 		}
 	}
 
+	jrOption(json, "quantize", m_quantize, m_quantize);
+	jrOption(json, "stream", m_streaming, m_streaming);
+	jrOption(json, "sortMorton", m_sortMorton, m_sortMorton);
+	jrOption(json, "streamingRingSize", m_streamingRingSize, m_streamingRingSize);
+	jrOption(json, "fps", m_fps, m_fps);
+	jrOption(json, "chunkSize", m_chunkSize, m_chunkSize);
+	if (m_chunkSize <= 0) {
+		ERR_LOG << "Field 'chunkSize' of PointCloudDataBehavior must be strictly positive";
+		return false;
+	}
+
 	m_filename = ResourceManager::resolveResourcePath(m_filename);
 
 	return true;
@@ -105,56 +140,133 @@ bool PointCloudDataBehavior::deserialize(const rapidjson::Value & json)
 
 void PointCloudDataBehavior::start()
 {
+	if (m_streaming) {
+		if (!endsWith(m_filename, ".bin")) {
+			WARN_LOG << "Only .bin point clouds can be streamed, loading " << m_filename << " entirely";
+		}
+		else if (startStreaming()) {
+			return;
+		}
+	}
+
 	// 1. Initialize members
 
 	m_pointBuffer = std::make_unique<GlBuffer>(GL_ARRAY_BUFFER);
 
 	// 2. Load point cloud data
+	// Bin files are mapped rather than loaded, so that they are streamed from
+	// disk to video memory without ever being copied in client memory.
 
 	PointCloud pointCloud;
-	
-	if (m_useBbox) {
-		PointCloud fullPointCloud;
-		fullPointCloud.load(m_filename);
+	bool success = endsWith(m_filename, ".bin") && !m_sortMorton
+		? pointCloud.mapBin(m_filename)
+		: pointCloud.load(m_filename);
+	if (!success) {
+		ERR_LOG << "Could not load point cloud from " << m_filename;
+	}
+
+	if (m_sortMorton) {
+		// Better done offline, using PointCloudConvert --sort-morton
+		pointCloud.sortMorton();
+	}
+
+	const glm::vec3 *points = pointCloud.points();
+	size_t inputPointCount = pointCloud.pointCount();
+	m_frameCount = static_cast<GLsizei>(pointCloud.frameCount());
 
-		if (fullPointCloud.frameCount() > 1) {
+	auto isInBbox = [this](const glm::vec3 & p) {
+		return p.x >= m_bboxMin.x && p.x <= m_bboxMax.x
+			&& p.y >= m_bboxMin.y && p.y <= m_bboxMax.y
+			&& p.z >= m_bboxMin.z && p.z <= m_bboxMax.z;
+	};
+
+	if (m_useBbox) {
+		if (m_frameCount > 1) {
 			WARN_LOG << "Using bbox with animated point cloud has undefined behavior";
 		}
+		// First pass only counts points, to allocate the exact buffer size
+		size_t count = 0;
+		for (size_t i = 0; i < inputPointCount; ++i) {
+			if (isInBbox(points[i])) ++count;
+		}
+		if (count == 0) {
+			WARN_LOG << "No point of " << m_filename << " is in the bbox of PointCloudDataBehavior, nothing will be drawn";
+		}
+		m_pointCount = static_cast<GLsizei>(count);
+	}
+	else {
+		m_pointCount = static_cast<GLsizei>(inputPointCount);
+	}
 
-		pointCloud.data().resize(128);
-		int k = 0;
-		for (const auto & p : fullPointCloud.data()) {
-			if (k >= pointCloud.data().size()) {
-				pointCloud.data().resize(2 * pointCloud.data().size());
-			}
+	// 3. Stream data from PointCloud object to GlBuffer (in VRAM)
+	// Points are gathered chunk by chunk, so that the bounding box of a chunk
+	// is known before its points get quantized. Chunks span consecutive
+	// points of the buffer, regardless of frame boundaries.
 
-			if (p.x >= m_bboxMin.x && p.x <= m_bboxMax.x
-				&& p.y >= m_bboxMin.y && p.y <= m_bboxMax.y
-				&& p.z >= m_bboxMin.z && p.z <= m_bboxMax.z)
-			{
-				pointCloud.data()[k] = p;
-				++k;
-			}
-		}
+	// The buffer holds at least one element, because glNamedBufferStorage
+	// rejects empty buffers, but only m_pointCount points are ever drawn.
+	GLsizei capacity = std::max(m_pointCount, 1);
+	GLsizeiptr stride;
+	if (m_quantize) {
+		stride = sizeof(glm::uvec2);
+		m_pointBuffer->addBlock<glm::uvec2>(capacity);
+		// Seen by vertex shaders as a vec4 position of (x, y, z, 0), relative to the chunk, in [0,1]
+		m_pointBuffer->addBlockAttributeUnorm16(0, 4);  // quantized position
 	}
 	else {
-		pointCloud.load(m_filename);
+		stride = sizeof(glm::vec4);
+		m_pointBuffer->addBlock<glm::vec4>(capacity);
+		m_pointBuffer->addBlockAttribute(0, 4);  // position
 	}
-	m_frameCount = static_cast<GLsizei>(pointCloud.frameCount());
-	m_pointCount = static_cast<GLsizei>(pointCloud.data().size());
+	m_pointBuffer->alloc(0); // never mapped, only written by the streaming buffer
+
+	size_t chunkSize = static_cast<size_t>(m_chunkSize);
+	std::vector<ChunkBounds> chunks;
+	chunks.reserve((m_pointCount + chunkSize - 1) / chunkSize);
+	std::vector<glm::vec3> chunkPoints;
+	chunkPoints.reserve(chunkSize);
+	size_t i = 0; // next point to read
+	size_t j = 0; // next point of chunkPoints to write
 
-	// 3. Move data from PointCloud object to GlBuffer (in VRAM)
+	auto gatherChunk = [&]() {
+		size_t begin = i;
+		chunkPoints.clear();
+		glm::vec3 minCorner(std::numeric_limits<float>::max());
+		glm::vec3 maxCorner(std::numeric_limits<float>::lowest());
+		while (chunkPoints.size() < chunkSize && i < inputPointCount) {
+			const glm::vec3 & p = points[i++];
+			if (!m_useBbox || isInBbox(p)) {
+				chunkPoints.push_back(p);
+				minCorner = glm::min(minCorner, p);
+				maxCorner = glm::max(maxCorner, p);
+			}
+		}
+		pointCloud.discard(begin, i);
+		chunks.push_back(ChunkBounds{ glm::vec4(minCorner, 1.0f), glm::vec4(maxCorner, 1.0f) });
+		j = 0;
+	};
 
-	m_pointBuffer->addBlock<glm::vec4>(m_pointCount);
-	m_pointBuffer->addBlockAttribute(0, 4);  // position
-	m_pointBuffer->alloc();
-	m_pointBuffer->fillBlock<glm::vec4>(0, [&pointCloud](glm::vec4 *data, size_t _) {
-		glm::vec4 *v = data;
-		for (auto p : pointCloud.data()) {
-			v->x = p.x; v->y = p.y; v->z = p.z; v++;
+	GlStreamingBuffer staging(s_stagingSegmentSize);
+	staging.upload(m_pointBuffer->name(), 0, m_pointCount * stride, [&](void *data, GLsizeiptr, GLsizeiptr size) {
+		size_t n = static_cast<size_t>(size / stride);
+		for (size_t k = 0; k < n; ++k) {
+			if (j == chunkPoints.size()) gatherChunk();
+			const glm::vec3 & p = chunkPoints[j++];
+			if (m_quantize) {
+				static_cast<glm::uvec2*>(data)[k] = quantize(p, chunks.back());
+			}
+			else {
+				static_cast<glm::vec4*>(data)[k] = glm::vec4(p, 1.0f);
+			}
 		}
 	});
 
+	if (!chunks.empty()) {
+		m_chunkBuffer = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_chunkBuffer->importBlock(chunks);
+		m_chunkBuffer->finalize();
+	}
+
 	glCreateVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
 	m_pointBuffer->bind();
@@ -164,7 +276,54 @@ void PointCloudDataBehavior::start()
 	m_pointBuffer->finalize(); // This buffer will never be mapped on CPU
 }
 
+void PointCloudDataBehavior::update(float time, int frame)
+{
+	if (m_stream) {
+		m_stream->update(static_cast<int>(time * m_fps));
+	}
+}
+
 void PointCloudDataBehavior::onDestroy()
 {
+	m_stream.reset();
 	glDeleteVertexArrays(1, &m_vao);
 }
+
+//-----------------------------------------------------------------------------
+// Private methods
+
+bool PointCloudDataBehavior::startStreaming()
+{
+	auto pointCloud = std::make_unique<PointCloud>();
+	if (!pointCloud->mapBin(m_filename)) {
+		return false;
+	}
+
+	if (m_useBbox) {
+		WARN_LOG << "Option 'bbox' of PointCloudDataBehavior is ignored when streaming";
+	}
+	if (m_quantize) {
+		WARN_LOG << "Option 'quantize' of PointCloudDataBehavior is ignored when streaming";
+		m_quantize = false;
+	}
+	if (m_sortMorton) {
+		WARN_LOG << "Option 'sortMorton' of PointCloudDataBehavior is ignored when streaming";
+	}
+
+	m_stream = std::make_unique<PointCloudStream>(std::move(pointCloud), m_streamingRingSize);
+	m_stream->update(0, true /* wait */);
+	LOG << "Streaming " << m_stream->frameCount() << " frames of " << m_stream->pointCount() << " points from " << m_filename;
+	return true;
+}
+
+glm::uvec2 PointCloudDataBehavior::quantize(const glm::vec3& p, const ChunkBounds& chunk)
+{
+	glm::vec3 minCorner = glm::vec3(chunk.aabbMin);
+	glm::vec3 extent = glm::vec3(chunk.aabbMax) - minCorner;
+	glm::vec3 t(0.0f);
+	for (int k = 0; k < 3; ++k) {
+		if (extent[k] > 0.0f) t[k] = (p[k] - minCorner[k]) / extent[k];
+	}
+	glm::uvec3 q = glm::uvec3(glm::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f));
+	return glm::uvec2(q.x | (q.y << 16), q.z);
+}
@@ -35,22 +35,41 @@
 #include "Mesh.h"
 #include "GlBuffer.h"
 #include "IPointCloudData.h"
+#include "PointCloud.h"
 
 #include <glm/glm.hpp>
 
 #include <memory>
 
+class PointCloudStream;
+
 /**
  * Load point cloud from XYZ or adhoc BIN file to video memory. The later
- * can be animated.
+ * can be animated, and is memory mapped and streamed to video memory
+ * through a persistently mapped staging buffer rather than loaded.
+ * Points are grouped in chunks of consecutive points whose bounding boxes
+ * are stored in chunkBuffer(). When "quantize" is on, positions are stored
+ * as 16 bit integers relative to the bounding box of their chunk, hence 8
+ * bytes per point instead of 16 (see include/points.inc.glsl).
+ *
+ * Animated BIN files can also be streamed ("stream": true), in which case
+ * only a small ring of frames lives in video memory (see PointCloudStream).
+ * The current frame is then exposed as a single frame point cloud.
  */
 class PointCloudDataBehavior : public Behavior, public IPointCloudData {
 public:
+	// Out of line because of PointCloudStream forward declaration
+	PointCloudDataBehavior();
+	~PointCloudDataBehavior();
+
 	// IPointCloudData implementation
 	GLsizei pointCount() const override;
 	GLsizei frameCount() const override;
 	GLuint vao() const override;
 	const GlBuffer & vbo() const override;
+	const GlBuffer* chunkBuffer() const override;
+	GLuint chunkSize() const override;
+	bool isQuantized() const override;
 
 	const GlBuffer& data() const;
 
@@ -58,18 +77,42 @@ public:
 	// Behavior implementation
 	bool deserialize(const rapidjson::Value & json) override;
 	void start() override;
+	void update(float time, int frame) override;
 	void onDestroy() override;
 
+private:
+	// Size of the staging area used to upload points, in bytes
+	static constexpr GLsizeiptr s_stagingSegmentSize = 16 * 1024 * 1024;
+
+	// Matches PointChunk in include/points.inc.glsl
+	struct ChunkBounds {
+		glm::vec4 aabbMin;
+		glm::vec4 aabbMax;
+	};
+
+	static glm::uvec2 quantize(const glm::vec3& p, const ChunkBounds& chunk);
+
+	// Return false if the file could not be mapped
+	bool startStreaming();
+
 private:
 	std::string m_filename = "";
 	bool m_useBbox = false; // if true, remove all points out of the supplied bbox
 	glm::vec3 m_bboxMin;
 	glm::vec3 m_bboxMax;
+	bool m_quantize = false; // if true, store positions on 16 bits relative to their chunk
+	int m_chunkSize = static_cast<int>(PointCloud::s_defaultChunkSize);
+	bool m_sortMorton = false; // if true, reorder points along a Morton curve at load time
+	bool m_streaming = false; // if true, stream animation frames from disk
+	int m_streamingRingSize = 3; // number of frames resident in video memory when streaming
+	float m_fps = 25.0f; // animation speed when streaming
 
 	GLsizei m_pointCount;
 	GLsizei m_frameCount;
 	std::unique_ptr<GlBuffer> m_pointBuffer;
-	GLuint m_vao;
+	std::unique_ptr<GlBuffer> m_chunkBuffer;
+	std::unique_ptr<PointCloudStream> m_stream;
+	GLuint m_vao = 0;
 };
 
 registerBehaviorType(PointCloudDataBehavior)
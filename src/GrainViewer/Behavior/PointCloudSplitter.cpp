@@ -36,21 +36,38 @@
 #include "utils/jsonutils.h"
 #include "utils/behaviorutils.h"
 #include "Framebuffer.h"
+#include "Filtering.h"
 #include "GlobalTimer.h"
 #include "ResourceManager.h"
 #include "PointCloudView.h"
 
 #include <magic_enum.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
 #include <filesystem>
 namespace fs = std::filesystem;
 
 //-----------------------------------------------------------------------------
 
+PROPERTIES_OPERATORS_DEF(PointCloudSplitter)
+
+//-----------------------------------------------------------------------------
+
 bool PointCloudSplitter::deserialize(const rapidjson::Value& json)
 {
 	jrOption(json, "shader", m_shaderName, m_shaderName);
 	jrOption(json, "occlusionCullingShader", m_occlusionCullingShaderName, m_occlusionCullingShaderName);
+	jrOption(json, "chunkCullingShader", m_chunkCullingShaderName, m_chunkCullingShaderName);
+	jrOption(json, "prefixSumShader", m_prefixSumShaderName, m_prefixSumShaderName);
+	jrOption(json, "drawCommandsShader", m_drawCommandsShaderName, m_drawCommandsShaderName);
+	jrOption(json, "incrementalShader", m_incrementalShaderName, m_incrementalShaderName);
+	jrOption(json, "hzbOccludersShader", m_hzbOccludersShaderName, m_hzbOccludersShaderName);
+	jrOption(json, "hzbSaveOccludersShader", m_hzbSaveOccludersShaderName, m_hzbSaveOccludersShaderName);
+	jrOption(json, "multiViewShader", m_multiViewShaderName, m_multiViewShaderName);
+	jrOption(json, "localSize", m_local_size_x, m_local_size_x);
 	autoDeserialize(json, m_properties);
 
 	if (jrOption(json, "outputStats", m_outputStats)) {
@@ -70,144 +87,495 @@ void PointCloudSplitter::start()
 	auto pointData = m_pointData.lock();
 	m_elementCount = static_cast<GLuint>(pointData->pointCount() / pointData->frameCount());
 	
-	m_elementBuffer = std::make_unique<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
-	m_elementBuffer->addBlock<GLuint>(m_elementCount);
-	m_elementBuffer->alloc();
-	m_elementBuffer->finalize();
+	reserveElementBuffer(m_elementCount);
 
 	// Small extra buffer to count the number of elements for each model
 	m_counters.resize(magic_enum::enum_count<RenderModel>());
 	m_countersSsbo = std::make_unique<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
 	m_countersSsbo->importBlock(m_counters);
 
+	m_drawCommandBuffer = std::make_unique<GlBuffer>(GL_DRAW_INDIRECT_BUFFER);
+	m_drawCommandBuffer->addBlock<DrawArraysIndirectCommand>(2 * m_counters.size());
+	m_drawCommandBuffer->alloc(0);
+	m_drawCommandBuffer->finalize();
+
+	m_countersReadbacks.resize(s_countersReadbackCount);
+	for (auto& readback : m_countersReadbacks) {
+		readback.buffer = std::make_unique<GlBuffer>(GL_COPY_WRITE_BUFFER);
+		readback.buffer->addBlock<Counter>(m_counters.size());
+		readback.buffer->alloc(GL_MAP_READ_BIT);
+	}
+
+	// The work group size is baked in shader variants, within the limits of the GPU
+	GLint maxLocalSize = 0;
+	GLint maxInvocations = 0;
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxLocalSize);
+	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+	int localSize = std::clamp(m_local_size_x, 32, std::max(32, std::min(maxLocalSize, maxInvocations)));
+	localSize -= localSize % 32;
+	if (localSize != m_local_size_x) {
+		WARN_LOG << "Work group size " << m_local_size_x << " is not supported, using " << localSize << " instead";
+		m_local_size_x = localSize;
+	}
+	std::map<std::string, std::string> snippets;
+	snippets["settings"] = "#define LOCAL_SIZE_X " + std::to_string(m_local_size_x);
+	m_shaders.setBaseShader(m_shaderName, snippets);
+	m_prefixSumShaders.setBaseShader(m_prefixSumShaderName, snippets);
+	m_incrementalShaders.setBaseShader(m_incrementalShaderName, snippets);
+	m_multiViewShaders.setBaseShader(m_multiViewShaderName, snippets);
+
 	m_xWorkGroups = (m_elementCount + (m_local_size_x - 1)) / m_local_size_x;
 
+	// Chunks do not start at frame boundaries, so a frame may overlap one
+	// more chunk than its size would require.
+	if (pointData->chunkBuffer() && pointData->chunkSize() > 0) {
+		m_maxChunkCount = (m_elementCount + pointData->chunkSize() - 1) / pointData->chunkSize() + 1;
+		m_groupsPerChunk = (pointData->chunkSize() + m_local_size_x - 1) / m_local_size_x;
+		m_chunkCullingSsbo = std::make_unique<GlBuffer>(GL_DISPATCH_INDIRECT_BUFFER);
+		m_chunkCullingSsbo->addBlock<ChunkCullingHeader>();
+		m_chunkCullingSsbo->addBlock<GLuint>(m_maxChunkCount);
+		m_chunkCullingSsbo->alloc(0);
+		m_chunkCullingSsbo->finalize();
+	}
+
 	// Create proxies to sub parts of the output point clouds
 	m_subClouds.resize(magic_enum::enum_count<RenderModel>());
 	for (int i = 0; i < m_subClouds.size(); ++i) {
 		m_subClouds[i] = std::make_shared<PointCloudView>(*this, static_cast<RenderModel>(i));
 	}
 
-	// Shader (other shaders are lazy loaded by getShader())
+	// Shader (splitting shaders are lazy loaded from variant tables)
 	m_occlusionCullingShader = ShaderPool::GetShader(m_occlusionCullingShaderName);
+	m_chunkCullingShader = ShaderPool::GetShader(m_chunkCullingShaderName);
+	m_drawCommandsShader = ShaderPool::GetShader(m_drawCommandsShaderName);
+	m_hzbOccludersShader = ShaderPool::GetShader(m_hzbOccludersShaderName);
+	m_hzbSaveOccludersShader = ShaderPool::GetShader(m_hzbSaveOccludersShaderName);
+}
+
+void PointCloudSplitter::precompileShaders()
+{
+	// Chunk culling and Incremental need point chunks
+	bool hasChunks = m_chunkCullingSsbo != nullptr;
+	m_shaders.precompile([hasChunks](RenderTypeShaderVariant renderType, StepShaderVariant step, ShaderOptionSet options) {
+		// Only Precompute caching has a precompute step
+		if (step == StepShaderVariant::STEP_PRECOMPUTE && renderType != RenderTypeShaderVariant::RENDER_TYPE_PRECOMPUTE) return false;
+		return hasChunks || !options.test(ShaderOption::CHUNK_CULLING);
+	});
+	m_prefixSumShaders.precompile([hasChunks](ShaderOptionSet options) {
+		return hasChunks || !options.test(ShaderOption::CHUNK_CULLING);
+	});
+	if (hasChunks) {
+		m_incrementalShaders.precompile();
+	}
+	m_multiViewShaders.precompile();
 }
 
 void PointCloudSplitter::update(float time, int frame)
 {
 	m_time = time;
+	updateFrameTimeBudget();
 }
 
-void PointCloudSplitter::onPreRender(const Camera& camera, const World& world, RenderType target)
+void PointCloudSplitter::onPreRenderViews(const std::vector<PreRenderView>& views, const World& world)
 {
-	ScopedTimer timer((target == RenderType::ShadowMap ? "PointCloudSplitter_shadowmap" : "PointCloudSplitter"));
+	m_batch.views.clear();
 
 	auto pointData = m_pointData.lock();
 	if (!pointData) return;
 
 	const auto& props = properties();
+	if (!props.batchViews || splittingAlgorithm() == SplittingAlgorithm::Incremental) return;
 
-	std::shared_ptr<Framebuffer> occlusionCullingFbo;
-	
-	// 1. Occlusion culling map (kind of shadow map)
-	if (props.enableOcclusionCulling) {
-		ScopedFramebufferOverride scoppedFramebufferOverride;
+	// A view may be listed several times, e.g. when the occlusion camera is frozen
+	std::vector<PreRenderView> uniqueViews;
+	for (const auto& view : views) {
+		bool isDuplicate = false;
+		for (const auto& other : uniqueViews) {
+			isDuplicate = isDuplicate || (other.camera == view.camera && other.target == view.target);
+		}
+		if (!isDuplicate) uniqueViews.push_back(view);
+	}
+	// Nothing to share with a single view, and beyond the limit views are
+	// split one by one by onPreRender().
+	if (uniqueViews.size() < 2 || uniqueViews.size() > s_maxBatchedViews) return;
 
-		glEnable(GL_PROGRAM_POINT_SIZE);
+	ScopedTimer timer("PointCloudSplitter_batch");
 
-		occlusionCullingFbo = camera.getExtraFramebuffer(Camera::ExtraFramebufferOption::Rgba32fDepth);
-		occlusionCullingFbo->bind();
-		glClearColor(0, 0, 0, 1);
-		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	if (!m_hasLoggedBatchOverride) {
+		LOG
+			<< "PointCloudSplitter splits " << uniqueViews.size() << " views in a single pass, "
+			<< "so the " << magic_enum::enum_name(props.algorithm) << " algorithm"
+			<< (props.enableChunkCulling ? " and chunk culling are" : " is")
+			<< " not used (turn batchViews off to use them)";
+		m_hasLoggedBatchOverride = true;
+	}
 
-		// 1.1. z-prepass (optional)
-		if (props.zPrepass) {
-			occlusionCullingFbo->deactivateColorAttachments();
-			const ShaderProgram& shader = *m_occlusionCullingShader;
+	GLuint viewCount = static_cast<GLuint>(uniqueViews.size());
+	if (m_batch.capacity < viewCount) {
+		m_batch.countersSsbo = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_batch.countersSsbo->addBlock<Counter>(viewCount * m_counters.size());
+		m_batch.countersSsbo->alloc(0);
+		m_batch.countersSsbo->finalize();
 
-			setCommonUniforms(shader, camera);
+		m_batch.scanSsbo = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_batch.scanSsbo->addBlock<GLuint>(1 + s_maxBatchedViews * 3 * static_cast<size_t>(m_xWorkGroups));
+		m_batch.scanSsbo->alloc(0);
+		m_batch.scanSsbo->finalize();
 
-			shader.use();
-			glBindVertexArray(pointData->vao());
-			pointData->vbo().bindSsbo(1);
-			glDrawArrays(GL_POINTS, 0, m_elementCount);
-			glBindVertexArray(0);
+		m_batch.elementBuffer = std::make_shared<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+		m_batch.elementBuffer->addBlock<GLuint>(2 * static_cast<size_t>(viewCount) * std::max(m_elementCount, static_cast<GLuint>(1)));
+		m_batch.elementBuffer->alloc();
+		m_batch.elementBuffer->finalize();
 
-			glTextureBarrier();
-			occlusionCullingFbo->activateColorAttachments();
-		}
-		// 1.2. core pass
-		{
-			ScopedFramebufferOverride scoppedFramebufferOverride;
+		m_batch.capacity = viewCount;
+	}
 
-			glEnable(GL_PROGRAM_POINT_SIZE);
-			if (props.zPrepass) {
-				glDepthMask(GL_FALSE);
-				glDepthFunc(GL_LEQUAL);
+	// Other algorithms do not maintain incremental states
+	for (auto& state : m_incrementalStates) {
+		state.second.isValid = false;
+	}
+
+	// 1. Occlusion culling maps, which remain one per view
+	std::vector<std::shared_ptr<Framebuffer>> occlusionCullingFbos;
+	for (const auto& view : uniqueViews) {
+		occlusionCullingFbos.push_back(renderOcclusionCulling(*pointData, *view.camera));
+	}
+
+	// 2. Splitting, all views at once
+	const GLuint zero = 0;
+	glClearNamedBufferData(m_batch.countersSsbo->name(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glClearNamedBufferData(m_batch.scanSsbo->name(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	m_batch.countersSsbo->bindSsbo(0);
+	m_batch.scanSsbo->bindSsbo(1);
+	m_batch.elementBuffer->bindSsbo(2);
+
+	const ShaderProgram& shader = *m_multiViewShaders.get();
+	setCommonUniforms(shader, *uniqueViews[0].camera);
+	pointData->bindPoints(shader, 3);
+	shader.setUniform("uViewCount", viewCount);
+	// Per view arrays, each uploaded at once
+	glm::mat4 viewModelMatrices[s_maxBatchedViews];
+	glm::mat4 projectionMatrices[s_maxBatchedViews];
+	glm::vec2 resolutions[s_maxBatchedViews];
+	glm::vec2 lodLimits[s_maxBatchedViews];
+	GLint occlusionMapUnits[s_maxBatchedViews];
+	GLint hzbUnits[s_maxBatchedViews];
+	for (GLuint v = 0; v < viewCount; ++v) {
+		const Camera& camera = *uniqueViews[v].camera;
+		viewModelMatrices[v] = camera.viewMatrix() * modelMatrix();
+		projectionMatrices[v] = camera.projectionMatrix();
+		resolutions[v] = camera.resolution();
+		lodLimits[v] = lodDistanceLimits(camera);
+		occlusionMapUnits[v] = static_cast<GLint>(v);
+		hzbUnits[v] = static_cast<GLint>(s_maxBatchedViews + v);
+		if (const auto& fbo = occlusionCullingFbos[v]) {
+			if (props.occlusionCulling == OcclusionCulling::Hzb) {
+				glBindTextureUnit(hzbUnits[v], fbo->depthTexture());
 			}
+			else {
+				glBindTextureUnit(occlusionMapUnits[v], fbo->colorTexture(0));
+			}
+		}
+	}
+	GLsizei count = static_cast<GLsizei>(viewCount);
+	shader.setUniform("uViewModelMatrices", viewModelMatrices, count);
+	shader.setUniform("uProjectionMatrices", projectionMatrices, count);
+	shader.setUniform("uResolutions", resolutions, count);
+	shader.setUniform("uLodLimits", lodLimits, count);
+	shader.setUniform("uOcclusionMaps", occlusionMapUnits, count);
+	shader.setUniform("uHzbs", hzbUnits, count);
+	shader.use();
+	glDispatchCompute(static_cast<GLuint>(m_xWorkGroups), 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-			occlusionCullingFbo = camera.getExtraFramebuffer(Camera::ExtraFramebufferOption::Rgba32fDepth);
-			occlusionCullingFbo->bind();
-			glClearColor(0, 0, 0, 1);
-			glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	m_batch.views = uniqueViews;
+}
 
-			const ShaderProgram& shader = *m_occlusionCullingShader;
+void PointCloudSplitter::onPreRender(const Camera& camera, const World& world, RenderType target)
+{
+	ScopedTimer timer((target == RenderType::ShadowMap ? "PointCloudSplitter_shadowmap" : "PointCloudSplitter"));
 
-			setCommonUniforms(shader, camera);
+	auto pointData = m_pointData.lock();
+	if (!pointData) return;
 
-			shader.use();
-			glBindVertexArray(pointData->vao());
-			pointData->vbo().bindSsbo(1);
-			glDrawArrays(GL_POINTS, 0, m_elementCount);
-			glBindVertexArray(0);
+	const auto& props = properties();
 
-			glTextureBarrier();
-			glDepthMask(GL_TRUE);
-			glDepthFunc(GL_LESS);
+	// Already split by onPreRenderViews()
+	for (size_t v = 0; v < m_batch.views.size(); ++v) {
+		if (m_batch.views[v].camera == &camera && m_batch.views[v].target == target) {
+			if (props.checkBatchedViews) {
+				checkBatchedView(*pointData, v);
+			}
+			else {
+				exposeBatchedView(v);
+			}
+			saveHzbOccluders(camera);
+			collectCounters(m_outputStatsFile.is_open());
+			return;
 		}
 	}
 
+	// 1. Occlusion culling map (kind of shadow map)
+	std::shared_ptr<Framebuffer> occlusionCullingFbo = renderOcclusionCulling(*pointData, camera);
+
 	// 2. Splitting
 	{
-		m_countersSsbo->bindSsbo(0);
-		m_elementBuffer->bindSsbo(2);
-		pointData->vbo().bindSsbo(3);
-
-		if (props.renderTypeCaching != RenderTypeCaching::Forget) {
-			// Cache for render types
-			if (!m_renderTypeCache) {
-				m_renderTypeCache = std::make_unique<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
-				m_renderTypeCache->addBlock<GLuint>(m_elementCount);
-				m_renderTypeCache->alloc();
-				m_renderTypeCache->finalize();
+		SplittingAlgorithm algorithm = splittingAlgorithm();
+		if (algorithm != SplittingAlgorithm::Incremental) {
+			// Other algorithms do not maintain incremental states
+			for (auto& state : m_incrementalStates) {
+				state.second.isValid = false;
 			}
-			m_renderTypeCache->bindSsbo(1);
 		}
 
-		StepShaderVariant firstStep = StepShaderVariant::STEP_RESET;
-		if (props.renderTypeCaching == RenderTypeCaching::Precompute) {
-			firstStep = StepShaderVariant::STEP_PRECOMPUTE;
+		// 2.1. Chunk culling (optional)
+		// Per grain passes are then dispatched indirectly on visible chunks only
+		// (Incremental culls chunks on its own)
+		bool useChunkCulling = props.enableChunkCulling && m_chunkCullingSsbo && m_chunkCullingShader && algorithm != SplittingAlgorithm::Incremental;
+		if (useChunkCulling) {
+			cullChunks(*pointData, camera, occlusionCullingFbo);
 		}
 
-		constexpr StepShaderVariant lastStep = lastValue<StepShaderVariant>();
-		constexpr int STEP_RESET = static_cast<int>(StepShaderVariant::STEP_RESET);
-		constexpr int STEP_OFFSET = static_cast<int>(StepShaderVariant::STEP_OFFSET);
-		for (int i = static_cast<int>(firstStep); i <= static_cast<int>(lastStep); ++i) {
-			const ShaderProgram& shader = *getShader(props.renderTypeCaching, i);
-			setCommonUniforms(shader, camera);
-			if (props.enableOcclusionCulling) {
-				glBindTextureUnit(0, occlusionCullingFbo->colorTexture(0));
-				shader.setUniform("uOcclusionMap", 0);
-			}
-			shader.use();
-			glDispatchCompute(i == STEP_RESET || i == STEP_OFFSET ? 1 : static_cast<GLuint>(m_xWorkGroups), 1, 1);
-			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		// 2.2. Per grain passes
+		ScopedTimer timer(std::string("PointCloudSplitter_") + std::string(magic_enum::enum_name(algorithm)));
+		switch (algorithm) {
+		case SplittingAlgorithm::GlobalAtomic:
+			splitGlobalAtomic(*pointData, camera, occlusionCullingFbo, useChunkCulling);
+			break;
+		case SplittingAlgorithm::PrefixSum:
+			splitPrefixSum(*pointData, camera, occlusionCullingFbo, useChunkCulling);
+			break;
+		case SplittingAlgorithm::Incremental:
+			splitIncremental(*pointData, camera, occlusionCullingFbo);
+			break;
+		}
+
+		writeDrawCommands();
+		saveHzbOccluders(camera);
+	}
+
+	// Stats must not miss any frame, whereas the UI may lag behind
+	collectCounters(m_outputStatsFile.is_open());
+}
+
+void PointCloudSplitter::onDestroy()
+{
+	for (auto& readback : m_countersReadbacks) {
+		if (readback.fence) {
+			glDeleteSync(readback.fence);
+			readback.fence = nullptr;
+		}
+	}
+}
+
+void PointCloudSplitter::splitGlobalAtomic(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo, bool useChunkCulling)
+{
+	const auto& props = properties();
+
+	reserveElementBuffer(m_elementCount);
+	m_countersSsbo->bindSsbo(0);
+	m_elementBuffer->bindSsbo(2);
+
+	if (props.renderTypeCaching != RenderTypeCaching::Forget) {
+		// Cache for render types
+		if (!m_renderTypeCache) {
+			m_renderTypeCache = std::make_unique<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+			m_renderTypeCache->addBlock<GLuint>(std::max(m_elementCount, static_cast<GLuint>(1)));
+			m_renderTypeCache->alloc();
+			m_renderTypeCache->finalize();
 		}
+		m_renderTypeCache->bindSsbo(1);
+	}
+
+	if (useChunkCulling) {
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_chunkCullingSsbo->name());
+	}
+
+	StepShaderVariant firstStep = StepShaderVariant::STEP_RESET;
+	if (props.renderTypeCaching == RenderTypeCaching::Precompute) {
+		firstStep = StepShaderVariant::STEP_PRECOMPUTE;
+	}
 
-		// Get counters back
-		m_countersSsbo->exportBlock(0, m_counters);
+	constexpr StepShaderVariant lastStep = lastValue<StepShaderVariant>();
+	constexpr int STEP_RESET = static_cast<int>(StepShaderVariant::STEP_RESET);
+	constexpr int STEP_OFFSET = static_cast<int>(StepShaderVariant::STEP_OFFSET);
+	for (int i = static_cast<int>(firstStep); i <= static_cast<int>(lastStep); ++i) {
+		const ShaderProgram& shader = *m_shaders.get(
+			static_cast<RenderTypeShaderVariant>(props.renderTypeCaching),
+			static_cast<StepShaderVariant>(i),
+			shaderOptions(useChunkCulling));
+		setCommonUniforms(shader, camera);
+		pointData.bindPoints(shader, 3);
+		bindOcclusionCulling(shader, occlusionCullingFbo);
+		shader.use();
+		if (i == STEP_RESET || i == STEP_OFFSET) {
+			glDispatchCompute(1, 1, 1);
+		}
+		else if (useChunkCulling) {
+			shader.setUniform("uGroupsPerChunk", m_groupsPerChunk);
+			glDispatchComputeIndirect(0);
+		}
+		else {
+			glDispatchCompute(static_cast<GLuint>(m_xWorkGroups), 1, 1);
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	}
 
-	writeStats();
+	if (useChunkCulling) {
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	}
+}
+
+void PointCloudSplitter::splitPrefixSum(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo, bool useChunkCulling)
+{
+	const auto& props = properties();
+
+	reserveElementBuffer(2 * m_elementCount);
+
+	if (!m_scanSsbo) {
+		// One descriptor per written model and work group, whichever the dispatch
+		GLuint maxWorkGroups = std::max(static_cast<GLuint>(m_xWorkGroups), m_maxChunkCount * m_groupsPerChunk);
+		m_scanSsbo = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_scanSsbo->addBlock<GLuint>(1 + 3 * maxWorkGroups);
+		m_scanSsbo->alloc(0);
+		m_scanSsbo->finalize();
+	}
+
+	// Counters are only written by the last work group, so they must be
+	// valid even if no work group is dispatched.
+	const GLuint zero = 0;
+	glClearNamedBufferData(m_countersSsbo->name(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glClearNamedBufferData(m_scanSsbo->name(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	m_countersSsbo->bindSsbo(0);
+	m_scanSsbo->bindSsbo(1);
+	m_elementBuffer->bindSsbo(2);
+
+	const ShaderProgram& shader = *m_prefixSumShaders.get(shaderOptions(useChunkCulling));
+	setCommonUniforms(shader, camera);
+	pointData.bindPoints(shader, 3);
+	bindOcclusionCulling(shader, occlusionCullingFbo);
+	shader.use();
+	if (useChunkCulling) {
+		shader.setUniform("uGroupsPerChunk", m_groupsPerChunk);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_chunkCullingSsbo->name());
+		glDispatchComputeIndirect(0);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	}
+	else {
+		glDispatchCompute(static_cast<GLuint>(m_xWorkGroups), 1, 1);
+	}
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void PointCloudSplitter::splitIncremental(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo)
+{
+	const auto& props = properties();
+	GLuint chunkSize = pointData.chunkSize();
+
+	IncrementalState& state = m_incrementalStates[&camera];
+	if (!state.stateSsbo) {
+		state.stateSsbo = std::make_unique<GlBuffer>(GL_DISPATCH_INDIRECT_BUFFER);
+		state.stateSsbo->addBlock<IncrementalHeader>();
+		state.stateSsbo->addBlock<IncrementalChunkState>(m_maxChunkCount);
+		state.stateSsbo->alloc(0);
+		state.stateSsbo->finalize();
+
+		state.dirtyChunksSsbo = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		state.dirtyChunksSsbo->addBlock<GLuint>(m_maxChunkCount);
+		state.dirtyChunksSsbo->alloc(0);
+		state.dirtyChunksSsbo->finalize();
+
+		// Chunk regions, then temporary (model, rank) pairs
+		state.chunkElementsSsbo = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		state.chunkElementsSsbo->addBlock<GLuint>(2 * static_cast<size_t>(m_maxChunkCount) * chunkSize);
+		state.chunkElementsSsbo->alloc(0);
+		state.chunkElementsSsbo->finalize();
+
+		state.countersSsbo = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		state.countersSsbo->addBlock<Counter>(m_counters.size());
+		state.countersSsbo->alloc(0);
+		state.countersSsbo->finalize();
+
+		state.elementBuffer = std::make_shared<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+		state.elementBuffer->addBlock<GLuint>(std::max(m_elementCount, static_cast<GLuint>(1)));
+		state.elementBuffer->alloc();
+		state.elementBuffer->finalize();
+	}
+
+	// Changes that the chunk states do not capture
+	float grainRadius = 0, grainInnerRadiusRatio = 0;
+	if (auto grain = m_grain.lock()) {
+		grainRadius = grain->properties().grainRadius;
+		grainInnerRadiusRatio = grain->properties().grainInnerRadiusRatio;
+	}
+	glm::vec2 lodLimits = lodDistanceLimits(camera);
+	// The first split of a camera has no Hzb occluders yet, so it culls nothing
+	bool hasHzbOccluders = false;
+	if (props.enableOcclusionCulling && props.occlusionCulling == OcclusionCulling::Hzb) {
+		auto it = m_hzbStates.find(&camera);
+		hasHzbOccluders = it != m_hzbStates.end() && it->second.hasOccluders;
+	}
+	bool forceRefresh =
+		!state.isValid
+		|| state.properties != m_properties
+		|| state.grainRadius != grainRadius
+		|| state.grainInnerRadiusRatio != grainInnerRadiusRatio
+		|| state.lodLimits != lodLimits
+		|| state.hasHzbOccluders != hasHzbOccluders;
+	state.isValid = true;
+	state.properties = m_properties;
+	state.grainRadius = grainRadius;
+	state.grainInnerRadiusRatio = grainInnerRadiusRatio;
+	state.lodLimits = lodLimits;
+	state.hasHzbOccluders = hasHzbOccluders;
+
+	// Indirect dispatches of all steps but the first start empty
+	const GLuint reset[4] = { 0, 1, 1, 0 };
+	glClearNamedBufferSubData(state.stateSsbo->name(), GL_RGBA32UI, 0, sizeof(IncrementalHeader), GL_RGBA_INTEGER, GL_UNSIGNED_INT, reset);
+
+	state.countersSsbo->bindSsbo(0);
+	state.stateSsbo->bindSsbo(1);
+	state.elementBuffer->bindSsbo(2);
+	state.dirtyChunksSsbo->bindSsbo(4);
+	state.chunkElementsSsbo->bindSsbo(6);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, state.stateSsbo->name());
+
+	constexpr IncrementalStepShaderVariant lastStep = lastValue<IncrementalStepShaderVariant>();
+	for (int i = 0; i <= static_cast<int>(lastStep); ++i) {
+		IncrementalStepShaderVariant step = static_cast<IncrementalStepShaderVariant>(i);
+		const ShaderProgram& shader = *m_incrementalShaders.get(step);
+		setCommonUniforms(shader, camera);
+		pointData.bindPoints(shader, 3);
+		shader.setUniform("uMaxChunkCount", m_maxChunkCount);
+		shader.setUniform("uForceRefresh", forceRefresh);
+		bindOcclusionCulling(shader, occlusionCullingFbo);
+		shader.use();
+		switch (step) {
+		case IncrementalStepShaderVariant::STEP_CHUNKS:
+			glDispatchCompute((m_maxChunkCount + m_local_size_x - 1) / m_local_size_x, 1, 1);
+			break;
+		case IncrementalStepShaderVariant::STEP_CLASSIFY:
+			glDispatchComputeIndirect(offsetof(IncrementalHeader, classifyDispatch));
+			break;
+		case IncrementalStepShaderVariant::STEP_SCAN:
+			glDispatchComputeIndirect(offsetof(IncrementalHeader, scanDispatch));
+			break;
+		case IncrementalStepShaderVariant::STEP_GATHER:
+			glDispatchComputeIndirect(offsetof(IncrementalHeader, gatherDispatch));
+			break;
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	}
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+	// Expose the result of this camera as the output of the splitter
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	GLsizeiptr countersSize = static_cast<GLsizeiptr>(m_counters.size() * sizeof(Counter));
+	glCopyNamedBufferSubData(state.countersSsbo->name(), m_countersSsbo->name(), 0, 0, countersSize);
+	m_elementBuffer = state.elementBuffer;
+	m_elementBufferSize = m_elementCount;
 }
 
 //-----------------------------------------------------------------------------
@@ -251,6 +619,42 @@ GLint PointCloudSplitter::pointOffset(RenderModel model) const
 	return static_cast<GLint>(m_counters[static_cast<int>(model)].offset);
 }
 
+const GlBuffer* PointCloudSplitter::chunkBuffer(RenderModel model) const
+{
+	auto pointData = m_pointData.lock();
+	assert(pointData);
+	return pointData->chunkBuffer();
+}
+
+GLuint PointCloudSplitter::chunkSize(RenderModel model) const
+{
+	auto pointData = m_pointData.lock();
+	assert(pointData);
+	return pointData->chunkSize();
+}
+
+bool PointCloudSplitter::isQuantized(RenderModel model) const
+{
+	auto pointData = m_pointData.lock();
+	assert(pointData);
+	return pointData->isQuantized();
+}
+
+const GlBuffer* PointCloudSplitter::drawCommandBuffer(RenderModel model) const
+{
+	return m_drawCommandsShader ? m_drawCommandBuffer.get() : nullptr;
+}
+
+GLintptr PointCloudSplitter::drawCommandOffset(RenderModel model) const
+{
+	return static_cast<GLintptr>((2 * static_cast<int>(model) + 0) * sizeof(DrawArraysIndirectCommand));
+}
+
+GLintptr PointCloudSplitter::instancedDrawCommandOffset(RenderModel model) const
+{
+	return static_cast<GLintptr>((2 * static_cast<int>(model) + 1) * sizeof(DrawArraysIndirectCommand));
+}
+
 //-----------------------------------------------------------------------------
 
 glm::mat4 PointCloudSplitter::modelMatrix() const {
@@ -272,49 +676,411 @@ void PointCloudSplitter::setCommonUniforms(const ShaderProgram& shader, const Ca
 
 	autoSetUniforms(shader, properties());
 	if (auto grain = m_grain.lock()) {
-		autoSetUniforms(shader, grain->properties());
-		shader.setUniform("uOuterOverInnerRadius", 1.0f / grain->properties().grainInnerRadiusRatio);
+		grain->bindProperties(shader);
 	}
 
+	glm::vec2 lodLimits = lodDistanceLimits(camera);
+	shader.setUniform("uInstanceLimit", lodLimits.x);
+	shader.setUniform("uImpostorLimit", lodLimits.y);
+
 	shader.setUniform("uPointCount", m_elementCount);
 	shader.setUniform("uRenderModelCount", static_cast<GLuint>(magic_enum::enum_count<RenderModel>()));
 	shader.setUniform("uFrameCount", static_cast<GLuint>(m_pointData.lock()->frameCount()));
 	shader.setUniform("uTime", m_time);
 }
 
-std::shared_ptr<ShaderProgram> PointCloudSplitter::getShader(RenderTypeCaching renderType, int step) const
+PointCloudSplitter::SplittingAlgorithm PointCloudSplitter::splittingAlgorithm()
+{
+	SplittingAlgorithm algorithm = properties().algorithm;
+	if (algorithm == SplittingAlgorithm::Incremental && !m_chunkCullingSsbo) {
+		if (!m_hasWarnedIncrementalFallback) {
+			WARN_LOG << "Incremental splitting requires point chunks, falling back to GlobalAtomic";
+			m_hasWarnedIncrementalFallback = true;
+		}
+		algorithm = SplittingAlgorithm::GlobalAtomic;
+	}
+	return algorithm;
+}
+
+glm::vec2 PointCloudSplitter::lodDistanceLimits(const Camera& camera) const
+{
+	const auto& props = properties();
+	if (props.lodMode == LodMode::Distance) {
+		return glm::vec2(props.instanceLimit, props.impostorLimit);
+	}
+
+	float r = 0.0f;
+	if (auto grain = m_grain.lock()) {
+		r = grain->properties().grainRadius;
+	}
+	glm::vec2 pixelRadii = glm::vec2(props.instancePixelRadius, props.impostorPixelRadius) * m_lodScale;
+
+	// Radius on screen of a grain at distance d on the view axis is
+	//   fl * r * height / sqrt(d^2 - r^2)
+	// where fl = projection[1][1] / 2 is the focal length relative to the
+	// viewport height.
+	glm::mat4 projection = camera.projectionMatrix();
+	float height = camera.resolution().y;
+	float k = 0.5f * projection[1][1] * r * height;
+	if (std::abs(projection[3][3]) > 0.01f) {
+		// Orthographic: all grains have the same size on screen
+		constexpr float infinity = std::numeric_limits<float>::max();
+		return glm::vec2(k >= pixelRadii.x ? infinity : 0.0f, k >= pixelRadii.y ? infinity : 0.0f);
+	}
+	glm::vec2 q = k / glm::max(pixelRadii, glm::vec2(1e-6f));
+	// discriminate() compares limits with the length of position_cs, whose
+	// w is 1, i.e. with sqrt(d^2 + 1)
+	return glm::sqrt(q * q + r * r + 1.0f);
+}
+
+void PointCloudSplitter::updateFrameTimeBudget()
+{
+	const auto& props = properties();
+	if (props.lodMode != LodMode::ScreenSize || !props.enableFrameTimeBudget) {
+		m_lodScale = 1.0f;
+		return;
+	}
+
+	// GlobalTimer reads its queries synchronously at the end of each frame,
+	// so this reacts once per completed frame
+	const GlobalTimer::Stats& frameStats = GlobalTimer::GetInstance()->frameStats();
+	if (frameStats.sampleCount == m_lastBudgetSample || frameStats.lastGpuTime <= 0.0) return;
+	m_lastBudgetSample = frameStats.sampleCount;
+
+	// Multiplicative steps, small enough not to oscillate, and a dead band so
+	// that Incremental splitting is not restarted at every frame.
+	float ratio = static_cast<float>(frameStats.lastGpuTime) / props.targetFrameTime;
+	if (ratio > 0.95f && ratio < 1.05f) return;
+	m_lodScale *= glm::clamp(std::sqrt(ratio), 0.9f, 1.1f);
+	m_lodScale = glm::clamp(m_lodScale, 0.25f, 16.0f);
+}
+
+PointCloudSplitter::ShaderOptionSet PointCloudSplitter::shaderOptions(bool chunkCulling)
+{
+	ShaderOptionSet options;
+	options.set(ShaderOption::CHUNK_CULLING, chunkCulling);
+	return options;
+}
+
+void PointCloudSplitter::reserveElementBuffer(GLuint elementCount)
+{
+	// Buffers of Incremental and of batched views are not owned by a single split
+	bool isShared = m_elementBuffer && m_elementBuffer == m_batch.elementBuffer;
+	for (const auto& state : m_incrementalStates) {
+		isShared = isShared || (m_elementBuffer && m_elementBuffer == state.second.elementBuffer);
+	}
+	if (m_elementBuffer && !isShared && m_elementBufferSize >= elementCount) return;
+
+	// A new buffer rather than a reallocation, because the element buffer is shared with renderers
+	m_elementBuffer = std::make_shared<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+	m_elementBuffer->addBlock<GLuint>(std::max(elementCount, static_cast<GLuint>(1)));
+	m_elementBuffer->alloc();
+	m_elementBuffer->finalize();
+	m_elementBufferSize = elementCount;
+}
+
+void PointCloudSplitter::cullChunks(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo) const
+{
+	const ChunkCullingHeader reset = { { 0, 1, 1 }, 0 };
+	glClearNamedBufferSubData(m_chunkCullingSsbo->name(), GL_RGBA32UI, 0, sizeof(ChunkCullingHeader), GL_RGBA_INTEGER, GL_UNSIGNED_INT, &reset);
+
+	const ShaderProgram& shader = *m_chunkCullingShader;
+	setCommonUniforms(shader, camera);
+	pointData.bindPoints(shader, 3);
+	shader.setUniform("uGroupsPerChunk", m_groupsPerChunk);
+	bindOcclusionCulling(shader, occlusionCullingFbo);
+	m_chunkCullingSsbo->bindSsbo(4);
+
+	shader.use();
+	glDispatchCompute((m_maxChunkCount + s_chunkCullingLocalSize - 1) / s_chunkCullingLocalSize, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+std::shared_ptr<Framebuffer> PointCloudSplitter::renderOcclusionCulling(const IPointCloudData& pointData, const Camera& camera)
+{
+	const auto& props = properties();
+
+	if (!props.enableOcclusionCulling) {
+		return nullptr;
+	}
+	if (props.occlusionCulling == OcclusionCulling::Hzb) {
+		// No full cloud draw, only the occluders of the previous frame
+		return renderHzb(pointData, camera);
+	}
+
+	std::shared_ptr<Framebuffer> occlusionCullingFbo;
+	{
+		ScopedFramebufferOverride scoppedFramebufferOverride;
+		// Batched views are not preceded by the viewport of their own camera
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glViewport(0, 0, static_cast<GLsizei>(camera.resolution().x), static_cast<GLsizei>(camera.resolution().y));
+
+		glEnable(GL_PROGRAM_POINT_SIZE);
+
+		occlusionCullingFbo = camera.getExtraFramebuffer(Camera::ExtraFramebufferOption::Rgba32fDepth);
+		occlusionCullingFbo->bind();
+		glClearColor(0, 0, 0, 1);
+		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+
+		// 1.1. z-prepass (optional)
+		if (props.zPrepass) {
+			occlusionCullingFbo->deactivateColorAttachments();
+			const ShaderProgram& shader = *m_occlusionCullingShader;
+
+			setCommonUniforms(shader, camera);
+
+			shader.use();
+			glBindVertexArray(pointData.vao());
+			pointData.bindPoints(shader, 1);
+			glDrawArrays(GL_POINTS, 0, m_elementCount);
+			glBindVertexArray(0);
+
+			glTextureBarrier();
+			occlusionCullingFbo->activateColorAttachments();
+		}
+		// 1.2. core pass
+		{
+			ScopedFramebufferOverride scoppedFramebufferOverride;
+
+			glEnable(GL_PROGRAM_POINT_SIZE);
+			if (props.zPrepass) {
+				glDepthMask(GL_FALSE);
+				glDepthFunc(GL_LEQUAL);
+			}
+
+			occlusionCullingFbo = camera.getExtraFramebuffer(Camera::ExtraFramebufferOption::Rgba32fDepth);
+			occlusionCullingFbo->bind();
+			glClearColor(0, 0, 0, 1);
+			glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+
+			const ShaderProgram& shader = *m_occlusionCullingShader;
+
+			setCommonUniforms(shader, camera);
+
+			shader.use();
+			glBindVertexArray(pointData.vao());
+			pointData.bindPoints(shader, 1);
+			glDrawArrays(GL_POINTS, 0, m_elementCount);
+			glBindVertexArray(0);
+
+			glTextureBarrier();
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+		}
+
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+	return occlusionCullingFbo;
+}
+
+std::shared_ptr<Framebuffer> PointCloudSplitter::renderHzb(const IPointCloudData& pointData, const Camera& camera)
 {
-	return getShader(static_cast<RenderTypeShaderVariant>(renderType), static_cast<StepShaderVariant>(step));
+	const auto& props = properties();
+
+	HzbState& state = m_hzbStates[&camera];
+	auto& fbo = state.framebuffer;
+	GLsizei width = std::max(1, static_cast<GLsizei>(camera.resolution().x * props.hzbResolutionScale));
+	GLsizei height = std::max(1, static_cast<GLsizei>(camera.resolution().y * props.hzbResolutionScale));
+	if (!fbo || fbo->width() != width || fbo->height() != height) {
+		fbo = std::make_shared<Framebuffer>(width, height, std::vector<ColorLayerInfo>{}, true /* mipmapDepthBuffer */);
+	}
+
+	ScopedFramebufferOverride scoppedFramebufferOverride;
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	fbo->bind();
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	// Before the first split of this camera, the pyramid is left empty and culls nothing
+	if (state.hasOccluders && m_hzbOccludersShader) {
+		const ShaderProgram& shader = *m_hzbOccludersShader;
+		setCommonUniforms(shader, camera);
+		pointData.bindPoints(shader, 1);
+		state.occluders->bindSsbo(2);
+
+		glEnable(GL_PROGRAM_POINT_SIZE);
+		shader.use();
+		glBindVertexArray(pointData.vao());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, state.drawCommand->name());
+		glDrawArraysIndirect(GL_POINTS, nullptr);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	glTextureBarrier();
+	Filtering::MipmapDepthBuffer(*fbo);
+
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	return fbo;
 }
 
-std::shared_ptr<ShaderProgram> PointCloudSplitter::getShader(RenderTypeShaderVariant renderType, StepShaderVariant step) const
+void PointCloudSplitter::saveHzbOccluders(const Camera& camera)
 {
-	constexpr size_t n1 = magic_enum::enum_count<RenderTypeShaderVariant>();
-	constexpr size_t n2 = magic_enum::enum_count<StepShaderVariant>();
-	if (m_shaders.empty()) {
-		m_shaders.resize(n1 * n2);
+	const auto& props = properties();
+	if (!props.enableOcclusionCulling || props.occlusionCulling != OcclusionCulling::Hzb || !m_hzbSaveOccludersShader) return;
+
+	HzbState& state = m_hzbStates[&camera];
+	if (!state.occluders) {
+		state.occluders = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		state.occluders->addBlock<GLuint>(std::max(m_elementCount, static_cast<GLuint>(1)));
+		state.occluders->alloc(0);
+		state.occluders->finalize();
+
+		state.drawCommand = std::make_unique<GlBuffer>(GL_DRAW_INDIRECT_BUFFER);
+		state.drawCommand->addBlock<DrawArraysIndirectCommand>(1);
+		state.drawCommand->alloc(0);
+		state.drawCommand->finalize();
+	}
+
+	const ShaderProgram& shader = *m_hzbSaveOccludersShader;
+	m_countersSsbo->bindSsbo(0);
+	m_elementBuffer->bindSsbo(1);
+	state.occluders->bindSsbo(2);
+	state.drawCommand->bindSsbo(3);
+	shader.use();
+	// Must match local_size_x in grain/hzb-save-occluders.comp.glsl
+	constexpr GLuint localSize = 128;
+	glDispatchCompute((m_elementCount + localSize - 1) / localSize, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	state.hasOccluders = true;
+}
+
+void PointCloudSplitter::bindOcclusionCulling(const ShaderProgram& shader, std::shared_ptr<Framebuffer> occlusionCullingFbo) const
+{
+	if (!properties().enableOcclusionCulling || !occlusionCullingFbo) return;
+	switch (properties().occlusionCulling) {
+	case OcclusionCulling::PointSplat:
+		glBindTextureUnit(0, occlusionCullingFbo->colorTexture(0));
+		shader.setUniform("uOcclusionMap", 0);
+		break;
+	case OcclusionCulling::Hzb:
+		glBindTextureUnit(1, occlusionCullingFbo->depthTexture());
+		shader.setUniform("uHzb", 1);
+		break;
 	}
+}
+
+void PointCloudSplitter::exposeBatchedView(size_t v)
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	GLsizeiptr countersSize = static_cast<GLsizeiptr>(m_counters.size() * sizeof(Counter));
+	glCopyNamedBufferSubData(m_batch.countersSsbo->name(), m_countersSsbo->name(), static_cast<GLintptr>(v) * countersSize, 0, countersSize);
+	m_elementBuffer = m_batch.elementBuffer;
+	m_elementBufferSize = static_cast<GLuint>(2 * m_batch.capacity * m_elementCount);
 
-	int i1 = static_cast<int>(renderType);
-	int i2 = static_cast<int>(step);
-	int index = i1 + n1 * i2;
+	writeDrawCommands();
+}
 
-	if (!m_shaders[index]) {
-		// Lazy loading of shader variants
-		std::string variantName = m_shaderName + "_RenderType" + std::to_string(i1) + "_Step" + std::to_string(i2);
+void PointCloudSplitter::checkBatchedView(const IPointCloudData& pointData, size_t v)
+{
+	const PreRenderView& view = m_batch.views[v];
 
-		std::vector<std::string> defines;
-		defines.push_back(std::string(magic_enum::enum_name(renderType)));
-		defines.push_back(std::string(magic_enum::enum_name(step)));
+	// The occlusion map of the batch lives in an extra framebuffer of the
+	// camera, which may have been overwritten since then (e.g. by the splitter
+	// of another object), so it is rendered again. Batched views do not use
+	// chunk culling either.
+	std::shared_ptr<Framebuffer> occlusionCullingFbo = renderOcclusionCulling(pointData, *view.camera);
+	splitPrefixSum(pointData, *view.camera, occlusionCullingFbo, false);
+	std::vector<std::vector<GLuint>> expected = readModelElements(false);
 
-		std::map<std::string, std::string> snippets;
-		snippets["settings"] = "#define LOCAL_SIZE_X " + std::to_string(m_local_size_x);
+	exposeBatchedView(v);
+	std::vector<std::vector<GLuint>> actual = readModelElements(m_drawCommandsShader != nullptr);
 
-		DEBUG_LOG << "loading variant " << variantName;
-		ShaderPool::AddShaderVariant(variantName, m_shaderName, defines);
-		m_shaders[index] = ShaderPool::GetShader(variantName);
+	for (RenderModel model : { RenderModel::Instance, RenderModel::Impostor, RenderModel::Point }) {
+		int i = static_cast<int>(model);
+		if (actual[i] != expected[i]) {
+			WARN_LOG
+				<< "Batched view #" << v << " (" << magic_enum::enum_name(view.target) << ") "
+				<< "differs from its own split for model " << magic_enum::enum_name(model) << ": "
+				<< actual[i].size() << " elements instead of " << expected[i].size();
+		}
+	}
+}
+
+std::vector<std::vector<GLuint>> PointCloudSplitter::readModelElements(bool fromDrawCommands) const
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	std::vector<Counter> counters(m_counters.size());
+	glGetNamedBufferSubData(m_countersSsbo->name(), 0, static_cast<GLsizeiptr>(counters.size() * sizeof(Counter)), counters.data());
+	if (fromDrawCommands) {
+		std::vector<DrawArraysIndirectCommand> commands(2 * m_counters.size());
+		glGetNamedBufferSubData(m_drawCommandBuffer->name(), 0, static_cast<GLsizeiptr>(commands.size() * sizeof(DrawArraysIndirectCommand)), commands.data());
+		for (size_t i = 0; i < counters.size(); ++i) {
+			counters[i].count = commands[2 * i + 1].instanceCount;
+			counters[i].offset = commands[2 * i + 1].baseInstance;
+		}
+	}
+
+	std::vector<std::vector<GLuint>> elements(counters.size());
+	for (size_t i = 0; i < counters.size(); ++i) {
+		if (i == static_cast<size_t>(RenderModel::None)) continue; // not written
+		if (static_cast<size_t>(counters[i].offset) + counters[i].count > m_elementBufferSize) {
+			ERR_LOG << "Range of model #" << i << " overflows the element buffer";
+			continue;
+		}
+		elements[i].resize(counters[i].count);
+		GLintptr offset = static_cast<GLintptr>(counters[i].offset * sizeof(GLuint));
+		GLsizeiptr size = static_cast<GLsizeiptr>(counters[i].count * sizeof(GLuint));
+		glGetNamedBufferSubData(m_elementBuffer->name(), offset, size, elements[i].data());
+		std::sort(elements[i].begin(), elements[i].end());
+	}
+	return elements;
+}
+
+void PointCloudSplitter::writeDrawCommands()
+{
+	if (m_drawCommandsShader) {
+		const ShaderProgram& shader = *m_drawCommandsShader;
+		shader.setUniform("uRenderModelCount", static_cast<GLuint>(m_counters.size()));
+		m_countersSsbo->bindSsbo(0);
+		m_drawCommandBuffer->bindSsbo(1);
+		shader.use();
+		glDispatchCompute(1, 1, 1);
+	}
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// If all readback buffers are in flight, the oldest one is dropped
+	CountersReadback& readback = m_countersReadbacks[m_nextCountersReadback];
+	m_nextCountersReadback = (m_nextCountersReadback + 1) % s_countersReadbackCount;
+	if (readback.fence) {
+		glDeleteSync(readback.fence);
+	}
+	GLsizeiptr size = static_cast<GLsizeiptr>(m_counters.size() * sizeof(Counter));
+	glCopyNamedBufferSubData(m_countersSsbo->name(), readback.buffer->name(), 0, 0, size);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.statFrame = m_statFrame++;
+}
+
+void PointCloudSplitter::collectCounters(bool wait)
+{
+	// Oldest first, so that m_counters ends up with the most recent ones
+	for (int k = 0; k < s_countersReadbackCount; ++k) {
+		CountersReadback& readback = m_countersReadbacks[(m_nextCountersReadback + k) % s_countersReadbackCount];
+		if (!readback.fence) continue;
+
+		GLenum status;
+		if (wait) {
+			constexpr GLuint64 timeout = 1000000000; // 1s
+			do {
+				status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+		else {
+			status = glClientWaitSync(readback.fence, 0, 0);
+		}
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+
+		glDeleteSync(readback.fence);
+		readback.fence = nullptr;
+		readback.buffer->exportBlock(0, m_counters);
+		writeStats(readback.statFrame);
 	}
-	return m_shaders[index];
 }
 
 void PointCloudSplitter::initStats()
@@ -326,15 +1092,13 @@ void PointCloudSplitter::initStats()
 	m_statFrame = 0;
 }
 
-void PointCloudSplitter::writeStats()
+void PointCloudSplitter::writeStats(int frame)
 {
 	if (!m_outputStatsFile.is_open()) return;
-	m_outputStatsFile << m_statFrame << ";";
+	m_outputStatsFile << frame << ";";
 
 	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::Instance)].count << ";";
 	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::Impostor)].count << ";";
 	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::Point)].count << ";";
 	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::None)].count << "\n";
-
-	++m_statFrame;
 }
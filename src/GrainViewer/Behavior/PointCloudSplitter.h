@@ -34,18 +34,23 @@
 #include "Behavior.h"
 #include "GlBuffer.h"
 #include "IPointCloudData.h"
+#include "ShaderVariantTable.h"
 #include "utils/ReflectionAttributes.h"
+#include "utils/behaviorutils.h"
+#include "utils/discriminate.glsl.h"
 
 #include <refl.hpp>
 
 #include <fstream>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 class ShaderProgram;
 class PointCloudView;
 class TransformBehavior;
 class GrainBehavior;
+class Framebuffer;
 
 /**
  * The Point Cloud Splitter behavior uses the preRender pass to split
@@ -58,7 +63,10 @@ public:
 	bool deserialize(const rapidjson::Value & json) override;
 	void start() override;
 	void update(float time, int frame) override;
+	void precompileShaders() override;
+	void onPreRenderViews(const std::vector<PreRenderView>& views, const World& world) override;
 	void onPreRender(const Camera& camera, const World& world, RenderType target) override;
+	void onDestroy() override;
 
 public:
 	enum class RenderTypeCaching {
@@ -66,23 +74,51 @@ public:
 		Cache, // Faster, but by max 1%...
 		Precompute, // Not recommended
 	};
+	enum class SplittingAlgorithm {
+		GlobalAtomic, // count, offset and write passes, using global atomic counters
+		PrefixSum, // single pass, using a decoupled look-back scan
+		Incremental, // only classify again chunks that changed since the previous frame (requires point chunks)
+	};
+	enum class LodMode {
+		Distance, // models are chosen from the distance of grains to the camera (instanceLimit, impostorLimit)
+		ScreenSize, // models are chosen from the radius of grains on screen, in pixels (instancePixelRadius, impostorPixelRadius)
+	};
+	enum class OcclusionCulling {
+		PointSplat, // splat all grains into an occlusion map, then test each grain against the grain in front of it
+		Hzb, // test chunks and grains against a max depth pyramid of the grains that were close enough to be occluders at the previous frame
+	};
 	struct Properties {
-		RenderTypeCaching renderTypeCaching = RenderTypeCaching::Cache;
+		SplittingAlgorithm algorithm = SplittingAlgorithm::GlobalAtomic;
+		bool batchViews = false; // classify grains against all the views of a frame in a single pass, instead of using algorithm and chunk culling (except with Incremental)
+		bool checkBatchedViews = false; // debug, split each batched view alone again and warn if renderers would not get the same grains (slow)
+		RenderTypeCaching renderTypeCaching = RenderTypeCaching::Cache; // GlobalAtomic only
 		bool enableOcclusionCulling = true;
+		OcclusionCulling occlusionCulling = OcclusionCulling::PointSplat;
+		float hzbResolutionScale = 0.5f; // resolution of the occluder depth buffer relative to the camera
 		bool enableFrustumCulling = true;
+		bool enableChunkCulling = true; // cull whole chunks of points before testing individual grains
+		LodMode lodMode = LodMode::Distance;
 		float instanceLimit = 1.05f; // distance beyond which we switch from instances to impostors
 		float impostorLimit = 10.0f;
+		float instancePixelRadius = 8.0f; // radius on screen below which we switch from instances to impostors
+		float impostorPixelRadius = 1.5f; // radius on screen below which we switch from impostors to points
+		bool enableFrameTimeBudget = false; // ScreenSize only, scale pixel radii to hold targetFrameTime
+		float targetFrameTime = 16.0f; // GPU time of a frame, in milliseconds
 		bool zPrepass = true; // for occluder map
 		bool useBbox = false; // if true, remove all points out of the supplied bounding box
 		glm::vec3 bboxMin;
 		glm::vec3 bboxMax;
 		float occluderMapSpriteScale = 0.2f;
+		float incrementalTolerance = 0.5f; // motion on screen, in pixels, below which Incremental keeps the classification of a chunk
+
+		PROPERTIES_OPERATORS_DECL
 	};
+	// Values are shared with the shaders through the CPU port of discriminate()
 	enum class RenderModel {
-		Instance = 0,
-		Impostor,
-		Point,
-		None,
+		Instance = glsl::cRenderModelInstance,
+		Impostor = glsl::cRenderModelImpostor,
+		Point = glsl::cRenderModelPoint,
+		None = glsl::cRenderModelNone,
 	};
 
 	Properties & properties() { return m_properties; }
@@ -92,6 +128,7 @@ public:
 		GLuint count = 0;
 		GLuint offset = 0;
 	};
+	// Read back asynchronously, so they may lag a few frames behind what is drawn
 	const std::vector<Counter> counters() const { return m_counters; }
 
 	// Return a point buffer for a given model
@@ -102,9 +139,43 @@ public:
 	const GlBuffer& vbo(RenderModel model) const;
 	std::shared_ptr<GlBuffer> ebo(RenderModel model) const;
 	GLint pointOffset(RenderModel model) const;
+	const GlBuffer* chunkBuffer(RenderModel model) const;
+	GLuint chunkSize(RenderModel model) const;
+	bool isQuantized(RenderModel model) const;
+	const GlBuffer* drawCommandBuffer(RenderModel model) const;
+	GLintptr drawCommandOffset(RenderModel model) const;
+	GLintptr instancedDrawCommandOffset(RenderModel model) const;
+
+	// Factor applied to pixel radii by the frame time budget
+	float lodScale() const { return m_lodScale; }
+	// Number of views split together at the last frame, 0 if they were split
+	// one by one. Batched views ignore the algorithm and chunk culling.
+	size_t batchedViewCount() const { return m_batch.views.size(); }
 
 private:
 	glm::mat4 modelMatrix() const;
+
+	/**
+	 * The algorithm property, unless it cannot be used with this point data,
+	 * in which case a warning is issued (once) and GlobalAtomic is returned.
+	 * The property itself is left untouched.
+	 */
+	SplittingAlgorithm splittingAlgorithm();
+
+	/**
+	 * View space distances beyond which grains switch from instances to
+	 * impostors (x) and from impostors to points (y) for a given camera. In
+	 * ScreenSize mode, these are the distances at which a grain on the view
+	 * axis has the pixel radii of the properties, measured as in
+	 * Camera::projectSphere(). Like discriminate(), limits measure distances
+	 * in homogeneous coordinates, i.e. sqrt(d^2 + 1).
+	 */
+	glm::vec2 lodDistanceLimits(const Camera& camera) const;
+
+	/**
+	 * Adapt m_lodScale to the GPU time of the last measured frame.
+	 */
+	void updateFrameTimeBudget();
 	void setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const;
 
 	// These must match defines in the shader (magic_enum reflexion is used to set defines)
@@ -121,38 +192,241 @@ private:
 		STEP_OFFSET,
 		STEP_WRITE,
 	};
-	typedef int ShaderVariantFlagSet;
-	std::shared_ptr<ShaderProgram> getShader(RenderTypeCaching renderType, int step) const; // for convenience
-	std::shared_ptr<ShaderProgram> getShader(RenderTypeShaderVariant renderType, StepShaderVariant step) const;
+	enum class ShaderOption {
+		CHUNK_CULLING,
+	};
+	typedef ShaderVariantFlags<ShaderOption> ShaderOptionSet;
+	static ShaderOptionSet shaderOptions(bool chunkCulling);
+
+	/**
+	 * (Re)allocate the element buffer if it is smaller than elementCount.
+	 * GlobalAtomic needs one element per point and PrefixSum two, because
+	 * it writes models in separate streams before knowing their sizes.
+	 */
+	void reserveElementBuffer(GLuint elementCount);
+
+	// Splitting algorithms, called by onPreRender() once the occlusion map is ready
+	void splitGlobalAtomic(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo, bool useChunkCulling);
+	void splitPrefixSum(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo, bool useChunkCulling);
+	void splitIncremental(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo);
+
+	enum class IncrementalStepShaderVariant {
+		STEP_CHUNKS,
+		STEP_CLASSIFY,
+		STEP_SCAN,
+		STEP_GATHER,
+	};
+
+	// Must match chunkCullingSsbo in grain/cull-chunks.comp.glsl
+	struct ChunkCullingHeader {
+		GLuint dispatchGroupCount[3]; // indirect dispatch command of per grain steps
+		GLuint visibleChunkCount;
+	};
+	// Must match local_size_x in grain/cull-chunks.comp.glsl
+	static constexpr GLuint s_chunkCullingLocalSize = 64;
+
+	/**
+	 * Test the bounding boxes of the chunks of the current frame and list
+	 * visible ones in m_chunkCullingSsbo, together with the indirect dispatch
+	 * command of per grain steps.
+	 */
+	void cullChunks(const IPointCloudData& pointData, const Camera& camera, std::shared_ptr<Framebuffer> occlusionCullingFbo) const;
+
+	/**
+	 * Render the occlusion map or depth pyramid of the camera, depending on
+	 * the occlusion culling mode. Return null if occlusion culling is off.
+	 */
+	std::shared_ptr<Framebuffer> renderOcclusionCulling(const IPointCloudData& pointData, const Camera& camera);
+
+	/**
+	 * Draw the grains that the previous split of this camera sent to Instance
+	 * and Impostor models into a depth buffer of the camera, then turn it
+	 * into a max depth pyramid, used by Hzb occlusion culling. Return its
+	 * framebuffer.
+	 */
+	std::shared_ptr<Framebuffer> renderHzb(const IPointCloudData& pointData, const Camera& camera);
+
+	/**
+	 * Copy the Instance and Impostor elements of the split that was just
+	 * exposed, to be drawn as occluders by the next renderHzb() of the camera.
+	 */
+	void saveHzbOccluders(const Camera& camera);
+
+	/**
+	 * Expose the result of view v of the last batch as the output of the
+	 * splitter.
+	 */
+	void exposeBatchedView(size_t v);
+
+	/**
+	 * Split view v of the last batch alone with PrefixSum, then expose its
+	 * batched result and warn about any difference between the two.
+	 */
+	void checkBatchedView(const IPointCloudData& pointData, size_t v);
+
+	/**
+	 * Read back the sorted elements of each model, at the ranges given either
+	 * by counters or by the instanced draw commands used by renderers.
+	 */
+	std::vector<std::vector<GLuint>> readModelElements(bool fromDrawCommands) const;
+
+	/**
+	 * Bind the occlusion map or depth pyramid, depending on the occlusion
+	 * culling mode, for the splitting shaders.
+	 */
+	void bindOcclusionCulling(const ShaderProgram& shader, std::shared_ptr<Framebuffer> occlusionCullingFbo) const;
+
+	/**
+	 * Write the indirect draw commands of each model from the counters,
+	 * then start copying counters to a readback buffer.
+	 */
+	void writeDrawCommands();
+
+	/**
+	 * Update m_counters from readbacks that are over. If wait is true, block
+	 * until all of them are.
+	 */
+	void collectCounters(bool wait);
 
 	void initStats();
-	void writeStats();
+	void writeStats(int frame);
 
 private:
 	Properties m_properties;
 
 	std::string m_shaderName = "GlobalAtomic";
 	std::string m_occlusionCullingShaderName = "OcclusionCulling";
-	mutable std::vector<std::shared_ptr<ShaderProgram>> m_shaders; // mutable for lazy loading, do NOT use this directly, rather use getShader()
+	std::string m_chunkCullingShaderName = "GrainSplitChunkCulling";
+	std::string m_prefixSumShaderName = "PrefixSumSplitter";
+	std::string m_drawCommandsShaderName = "GrainSplitDrawCommands";
+	std::string m_incrementalShaderName = "IncrementalSplitter";
+	std::string m_hzbOccludersShaderName = "GrainSplitHzbOccluders";
+	std::string m_hzbSaveOccludersShaderName = "GrainSplitHzbSaveOccluders";
+	std::string m_multiViewShaderName = "MultiViewSplitter";
+	// Variants of the splitting shaders, all sharing the LOCAL_SIZE_X setting
+	ShaderVariantTable<RenderTypeShaderVariant, StepShaderVariant, ShaderOptionSet> m_shaders;
+	ShaderVariantTable<ShaderOptionSet> m_prefixSumShaders;
+	ShaderVariantTable<IncrementalStepShaderVariant> m_incrementalShaders;
+	ShaderVariantTable<> m_multiViewShaders;
 	std::shared_ptr<ShaderProgram> m_occlusionCullingShader;
+	std::shared_ptr<ShaderProgram> m_chunkCullingShader;
+	std::shared_ptr<ShaderProgram> m_drawCommandsShader;
+	std::shared_ptr<ShaderProgram> m_hzbOccludersShader;
+	std::shared_ptr<ShaderProgram> m_hzbSaveOccludersShader;
 
 	std::weak_ptr<TransformBehavior> m_transform;
 	std::weak_ptr<GrainBehavior> m_grain;
 	std::weak_ptr<IPointCloudData> m_pointData;
 
 	std::shared_ptr<GlBuffer> m_elementBuffer; // must be shared because exposed through IPointCloudData interface
+	GLuint m_elementBufferSize = 0;
 	mutable std::unique_ptr<GlBuffer> m_renderTypeCache; // lazily allocated
 
 	std::vector<Counter> m_counters;
 	std::unique_ptr<GlBuffer> m_countersSsbo;
 
+	// Must match grain/splitter-draw-commands.comp.glsl
+	struct DrawArraysIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+	// Two commands per model, see IPointCloudData::drawCommandBuffer()
+	std::unique_ptr<GlBuffer> m_drawCommandBuffer;
+
+	// Hzb occlusion culling state of a camera, lazily allocated. There is one
+	// per camera because all cameras of a frame may be split at once, and
+	// occluders must come from the previous split of the same camera.
+	struct HzbState {
+		std::shared_ptr<Framebuffer> framebuffer; // occluder depth pyramid
+		std::unique_ptr<GlBuffer> occluders; // Instance then Impostor elements, m_elementCount at most
+		std::unique_ptr<GlBuffer> drawCommand; // DrawArraysIndirectCommand drawing all occluders
+		bool hasOccluders = false; // false until the first split of the camera
+	};
+	std::unordered_map<const Camera*, HzbState> m_hzbStates;
+
+	// Ring of buffers to which counters are copied, so that they can be read
+	// once the GPU is done with them rather than stalling the CPU.
+	struct CountersReadback {
+		std::unique_ptr<GlBuffer> buffer;
+		GLsync fence = nullptr;
+		int statFrame;
+	};
+	static constexpr int s_countersReadbackCount = 3;
+	std::vector<CountersReadback> m_countersReadbacks;
+	int m_nextCountersReadback = 0;
+
+	// Work group ticket followed by the look-back descriptors of PrefixSum,
+	// lazily allocated.
+	std::unique_ptr<GlBuffer> m_scanSsbo;
+
+	// Chunk culling header followed by the list of visible chunks,
+	// null if point data has no chunks.
+	std::unique_ptr<GlBuffer> m_chunkCullingSsbo;
+	GLuint m_maxChunkCount = 0; // max number of chunks overlapping a frame
+	GLuint m_groupsPerChunk = 0; // work groups needed by per grain steps to cover a chunk
+
+	// Must match incrementalSsbo in grain/incremental-splitter.comp.glsl
+	struct IncrementalHeader {
+		GLuint classifyDispatch[4]; // indirect dispatch commands, padded to 16 bytes
+		GLuint scanDispatch[4];
+		GLuint gatherDispatch[4];
+	};
+	struct IncrementalChunkState {
+		glm::vec4 screen;
+		GLuint chunk;
+		GLuint signature;
+		GLuint _pad[2];
+		GLuint counts[4];
+		GLuint offsets[4];
+	};
+	// Classification kept from one frame to the next by Incremental. There is
+	// one per camera, like HzbState, so that several viewports or shadow
+	// casting lights do not keep invalidating each other's classification.
+	struct IncrementalState {
+		std::unique_ptr<GlBuffer> stateSsbo; // IncrementalHeader followed by one IncrementalChunkState per slot
+		std::unique_ptr<GlBuffer> dirtyChunksSsbo;
+		std::unique_ptr<GlBuffer> chunkElementsSsbo;
+		std::unique_ptr<GlBuffer> countersSsbo;
+		std::shared_ptr<GlBuffer> elementBuffer;
+		bool isValid = false; // if false, all chunks must be classified again
+		Properties properties; // when last split
+		float grainRadius = 0;
+		float grainInnerRadiusRatio = 0;
+		glm::vec2 lodLimits = glm::vec2(0);
+		bool hasHzbOccluders = false; // whether the Hzb of the camera had occluders
+	};
+	std::unordered_map<const Camera*, IncrementalState> m_incrementalStates; // lazily allocated
+
+	// Must match MAX_VIEWS in grain/multiview-splitter.comp.glsl
+	static constexpr size_t s_maxBatchedViews = 4;
+	// Views split together by onPreRenderViews(), whose results are exposed
+	// by onPreRender() when it is called for one of them. Buffers are lazily
+	// allocated and only grow.
+	struct ViewBatch {
+		std::vector<PreRenderView> views; // empty if the views of the frame are split one by one
+		std::unique_ptr<GlBuffer> countersSsbo; // one Counter per model and view
+		std::unique_ptr<GlBuffer> scanSsbo; // work group ticket followed by look-back descriptors
+		std::shared_ptr<GlBuffer> elementBuffer; // 2 * m_elementCount elements per view, laid out as in PrefixSum
+		size_t capacity = 0; // number of views buffers can hold
+	};
+	ViewBatch m_batch;
+
 	// Output subclouds
 	std::vector<std::shared_ptr<PointCloudView>> m_subClouds;
 
 	GLuint m_elementCount;
+	// Frame time budget
+	float m_lodScale = 1.0f;
+	int m_lastBudgetSample = 0; // frame sample count of the global timer when m_lodScale was last updated
+
+	// Work group size of splitting shaders, set through the "settings" snippet
 	int m_local_size_x = 128;
 	int m_xWorkGroups;
 	float m_time;
+	bool m_hasWarnedIncrementalFallback = false;
+	bool m_hasLoggedBatchOverride = false;
 
 	// stats
 	std::string m_outputStats;
@@ -162,16 +436,28 @@ private:
 
 #define _ ReflectionAttributes::
 REFL_TYPE(PointCloudSplitter::Properties)
+REFL_FIELD(algorithm)
+REFL_FIELD(batchViews)
+REFL_FIELD(checkBatchedViews)
 REFL_FIELD(renderTypeCaching, _ HideInDialog())
 REFL_FIELD(enableOcclusionCulling)
+REFL_FIELD(occlusionCulling)
+REFL_FIELD(hzbResolutionScale, _ Range(0.125f, 1.0f))
 REFL_FIELD(enableFrustumCulling)
+REFL_FIELD(enableChunkCulling)
+REFL_FIELD(lodMode)
 REFL_FIELD(instanceLimit, _ Range(0.01f, 3.0f))
 REFL_FIELD(impostorLimit, _ Range(0.01f, 20.0f))
+REFL_FIELD(instancePixelRadius, _ Range(0.5f, 64.0f))
+REFL_FIELD(impostorPixelRadius, _ Range(0.1f, 16.0f))
+REFL_FIELD(enableFrameTimeBudget)
+REFL_FIELD(targetFrameTime, _ Range(1.0f, 100.0f))
 REFL_FIELD(zPrepass)
 REFL_FIELD(useBbox)
 REFL_FIELD(bboxMin, _ Range(-1, 1))
 REFL_FIELD(bboxMax, _ Range(-1, 1))
 REFL_FIELD(occluderMapSpriteScale)
+REFL_FIELD(incrementalTolerance, _ Range(0.0f, 8.0f))
 REFL_END
 #undef _
 
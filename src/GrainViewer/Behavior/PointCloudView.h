@@ -49,6 +49,12 @@ public:
 	const GlBuffer& vbo() const override { return m_splitter.vbo(m_model); }
 	std::shared_ptr<GlBuffer> ebo() const override { return m_splitter.ebo(m_model); }
 	GLint pointOffset() const override { return m_splitter.pointOffset(m_model); }
+	const GlBuffer* chunkBuffer() const override { return m_splitter.chunkBuffer(m_model); }
+	GLuint chunkSize() const override { return m_splitter.chunkSize(m_model); }
+	bool isQuantized() const override { return m_splitter.isQuantized(m_model); }
+	const GlBuffer* drawCommandBuffer() const override { return m_splitter.drawCommandBuffer(m_model); }
+	GLintptr drawCommandOffset() const override { return m_splitter.drawCommandOffset(m_model); }
+	GLintptr instancedDrawCommandOffset() const override { return m_splitter.instancedDrawCommandOffset(m_model); }
 
 private:
 	const PointCloudSplitter& m_splitter;
@@ -0,0 +1,290 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "QualityGovernor.h"
+#include "FarGrainRenderer.h"
+#include "ImpostorGrainRenderer.h"
+#include "InstanceGrainRenderer.h"
+#include "PointCloudSplitter.h"
+#include "GlobalTimer.h"
+#include "World.h"
+#include "Light.h"
+#include "ShadowMap.h"
+
+#include "utils/jsonutils.h"
+#include "utils/behaviorutils.h"
+#include "Logger.h"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+
+// Used when no "knobs" are given, from cheapest to most visible trade-off
+static const char* s_defaultKnobs = R"([
+	{ "behavior": "ImpostorGrainRenderer", "property": "interpolationMode", "levels": ["None"] },
+	{ "behavior": "FarGrainRenderer", "property": "epsilonFactor", "levels": [5.0, 2.0] },
+	{ "behavior": "ImpostorGrainRenderer", "property": "prerenderSurface", "levels": [false] },
+	{ "behavior": "World", "property": "shadowMapSize", "levels": [1024, 512] },
+	{ "behavior": "FarGrainRenderer", "property": "useShellCulling", "levels": [false] }
+])";
+
+///////////////////////////////////////////////////////////////////////////////
+// Behavior implementation
+///////////////////////////////////////////////////////////////////////////////
+
+bool QualityGovernor::deserialize(const rapidjson::Value& json)
+{
+	autoDeserialize(json, m_properties);
+	jrArray(json, "timers", m_timers);
+
+	// Knobs refer to sibling behaviors, which may not be deserialized yet
+	if (json.HasMember("knobs")) {
+		if (!json["knobs"].IsArray()) {
+			ERR_LOG << "Field 'knobs' of QualityGovernor must be an array";
+			return false;
+		}
+		m_knobsJson.CopyFrom(json["knobs"], m_knobsJson.GetAllocator());
+	} else {
+		m_knobsJson.Parse(s_defaultKnobs);
+	}
+
+	return true;
+}
+
+void QualityGovernor::start()
+{
+	m_knobs.clear();
+	for (const auto& knob : m_knobsJson.GetArray()) {
+		addKnob(knob);
+	}
+	m_knobsJson.SetNull();
+	m_step = 0;
+	m_cooldown = 0;
+	m_smoothedGpuTime = 0.0f;
+}
+
+void QualityGovernor::onPreRenderViews(const std::vector<PreRenderView>& views, const World& world)
+{
+	// React once per completed frame
+	const GlobalTimer::Stats& frameStats = GlobalTimer::GetInstance()->frameStats();
+	if (frameStats.sampleCount == m_lastSample) return;
+	m_lastSample = frameStats.sampleCount;
+
+	// Timers may run several times per frame (once per view, shadow map or
+	// object), and keep their last time once they stop running (e.g. shadow
+	// maps turned off, or a renderer disabled by a knob), so only sum the
+	// samples of the last frame.
+	const auto& stats = GlobalTimer::GetInstance()->stats();
+	auto frameGpuTime = [&](const std::string& name) {
+		auto it = stats.find(name);
+		return it == stats.end() ? 0.0 : it->second.frameGpuTime;
+	};
+	double gpuTime = 0.0;
+	for (const auto& name : m_timers) {
+		gpuTime += frameGpuTime(name) + frameGpuTime(name + "_shadowmap");
+	}
+	if (gpuTime <= 0.0) return;
+
+	const Properties& props = properties();
+	float sample = static_cast<float>(gpuTime);
+	m_smoothedGpuTime = m_smoothedGpuTime > 0.0f ? glm::mix(m_smoothedGpuTime, sample, props.smoothing) : sample;
+
+	// Let timers and the smoothed time reflect the previous change first
+	if (m_cooldown > 0) {
+		--m_cooldown;
+		return;
+	}
+
+	// Steps that change nothing (e.g. shadow map sizes in a scene without
+	// lights) are skipped rather than waiting for a cooldown
+	if (m_smoothedGpuTime > props.targetGpuTime * (1.0f + props.hysteresis)) {
+		while (m_step < stepCount() && !setStep(m_step + 1, world)) {}
+	} else if (m_smoothedGpuTime < props.targetGpuTime * (1.0f - props.hysteresis)) {
+		while (m_step > 0 && !setStep(m_step - 1, world)) {}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Public methods
+///////////////////////////////////////////////////////////////////////////////
+
+int QualityGovernor::stepCount() const
+{
+	int count = 0;
+	for (const auto& knob : m_knobs) {
+		count += knob.levelCount - 1;
+	}
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Private methods
+///////////////////////////////////////////////////////////////////////////////
+
+bool QualityGovernor::addKnob(const rapidjson::Value& json)
+{
+	std::string behavior, property;
+	if (!json.IsObject() || !jrOption(json, "behavior", behavior) || !jrOption(json, "property", property)) {
+		ERR_LOG << "QualityGovernor knobs must have string fields 'behavior' and 'property'";
+		return false;
+	}
+	if (!json.HasMember("levels") || !json["levels"].IsArray() || json["levels"].Empty()) {
+		ERR_LOG << "QualityGovernor knob " << behavior << "." << property << " must have a non empty array of 'levels'";
+		return false;
+	}
+	const rapidjson::Value& levels = json["levels"];
+
+	if (behavior == "World" && property == "shadowMapSize") {
+		return addShadowMapKnob(levels);
+	}
+	if (behavior == BehaviorRegistryEntry<FarGrainRenderer>::Name()) {
+		return addPropertyKnob<FarGrainRenderer>(property, levels);
+	}
+	if (behavior == BehaviorRegistryEntry<ImpostorGrainRenderer>::Name()) {
+		return addPropertyKnob<ImpostorGrainRenderer>(property, levels);
+	}
+	if (behavior == BehaviorRegistryEntry<InstanceGrainRenderer>::Name()) {
+		return addPropertyKnob<InstanceGrainRenderer>(property, levels);
+	}
+	if (behavior == BehaviorRegistryEntry<PointCloudSplitter>::Name()) {
+		return addPropertyKnob<PointCloudSplitter>(property, levels);
+	}
+	ERR_LOG << "Unsupported behavior for QualityGovernor knob: " << behavior;
+	return false;
+}
+
+template <typename T>
+bool QualityGovernor::addPropertyKnob(const std::string& property, const rapidjson::Value& levels)
+{
+	std::string name = std::string(BehaviorRegistryEntry<T>::Name()) + "." + property;
+	auto behavior = getComponent<T>().lock();
+	if (!behavior) {
+		WARN_LOG << "Ignoring QualityGovernor knob " << name << " (no such behavior on this object)";
+		return false;
+	}
+	if (!hasProperty(behavior->properties(), property)) {
+		ERR_LOG << "Ignoring QualityGovernor knob " << name << " (no such property)";
+		return false;
+	}
+
+	// Level 0 restores the value the property had at start, other levels are
+	// stored as {property: value} objects to be loaded by autoDeserialize()
+	auto levelsJson = std::make_shared<rapidjson::Document>();
+	auto& allocator = levelsJson->GetAllocator();
+	levelsJson->SetArray();
+	for (const auto& level : levels.GetArray()) {
+		rapidjson::Value key(property.c_str(), allocator);
+		rapidjson::Value value(level, allocator);
+		rapidjson::Value obj(rapidjson::kObjectType);
+		obj.AddMember(key, value, allocator);
+		levelsJson->PushBack(obj, allocator);
+	}
+
+	Knob knob;
+	knob.name = name;
+	knob.levelCount = 1 + static_cast<int>(levels.Size());
+	std::weak_ptr<T> weakBehavior = behavior;
+	typename T::Properties original = behavior->properties();
+	knob.apply = [weakBehavior, original, levelsJson, property](int level, const World&) {
+		auto behavior = weakBehavior.lock();
+		if (!behavior) return false;
+		typename T::Properties previous = behavior->properties();
+		if (level == 0) {
+			copyProperty(original, behavior->properties(), property);
+		} else {
+			autoDeserialize((*levelsJson)[static_cast<rapidjson::SizeType>(level - 1)], behavior->properties());
+		}
+		return !isPropertyEqual(previous, behavior->properties(), property);
+	};
+	m_knobs.push_back(knob);
+	return true;
+}
+
+bool QualityGovernor::addShadowMapKnob(const rapidjson::Value& levels)
+{
+	std::vector<int> sizes;
+	for (const auto& level : levels.GetArray()) {
+		if (!level.IsInt() || level.GetInt() <= 0) {
+			ERR_LOG << "Ignoring QualityGovernor knob World.shadowMapSize (levels must be positive integers)";
+			return false;
+		}
+		sizes.push_back(level.GetInt());
+	}
+
+	// Lights are owned by the World, which is only known at render time, so
+	// their original sizes are recorded when first degrading them.
+	auto originalSizes = std::make_shared<std::vector<int>>();
+
+	Knob knob;
+	knob.name = "World.shadowMapSize";
+	knob.levelCount = 1 + static_cast<int>(sizes.size());
+	knob.apply = [sizes, originalSizes](int level, const World& world) {
+		const auto& lights = world.lights();
+		if (originalSizes->empty()) {
+			for (const auto& light : lights) {
+				originalSizes->push_back(light->shadowMap().width());
+			}
+		}
+		bool hasChanged = false;
+		for (size_t i = 0; i < lights.size() && i < originalSizes->size(); ++i) {
+			int size = level == 0 ? (*originalSizes)[i] : glm::min(sizes[level - 1], (*originalSizes)[i]);
+			if (lights[i]->shadowMap().width() != size) {
+				lights[i]->shadowMap().setSize(static_cast<size_t>(size));
+				hasChanged = true;
+			}
+		}
+		return hasChanged;
+	};
+	m_knobs.push_back(knob);
+	return true;
+}
+
+bool QualityGovernor::setStep(int step, const World& world)
+{
+	DEBUG_LOG << "QualityGovernor: step " << m_step << " -> " << step << " (GPU time " << m_smoothedGpuTime << " ms)";
+	m_step = step;
+
+	// Knobs are consumed in order: knob k only degrades once knobs before it
+	// reached their last level.
+	bool hasChanged = false;
+	int offset = 0;
+	for (auto& knob : m_knobs) {
+		int level = glm::clamp(step - offset, 0, knob.levelCount - 1);
+		if (level != knob.level) {
+			hasChanged = knob.apply(level, world) || hasChanged;
+			knob.level = level;
+		}
+		offset += knob.levelCount - 1;
+	}
+
+	if (hasChanged) {
+		m_cooldown = properties().cooldownFrames;
+	}
+	return hasChanged;
+}
@@ -0,0 +1,118 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include "Behavior.h"
+#include "utils/ReflectionAttributes.h"
+
+#include <refl.hpp>
+#include <rapidjson/document.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Runtime governor trading rendering quality of the grain behaviors of its
+ * object for speed, in order to hold the GPU time of grain rendering close
+ * to a target. Quality knobs are reflected properties of these behaviors
+ * (or the shadow map size of lights), each one given a list of increasingly
+ * degraded values. Knobs are degraded one step at a time, in the order they
+ * are listed, when over budget, and restored in reverse order when well
+ * under budget.
+ */
+class QualityGovernor : public Behavior {
+public:
+	// Behavior implementation
+	bool deserialize(const rapidjson::Value& json) override;
+	void start() override;
+	void onPreRenderViews(const std::vector<PreRenderView>& views, const World& world) override;
+
+public:
+	// Public properties
+	struct Properties {
+		float targetGpuTime = 12.0f; // in milliseconds, summed over measured timers
+		float hysteresis = 0.15f; // relative margin around the target within which nothing changes
+		int cooldownFrames = 20; // time samples to wait after a change before the next one
+		float smoothing = 0.2f; // weight of the last sample in the smoothed GPU time
+	};
+	Properties& properties() { return m_properties; }
+	const Properties& properties() const { return m_properties; }
+
+	// Number of degradation steps currently applied, out of stepCount()
+	int step() const { return m_step; }
+	int stepCount() const;
+	float smoothedGpuTime() const { return m_smoothedGpuTime; }
+	// Name and current level of a knob, 0 meaning full quality
+	int knobCount() const { return static_cast<int>(m_knobs.size()); }
+	const std::string& knobName(int i) const { return m_knobs[i].name; }
+	int knobLevel(int i) const { return m_knobs[i].level; }
+
+private:
+	struct Knob {
+		std::string name; // "Behavior.property", for display
+		int levelCount = 1; // including level 0, i.e. the original value
+		int level = 0;
+		std::function<bool(int level, const World& world)> apply; // return false if nothing changed
+	};
+
+	bool addKnob(const rapidjson::Value& json);
+	template <typename T>
+	bool addPropertyKnob(const std::string& property, const rapidjson::Value& levels);
+	bool addShadowMapKnob(const rapidjson::Value& levels);
+	// Return false if no knob actually changed, in which case there is no cooldown
+	bool setStep(int step, const World& world);
+
+private:
+	Properties m_properties;
+	std::vector<std::string> m_timers = {
+		"FarGrainRenderer",
+		"ImpostorGrainRenderer",
+		"InstanceGrainRenderer",
+		"PointCloudSplitter",
+		"PointCloudSplitter_batch",
+	};
+	rapidjson::Document m_knobsJson; // kept from deserialize() until start()
+	std::vector<Knob> m_knobs;
+	int m_step = 0;
+	float m_smoothedGpuTime = 0.0f;
+	int m_lastSample = -1;
+	int m_cooldown = 0;
+};
+
+registerBehaviorType(QualityGovernor)
+
+using namespace ReflectionAttributes;
+REFL_TYPE(QualityGovernor::Properties)
+REFL_FIELD(targetGpuTime, Range(1.0f, 50.0f))
+REFL_FIELD(hysteresis, Range(0.0f, 0.5f))
+REFL_FIELD(cooldownFrames, Range(0, 120))
+REFL_FIELD(smoothing, Range(0.01f, 1.0f))
+REFL_END
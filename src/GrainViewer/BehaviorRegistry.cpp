@@ -44,6 +44,7 @@
 #include "Behavior/ImpostorGrainRenderer.h"
 #include "Behavior/GrainBehavior.h"
 #include "Behavior/QuadMeshData.h"
+#include "Behavior/QualityGovernor.h"
 
 #include "Behavior/PointCloudView.h"
 
@@ -62,6 +63,7 @@ void BehaviorRegistry::addBehavior(std::shared_ptr<Behavior> & b, std::shared_pt
 	handleType(ImpostorGrainRenderer);
 	handleType(GrainBehavior);
 	handleType(QuadMeshData);
+	handleType(QualityGovernor);
 }
 
 std::weak_ptr<IPointCloudData> BehaviorRegistry::getPointCloudDataComponent(Behavior& behavior, PointCloudSplitter::RenderModel preferedModel) {
@@ -0,0 +1,174 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "CpuSplitter.h"
+#include "utils/parallel.h"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+
+void CpuSplitter::split(const vec3* points, size_t pointCount, const View& view, const mat4& modelMatrix)
+{
+	const Properties& props = properties();
+
+	glsl::DiscriminateUniforms uniforms;
+	uniforms.viewModelMatrix = view.viewMatrix * modelMatrix;
+	uniforms.projectionMatrix = view.projectionMatrix;
+	uniforms.resolution = vec2(view.resolution);
+	uniforms.enableOcclusionCulling = props.enableOcclusionCulling;
+	uniforms.enableFrustumCulling = props.enableFrustumCulling;
+	uniforms.instanceLimit = props.instanceLimit;
+	uniforms.impostorLimit = props.impostorLimit;
+	uniforms.useBbox = props.useBbox;
+	uniforms.bboxMin = props.bboxMin;
+	uniforms.bboxMax = props.bboxMax;
+
+	m_occlusionMap.clear();
+	if (props.enableOcclusionCulling) {
+		renderOcclusionMap(points, pointCount, uniforms);
+	}
+
+	float innerRadius = props.grainRadius * props.grainInnerRadiusRatio;
+	float outerOverInnerRadius = 1.0f / props.grainInnerRadiusRatio;
+
+	// 1. Discriminate and count models in each range of points
+	typedef std::array<uint32_t, glsl::cRenderModelCount> ModelCounts;
+	size_t rangeCount = std::max<size_t>(1, std::min(workerCount(), pointCount));
+	std::vector<ModelCounts> rangeCounts(rangeCount, ModelCounts{});
+	m_renderModels.resize(pointCount);
+	parallelFor(pointCount, [&](size_t begin, size_t end, size_t range) {
+		ModelCounts& counts = rangeCounts[range];
+		for (size_t i = begin; i < end; ++i) {
+			glm::uint model = glsl::discriminate(uniforms, points[i], props.grainRadius, innerRadius, outerOverInnerRadius, m_occlusionMap);
+			m_renderModels[i] = model;
+			++counts[model];
+		}
+	}, rangeCount);
+
+	// 2. Offsets of models, then of each range within each model
+	m_counters.assign(glsl::cRenderModelCount, Counter{});
+	uint32_t offset = 0;
+	for (size_t m = 0; m < m_counters.size(); ++m) {
+		m_counters[m].offset = offset;
+		for (const ModelCounts& counts : rangeCounts) {
+			m_counters[m].count += counts[m];
+		}
+		offset += m_counters[m].count;
+	}
+	std::vector<ModelCounts> rangeOffsets(rangeCount);
+	for (size_t m = 0; m < m_counters.size(); ++m) {
+		uint32_t rangeOffset = m_counters[m].offset;
+		for (size_t r = 0; r < rangeCount; ++r) {
+			rangeOffsets[r][m] = rangeOffset;
+			rangeOffset += rangeCounts[r][m];
+		}
+	}
+
+	// 3. Compaction
+	m_elements.resize(pointCount);
+	parallelFor(pointCount, [&](size_t begin, size_t end, size_t range) {
+		ModelCounts& offsets = rangeOffsets[range];
+		for (size_t i = begin; i < end; ++i) {
+			m_elements[offsets[m_renderModels[i]]++] = static_cast<uint32_t>(i);
+		}
+	}, rangeCount);
+}
+
+void CpuSplitter::renderOcclusionMap(const vec3* points, size_t pointCount, const glsl::DiscriminateUniforms& uniforms)
+{
+	const Properties& props = properties();
+	int width = static_cast<int>(uniforms.resolution.x);
+	int height = static_cast<int>(uniforms.resolution.y);
+	size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+	float innerRadius = props.grainRadius * props.grainInnerRadiusRatio;
+
+	// Depth test: each pixel keeps the smallest (depth, point index) pair,
+	// packed such that integer order matches, which also makes the result
+	// independent of the order in which threads splat points.
+	constexpr uint64_t emptyPixel = std::numeric_limits<uint64_t>::max();
+	std::unique_ptr<std::atomic<uint64_t>[]> pixels(new std::atomic<uint64_t>[pixelCount]);
+	parallelFor(pixelCount, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) pixels[i].store(emptyPixel, std::memory_order_relaxed);
+	});
+
+	parallelFor(pointCount, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			vec4 position_cs = uniforms.viewModelMatrix * vec4(points[i], 1.0f);
+			vec4 position_clip = uniforms.projectionMatrix * position_cs;
+
+			// Points are clipped as a whole
+			float w = position_clip.w;
+			if (!(std::abs(position_clip.x) <= w && std::abs(position_clip.y) <= w && std::abs(position_clip.z) <= w)) continue;
+
+			vec3 position_ndc = vec3(position_clip) / w;
+			float depth = position_ndc.z * 0.5f + 0.5f;
+			uint64_t key = (static_cast<uint64_t>(glm::floatBitsToUint(depth)) << 32) | static_cast<uint64_t>(i);
+
+			float size = glsl::SpriteSize(uniforms.projectionMatrix, uniforms.resolution, innerRadius, position_clip) * props.occluderMapSpriteScale;
+			float halfSize = 0.5f * std::max(size, 1.0f);
+			vec2 fragCoord = uniforms.resolution * (vec2(position_ndc) * 0.5f + 0.5f);
+
+			// Pixels whose center is covered by the sprite
+			glm::ivec2 minPixel = glm::ivec2(glm::ceil(fragCoord - halfSize - 0.5f));
+			glm::ivec2 maxPixel = glm::ivec2(glm::floor(fragCoord + halfSize - 0.5f));
+			minPixel = glm::max(minPixel, glm::ivec2(0));
+			maxPixel = glm::min(maxPixel, glm::ivec2(width - 1, height - 1));
+			for (int y = minPixel.y; y <= maxPixel.y; ++y) {
+				for (int x = minPixel.x; x <= maxPixel.x; ++x) {
+					std::atomic<uint64_t>& pixel = pixels[static_cast<size_t>(y) * width + x];
+					uint64_t current = pixel.load(std::memory_order_relaxed);
+					while (key < current && !pixel.compare_exchange_weak(current, key, std::memory_order_relaxed)) {}
+				}
+			}
+		}
+	});
+
+	// Resolve: the map stores camera space positions, cleared to (0, 0, 0, 1)
+	m_occlusionMap.resize(pixelCount);
+	parallelFor(pixelCount, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			uint64_t key = pixels[i].load(std::memory_order_relaxed);
+			if (key == emptyPixel) {
+				m_occlusionMap[i] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			}
+			else {
+				size_t pointIndex = static_cast<size_t>(key & 0xffffffff);
+				m_occlusionMap[i] = uniforms.viewModelMatrix * vec4(points[pointIndex], 1.0f);
+			}
+		}
+	});
+}
@@ -0,0 +1,103 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include "utils/discriminate.glsl.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * CPU reference implementation of PointCloudSplitter, for machines without
+ * GPU: it rasterizes the same occlusion map, calls the C++ port of
+ * discriminate() on each point and compacts points by render model, using
+ * all available threads.
+ * Within a model, elements are sorted by point index, whereas their order
+ * is not deterministic on the GPU, so only counters must be compared.
+ */
+class CpuSplitter {
+public:
+	// Mirrors relevant fields of PointCloudSplitter::Properties and GrainBehavior::Properties
+	struct Properties {
+		bool enableOcclusionCulling = true;
+		bool enableFrustumCulling = true;
+		float instanceLimit = 1.05f;
+		float impostorLimit = 10.0f;
+		bool useBbox = false;
+		glm::vec3 bboxMin = glm::vec3(0.0f);
+		glm::vec3 bboxMax = glm::vec3(0.0f);
+		float occluderMapSpriteScale = 0.2f;
+		float grainRadius = 0.01f;
+		float grainInnerRadiusRatio = 0.8f;
+	};
+	// What splitting depends on in Camera
+	struct View {
+		glm::mat4 viewMatrix = glm::mat4(1.0f);
+		glm::mat4 projectionMatrix = glm::mat4(1.0f);
+		glm::ivec2 resolution = glm::ivec2(1);
+	};
+	struct Counter {
+		uint32_t count = 0;
+		uint32_t offset = 0;
+	};
+
+	Properties & properties() { return m_properties; }
+	const Properties& properties() const { return m_properties; }
+
+	/**
+	 * Split the pointCount points starting at points, as the splitter would
+	 * for a single frame.
+	 */
+	void split(const glm::vec3* points, size_t pointCount, const View& view, const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+	// One counter per model, ordered like PointCloudSplitter::RenderModel
+	const std::vector<Counter>& counters() const { return m_counters; }
+	// Indices of points, grouped by model
+	const std::vector<uint32_t>& elements() const { return m_elements; }
+	// Occlusion map of the last split, empty if occlusion culling is disabled
+	const glsl::OcclusionMap& occlusionMap() const { return m_occlusionMap; }
+
+private:
+	/**
+	 * Equivalent of the occlusion culling pass (grain/occlusion-culling.*.glsl):
+	 * each point is splat as a square sprite and the closest one to the camera
+	 * writes its camera space position in each pixel.
+	 */
+	void renderOcclusionMap(const glm::vec3* points, size_t pointCount, const glsl::DiscriminateUniforms& uniforms);
+
+private:
+	Properties m_properties;
+	std::vector<Counter> m_counters;
+	std::vector<uint32_t> m_elements;
+	std::vector<uint32_t> m_renderModels;
+	glsl::OcclusionMap m_occlusionMap;
+};
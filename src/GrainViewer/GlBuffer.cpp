@@ -53,13 +53,23 @@ void GlBuffer::addBlockAttributeUint(size_t blockId, GLint size, GLuint divisor)
 	b.attributes.push_back(attr);
 }
 
-void GlBuffer::alloc() {
+void GlBuffer::addBlockAttributeUnorm16(size_t blockId, GLint size, GLuint divisor) {
+	Block & b = m_blocks[blockId];
+	BlockAttribute attr{ size, GL_UNSIGNED_SHORT, divisor, 0 };
+	if (!b.attributes.empty()) {
+		BlockAttribute prevAttr = b.attributes.back();
+		attr.byteOffset = prevAttr.byteOffset + prevAttr.size * sizeof(GLushort);
+	}
+	b.attributes.push_back(attr);
+}
+
+void GlBuffer::alloc(GLbitfield flags) {
 	if (m_isAllocated) {
 		ERR_LOG << "Cannot allocate buffer twice";
 		return;
 	}
 	glCreateBuffers(1, &m_buffer);
-	glNamedBufferStorage(m_buffer, byteSize(), NULL, GL_MAP_WRITE_BIT | GL_MAP_READ_BIT);
+	glNamedBufferStorage(m_buffer, byteSize(), NULL, flags);
 	m_isAllocated = true;
 }
 
@@ -71,11 +81,11 @@ void GlBuffer::free() {
 	}
 }
 
-void GlBuffer::enableAttributes(GLuint vao) {
+void GlBuffer::enableAttributes(GLuint vao) const {
 	GLintptr blockOffset = 0;
 	GLuint id = 0;
-	for (auto b : m_blocks) {
-		for (auto attr : b.attributes) {
+	for (const auto& b : m_blocks) {
+		for (const auto& attr : b.attributes) {
 			GLintptr offset = blockOffset + static_cast<GLintptr>(attr.byteOffset);
 			/* // More modern, but fails on some devices :/
 			glEnableVertexArrayAttrib(vao, id);
@@ -87,7 +97,18 @@ void GlBuffer::enableAttributes(GLuint vao) {
 			glVertexArrayBindingDivisor(vao, bindingindex, attr.divisor);
 			glEnableVertexArrayAttrib(vao, id);
 			glVertexArrayAttribBinding(vao, id, bindingindex);
-			glVertexArrayAttribFormat(vao, id, attr.size, attr.type, GL_FALSE, 0);
+			switch (attr.type) {
+			case GL_UNSIGNED_INT:
+			case GL_INT:
+				glVertexArrayAttribIFormat(vao, id, attr.size, attr.type, 0);
+				break;
+			case GL_UNSIGNED_SHORT:
+				glVertexArrayAttribFormat(vao, id, attr.size, attr.type, GL_TRUE, 0);
+				break;
+			default:
+				glVertexArrayAttribFormat(vao, id, attr.size, attr.type, GL_FALSE, 0);
+				break;
+			}
 			//*/
 			++id;
 		}
@@ -97,10 +97,17 @@ public:
 	}
 
 	void addBlockAttribute(size_t blockId, GLint size, GLuint divisor = 0);
+	// Integer attribute, to be read as uint/uvecN in shaders
 	void addBlockAttributeUint(size_t blockId, GLint size, GLuint divisor = 0);
+	// 16 bit unsigned attribute, read as a float in [0,1] in shaders
+	void addBlockAttributeUnorm16(size_t blockId, GLint size, GLuint divisor = 0);
 
-	/// Allocate buffer
-	void alloc();
+	/**
+	 * Allocate buffer. Use flags = 0 for buffers that are never mapped, so
+	 * that the driver can keep them in device memory (they can still be
+	 * written through glCopyNamedBufferSubData, see GlStreamingBuffer).
+	 */
+	void alloc(GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT);
 	/// Free buffer
 	void free();
 
@@ -141,7 +148,7 @@ public:
 	}
 
 	/// To be called when buffer is bound, in a VAO
-	void enableAttributes(GLuint vao);
+	void enableAttributes(GLuint vao) const;
 
 	/// Free memory that was used for building. Never call fill_block() or fill() after that
 	void finalize();
@@ -151,6 +158,12 @@ public:
 	void bindSsbo(GLuint index) const;
 	void unbind() const;
 
+	/// Offset of the first byte of a block in the buffer
+	inline GLintptr blockByteOffset(size_t blockId) const {
+		const Block & b = m_blocks[blockId];
+		return static_cast<GLintptr>(b.endByteOffset) - static_cast<GLintptr>(b.nbElements * b.stride);
+	}
+
 	inline GLuint name() const { return m_buffer; }
 	inline bool isAllocated() const { return m_isAllocated; }
 
@@ -29,8 +29,6 @@
 
 #include "Logger.h"
 #include "GlDeferredShader.h"
-#include "Light.h"
-#include "ShadowMap.h"
 #include "ResourceManager.h"
 #include "GlTexture.h"
 #include "utils/strutils.h"
@@ -127,24 +125,7 @@ void GlDeferredShader::render(const Camera & camera, const World & world, Render
 	glBindTextureUnit(static_cast<GLuint>(o), fbo->depthTexture());
 	++o;
 
-	// TODO: Use UBO, move to World
-	auto lights = world.lights();
-	for (size_t k = 0; k < lights.size(); ++k) {
-		std::string prefix = MAKE_STR("light[" << k << "].");
-		shader.setUniform(prefix + "position_ws", lights[k]->position());
-		shader.setUniform(prefix + "color", lights[k]->color());
-		shader.setUniform(prefix + "matrix", lights[k]->shadowMap().camera().projectionMatrix() * lights[k]->shadowMap().camera().viewMatrix());
-		shader.setUniform(prefix + "isRich", lights[k]->isRich() ? 1 : 0);
-		shader.setUniform(prefix + "hasShadowMap", lights[k]->hasShadowMap() ? 1 : 0);
-		shader.setUniform(prefix + "shadowMap", o);
-		glBindTextureUnit(static_cast<GLuint>(o), lights[k]->shadowMap().depthTexture());
-		++o;
-		if (lights[k]->isRich()) {
-			shader.setUniform(prefix + "richShadowMap", o);
-			glBindTextureUnit(static_cast<GLuint>(o), lights[k]->shadowMap().colorTexture(0));
-			++o;
-		}
-	}
+	world.bindLights(shader);
 
 	shader.setUniform("uIsShadowMapEnabled", world.isShadowMapEnabled());
 
@@ -0,0 +1,114 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "GlStreamingBuffer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cassert>
+
+constexpr GLbitfield persistentMappingFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+GlStreamingBuffer::GlStreamingBuffer(GLsizeiptr segmentSize, int segmentCount)
+	: m_segmentSize(segmentSize)
+	, m_fences(std::max(1, segmentCount), nullptr)
+{
+	GLsizeiptr size = m_segmentSize * static_cast<GLsizeiptr>(m_fences.size());
+	glCreateBuffers(1, &m_buffer);
+	glNamedBufferStorage(m_buffer, size, nullptr, persistentMappingFlags);
+	m_data = static_cast<char*>(glMapNamedBufferRange(m_buffer, 0, size, persistentMappingFlags));
+	if (!m_data) {
+		ERR_LOG << "Could not map streaming buffer persistently";
+	}
+}
+
+GlStreamingBuffer::~GlStreamingBuffer()
+{
+	for (int i = 0; i < segmentCount(); ++i) {
+		waitSegment(i);
+	}
+	if (m_data) {
+		glUnmapNamedBuffer(m_buffer);
+	}
+	glDeleteBuffers(1, &m_buffer);
+}
+
+void *GlStreamingBuffer::segmentData(int segment) const
+{
+	return m_data + m_segmentSize * segment;
+}
+
+bool GlStreamingBuffer::isSegmentAvailable(int segment)
+{
+	GLsync & fence = m_fences[segment];
+	if (!fence) return true;
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+		glDeleteSync(fence);
+		fence = nullptr;
+		return true;
+	}
+	return false;
+}
+
+void GlStreamingBuffer::waitSegment(int segment)
+{
+	GLsync & fence = m_fences[segment];
+	if (!fence) return;
+	constexpr GLuint64 timeout = 1000000000; // 1s
+	GLenum status;
+	do {
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	} while (status == GL_TIMEOUT_EXPIRED);
+	if (status == GL_WAIT_FAILED) {
+		ERR_LOG << "Error while waiting for streaming buffer fence";
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void GlStreamingBuffer::copySegment(int segment, GLuint destination, GLintptr destinationOffset, GLsizeiptr byteCount)
+{
+	assert(byteCount <= m_segmentSize);
+	glCopyNamedBufferSubData(m_buffer, destination, m_segmentSize * segment, destinationOffset, byteCount);
+	m_fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GlStreamingBuffer::upload(GLuint destination, GLintptr destinationOffset, GLsizeiptr byteCount, std::function<void(void*, GLsizeiptr, GLsizeiptr)> fill)
+{
+	if (!m_data) return;
+	for (GLsizeiptr offset = 0; offset < byteCount; offset += m_segmentSize) {
+		GLsizeiptr size = std::min(m_segmentSize, byteCount - offset);
+		int segment = m_nextSegment;
+		m_nextSegment = (m_nextSegment + 1) % segmentCount();
+		waitSegment(segment);
+		fill(segmentData(segment), offset, size);
+		copySegment(segment, destination, destinationOffset + offset, size);
+	}
+}
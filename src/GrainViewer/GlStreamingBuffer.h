@@ -0,0 +1,92 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <OpenGL>
+
+#include <vector>
+#include <functional>
+
+/**
+ * Ring of staging segments living in a persistently mapped buffer, used to
+ * upload data to device-local buffers without any intermediate copy in
+ * client memory: data is written directly into the mapped segment, then the
+ * GPU copies it to its final destination. A fence is inserted after each
+ * copy so that a segment is never overwritten while still being read.
+ *
+ * The memory returned by segmentData() may be written from any thread, but
+ * all other methods must be called from the thread owning the GL context.
+ *
+ * Usage:
+ *   GlStreamingBuffer staging(32 * 1024 * 1024);
+ *   staging.upload(buffer.name(), 0, byteCount, [](void *data, GLsizeiptr offset, GLsizeiptr size) {
+ *       // write size bytes corresponding to [offset, offset + size[ in data
+ *   });
+ */
+class GlStreamingBuffer {
+public:
+	GlStreamingBuffer(GLsizeiptr segmentSize, int segmentCount = 3);
+	~GlStreamingBuffer();
+	GlStreamingBuffer(const GlStreamingBuffer &) = delete;
+	GlStreamingBuffer & operator=(const GlStreamingBuffer &) = delete;
+
+	inline GLsizeiptr segmentSize() const { return m_segmentSize; }
+	inline int segmentCount() const { return static_cast<int>(m_fences.size()); }
+
+	/// Pointer to the persistently mapped memory of a segment
+	void *segmentData(int segment) const;
+
+	/// Return true iff the last copy from this segment is over (non blocking)
+	bool isSegmentAvailable(int segment);
+
+	/// Block until the last copy from this segment is over
+	void waitSegment(int segment);
+
+	/**
+	 * Copy the first byteCount bytes of a segment into another buffer and
+	 * fence the segment until the copy is done.
+	 */
+	void copySegment(int segment, GLuint destination, GLintptr destinationOffset, GLsizeiptr byteCount);
+
+	/**
+	 * Sequential upload of byteCount bytes: call fill(data, offset, size) to
+	 * write bytes [offset, offset + size[ of the uploaded range into the
+	 * mapped memory, one segment at a time, and copy them to destination.
+	 * Filling a segment overlaps with the copy of the previous ones.
+	 */
+	void upload(GLuint destination, GLintptr destinationOffset, GLsizeiptr byteCount, std::function<void(void*, GLsizeiptr, GLsizeiptr)> fill);
+
+private:
+	GLuint m_buffer = 0;
+	char *m_data = nullptr;
+	GLsizeiptr m_segmentSize;
+	std::vector<GLsync> m_fences;
+	int m_nextSegment = 0;
+};
@@ -77,6 +77,11 @@ void GlTexture::subImage(GLint level, GLint xoffset, GLint yoffset, GLint zoffse
 	glTextureSubImage3D(m_id, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
 }
 
+void GlTexture::compressedSubImage(GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const void* data)
+{
+	glCompressedTextureSubImage3D(m_id, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, data);
+}
+
 void GlTexture::generateMipmap() const
 {
 	glGenerateTextureMipmap(m_id);
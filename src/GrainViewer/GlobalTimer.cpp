@@ -190,7 +190,10 @@ void GlobalTimer::gatherQueries() noexcept
 
 	m_frameStats.lastGpuTime = static_cast<double>(frameEndNs - frameStartNs) * 1e-6;
 	addSample(m_frameStats.cumulatedGpuTime, m_frameStats.lastGpuTime, m_frameStats.sampleCount);
-	
+
+	for (auto& s : m_stats) {
+		s.second.frameGpuTime = 0.0;
+	}
 	while (!m_stopped.empty()) {
 		auto it = m_stopped.begin();
 		Timer* timer = *it;
@@ -203,6 +206,7 @@ void GlobalTimer::gatherQueries() noexcept
 		Stats& stats = m_stats[timer->message];
 		stats.lastGpuTime = static_cast<double>(endNs - startNs) * 1e-6;
 		stats.lastGpuFrameOffset = static_cast<double>(startNs - frameStartNs) * 1e-6;
+		stats.frameGpuTime += stats.lastGpuTime;
 		addSample(stats.cumulatedGpuTime, stats.lastGpuTime, stats.sampleCount);
 		addSample(stats.cumulatedGpuFrameOffset, stats.lastGpuFrameOffset, stats.sampleCount);
 
@@ -69,6 +69,9 @@ public:
         double lastFrameOffset = 0.0;
         double lastGpuTime = 0.0;
         double lastGpuFrameOffset = 0.0;
+        // sum of the GPU times of all samples of the last frame, e.g. when a
+        // timer runs once per view, whereas lastGpuTime only keeps the last one
+        double frameGpuTime = 0.0;
 
         // for UI -- not reset by reset()
         mutable StatsUi ui;
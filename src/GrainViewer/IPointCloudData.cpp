@@ -0,0 +1,53 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "IPointCloudData.h"
+
+void IPointCloudData::bindPoints(const ShaderProgram& shader, GLuint pointsBinding) const
+{
+	vbo().bindSsbo(pointsBinding);
+	const GlBuffer* chunks = chunkBuffer();
+	if (chunks) {
+		chunks->bindSsbo(5); // POINT_CHUNKS_BINDING
+	}
+	shader.setUniform("uQuantizedPositions", chunks != nullptr && isQuantized());
+	shader.setUniform("uPointChunkSize", chunkSize());
+}
+
+void IPointCloudData::drawPoints() const
+{
+	if (const GlBuffer* commands = drawCommandBuffer()) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands->name());
+		glDrawArraysIndirect(GL_POINTS, reinterpret_cast<const void*>(drawCommandOffset()));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else {
+		glDrawArrays(GL_POINTS, pointOffset(), pointCount());
+	}
+}
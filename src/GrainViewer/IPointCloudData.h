@@ -31,6 +31,7 @@
 
 #include <OpenGL>
 #include "GlBuffer.h"
+#include "ShaderProgram.h"
 #include <memory>
 
 /**
@@ -44,4 +45,34 @@ public:
 	virtual const GlBuffer& vbo() const = 0;
 	virtual std::shared_ptr<GlBuffer> ebo() const { return nullptr; } // if null, then regular array is used as element buffer
 	virtual GLint pointOffset() const { return 0; } // offset in the ebo
+
+	// Bounding boxes of consecutive runs of chunkSize() points of the vbo,
+	// as pairs of vec4 (min, max). If null, no chunk information is available.
+	virtual const GlBuffer* chunkBuffer() const { return nullptr; }
+	virtual GLuint chunkSize() const { return 0; }
+	// If true, vbo contains positions quantized relative to their chunk
+	// bounding box rather than vec4 (see include/points.inc.glsl).
+	virtual bool isQuantized() const { return false; }
+
+	// If not null, the actual point count and offset are only known by the
+	// GPU, which writes them as DrawArraysIndirectCommand records in this
+	// buffer: (count, 1, offset, 0) at drawCommandOffset() and, for instanced
+	// rendering, (0, count, 0, offset) at instancedDrawCommandOffset(), in
+	// which the vertex count must be filled in by the renderer. pointCount()
+	// and pointOffset() may then lag a few frames behind.
+	virtual const GlBuffer* drawCommandBuffer() const { return nullptr; }
+	virtual GLintptr drawCommandOffset() const { return 0; }
+	virtual GLintptr instancedDrawCommandOffset() const { return 0; }
+
+	/**
+	 * Bind point buffers and set the uniforms expected by
+	 * include/points.inc.glsl, which declares the points at pointsBinding.
+	 */
+	void bindPoints(const ShaderProgram& shader, GLuint pointsBinding) const;
+
+	/**
+	 * Draw all points as GL_POINTS with the currently bound program and vao,
+	 * indirectly if there is a draw command buffer.
+	 */
+	void drawPoints() const;
 };
@@ -38,15 +38,51 @@
 #include "Framebuffer2.h"
 #include "Behavior/MeshDataBehavior.h"
 #include "utils/ScopedFramebufferOverride.h"
+#include "MeshCache.h"
+#include "utils/hashutils.h"
+#include "utils/MappedFile.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+// Header of impostor atlas cache files, followed for each texture (normal
+// alpha, base color, metallic roughness) and each of its mip levels by the
+// byte size of the level (as a uint64_t) and its compressed data.
+struct ImpostorAtlasCacheHeader {
+	uint32_t magic = s_magic;
+	uint32_t version = s_version;
+	uint64_t key = 0;
+	uint32_t internalFormat = 0;
+	uint32_t width = 0;
+	uint32_t depth = 0;
+	uint32_t levels = 0;
+	uint32_t textureCount = 0;
+	uint32_t padding = 0;
+
+	static constexpr uint32_t s_magic = 0x41495647; // "GVIA"
+	static constexpr uint32_t s_version = 1;
+};
+
+// BC7, compressed by the driver when writing the cache
+static constexpr GLenum s_cacheFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+
 bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 {
 	bool baseColorOverriden = jrOption(json, "baseColor", baseColor, baseColor);
 	bool metallicOverriden = jrOption(json, "metallic", metallic, metallic);
 	bool roughnessOverriden = jrOption(json, "roughness", roughness, roughness);
 
+	bool isFromCache = false;
+	uint64_t key = 0;
 	jrOption(json, "bake", bake, bake);
 	if (bake) {
 		std::string filename;
@@ -59,41 +95,79 @@ bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 		viewCount = static_cast<GLuint>(sqrt(angularDefinition / 2));
 		angularDefinition = static_cast<int>(2 * viewCount * viewCount);
 
-		DEBUG_LOG << "Loading object '" << filename << "' for backing...";
-		MeshDataBehavior mesh;
-		{
-			using namespace rapidjson;
-			Document d(kObjectType);
-			Value meshOpt(kObjectType);
+		filename = ResourceManager::resolveResourcePath(filename);
+		jrOption(json, "useCache", useCache, useCache);
+		jrOption(json, "cacheFilename", cacheFilename, filename + ".atlas.cache");
+		cacheFilename = ResourceManager::resolveResourcePath(cacheFilename);
+
+		using clock = std::chrono::high_resolution_clock;
+		double bakeTime = -1; // negative if not baked
+		if (useCache && cacheKey(filename, key)) {
+			auto start = clock::now();
+			isFromCache = loadCache(cacheFilename, key);
+			if (isFromCache) {
+				glFinish();
+				double time = std::chrono::duration<double>(clock::now() - start).count();
+				LOG << "Loaded impostor atlas from cache " << cacheFilename << " in " << time * 1e3 << " ms";
+			}
+		}
 
-			Value filenameValue;
-			filenameValue.SetString(filename.c_str(), d.GetAllocator());
-			meshOpt.AddMember("filename", filenameValue, d.GetAllocator());
+		if (!isFromCache) {
+			auto start = clock::now();
+			DEBUG_LOG << "Loading object '" << filename << "' for backing...";
+			MeshDataBehavior mesh;
+			{
+				using namespace rapidjson;
+				Document d(kObjectType);
+				Value meshOpt(kObjectType);
 
-			Value boundingValue;
-			boundingValue.SetBool(true);
-			meshOpt.AddMember("computeBoundingSphere", boundingValue, d.GetAllocator());
+				Value filenameValue;
+				filenameValue.SetString(filename.c_str(), d.GetAllocator());
+				meshOpt.AddMember("filename", filenameValue, d.GetAllocator());
 
-			mesh.deserialize(meshOpt);
+				Value boundingValue;
+				boundingValue.SetBool(true);
+				meshOpt.AddMember("computeBoundingSphere", boundingValue, d.GetAllocator());
+
+				mesh.deserialize(meshOpt);
+			}
+			mesh.start();
+			bakeMaps(mesh, mesh.boundingSphereRadius(), mesh.boundingSphereCenter());
+			mipMapUsingAlpha();
+			glFinish();
+			bakeTime = std::chrono::duration<double>(clock::now() - start).count();
+			LOG << "Baked impostor atlas from " << filename << " in " << bakeTime * 1e3 << " ms";
+			// Render the compressed atlas, like later runs that load the cache
+			if (useCache && saveCache(cacheFilename, key) && !loadCache(cacheFilename, key)) {
+				WARN_LOG << "Could not load back impostor atlas cache " << cacheFilename;
+			}
 		}
-		mesh.start();
-		bakeMaps(mesh, mesh.boundingSphereRadius(), mesh.boundingSphereCenter());
 
 		bool save = false;
 		jrOption(json, "save", save, save);
 		if (save) {
+			std::vector<std::string> stackDirectories;
 #define writeAtlas(name) \
 			std::string name; \
 			if (jrOption(json, #name, name)) { \
 				ResourceManager::saveTextureStack(name, *name ## Texture); \
+				stackDirectories.push_back(name); \
 			}
 			writeAtlas(normalAlpha);
 			writeAtlas(baseColor);
 			writeAtlas(metallicRoughness);
 #undef writeAtlas
+
+			bool benchmark = false;
+			jrOption(json, "benchmarkCache", benchmark, benchmark);
+			if (benchmark && useCache) {
+				benchmarkCache(stackDirectories, key, bakeTime);
+			}
 		}
 	}
 	else {
+		using clock = std::chrono::high_resolution_clock;
+		auto start = clock::now();
 #define readAtlas(name) \
 		std::string name; \
 		if (jrOption(json, #name, name)) { \
@@ -103,45 +177,66 @@ bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 		readAtlas(baseColor);
 		readAtlas(metallicRoughness);
 #undef readAtlas
+		mipMapUsingAlpha();
+		glFinish();
+		double time = std::chrono::duration<double>(clock::now() - start).count();
+		LOG << "Loaded impostor atlas from PNG stacks in " << time * 1e3 << " ms";
 	}
 
 	GLuint n = normalAlphaTexture->depth();
 	viewCount = static_cast<GLuint>(sqrt(n / 2));
 
-	if (baseColorTexture && normalAlphaTexture) {
-		Filtering::MipMapUsingAlpha(*baseColorTexture, *normalAlphaTexture);
-	}
-	if (metallicRoughnessTexture && normalAlphaTexture) {
-		Filtering::MipMapUsingAlpha(*metallicRoughnessTexture, *normalAlphaTexture);
+	return true;
+}
+
+ImpostorAtlasMaterial::UniformNames::UniformNames(const std::string& prefix)
+	: normalAlphaTexture(prefix + "normalAlphaTexture")
+	, baseColorTexture(prefix + "baseColorTexture")
+	, metallicRoughnessTexture(prefix + "metallicRoughnessTexture")
+{}
+
+const ImpostorAtlasMaterial::UniformNames& ImpostorAtlasMaterial::UniformNames::mapsArray(size_t index)
+{
+	// A deque, so that growing it does not move names already handed out
+	static std::deque<UniformNames> names;
+	while (names.size() <= index) {
+		names.emplace_back("uImpostorMaps[" + std::to_string(names.size()) + "].");
 	}
+	return names[index];
+}
 
-	return true;
+static_assert(sizeof(ImpostorAtlasMaterial::UboData) == 48, "UboData must match the std140 layout of SphericalImpostor");
+
+ImpostorAtlasMaterial::UboData ImpostorAtlasMaterial::uboData() const
+{
+	UboData data = {};
+	data.baseColor = baseColor;
+	data.metallic = metallic;
+	data.roughness = roughness;
+	data.viewCount = viewCount;
+	data.hasBaseColorMap = baseColorTexture ? 1 : 0;
+	data.hasMetallicRoughnessMap = metallicRoughnessTexture ? 1 : 0;
+	data.hasLeanMapping = 0;
+	return data;
 }
 
-GLint ImpostorAtlasMaterial::setUniforms(const ShaderProgram& shader, const std::string& prefix, GLint nextTextureUnit) const
+GLint ImpostorAtlasMaterial::bindTextures(const ShaderProgram& shader, const UniformNames& names, GLint nextTextureUnit) const
 {
 	GLint o = nextTextureUnit;
 
-	shader.setUniform(prefix + "viewCount", viewCount);
-	shader.setUniform(prefix + "baseColor", baseColor);
-	shader.setUniform(prefix + "metallic", metallic);
-	shader.setUniform(prefix + "roughness", roughness);
-
 	normalAlphaTexture->bind(o);
-	shader.setUniform(prefix + "normalAlphaTexture", o++);
+	shader.setUniform(names.normalAlphaTexture, o++);
 
 	if (baseColorTexture) {
 		baseColorTexture->bind(o);
-		shader.setUniform(prefix + "baseColorTexture", o++);
+		shader.setUniform(names.baseColorTexture, o++);
 	}
-	shader.setUniform(prefix + "hasBaseColorMap", static_cast<bool>(baseColorTexture));
 
 	if (metallicRoughnessTexture) {
 		metallicRoughnessTexture->bind(o);
-		shader.setUniform(prefix + "metallicRoughnessTexture", o++);
+		shader.setUniform(names.metallicRoughnessTexture, o++);
 	}
-	shader.setUniform(prefix + "hasMetallicRoughnessMap", static_cast<bool>(metallicRoughnessTexture));
-	
+
 	return o;
 }
 
@@ -205,7 +300,7 @@ void ImpostorAtlasMaterial::bakeMaps(const MeshDataBehavior & mesh, float scale,
 	int n = static_cast<int>(mesh.materials().size());
 	for (int i = 0; i < n; ++i) {
 		const StandardMaterial& mat = mesh.materials()[i];
-		o = mat.setUniforms(shader, MAKE_STR("uMaterial[" << i << "]."), o);
+		o = mat.setUniforms(shader, StandardMaterial::UniformNames::materialArray(i), o);
 	}
 
 	blitShader.setUniform("uMultiplier", 1.0f / static_cast<float>(msaa * msaa));
@@ -216,6 +311,7 @@ void ImpostorAtlasMaterial::bakeMaps(const MeshDataBehavior & mesh, float scale,
 	metallicRoughnessMsaa->bind(2);
 	blitShader.setUniform("uMetallicRoughness", 2);
 
+	const MeshDataBehavior::Lod& lod = mesh.lod(0);
 	for (int xx = 0; xx < msaa; ++xx) {
 		for (int yy = 0; yy < msaa; ++yy) {
 			
@@ -232,7 +328,7 @@ void ImpostorAtlasMaterial::bakeMaps(const MeshDataBehavior & mesh, float scale,
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 			glBindVertexArray(mesh.vao());
-			glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.pointCount(), angularDefinition);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, lod.indices(), angularDefinition, lod.baseVertex);
 			glBindVertexArray(0);
 
 			fbo.bind();
@@ -249,3 +345,212 @@ void ImpostorAtlasMaterial::bakeMaps(const MeshDataBehavior & mesh, float scale,
 	baseColorTexture->generateMipmap();
 	metallicRoughnessTexture->generateMipmap();
 }
+
+void ImpostorAtlasMaterial::mipMapUsingAlpha()
+{
+	if (baseColorTexture && normalAlphaTexture) {
+		Filtering::MipMapUsingAlpha(*baseColorTexture, *normalAlphaTexture);
+	}
+	if (metallicRoughnessTexture && normalAlphaTexture) {
+		Filtering::MipMapUsingAlpha(*metallicRoughnessTexture, *normalAlphaTexture);
+	}
+}
+
+bool ImpostorAtlasMaterial::cacheKey(const std::string& objFilename, uint64_t& key) const
+{
+	uint64_t meshKey;
+	if (!MeshCache::contentKey(objFilename, glm::vec3(0), meshKey)) return false;
+
+	Fnv1a hash;
+	hash.addValue(meshKey);
+	hash.addValue(angularDefinition);
+	hash.addValue(spatialDefinition);
+	hash.addValue(s_cacheFormat);
+	// Shader keys also depend on the driver, which compresses the cache
+	hash.add(ShaderPool::GetShader("BakeImpostorAtlas")->sourceKey());
+	hash.add(ShaderPool::GetShader("BakeImpostorAtlas_Blit")->sourceKey());
+	hash.add(ShaderPool::GetShader("MipMapUsingAlpha")->sourceKey());
+	key = hash.value();
+	return true;
+}
+
+bool ImpostorAtlasMaterial::loadCache(const std::string& path, uint64_t key)
+{
+	std::error_code err;
+	if (!fs::exists(path, err)) return false;
+	MappedFile file;
+	if (!file.open(path)) return false;
+
+	const char* data = file.data();
+	size_t size = file.size();
+	size_t cursor = 0;
+
+	ImpostorAtlasCacheHeader header;
+	if (size < sizeof(header)) {
+		WARN_LOG << "Ignoring invalid impostor atlas cache " << path;
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	cursor += sizeof(header);
+	if (header.magic != ImpostorAtlasCacheHeader::s_magic
+		|| header.version != ImpostorAtlasCacheHeader::s_version
+		|| header.textureCount != 3
+		|| header.width == 0 || header.depth == 0 || header.levels == 0) {
+		WARN_LOG << "Ignoring invalid impostor atlas cache " << path;
+		return false;
+	}
+	if (header.key != key) {
+		DEBUG_LOG << "Impostor atlas cache " << path << " is outdated";
+		return false;
+	}
+
+	GLsizei width = static_cast<GLsizei>(header.width);
+	GLsizei depth = static_cast<GLsizei>(header.depth);
+	GLsizei levels = static_cast<GLsizei>(header.levels);
+	GLenum internalFormat = static_cast<GLenum>(header.internalFormat);
+
+	// Textures are only replaced once the whole file has been read
+	std::unique_ptr<GlTexture> textures[3];
+	for (auto& texture : textures) {
+		texture = initTexture(width, depth, levels, internalFormat);
+		for (GLint level = 0; level < levels; ++level) {
+			uint64_t byteSize = 0;
+			if (cursor + sizeof(byteSize) > size) {
+				WARN_LOG << "Ignoring truncated impostor atlas cache " << path;
+				return false;
+			}
+			memcpy(&byteSize, data + cursor, sizeof(byteSize));
+			cursor += sizeof(byteSize);
+			if (byteSize > size - cursor) {
+				WARN_LOG << "Ignoring truncated impostor atlas cache " << path;
+				return false;
+			}
+			GLsizei levelWidth = std::max(1, width >> level);
+			texture->compressedSubImage(level, 0, 0, 0, levelWidth, levelWidth, depth, internalFormat, static_cast<GLsizei>(byteSize), data + cursor);
+			cursor += byteSize;
+		}
+	}
+
+	normalAlphaTexture = std::move(textures[0]);
+	baseColorTexture = std::move(textures[1]);
+	metallicRoughnessTexture = std::move(textures[2]);
+	return true;
+}
+
+bool ImpostorAtlasMaterial::saveCache(const std::string& path, uint64_t key) const
+{
+	const GlTexture* textures[] = { normalAlphaTexture.get(), baseColorTexture.get(), metallicRoughnessTexture.get() };
+	for (const GlTexture* texture : textures) {
+		if (!texture) return false;
+	}
+
+	ImpostorAtlasCacheHeader header;
+	header.key = key;
+	header.internalFormat = static_cast<uint32_t>(s_cacheFormat);
+	header.width = static_cast<uint32_t>(normalAlphaTexture->width());
+	header.depth = static_cast<uint32_t>(normalAlphaTexture->depth());
+	header.levels = static_cast<uint32_t>(normalAlphaTexture->levels());
+	header.textureCount = 3;
+	GLsizei width = normalAlphaTexture->width();
+	GLsizei depth = normalAlphaTexture->depth();
+	GLsizei levels = normalAlphaTexture->levels();
+
+	// Write then rename, so that an interrupted write never leaves a valid
+	// looking cache behind
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary);
+		if (!file.is_open()) {
+			WARN_LOG << "Could not write impostor atlas cache " << tmpPath;
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		// Tightly packed transfers, restored afterwards not to leak into later uploads
+		GLint packAlignment, unpackAlignment;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		std::vector<unsigned char> pixels;
+		std::vector<char> compressed;
+		for (const GlTexture* texture : textures) {
+			// Let the driver compress each level by uploading it to a texture
+			// of compressed format, rather than compressing the mip chain again
+			auto compressedTexture = initTexture(width, depth, levels, s_cacheFormat);
+			for (GLint level = 0; level < levels; ++level) {
+				GLsizei levelWidth = std::max(1, width >> level);
+				pixels.resize(4 * static_cast<size_t>(levelWidth) * levelWidth * depth);
+				glGetTextureImage(texture->raw(), level, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<GLsizei>(pixels.size()), pixels.data());
+				compressedTexture->subImage(level, 0, 0, 0, levelWidth, levelWidth, depth, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+				GLint compressedSize = 0;
+				glGetTextureLevelParameteriv(compressedTexture->raw(), level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+				compressed.resize(static_cast<size_t>(compressedSize));
+				glGetCompressedTextureImage(compressedTexture->raw(), level, compressedSize, compressed.data());
+
+				uint64_t byteSize = static_cast<uint64_t>(compressedSize);
+				file.write(reinterpret_cast<const char*>(&byteSize), sizeof(byteSize));
+				file.write(compressed.data(), compressed.size());
+			}
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+		if (!file) {
+			WARN_LOG << "Could not write impostor atlas cache " << tmpPath;
+			return false;
+		}
+	}
+
+	std::error_code err;
+	fs::rename(tmpPath, path, err);
+	if (err) {
+		WARN_LOG << "Could not write impostor atlas cache " << path << ": " << err.message();
+		fs::remove(tmpPath, err);
+		return false;
+	}
+	DEBUG_LOG << "Wrote impostor atlas cache " << path;
+	return true;
+}
+
+void ImpostorAtlasMaterial::benchmarkCache(const std::vector<std::string>& stackDirectories, uint64_t key, double bakeTime) const
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	// Same steps as deserialize() when not baking
+	glFinish();
+	auto start = clock::now();
+	ImpostorAtlasMaterial fromStacks;
+	std::unique_ptr<GlTexture>* stackTextures[] = { &fromStacks.normalAlphaTexture, &fromStacks.baseColorTexture, &fromStacks.metallicRoughnessTexture };
+	for (size_t i = 0; i < stackDirectories.size() && i < 3; ++i) {
+		*stackTextures[i] = ResourceManager::loadTextureStack(stackDirectories[i]);
+	}
+	fromStacks.mipMapUsingAlpha();
+	glFinish();
+	double stackTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	start = clock::now();
+	ImpostorAtlasMaterial fromCache;
+	bool ok = fromCache.loadCache(cacheFilename, key);
+	glFinish();
+	double cacheTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	if (!ok) {
+		WARN_LOG << "Could not benchmark impostor atlas cache " << cacheFilename;
+		return;
+	}
+
+	std::error_code err;
+	std::ostringstream bakeInfo;
+	if (bakeTime >= 0) {
+		bakeInfo << bakeTime * 1e3 << " ms";
+	}
+	else {
+		bakeInfo << "not measured (atlas was loaded from cache, remove it to measure)";
+	}
+	LOG
+		<< "Impostor atlas load time (" << spatialDefinition << "px, " << angularDefinition << " views): "
+		<< "cold bake " << bakeInfo.str() << ", "
+		<< stackTime * 1e3 << " ms from " << stackDirectories.size() << " PNG stacks, "
+		<< cacheTime * 1e3 << " ms from cache (" << fs::file_size(cacheFilename, err) / 1024 << " KiB)";
+}
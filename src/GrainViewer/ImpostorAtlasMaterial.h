@@ -37,12 +37,16 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
 
 class ShaderProgram;
 class MeshDataBehavior;
 
 /**
- * Matches SphericalImpostor struct in include/impostor.inc.glsl
+ * Matches SphericalImpostor and SphericalImpostorMaps structs in
+ * include/impostor.inc.glsl
  */
 struct ImpostorAtlasMaterial
 {
@@ -60,10 +64,57 @@ struct ImpostorAtlasMaterial
 	// in this case, the following options are used:
 	int angularDefinition = 128; // rounded to the closest number such that 2n�
 	int spatialDefinition = 128; // number of pixels on each dimension of a precomputed view
+	// Baked atlases are cached in a single file of compressed texture arrays,
+	// mip levels included, next to the obj file unless cacheFilename is given.
+	bool useCache = true;
+	std::string cacheFilename;
+
+	// Memory layout on GPU, matches SphericalImpostor (std140)
+	struct UboData {
+		glm::vec3 baseColor;
+		GLfloat metallic;
+		GLfloat roughness;
+		GLuint viewCount;
+		GLuint hasBaseColorMap;
+		GLuint hasMetallicRoughnessMap;
+		GLuint hasLeanMapping;
+		GLuint _pad[3];
+	};
+
+	/**
+	 * Full names of the sampler uniforms of an atlas, built once rather than
+	 * at each draw.
+	 */
+	struct UniformNames {
+		std::string normalAlphaTexture;
+		std::string baseColorTexture;
+		std::string metallicRoughnessTexture;
+
+		explicit UniformNames(const std::string& prefix);
+		// Names of the atlas at the given index of the uImpostorMaps array
+		static const UniformNames& mapsArray(size_t index);
+	};
 
 	bool deserialize(const rapidjson::Value& json);
-	GLint setUniforms(const ShaderProgram& shader, const std::string& prefix, GLint nextTextureUnit) const;
+	// Parameters other than textures, uploaded in the "Impostors" uniform block
+	UboData uboData() const;
+	// Bind textures from nextTextureUnit on, return the next available unit
+	GLint bindTextures(const ShaderProgram& shader, const UniformNames& names, GLint nextTextureUnit) const;
 
 private:
 	void bakeMaps(const MeshDataBehavior& mesh, float radius, glm::vec3 center);
+	// Mip levels of color maps only average texels covered by the grain
+	void mipMapUsingAlpha();
+
+	// Hash of the obj file, of the bake options and of the bake shaders
+	bool cacheKey(const std::string& objFilename, uint64_t& key) const;
+	bool loadCache(const std::string& path, uint64_t key);
+	bool saveCache(const std::string& path, uint64_t key) const;
+
+	/**
+	 * Log the time needed to reload the atlas from PNG stacks (as written
+	 * by the "save" option) and from the cache file, next to the time of the
+	 * cold bake (negative if the atlas was loaded from the cache).
+	 */
+	void benchmarkCache(const std::vector<std::string>& stackDirectories, uint64_t key, double bakeTime) const;
 };
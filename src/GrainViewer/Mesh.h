@@ -46,11 +46,12 @@ public:
 	std::vector<std::string> diffuseTextures() const;
 	std::vector<std::string> bumpTextures() const;
 
-	inline tinyobj::attrib_t attrib() const { return m_attrib; }
-	inline std::vector<tinyobj::shape_t> shapes() const { return m_shapes; }
-	inline std::vector<tinyobj::material_t> materials() const { return m_materials; }
+	// Accessors return references, mesh data is never copied after loading
+	inline const tinyobj::attrib_t & attrib() const { return m_attrib; }
+	inline const std::vector<tinyobj::shape_t> & shapes() const { return m_shapes; }
+	inline const std::vector<tinyobj::material_t> & materials() const { return m_materials; }
 
-	inline const std::string baseDir() const { return m_baseDir; }
+	inline const std::string & baseDir() const { return m_baseDir; }
 
 private:
 	std::string m_baseDir;
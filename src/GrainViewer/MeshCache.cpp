@@ -0,0 +1,279 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "MeshCache.h"
+#include "Mesh.h"
+#include "Logger.h"
+#include "utils/fileutils.h"
+#include "utils/hashutils.h"
+
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <system_error>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+// Header of cache files, followed by vertices, indices and materials
+struct MeshCacheHeader {
+	uint32_t magic = s_magic;
+	uint32_t version = s_version;
+	uint64_t key = 0;
+	uint64_t vertexCount = 0;
+	uint64_t indexCount = 0;
+	uint64_t materialCount = 0;
+
+	static constexpr uint32_t s_magic = 0x434d5647; // "GVMC"
+	static constexpr uint32_t s_version = 1;
+};
+
+// Material fields used by StandardMaterial::fromTinyObj, which follow the
+// fixed size part of each material in the cache, as (length, characters).
+static std::string tinyobj::material_t::* const s_materialTextureNames[] = {
+	&tinyobj::material_t::diffuse_texname,
+	&tinyobj::material_t::metallic_texname,
+	&tinyobj::material_t::reflection_texname,
+	&tinyobj::material_t::specular_highlight_texname,
+	&tinyobj::material_t::roughness_texname,
+	&tinyobj::material_t::bump_texname,
+	&tinyobj::material_t::normal_texname,
+};
+
+struct MeshCacheMaterial {
+	float diffuse[3];
+	float roughness;
+	float metallic;
+};
+
+bool MeshCache::load(const std::string& filename, const glm::vec3& offset, bool useCache)
+{
+	uint64_t key = 0;
+	std::string path = cachePath(filename);
+	if (useCache && !contentKey(filename, offset, key)) {
+		WARN_LOG << "Could not hash mesh " << filename << ", loading it without cache";
+		useCache = false;
+	}
+	if (useCache) {
+		if (loadCache(path, key)) {
+			DEBUG_LOG << "Loaded mesh " << filename << " from cache " << path;
+			return true;
+		}
+	}
+
+	Mesh mesh(filename);
+	BufferFiller filler(mesh);
+	filler.setGlobalOffset(offset);
+	filler.fillIndexed(m_vertices, m_indices);
+	m_vertexCount = m_vertices.size();
+	m_indexCount = m_indices.size();
+	m_materials = mesh.materials();
+
+	if (useCache) {
+		saveCache(path, key);
+	}
+	return true;
+}
+
+const PointAttributes* MeshCache::vertices() const
+{
+	if (isFromCache()) {
+		return reinterpret_cast<const PointAttributes*>(m_file.data() + m_vertexOffset);
+	}
+	return m_vertices.data();
+}
+
+const GLuint* MeshCache::indices() const
+{
+	if (isFromCache()) {
+		return reinterpret_cast<const GLuint*>(m_file.data() + m_indexOffset);
+	}
+	return m_indices.data();
+}
+
+bool MeshCache::loadCache(const std::string& path, uint64_t key)
+{
+	std::error_code err;
+	if (!fs::exists(path, err)) return false;
+	if (!m_file.open(path)) return false;
+
+	// All reads are checked against the size of the file, which may be truncated
+	const char* data = m_file.data();
+	size_t size = m_file.size();
+	size_t cursor = 0;
+	auto read = [&](void* dst, size_t byteCount) {
+		if (cursor + byteCount > size) return false;
+		memcpy(dst, data + cursor, byteCount);
+		cursor += byteCount;
+		return true;
+	};
+	// Counts come from the file, so they are compared before multiplying,
+	// which could wrap around
+	auto fits = [&](uint64_t count, size_t elementSize) {
+		return count <= (size - cursor) / elementSize;
+	};
+	auto skip = [&](uint64_t count, size_t elementSize) {
+		if (!fits(count, elementSize)) return false;
+		cursor += static_cast<size_t>(count) * elementSize;
+		return true;
+	};
+
+	MeshCacheHeader header;
+	if (!read(&header, sizeof(header))
+		|| header.magic != MeshCacheHeader::s_magic
+		|| header.version != MeshCacheHeader::s_version) {
+		WARN_LOG << "Ignoring invalid mesh cache " << path;
+		m_file.close();
+		return false;
+	}
+	if (header.key != key) {
+		DEBUG_LOG << "Mesh cache " << path << " is outdated";
+		m_file.close();
+		return false;
+	}
+
+	bool ok = true;
+	m_vertexOffset = cursor;
+	ok = ok && skip(header.vertexCount, sizeof(PointAttributes));
+	m_indexOffset = cursor;
+	ok = ok && skip(header.indexCount, sizeof(GLuint));
+
+	ok = ok && fits(header.materialCount, sizeof(MeshCacheMaterial));
+	m_materials.resize(ok ? static_cast<size_t>(header.materialCount) : 0);
+	for (auto& mat : m_materials) {
+		MeshCacheMaterial m;
+		ok = ok && read(&m, sizeof(m));
+		if (!ok) break;
+		std::copy(m.diffuse, m.diffuse + 3, mat.diffuse);
+		mat.roughness = m.roughness;
+		mat.metallic = m.metallic;
+		for (auto texname : s_materialTextureNames) {
+			uint32_t length = 0;
+			ok = ok && read(&length, sizeof(length)) && cursor + length <= size;
+			if (!ok) break;
+			(mat.*texname).assign(data + cursor, length);
+			cursor += length;
+		}
+	}
+
+	if (!ok) {
+		WARN_LOG << "Ignoring truncated mesh cache " << path;
+		m_file.close();
+		m_materials.clear();
+		return false;
+	}
+
+	m_vertexCount = static_cast<size_t>(header.vertexCount);
+	m_indexCount = static_cast<size_t>(header.indexCount);
+	return true;
+}
+
+bool MeshCache::saveCache(const std::string& path, uint64_t key) const
+{
+	MeshCacheHeader header;
+	header.key = key;
+	header.vertexCount = static_cast<uint64_t>(m_vertexCount);
+	header.indexCount = static_cast<uint64_t>(m_indexCount);
+	header.materialCount = static_cast<uint64_t>(m_materials.size());
+
+	// Write then rename, so that concurrent instances never read partial files
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary);
+		if (!file.is_open()) {
+			DEBUG_LOG << "Could not write mesh cache " << tmpPath << " (is the directory read only?)";
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(vertices()), m_vertexCount * sizeof(PointAttributes));
+		file.write(reinterpret_cast<const char*>(indices()), m_indexCount * sizeof(GLuint));
+		for (const auto& mat : m_materials) {
+			MeshCacheMaterial m;
+			std::copy(mat.diffuse, mat.diffuse + 3, m.diffuse);
+			m.roughness = mat.roughness;
+			m.metallic = mat.metallic;
+			file.write(reinterpret_cast<const char*>(&m), sizeof(m));
+			for (auto texname : s_materialTextureNames) {
+				const std::string& str = mat.*texname;
+				uint32_t length = static_cast<uint32_t>(str.size());
+				file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+				file.write(str.data(), length);
+			}
+		}
+		if (!file) {
+			WARN_LOG << "Could not write mesh cache " << tmpPath;
+			return false;
+		}
+	}
+
+	std::error_code err;
+	fs::rename(tmpPath, path, err);
+	if (err) {
+		fs::remove(tmpPath, err);
+		return false;
+	}
+	DEBUG_LOG << "Wrote mesh cache " << path;
+	return true;
+}
+
+bool MeshCache::contentKey(const std::string& filename, const glm::vec3& offset, uint64_t& key)
+{
+	MappedFile file;
+	if (!file.open(filename)) return false;
+
+	Fnv1a hash;
+	hash.add(file.data(), file.size());
+	hash.addValue(offset);
+
+	// Material libraries, resolved like tinyobj does, relative to the OBJ file
+	std::string dir = baseDir(filename);
+	const char* data = file.data();
+	const char* end = data + file.size();
+	const std::string keyword = "mtllib";
+	for (const char* line = data; line < end; ) {
+		const char* lineEnd = std::find(line, end, '\n');
+		if (static_cast<size_t>(lineEnd - line) > keyword.size() && std::equal(keyword.begin(), keyword.end(), line)) {
+			std::istringstream names(std::string(line + keyword.size(), lineEnd));
+			std::string name;
+			while (names >> name) {
+				std::string path = joinPath(dir, name);
+				std::error_code err;
+				hash.add(name);
+				MappedFile mtl;
+				if (fs::exists(path, err) && mtl.open(path)) {
+					hash.add(mtl.data(), mtl.size());
+				}
+			}
+		}
+		line = lineEnd == end ? end : lineEnd + 1;
+	}
+
+	key = hash.value();
+	return true;
+}
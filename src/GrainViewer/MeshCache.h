@@ -0,0 +1,92 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <OpenGL>
+
+#include "bufferFillers.h"
+#include "utils/MappedFile.h"
+
+#include <tiny_obj_loader.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Mesh from an OBJ file, post-processed as MeshDataBehavior uploads it:
+ * welded and reordered vertices with their tangents, indices (see
+ * BufferFiller::FillIndexed) and materials. The result is cached in a binary
+ * file next to the OBJ, identified by a hash of the OBJ, of its material
+ * libraries and of the offset applied to positions. Later loads then map
+ * this file instead of parsing the OBJ.
+ */
+class MeshCache {
+public:
+	/**
+	 * Load from the cache file if it is valid, otherwise from the OBJ file,
+	 * in which case the cache file is written (if useCache is true).
+	 */
+	bool load(const std::string& filename, const glm::vec3& offset, bool useCache = true);
+
+	// Pointers remain valid as long as this object lives
+	const PointAttributes* vertices() const;
+	size_t vertexCount() const { return m_vertexCount; }
+	const GLuint* indices() const;
+	size_t indexCount() const { return m_indexCount; }
+	const std::vector<tinyobj::material_t>& materials() const { return m_materials; }
+
+	bool isFromCache() const { return m_file.isOpen(); }
+
+	static std::string cachePath(const std::string& filename) { return filename + ".cache"; }
+
+	/**
+	 * Hash of the OBJ file, of the material libraries it uses and of offset,
+	 * identifying the content of the cache.
+	 */
+	static bool contentKey(const std::string& filename, const glm::vec3& offset, uint64_t& key);
+
+private:
+	bool loadCache(const std::string& path, uint64_t key);
+	bool saveCache(const std::string& path, uint64_t key) const;
+
+private:
+	// Either mapped from the cache file, or built from the OBJ file
+	MappedFile m_file;
+	size_t m_vertexOffset = 0;
+	size_t m_indexOffset = 0;
+	std::vector<PointAttributes> m_vertices;
+	std::vector<GLuint> m_indices;
+
+	size_t m_vertexCount = 0;
+	size_t m_indexCount = 0;
+	std::vector<tinyobj::material_t> m_materials;
+};
@@ -30,9 +30,28 @@
 #include "Logger.h"
 #include "PointCloud.h"
 #include "utils/strutils.h"
+#include "utils/MappedFile.h"
+#include "utils/parallel.h"
+#include "utils/mathutils.h"
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+PointCloud::PointCloud()
+{}
+
+PointCloud::PointCloud(const std::string & filename)
+{
+	loadXYZ(filename);
+}
+
+PointCloud::~PointCloud()
+{}
 
 bool PointCloud::load(const std::string & filename)
 {
@@ -48,6 +67,92 @@ bool PointCloud::load(const std::string & filename)
 }
 
 bool PointCloud::loadXYZ(const std::string & filename) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		ERR_LOG << filename << " is not a valid XYZ file.";
+		return false;
+	}
+	m_mappedFile.reset();
+	const char *data = file.data();
+	size_t size = file.size();
+
+	// 1. Split file into line-aligned ranges, one per thread
+	size_t rangeCount = workerCount();
+	std::vector<size_t> rangeStart(rangeCount + 1, size);
+	rangeStart[0] = 0;
+	for (size_t r = 1; r < rangeCount; ++r) {
+		size_t pos = std::max(rangeStart[r - 1], r * size / rangeCount);
+		const void *eol = pos < size ? memchr(data + pos, '\n', size - pos) : nullptr;
+		rangeStart[r] = eol ? static_cast<const char*>(eol) - data + 1 : size;
+	}
+
+	// 2. Count numbers in each range to get the offset at which each range
+	// writes in the output buffer. Like operator>>, numbers are separated by
+	// any white space, not necessarily by lines of 3.
+	std::vector<size_t> tokenOffset(rangeCount + 1, 0);
+	parallelFor(rangeCount, [&](size_t begin, size_t end, size_t) {
+		for (size_t r = begin; r < end; ++r) {
+			size_t count = 0;
+			bool inToken = false;
+			for (size_t i = rangeStart[r]; i < rangeStart[r + 1]; ++i) {
+				bool isSpace = isClassicSpace(data[i]);
+				if (!isSpace && !inToken) ++count;
+				inToken = !isSpace;
+			}
+			tokenOffset[r + 1] = count;
+		}
+	}, rangeCount);
+	for (size_t r = 0; r < rangeCount; ++r) {
+		tokenOffset[r + 1] += tokenOffset[r];
+	}
+
+	// 3. Parse numbers in parallel, directly at their final location.
+	// Incomplete trailing points are dropped, like the sequential reader does.
+	size_t pointCount = tokenOffset[rangeCount] / 3;
+	m_data.resize(pointCount);
+	m_frame_count = 1;
+	m_chunks.clear();
+	m_radii.clear();
+	m_colors.clear();
+	float *coords = reinterpret_cast<float*>(m_data.data());
+	size_t coordCount = 3 * pointCount;
+	std::atomic<bool> isRegular(true);
+	parallelFor(rangeCount, [&](size_t begin, size_t end, size_t) {
+		for (size_t r = begin; r < end && isRegular; ++r) {
+			size_t token = tokenOffset[r];
+			const char *c = data + rangeStart[r];
+			const char *rangeEnd = data + rangeStart[r + 1];
+			while (c < rangeEnd) {
+				while (c < rangeEnd && isClassicSpace(*c)) ++c;
+				if (c == rangeEnd) break;
+				const char *tokenEnd = c;
+				while (tokenEnd < rangeEnd && !isClassicSpace(*tokenEnd)) ++tokenEnd;
+				float value;
+				if (!parseFloat(c, tokenEnd, value)) {
+					isRegular = false;
+					break;
+				}
+				if (token < coordCount) coords[token] = value;
+				++token;
+				c = tokenEnd;
+			}
+		}
+	}, rangeCount);
+
+	// Anything that is not a plain number (e.g. a header line) has subtle
+	// effects on the stream based reader, so we use it to get the exact same
+	// result in such cases.
+	if (!isRegular) {
+		DEBUG_LOG << "XYZ file contains irregular values, falling back to sequential reader: " << filename;
+		m_data.clear();
+		return loadXYZSequential(filename);
+	}
+
+	LOG << "Loaded cloud of " << m_data.size() << " points from " << filename;
+	return true;
+}
+
+bool PointCloud::loadXYZSequential(const std::string & filename) {
 	std::ifstream in(filename);
 	if (!in.is_open()) {
 		ERR_LOG << filename << " is not a valid XYZ file.";
@@ -64,32 +169,260 @@ bool PointCloud::loadXYZ(const std::string & filename) {
 	return true;
 }
 
+static_assert(sizeof(PointCloud::BinHeader) == 48, "BinHeader must have the same layout on all platforms");
+static_assert(sizeof(PointCloud::Chunk) == 48, "Chunk must have the same layout on all platforms");
+
+constexpr char binMagic[4] = { 'G', 'V', 'P', 'C' };
+
+/**
+ * Read header and chunk table of a Bin file using the read function, which
+ * must entirely fill the provided buffer or return false. Legacy headers are
+ * converted to a version 1 BinHeader.
+ */
+static bool readBinHeader(std::function<bool(void*, size_t)> read, const std::string & filename, PointCloud::BinHeader & header, std::vector<PointCloud::Chunk> & chunks)
+{
+	constexpr size_t legacyHeaderSize = 2 * sizeof(float);
+	if (!read(&header, legacyHeaderSize)) {
+		ERR_LOG << "Could not read point buffer header from file: " << filename;
+		return false;
+	}
+
+	if (memcmp(header.magic, binMagic, sizeof(binMagic)) != 0) {
+		float legacyHeader[2];
+		memcpy(legacyHeader, &header, legacyHeaderSize);
+		header.version = 1;
+		header.pointCount = static_cast<uint64_t>(legacyHeader[0]);
+		header.frameCount = static_cast<uint64_t>(legacyHeader[1]);
+		header.chunkCount = 0;
+		header.attributes = 0;
+		header.dataOffset = legacyHeaderSize;
+		chunks.clear();
+		if (header.frameCount == 0 && header.pointCount > 0) {
+			ERR_LOG << "Invalid frame count in point cloud file: " << filename;
+			return false;
+		}
+		return true;
+	}
+
+	if (header.version > PointCloud::s_binVersion) {
+		ERR_LOG << "Unsupported point cloud file version " << header.version << " (max supported: " << PointCloud::s_binVersion << "): " << filename;
+		return false;
+	}
+
+	char *rest = reinterpret_cast<char*>(&header) + legacyHeaderSize;
+	if (!read(rest, sizeof(header) - legacyHeaderSize)) {
+		ERR_LOG << "Could not read point buffer header from file: " << filename;
+		return false;
+	}
+
+	if (header.frameCount == 0 && header.pointCount > 0) {
+		ERR_LOG << "Invalid frame count in point cloud file: " << filename;
+		return false;
+	}
+	// Divisions rather than products, which could overflow
+	constexpr uint64_t maxCount = std::numeric_limits<uint64_t>::max();
+	if (header.frameCount > 0 && header.pointCount > maxCount / header.frameCount) {
+		ERR_LOG << "Invalid point count in point cloud file: " << filename;
+		return false;
+	}
+	uint64_t totalCount = header.pointCount * header.frameCount;
+	if (header.chunkCount > totalCount) {
+		ERR_LOG << "Invalid chunk count in point cloud file: " << filename;
+		return false;
+	}
+	chunks.resize(static_cast<size_t>(header.chunkCount));
+	if (!read(chunks.data(), chunks.size() * sizeof(PointCloud::Chunk))) {
+		ERR_LOG << "Could not read point buffer chunks from file: " << filename;
+		return false;
+	}
+	for (const PointCloud::Chunk & chunk : chunks) {
+		// Chunks must lie within their frame, which is within the point data
+		if (chunk.frame >= header.frameCount
+			|| chunk.firstPoint < chunk.frame * header.pointCount
+			|| chunk.pointCount > header.pointCount
+			|| chunk.firstPoint - chunk.frame * header.pointCount > header.pointCount - chunk.pointCount) {
+			ERR_LOG << "Invalid chunk range in point cloud file: " << filename;
+			return false;
+		}
+	}
+	return true;
+}
+
+static std::function<bool(void*, size_t)> streamReader(std::istream & in) {
+	return [&in](void *data, size_t size) {
+		return static_cast<bool>(in.read(static_cast<char*>(data), size));
+	};
+}
+
+bool PointCloud::loadBinRange(std::istream & in, const std::string & filename, const BinHeader & header, size_t firstPoint, size_t count)
+{
+	size_t totalCount = static_cast<size_t>(header.pointCount * header.frameCount);
+	std::streamoff offset = static_cast<std::streamoff>(header.dataOffset);
+
+	m_data.resize(count);
+	in.seekg(offset + firstPoint * sizeof(glm::vec3));
+	if (!in.read(reinterpret_cast<char*>(m_data.data()), count * sizeof(glm::vec3))) {
+		ERR_LOG << "Could not read point buffer from file: " << filename;
+		return false;
+	}
+	offset += totalCount * sizeof(glm::vec3);
+
+	m_radii.clear();
+	if (header.attributes & BinAttributeRadius) {
+		m_radii.resize(count);
+		in.seekg(offset + firstPoint * sizeof(float));
+		if (!in.read(reinterpret_cast<char*>(m_radii.data()), count * sizeof(float))) {
+			ERR_LOG << "Could not read point radii from file: " << filename;
+			return false;
+		}
+		offset += totalCount * sizeof(float);
+	}
+
+	m_colors.clear();
+	if (header.attributes & BinAttributeColor) {
+		m_colors.resize(count);
+		in.seekg(offset + firstPoint * sizeof(uint32_t));
+		if (!in.read(reinterpret_cast<char*>(m_colors.data()), count * sizeof(uint32_t))) {
+			ERR_LOG << "Could not read point colors from file: " << filename;
+			return false;
+		}
+		offset += totalCount * sizeof(uint32_t);
+	}
+
+	return true;
+}
+
 bool PointCloud::loadBin(const std::string & filename) {
 	std::ifstream in(filename, std::ios::binary);
 	if (!in.is_open()) {
 		ERR_LOG << filename << " is not a valid file.";
 		return false;
 	}
+	m_mappedFile.reset();
 
-	float header[2];
-	if (!in.read(reinterpret_cast<char*>(header), 2 * sizeof(float))) {
-		ERR_LOG << "Could not read point buffer from file: " << filename;
-		in.close();
+	BinHeader header;
+	if (!readBinHeader(streamReader(in), filename, header, m_chunks)) {
 		return false;
 	}
-	size_t point_count = static_cast<size_t>(header[0]);
-	m_frame_count = static_cast<size_t>(header[1]);
-	size_t size = point_count * m_frame_count;
+	m_frame_count = static_cast<size_t>(header.frameCount);
+	size_t size = static_cast<size_t>(header.pointCount) * m_frame_count;
 
-	m_data.resize(size);
-	if (!in.read(reinterpret_cast<char*>(m_data.data()), size * sizeof(float) * 3)) {
-		ERR_LOG << "Could not read point buffer from file: " << filename;
-		in.close();
+	if (!loadBinRange(in, filename, header, 0, size)) {
 		return false;
 	}
 
-	in.close();
-	LOG << "Loaded cloud of " << size << " points from " << filename << " (" << m_frame_count << " frames of " << point_count << " points)";
+	LOG << "Loaded cloud of " << size << " points from " << filename << " (" << m_frame_count << " frames of " << header.pointCount << " points, " << m_chunks.size() << " chunks)";
+	return true;
+}
+
+bool PointCloud::loadBinFrame(const std::string & filename, size_t frame) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open()) {
+		ERR_LOG << filename << " is not a valid file.";
+		return false;
+	}
+	m_mappedFile.reset();
+
+	BinHeader header;
+	std::vector<Chunk> allChunks;
+	if (!readBinHeader(streamReader(in), filename, header, allChunks)) {
+		return false;
+	}
+	if (frame >= header.frameCount) {
+		ERR_LOG << "Frame #" << frame << " is out of range in point cloud file: " << filename;
+		return false;
+	}
+
+	size_t firstPoint = static_cast<size_t>(header.pointCount) * frame;
+	m_frame_count = 1;
+	m_chunks.clear();
+	for (Chunk chunk : allChunks) {
+		if (chunk.frame == frame) {
+			chunk.frame = 0;
+			chunk.firstPoint -= firstPoint;
+			m_chunks.push_back(chunk);
+		}
+	}
+
+	if (!loadBinRange(in, filename, header, firstPoint, static_cast<size_t>(header.pointCount))) {
+		return false;
+	}
+
+	LOG << "Loaded frame #" << frame << " of " << header.pointCount << " points from " << filename;
+	return true;
+}
+
+bool PointCloud::loadBinChunk(const std::string & filename, size_t chunk) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open()) {
+		ERR_LOG << filename << " is not a valid file.";
+		return false;
+	}
+	m_mappedFile.reset();
+
+	BinHeader header;
+	std::vector<Chunk> allChunks;
+	if (!readBinHeader(streamReader(in), filename, header, allChunks)) {
+		return false;
+	}
+	if (chunk >= allChunks.size()) {
+		ERR_LOG << "Chunk #" << chunk << " is out of range in point cloud file: " << filename;
+		return false;
+	}
+
+	Chunk loadedChunk = allChunks[chunk];
+	size_t firstPoint = static_cast<size_t>(loadedChunk.firstPoint);
+	loadedChunk.frame = 0;
+	loadedChunk.firstPoint = 0;
+	m_frame_count = 1;
+	m_chunks = { loadedChunk };
+
+	if (!loadBinRange(in, filename, header, firstPoint, static_cast<size_t>(loadedChunk.pointCount))) {
+		return false;
+	}
+
+	LOG << "Loaded chunk #" << chunk << " of " << loadedChunk.pointCount << " points from " << filename;
+	return true;
+}
+
+bool PointCloud::mapBin(const std::string & filename) {
+	m_mappedFile = std::make_unique<MappedFile>();
+	m_mappedPoints = nullptr;
+	m_mappedPointCount = 0;
+	if (!m_mappedFile->open(filename)) {
+		m_mappedFile.reset();
+		return false;
+	}
+
+	size_t cursor = 0;
+	auto mappedReader = [this, &cursor](void *data, size_t size) {
+		if (cursor + size > m_mappedFile->size()) return false;
+		memcpy(data, m_mappedFile->data() + cursor, size);
+		cursor += size;
+		return true;
+	};
+
+	BinHeader header;
+	if (!readBinHeader(mappedReader, filename, header, m_chunks)) {
+		m_mappedFile.reset();
+		return false;
+	}
+	m_frame_count = static_cast<size_t>(header.frameCount);
+	size_t size = static_cast<size_t>(header.pointCount) * m_frame_count;
+
+	// Chunk ranges were checked against size by readBinHeader()
+	size_t fileSize = m_mappedFile->size();
+	if (header.dataOffset > fileSize || size > (fileSize - header.dataOffset) / sizeof(glm::vec3)) {
+		ERR_LOG << "Could not read point buffer from file: " << filename << " (file is truncated)";
+		m_mappedFile.reset();
+		return false;
+	}
+
+	m_mappedPoints = reinterpret_cast<const glm::vec3*>(m_mappedFile->data() + header.dataOffset);
+	m_mappedPointCount = size;
+	m_mappedFile->adviseSequential(static_cast<size_t>(header.dataOffset), size * sizeof(glm::vec3));
+
+	LOG << "Mapped cloud of " << size << " points from " << filename << " (" << m_frame_count << " frames of " << header.pointCount << " points, " << m_chunks.size() << " chunks)";
 	return true;
 }
 
@@ -146,29 +479,182 @@ bool PointCloud::loadMomentRaw(const std::string & filename, float threshold)
 	return true;
 }
 
-bool PointCloud::saveBin(const std::string & filename) {
+bool PointCloud::saveBin(const std::string & filename, uint32_t version) {
 	std::ofstream out(filename, std::ios::binary);
 	if (!out.is_open()) {
 		ERR_LOG << filename << " is not a writable file.";
 		return false;
 	}
 
-	float header[2];
-	header[0] = static_cast<float>(m_data.size() / m_frame_count);
-	header[1] = static_cast<float>(m_frame_count);
-	if (!out.write(reinterpret_cast<const char*>(header), 2 * sizeof(float))) {
-		ERR_LOG << "Could not write point buffer in file: " << filename;
-		out.close();
-		return false;
+	size_t size = pointCount();
+	size_t framePointCount = size / m_frame_count;
+
+	if (version == 1) {
+		if (framePointCount > (1 << 24)) {
+			WARN_LOG << "Point count cannot be exactly represented in version 1 of the Bin format, use version 2 instead";
+		}
+		float header[2];
+		header[0] = static_cast<float>(framePointCount);
+		header[1] = static_cast<float>(m_frame_count);
+		if (!out.write(reinterpret_cast<const char*>(header), 2 * sizeof(float))) {
+			ERR_LOG << "Could not write point buffer in file: " << filename;
+			out.close();
+			return false;
+		}
 	}
+	else {
+		if (m_chunks.empty()) {
+			computeChunks();
+		}
 
-	if (!out.write(reinterpret_cast<const char*>(m_data.data()), m_data.size() * sizeof(float) * 3)) {
+		BinHeader header;
+		memcpy(header.magic, binMagic, sizeof(binMagic));
+		header.version = s_binVersion;
+		header.pointCount = framePointCount;
+		header.frameCount = m_frame_count;
+		header.chunkCount = m_chunks.size();
+		header.attributes = 0;
+		if (m_radii.size() == size) header.attributes |= BinAttributeRadius;
+		if (m_colors.size() == size) header.attributes |= BinAttributeColor;
+		header.reserved = 0;
+		// Align point data on 16 bytes
+		size_t tableEnd = sizeof(BinHeader) + m_chunks.size() * sizeof(Chunk);
+		header.dataOffset = (tableEnd + 15) / 16 * 16;
+
+		const char padding[16] = { 0 };
+		if (!out.write(reinterpret_cast<const char*>(&header), sizeof(BinHeader))
+			|| !out.write(reinterpret_cast<const char*>(m_chunks.data()), m_chunks.size() * sizeof(Chunk))
+			|| !out.write(padding, header.dataOffset - tableEnd))
+		{
+			ERR_LOG << "Could not write point buffer in file: " << filename;
+			out.close();
+			return false;
+		}
+	}
+
+	if (!out.write(reinterpret_cast<const char*>(points()), size * sizeof(float) * 3)) {
 		ERR_LOG << "Could not write point buffer in file: " << filename;
 		out.close();
 		return false;
 	}
 
+	if (version > 1) {
+		if ((m_radii.size() == size && !out.write(reinterpret_cast<const char*>(m_radii.data()), size * sizeof(float)))
+			|| (m_colors.size() == size && !out.write(reinterpret_cast<const char*>(m_colors.data()), size * sizeof(uint32_t))))
+		{
+			ERR_LOG << "Could not write point attributes in file: " << filename;
+			out.close();
+			return false;
+		}
+	}
+
 	out.close();
-	LOG << "Saved cloud of " << m_data.size() << " points to " << filename << " (" << m_frame_count << " frames of " << (m_data.size() / m_frame_count) << " points)";
+	LOG << "Saved cloud of " << size << " points to " << filename << " (" << m_frame_count << " frames of " << framePointCount << " points, format version " << version << ")";
+	return true;
+}
+
+void PointCloud::computeChunks(size_t chunkSize)
+{
+	m_chunks.clear();
+	if (chunkSize == 0) return;
+	const glm::vec3 *p = points();
+	size_t framePointCount = pointCount() / m_frame_count;
+	for (size_t frame = 0; frame < m_frame_count; ++frame) {
+		for (size_t i = 0; i < framePointCount; i += chunkSize) {
+			Chunk chunk;
+			chunk.frame = frame;
+			chunk.firstPoint = frame * framePointCount + i;
+			chunk.pointCount = std::min(chunkSize, framePointCount - i);
+			chunk.aabbMin = chunk.aabbMax = p[chunk.firstPoint];
+			for (size_t j = chunk.firstPoint; j < chunk.firstPoint + chunk.pointCount; ++j) {
+				chunk.aabbMin = glm::min(chunk.aabbMin, p[j]);
+				chunk.aabbMax = glm::max(chunk.aabbMax, p[j]);
+			}
+			m_chunks.push_back(chunk);
+		}
+	}
+}
+
+bool PointCloud::sortMorton()
+{
+	if (m_mappedFile) {
+		ERR_LOG << "Cannot reorder a mapped point cloud, it must be loaded";
+		return false;
+	}
+
+	size_t framePointCount = pointCount() / m_frame_count;
+	if (framePointCount > std::numeric_limits<uint32_t>::max()) {
+		ERR_LOG << "Too many points per frame to be sorted: " << framePointCount;
+		return false;
+	}
+	if (framePointCount < 2) return true;
+
+	// 1. Compute Morton codes of the first frame, relative to its bounding box
+	glm::vec3 minCorner = m_data[0];
+	glm::vec3 maxCorner = m_data[0];
+	for (size_t i = 0; i < framePointCount; ++i) {
+		minCorner = glm::min(minCorner, m_data[i]);
+		maxCorner = glm::max(maxCorner, m_data[i]);
+	}
+	constexpr float gridSize = static_cast<float>((1 << 21) - 1);
+	glm::vec3 extent = maxCorner - minCorner;
+	glm::vec3 scale(0.0f);
+	for (int k = 0; k < 3; ++k) {
+		if (extent[k] > 0.0f) scale[k] = gridSize / extent[k];
+	}
+
+	std::vector<uint64_t> codes(framePointCount);
+	std::vector<uint32_t> permutation(framePointCount);
+	parallelFor(framePointCount, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			glm::vec3 q = glm::clamp((m_data[i] - minCorner) * scale, glm::vec3(0.0f), glm::vec3(gridSize));
+			codes[i] = mortonCode(static_cast<uint32_t>(q.x), static_cast<uint32_t>(q.y), static_cast<uint32_t>(q.z));
+			permutation[i] = static_cast<uint32_t>(i);
+		}
+	});
+
+	// 2. Sort point indices by code
+	parallelRadixSort(codes, permutation, 63);
+
+	// 3. Apply the same permutation to all frames, so that grains keep
+	// their identity along the animation, and to attributes
+	auto applyPermutation = [&](auto & values) {
+		auto permuted = values;
+		for (size_t frame = 0; frame < m_frame_count; ++frame) {
+			size_t offset = frame * framePointCount;
+			parallelFor(framePointCount, [&](size_t begin, size_t end, size_t) {
+				for (size_t i = begin; i < end; ++i) {
+					permuted[offset + i] = values[offset + permutation[i]];
+				}
+			});
+		}
+		values.swap(permuted);
+	};
+	applyPermutation(m_data);
+	if (m_radii.size() == m_data.size()) applyPermutation(m_radii);
+	if (m_colors.size() == m_data.size()) applyPermutation(m_colors);
+
+	// Chunk boundaries remain the same but their bounding boxes change
+	if (!m_chunks.empty()) {
+		computeChunks(static_cast<size_t>(m_chunks[0].pointCount));
+	}
+
 	return true;
 }
+
+const glm::vec3 *PointCloud::points() const
+{
+	return m_mappedFile ? m_mappedPoints : m_data.data();
+}
+
+size_t PointCloud::pointCount() const
+{
+	return m_mappedFile ? m_mappedPointCount : m_data.size();
+}
+
+void PointCloud::discard(size_t begin, size_t end) const
+{
+	if (!m_mappedFile || end <= begin) return;
+	size_t offset = reinterpret_cast<const char*>(m_mappedPoints + begin) - m_mappedFile->data();
+	m_mappedFile->discard(offset, (end - begin) * sizeof(glm::vec3));
+}
@@ -31,16 +31,64 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <iosfwd>
 
 #include <glm/glm.hpp>
 
+class MappedFile;
+
 /**
  * Class handling point cloud I/O
+ *
+ * Bin files (version 2) are laid out as follows:
+ *   BinHeader
+ *   Chunk[chunkCount], sorted by frame then by first point
+ *   positions, as 3 floats per point, frames one after the other (at dataOffset)
+ *   one array per optional attribute, in the order of BinAttribute bits
+ * Legacy files (version 1) only start with two floats, the point count per
+ * frame and the frame count, followed by positions.
  */
 class PointCloud {
 public:
-	PointCloud() {}
-	PointCloud(const std::string & filename) { loadXYZ(filename); }
+	static constexpr uint32_t s_binVersion = 2;
+	static constexpr size_t s_defaultChunkSize = 4096;
+
+	// Optional per-point attributes
+	enum BinAttribute : uint32_t {
+		BinAttributeRadius = 1 << 0, // one float per point
+		BinAttributeColor = 1 << 1, // one RGBA8 uint32 per point
+	};
+
+	struct BinHeader {
+		char magic[4]; // "GVPC"
+		uint32_t version;
+		uint64_t pointCount; // per frame
+		uint64_t frameCount;
+		uint64_t chunkCount; // all frames
+		uint32_t attributes; // bitfield of BinAttribute
+		uint32_t reserved;
+		uint64_t dataOffset; // byte offset of positions in the file
+	};
+
+	/**
+	 * Range of consecutive points of a single frame, together with its
+	 * bounding box. Points of a chunk are spatially close to each other only
+	 * if the point cloud has been sorted accordingly.
+	 */
+	struct Chunk {
+		uint64_t frame;
+		uint64_t firstPoint; // index in points(), i.e. including the frame offset
+		uint64_t pointCount;
+		glm::vec3 aabbMin;
+		glm::vec3 aabbMax;
+	};
+
+public:
+	PointCloud();
+	PointCloud(const std::string & filename);
+	~PointCloud();
 
 	// Guess codec using extension
 	bool load(const std::string & filename);
@@ -48,20 +96,92 @@ public:
 	// Force XYZ codec
 	bool loadXYZ(const std::string & filename);
 
-	// Force Bin codec (basically some ad-hoc memory dump)
+	/**
+	 * Reference XYZ reader, single threaded and based on standard streams.
+	 * loadXYZ() gives the exact same result much faster, this is only kept
+	 * for comparison.
+	 */
+	bool loadXYZSequential(const std::string & filename);
+
+	// Force Bin codec (basically some ad-hoc memory dump, with a header since version 2)
 	bool loadBin(const std::string & filename);
 
+	/**
+	 * Load a single animation frame, or a single chunk, from a Bin file.
+	 * Only the requested range is read from disk. The loaded cloud has a
+	 * single frame and the chunks contained in the loaded range.
+	 */
+	bool loadBinFrame(const std::string & filename, size_t frame);
+	bool loadBinChunk(const std::string & filename, size_t chunk);
+
 	// Force Raw codec (as specified in BlueNoise.py - by Moment in Graphics)
 	// threshold is used to determine the point density
 	bool loadMomentRaw(const std::string & filename, float threshold = 0.1f);
 
-	bool saveBin(const std::string & filename);
+	/**
+	 * Map a Bin file in memory instead of loading it, so that its content is
+	 * read lazily from disk without any copy. Points are then accessed using
+	 * points() and pointCount() while data() remains empty. Optional
+	 * attributes are not available for mapped clouds.
+	 */
+	bool mapBin(const std::string & filename);
+
+	/**
+	 * Save to Bin file. Chunks are computed if they have not been yet.
+	 * Version 1 is only meant for compatibility with older tools, it drops
+	 * chunks and attributes.
+	 */
+	bool saveBin(const std::string & filename, uint32_t version = s_binVersion);
+
+	/**
+	 * Split each frame into chunks of at most chunkSize consecutive points
+	 * and compute their bounding boxes.
+	 */
+	void computeChunks(size_t chunkSize = s_defaultChunkSize);
+
+	/**
+	 * Reorder points along a Morton curve of the first frame, so that
+	 * consecutive points, and hence chunks, are spatially close. All frames
+	 * and attributes are permuted the same way. Only works on loaded clouds.
+	 */
+	bool sortMorton();
 
 	size_t frameCount() const { return m_frame_count; }
 	const std::vector<glm::vec3> & data() const { return m_data; }
 	std::vector<glm::vec3> & data() { return m_data; }
 
+	// Raw access to points of all frames, valid whether the cloud is loaded or mapped
+	const glm::vec3 *points() const;
+	size_t pointCount() const;
+
+	// Chunks, empty if the file had none and computeChunks() was not called
+	const std::vector<Chunk> & chunks() const { return m_chunks; }
+
+	// Optional per-point attributes, empty if not available
+	const std::vector<float> & radii() const { return m_radii; }
+	std::vector<float> & radii() { return m_radii; }
+	const std::vector<uint32_t> & colors() const { return m_colors; }
+	std::vector<uint32_t> & colors() { return m_colors; }
+
+	/**
+	 * Tell that points [begin, end[ will not be read any more, so that the
+	 * memory they use can be released. Only has effect on mapped clouds.
+	 */
+	void discard(size_t begin, size_t end) const;
+
+private:
+	// Load point range [firstPoint, firstPoint + count[ and its attributes
+	bool loadBinRange(std::istream & in, const std::string & filename, const BinHeader & header, size_t firstPoint, size_t count);
+
 private:
 	std::vector<glm::vec3> m_data;
 	size_t m_frame_count = 1;
+	std::vector<Chunk> m_chunks;
+	std::vector<float> m_radii;
+	std::vector<uint32_t> m_colors;
+
+	// When mapped with mapBin()
+	std::unique_ptr<MappedFile> m_mappedFile;
+	const glm::vec3 *m_mappedPoints = nullptr;
+	size_t m_mappedPointCount = 0;
 };
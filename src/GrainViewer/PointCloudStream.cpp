@@ -0,0 +1,218 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "PointCloudStream.h"
+#include "PointCloud.h"
+#include "Logger.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+PointCloudStream::PointCloudStream(std::unique_ptr<PointCloud> pointCloud, int ringSize)
+	: m_pointCloud(std::move(pointCloud))
+{
+	size_t frameCount = std::max<size_t>(1, m_pointCloud->frameCount());
+	m_frameCount = static_cast<GLsizei>(frameCount);
+	m_pointCount = static_cast<GLsizei>(m_pointCloud->pointCount() / frameCount);
+	m_frameByteSize = std::max<GLsizeiptr>(1, m_pointCount * sizeof(glm::vec4));
+
+	int slotCount = std::max(2, std::min(ringSize, static_cast<int>(m_frameCount)));
+	m_staging = std::make_unique<GlStreamingBuffer>(m_frameByteSize, slotCount);
+	m_slots.resize(slotCount);
+	for (FrameSlot & slot : m_slots) {
+		slot.buffer = std::make_unique<GlBuffer>(GL_ARRAY_BUFFER);
+		slot.buffer->addBlock<glm::vec4>(m_pointCount);
+		slot.buffer->addBlockAttribute(0, 4);  // position
+		slot.buffer->alloc(0); // only written by copies from the staging buffer
+
+		glCreateVertexArrays(1, &slot.vao);
+		glBindVertexArray(slot.vao);
+		slot.buffer->bind();
+		slot.buffer->enableAttributes(slot.vao);
+		glBindVertexArray(0);
+
+		slot.buffer->finalize();
+	}
+
+	m_ioThread = std::thread(&PointCloudStream::ioThreadMain, this);
+}
+
+PointCloudStream::~PointCloudStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobsCondition.notify_all();
+	m_ioThread.join();
+
+	for (FrameSlot & slot : m_slots) {
+		glDeleteVertexArrays(1, &slot.vao);
+	}
+}
+
+int PointCloudStream::currentFrame() const
+{
+	return m_currentSlot >= 0 ? m_slots[m_currentSlot].frame : -1;
+}
+
+GLuint PointCloudStream::vao() const
+{
+	return m_slots[std::max(0, m_currentSlot)].vao;
+}
+
+const GlBuffer& PointCloudStream::vbo() const
+{
+	return *m_slots[std::max(0, m_currentSlot)].buffer;
+}
+
+void PointCloudStream::update(int frame, bool wait)
+{
+	frame = frame % m_frameCount;
+	collectLoadedFrames(false);
+	selectFrame(frame);
+	scheduleFrames(frame, false);
+	while (wait && currentFrame() != frame) {
+		// The requested frame is always either being loaded or scheduled
+		// here, because the blocking variant of scheduleFrames() waits for
+		// staging segments to be available.
+		scheduleFrames(frame, true);
+		collectLoadedFrames(true);
+		selectFrame(frame);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+
+void PointCloudStream::collectLoadedFrames(bool wait)
+{
+	std::vector<int> loadedSlots;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (wait) {
+			m_loadedCondition.wait(lock, [this] { return !m_loadedSlots.empty(); });
+		}
+		std::swap(loadedSlots, m_loadedSlots);
+	}
+
+	for (int i : loadedSlots) {
+		FrameSlot & slot = m_slots[i];
+		// Copies are ordered with the draw calls that previously read from
+		// the slot buffer, so there is no need to fence the slot itself.
+		m_staging->copySegment(i, slot.buffer->name(), 0, m_frameByteSize);
+		slot.state = SlotState::Resident;
+	}
+}
+
+void PointCloudStream::selectFrame(int frame)
+{
+	int slot = findSlot(frame);
+	if (slot != -1 && m_slots[slot].state == SlotState::Resident) {
+		m_currentSlot = slot;
+	}
+}
+
+void PointCloudStream::scheduleFrames(int frame, bool wait)
+{
+	int slotCount = static_cast<int>(m_slots.size());
+	for (int k = 0; k < slotCount; ++k) {
+		int nextFrame = (frame + k) % m_frameCount;
+		if (findSlot(nextFrame) != -1) continue;
+
+		// Find a slot that is neither current, busy nor holding a frame
+		// among the ones that are about to be displayed.
+		int freeSlot = -1;
+		for (int i = 0; i < slotCount && freeSlot == -1; ++i) {
+			const FrameSlot & slot = m_slots[i];
+			if (i == m_currentSlot) continue;
+			if (slot.state == SlotState::Loading) continue;
+			if (slot.frame != -1 && (slot.frame - frame + m_frameCount) % m_frameCount < k) continue;
+			if (wait) {
+				m_staging->waitSegment(i);
+			}
+			else if (!m_staging->isSegmentAvailable(i)) {
+				continue;
+			}
+			freeSlot = i;
+		}
+		if (freeSlot == -1) break;
+
+		FrameSlot & slot = m_slots[freeSlot];
+		slot.frame = nextFrame;
+		slot.state = SlotState::Loading;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(freeSlot);
+		}
+		m_jobsCondition.notify_one();
+	}
+}
+
+int PointCloudStream::findSlot(int frame) const
+{
+	for (int i = 0; i < static_cast<int>(m_slots.size()); ++i) {
+		if (m_slots[i].frame == frame && m_slots[i].state != SlotState::Empty) return i;
+	}
+	return -1;
+}
+
+void PointCloudStream::ioThreadMain()
+{
+	for (;;) {
+		int i;
+		int frame;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobsCondition.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_stop) return;
+			i = m_jobs.front();
+			m_jobs.pop_front();
+			frame = m_slots[i].frame;
+		}
+
+		size_t begin = static_cast<size_t>(frame) * m_pointCount;
+		size_t end = begin + m_pointCount;
+		const glm::vec3 *points = m_pointCloud->points();
+		glm::vec4 *data = static_cast<glm::vec4*>(m_staging->segmentData(i));
+		for (size_t j = begin; j < end; ++j) {
+			*(data++) = glm::vec4(points[j], 1.0f);
+		}
+		// Release the pages of the mapped file, the frame will be read again
+		// from disk when the animation loops
+		m_pointCloud->discard(begin, end);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_loadedSlots.push_back(i);
+		}
+		m_loadedCondition.notify_all();
+	}
+}
@@ -0,0 +1,125 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <OpenGL>
+
+#include "GlBuffer.h"
+#include "GlStreamingBuffer.h"
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class PointCloud;
+
+/**
+ * Play an animated point cloud back while keeping only a small ring of
+ * frames in video memory. Frames are read from a memory mapped PointCloud
+ * by a background thread, directly into the persistently mapped segments of
+ * a GlStreamingBuffer, then copied by the GPU into device local frame slots.
+ *
+ * Each slot has its own buffer and vao. All methods but the constructor
+ * must be called from the thread owning the GL context.
+ */
+class PointCloudStream {
+public:
+	/**
+	 * Take ownership of a point cloud, that should have been opened with
+	 * PointCloud::mapBin() so that frames are only read when streamed.
+	 */
+	PointCloudStream(std::unique_ptr<PointCloud> pointCloud, int ringSize = 3);
+	~PointCloudStream();
+	PointCloudStream(const PointCloudStream &) = delete;
+	PointCloudStream & operator=(const PointCloudStream &) = delete;
+
+	/// Number of points per frame
+	GLsizei pointCount() const { return m_pointCount; }
+	GLsizei frameCount() const { return m_frameCount; }
+
+	/// Frame currently displayed, i.e. held by vbo(), or -1
+	int currentFrame() const;
+	GLuint vao() const;
+	const GlBuffer& vbo() const;
+
+	/**
+	 * Retrieve frames loaded by the background thread, switch to the
+	 * requested frame if it is resident and schedule the loading of next
+	 * frames. If wait is false and the frame is not ready yet, the
+	 * previous one remains current.
+	 */
+	void update(int frame, bool wait = false);
+
+private:
+	enum class SlotState {
+		Empty,
+		Loading, // the slot's staging segment is being written by the I/O thread
+		Resident,
+	};
+
+	struct FrameSlot {
+		std::unique_ptr<GlBuffer> buffer;
+		GLuint vao;
+		int frame = -1;
+		SlotState state = SlotState::Empty;
+	};
+
+	// Copy frames loaded by the I/O thread from staging to slot buffers
+	void collectLoadedFrames(bool wait);
+	// Make the slot holding frame current, if it is resident
+	void selectFrame(int frame);
+	// Start loading frames [frame, frame + ring size[ in available slots
+	void scheduleFrames(int frame, bool wait);
+	int findSlot(int frame) const;
+	void ioThreadMain();
+
+private:
+	std::unique_ptr<PointCloud> m_pointCloud;
+	GLsizei m_pointCount;
+	GLsizei m_frameCount;
+	GLsizeiptr m_frameByteSize;
+
+	// Segment i of the staging buffer is the upload area of slot i
+	std::unique_ptr<GlStreamingBuffer> m_staging;
+	std::vector<FrameSlot> m_slots;
+	int m_currentSlot = -1;
+
+	// Shared with the I/O thread, guarded by m_mutex. Jobs are slot indices.
+	std::thread m_ioThread;
+	std::mutex m_mutex;
+	std::condition_variable m_jobsCondition;
+	std::condition_variable m_loadedCondition;
+	std::deque<int> m_jobs;
+	std::vector<int> m_loadedSlots;
+	bool m_stop = false;
+};
@@ -49,3 +49,13 @@ enum class RenderType
 	 */
 	ShadowMap,
 };
+
+class Camera;
+
+/**
+ * A view about to be rendered, see Behavior::onPreRenderViews()
+ */
+struct PreRenderView {
+	const Camera* camera;
+	RenderType target;
+};
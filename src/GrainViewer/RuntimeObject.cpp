@@ -53,6 +53,14 @@ void RuntimeObject::reloadShaders()
 	}
 }
 
+void RuntimeObject::precompileShaders()
+{
+	// Including disabled behaviors, which may get enabled from the UI
+	forEachBehavior {
+		b->precompileShaders();
+	}
+}
+
 void RuntimeObject::update(float time, int frame)
 {
 	forEachBehavior {
@@ -61,6 +69,14 @@ void RuntimeObject::update(float time, int frame)
 	}
 }
 
+void RuntimeObject::onPreRenderViews(const std::vector<PreRenderView>& views, const World& world)
+{
+	forEachBehavior {
+		if (b->isEnabled())
+			b->onPreRenderViews(views, world);
+	}
+}
+
 void RuntimeObject::onPreRender(const Camera& camera, const World& world, RenderType target)
 {
 	forEachBehavior {
@@ -48,8 +48,10 @@ public:
 
 	void start();
 	void reloadShaders();
+	void precompileShaders();
 	void update(float time, int frame);
 	void render(const Camera & camera, const World & world, RenderType target) const;
+	void onPreRenderViews(const std::vector<PreRenderView>& views, const World& world);
 	void onPreRender(const Camera& camera, const World& world, RenderType target);
 	void onPostRender(float time, int frame);
 
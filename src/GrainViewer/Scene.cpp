@@ -80,6 +80,8 @@ void Scene::reloadShaders() {
 }
 
 void Scene::update(float time) {
+	ShaderPool::PollLoadingShaders();
+
 	if (m_paused) {
 		m_timeOffset = time - m_time;
 	}
@@ -147,6 +149,8 @@ void Scene::render() const {
 	glDisable(GL_BLEND);
 	glDisable(GL_DITHER);
 
+	preRenderViews();
+
 	m_world->renderShadowMaps(m_objects);
 
 	for (const auto& camera : m_cameras) {
@@ -311,6 +315,24 @@ void Scene::renderCamera(const Camera& camera) const
 	}
 }
 
+void Scene::preRenderViews() const
+{
+	// Must list the same views as renderShadowMaps() and renderCamera()
+	std::vector<PreRenderView> shadowMapViews;
+	m_world->appendShadowMapViews(shadowMapViews);
+
+	for (auto obj : m_objects) {
+		std::vector<PreRenderView> views = shadowMapViews;
+		for (const auto& camera : m_cameras) {
+			if (camera->properties().displayInViewport && (obj->viewLayers & camera->properties().viewLayers)) {
+				const Camera& prerenderCamera = properties().freezeOcclusionCamera ? *occlusionCamera() : *camera;
+				views.push_back(PreRenderView{ &prerenderCamera, RenderType::Default });
+			}
+		}
+		obj->onPreRenderViews(views, *m_world);
+	}
+}
+
 void Scene::measureStats()
 {
 	if (m_statsCountColors.empty() || !m_outputStatsFile.is_open()) return;
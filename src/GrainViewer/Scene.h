@@ -88,12 +88,14 @@ public:
 		bool freezeOcclusionCamera = false;
 		bool realTime = false;
 		bool ui = true;
+		bool precompileShaders = true; // compile all shader variants in the background after loading
 	};
 	Properties& properties() { return m_properties; }
 	const Properties& properties() const { return m_properties; }
 
 private:
 	void renderCamera(const Camera & camera) const;
+	void preRenderViews() const;
 	std::shared_ptr<Camera> occlusionCamera() const;
 	void measureStats();
 	// TODO: This should be in another section of the code
@@ -148,4 +150,5 @@ REFL_TYPE(Scene::Properties)
 REFL_FIELD(freezeOcclusionCamera)
 REFL_FIELD(realTime)
 REFL_FIELD(ui)
+REFL_FIELD(precompileShaders)
 REFL_END
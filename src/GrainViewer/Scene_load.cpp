@@ -42,6 +42,7 @@
 #include "utils/behaviorutils.h"
 #include "Scene.h"
 #include "ShaderPool.h"
+#include "ShaderBinaryCache.h"
 #include "EnvironmentVariables.h"
 #include "BehaviorRegistry.h"
 #include "Behavior.h"
@@ -86,6 +87,17 @@ bool Scene::load(const std::string & filename)
 
 	rapidjson::Value& root = d["augen"];
 
+	if (root.HasMember("shaderCache")) {
+		const rapidjson::Value& cache = root["shaderCache"];
+		if (cache.IsString()) {
+			ShaderBinaryCache::setDirectory(ResourceManager::resolveResourcePath(cache.GetString()));
+		} else if (cache.IsBool() && !cache.GetBool()) {
+			ShaderBinaryCache::setDirectory("");
+		} else {
+			WARN_LOG << "Ignoring 'shaderCache' (expected a directory or false)";
+		}
+	}
+
 	if (root.HasMember("shaders")) {
 		if (!ShaderPool::Deserialize(root["shaders"])) {
 			return false;
@@ -226,6 +238,15 @@ bool Scene::load(const std::string & filename)
 
 	reloadShaders();
 
+	// Without background compilation, shaders keep being compiled on first use
+	if (properties().precompileShaders && ShaderPool::SetDeferredLoading(true)) {
+		for (auto& obj : m_objects) {
+			obj->precompileShaders();
+		}
+		ShaderPool::SetDeferredLoading(false);
+		DEBUG_LOG << ShaderPool::LoadingShaderCount() << " shaders compiling in the background";
+	}
+
 	// Start color output stats
 	if (!m_outputStats.empty()) {
 		fs::create_directories(fs::path(m_outputStats).parent_path());
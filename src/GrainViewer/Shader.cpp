@@ -60,16 +60,17 @@ bool Shader::load(const std::string &filename, const std::vector<std::string> &
 		return false;
 	}
 
-	std::vector<GLchar> buf;
-	preprocessor.source(buf);
-	const GLchar *source = &buf[0];
+	load(preprocessor);
+	return true;
+}
+
+void Shader::load(const ShaderPreprocessor & preprocessor) {
+	const GLchar *source = preprocessor.source().c_str();
     glShaderSource(m_shaderId, 1, &source, 0);
 
 #ifndef NDEBUG
 	m_preprocessor = preprocessor;
 #endif
-
-	return true;
 }
 
 
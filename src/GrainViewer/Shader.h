@@ -43,6 +43,8 @@
 #include <map>
 #include <memory>
 
+class ShaderPreprocessor;
+
 /**
  * Utility class providing an OO API to OpenGL shaders
  */
@@ -57,6 +59,11 @@ public:
      */
     bool load(const std::string &filename, const std::vector<std::string> & defines = {}, const std::map<std::string, std::string> & snippets = {});
 
+    /**
+     * Load already preprocessed source into the shader
+     */
+    void load(const ShaderPreprocessor & preprocessor);
+
     /**
      * Compile the shader
      */
@@ -0,0 +1,195 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "ShaderBinaryCache.h"
+#include "Logger.h"
+
+#include <cstdint>
+#include <fstream>
+#include <system_error>
+#include <vector>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+// Header of cache entries, followed by the identity of the program and the
+// binary itself
+struct ShaderBinaryCacheHeader {
+	uint32_t magic = s_magic;
+	uint32_t version = s_version;
+	uint32_t binaryFormat = 0;
+	uint32_t binaryLength = 0;
+	uint64_t identityLength = 0;
+
+	static constexpr uint32_t s_magic = 0x42505647; // "GVPB"
+	static constexpr uint32_t s_version = 2;
+};
+
+static std::string defaultDirectory()
+{
+	std::error_code err;
+	fs::path tmp = fs::temp_directory_path(err);
+	if (err) return "";
+	return (tmp / "GrainViewer" / "shader-cache").string();
+}
+
+std::string ShaderBinaryCache::s_directory = defaultDirectory();
+
+void ShaderBinaryCache::setDirectory(const std::string& path)
+{
+	s_directory = path;
+}
+
+bool ShaderBinaryCache::isEnabled()
+{
+	if (s_directory.empty()) return false;
+	// Some drivers support the API but no binary format
+	static GLint formatCount = -1;
+	if (formatCount < 0) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		if (formatCount == 0) {
+			WARN_LOG << "Driver supports no program binary format, shader binary cache is disabled";
+		}
+	}
+	return formatCount > 0;
+}
+
+const std::string& ShaderBinaryCache::driverId()
+{
+	static std::string id;
+	if (id.empty()) {
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+			const GLubyte* str = glGetString(name);
+			id += std::string(str ? reinterpret_cast<const char*>(str) : "") + "\n";
+		}
+	}
+	return id;
+}
+
+bool ShaderBinaryCache::load(GLuint program, const std::string& key, const std::string& identity)
+{
+	if (!isEnabled()) return false;
+
+	std::string path = entryPath(key);
+	std::error_code err;
+	uintmax_t fileSize = fs::file_size(path, err);
+	if (err) return false;
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) return false;
+
+	ShaderBinaryCacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != ShaderBinaryCacheHeader::s_magic || header.version != ShaderBinaryCacheHeader::s_version) {
+		WARN_LOG << "Ignoring invalid shader binary cache entry " << path;
+		return false;
+	}
+	// Lengths are bounded by the file size before allocating anything
+	if (header.identityLength > fileSize - sizeof(header) || header.binaryLength > fileSize - sizeof(header) - header.identityLength) {
+		WARN_LOG << "Ignoring truncated shader binary cache entry " << path;
+		return false;
+	}
+
+	if (header.identityLength != identity.size()) return false;
+	std::string storedIdentity(static_cast<size_t>(header.identityLength), '\0');
+	file.read(storedIdentity.data(), storedIdentity.size());
+	if (!file || storedIdentity != identity) {
+		DEBUG_LOG << "Shader binary cache entry " << path << " belongs to another program";
+		return false;
+	}
+
+	std::vector<char> binary(header.binaryLength);
+	file.read(binary.data(), binary.size());
+	if (!file) {
+		WARN_LOG << "Ignoring truncated shader binary cache entry " << path;
+		return false;
+	}
+
+	// The driver may still reject a binary, e.g. after an update that did not
+	// change its version string.
+	glProgramBinary(program, static_cast<GLenum>(header.binaryFormat), binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint ok;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		DEBUG_LOG << "Shader binary cache entry " << path << " rejected by the driver";
+		return false;
+	}
+	return true;
+}
+
+bool ShaderBinaryCache::save(GLuint program, const std::string& key, const std::string& identity)
+{
+	if (!isEnabled()) return false;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return false;
+
+	ShaderBinaryCacheHeader header;
+	std::vector<char> binary(static_cast<size_t>(length));
+	GLenum binaryFormat;
+	glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+	header.binaryFormat = static_cast<uint32_t>(binaryFormat);
+	header.binaryLength = static_cast<uint32_t>(length);
+	header.identityLength = static_cast<uint64_t>(identity.size());
+
+	std::error_code err;
+	fs::create_directories(s_directory, err);
+	if (err) {
+		WARN_LOG << "Could not create shader binary cache directory " << s_directory << ": " << err.message();
+		return false;
+	}
+
+	// Write then rename, so that concurrent instances never read partial entries
+	std::string path = entryPath(key);
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary);
+		if (!file.is_open()) {
+			WARN_LOG << "Could not write shader binary cache entry " << tmpPath;
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(identity.data(), identity.size());
+		file.write(binary.data(), header.binaryLength);
+		if (!file) {
+			WARN_LOG << "Could not write shader binary cache entry " << tmpPath;
+			return false;
+		}
+	}
+	fs::rename(tmpPath, path, err);
+	if (err) {
+		fs::remove(tmpPath, err);
+		return false;
+	}
+	return true;
+}
+
+std::string ShaderBinaryCache::entryPath(const std::string& key)
+{
+	return (fs::path(s_directory) / (key + ".bin")).string();
+}
@@ -0,0 +1,78 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <OpenGL>
+
+#include <string>
+
+/**
+ * On-disk cache of linked shader programs, as returned by glGetProgramBinary.
+ * Programs are identified by a key hashing their preprocessed sources
+ * together with the vendor, renderer and version of the OpenGL driver, so
+ * that changes of either lead to a recompilation.
+ * (This is a static class, like ResourceManager)
+ */
+class ShaderBinaryCache {
+public:
+	/**
+	 * Directory where binaries are stored, created when first needed.
+	 * An empty path disables the cache.
+	 */
+	static void setDirectory(const std::string& path);
+	static const std::string& directory() { return s_directory; }
+	static bool isEnabled();
+
+	/**
+	 * Identifier of the current driver, to be hashed in cache keys
+	 */
+	static const std::string& driverId();
+
+	/**
+	 * Load a cached binary into the program, which must not have been linked
+	 * yet. The key names the entry, and the identity (what the key hashes) is
+	 * compared with the one stored in it, so that hash collisions are not
+	 * mistaken for hits. Return false if there is no valid entry, in which
+	 * case the program must be built from sources.
+	 */
+	static bool load(GLuint program, const std::string& key, const std::string& identity);
+
+	/**
+	 * Store the binary of a successfully linked program. It must have been
+	 * linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+	 */
+	static bool save(GLuint program, const std::string& key, const std::string& identity);
+
+private:
+	static std::string entryPath(const std::string& key);
+
+private:
+	static std::string s_directory;
+};
@@ -30,6 +30,7 @@
 #include "Logger.h"
 #include "ShaderPool.h"
 
+#include <algorithm>
 #include <sstream>
 
 #undef GetObject
@@ -73,6 +74,26 @@ std::shared_ptr<ShaderProgram> ShaderPool::GetShader(const std::string & shaderN
 	return s_instance.getShader(shaderName);
 }
 
+void ShaderPool::PrecompileShader(const std::string & shaderName)
+{
+	s_instance.findShader(shaderName);
+}
+
+bool ShaderPool::SetDeferredLoading(bool deferred)
+{
+	return s_instance.setDeferredLoading(deferred);
+}
+
+void ShaderPool::PollLoadingShaders()
+{
+	s_instance.pollLoadingShaders();
+}
+
+int ShaderPool::LoadingShaderCount()
+{
+	return static_cast<int>(s_instance.m_loadingShaders.size());
+}
+
 void ShaderPool::ReloadShaders()
 {
 	s_instance.reloadShaders();
@@ -97,6 +118,38 @@ ShaderPool::ShaderPool()
 		"PrefixSum",
 		{ "prefix-sum", ShaderProgram::ComputeShader, {} }
 	});
+	m_defaultShaders.insert({
+		"GrainSplitChunkCulling",
+		{ "grain/cull-chunks", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"PrefixSumSplitter",
+		{ "grain/prefixsum-splitter", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"GrainSplitDrawCommands",
+		{ "grain/splitter-draw-commands", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"InstanceGrainLods",
+		{ "grain/instance-lods", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"IncrementalSplitter",
+		{ "grain/incremental-splitter", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"MultiViewSplitter",
+		{ "grain/multiview-splitter", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"GrainSplitHzbOccluders",
+		{ "grain/hzb-occluders", ShaderProgram::RenderShader, {} }
+	});
+	m_defaultShaders.insert({
+		"GrainSplitHzbSaveOccluders",
+		{ "grain/hzb-save-occluders", ShaderProgram::ComputeShader, {} }
+	});
 	m_defaultShaders.insert({
 		"LightGizmo",
 		{ "light-gizmo", ShaderProgram::RenderShader,{} }
@@ -146,7 +199,7 @@ void ShaderPool::addShader(
 	for (const auto& s : snippets) {
 		m_shaders[shaderName]->setSnippet(s.first, s.second);
 	}
-	m_shaders[shaderName]->load();
+	loadShader(m_shaders[shaderName]);
 }
 
 void ShaderPool::addShaderVariant(
@@ -155,21 +208,35 @@ void ShaderPool::addShaderVariant(
 	const std::vector<std::string> & defines,
 	const std::map<std::string, std::string>& snippets)
 {
-	auto baseShader = getShader(baseShaderName);
+	if (m_shaders.count(shaderName) > 0) {
+		// Already added, e.g. when precompiling variants
+		return;
+	}
+
+	auto baseShader = findShader(baseShaderName);
 	if (!baseShader) {
 		WARN_LOG << "Cannot add variant to unexistant shader: " << baseShaderName;
 		return;
 	}
 
-	bool alreadyDefined = true;
+	// Alias the base shader if it already has all defines and snippets
+	bool isAlias = true;
 	for (const auto & def : defines) {
 		if (baseShader->getDefines().count(def) == 0) {
-			alreadyDefined = false;
+			isAlias = false;
+			break;
+		}
+	}
+	const auto& baseSnippets = baseShader->getSnippets();
+	for (const auto& s : snippets) {
+		auto it = baseSnippets.find(s.first);
+		if (it == baseSnippets.end() || it->second != s.second) {
+			isAlias = false;
 			break;
 		}
 	}
 
-	if (alreadyDefined) {
+	if (isAlias) {
 		m_shaders[shaderName] = baseShader;
 	} else {
 		m_shaders[shaderName] = std::make_shared<ShaderProgram>(baseShader->shaderName());
@@ -179,16 +246,25 @@ void ShaderPool::addShaderVariant(
 				m_shaders[shaderName]->define(def);
 			}
 		}
-		m_shaders[shaderName]->load();
+		// (override snippets of the base shader)
+		for (const auto& s : snippets) {
+			m_shaders[shaderName]->setSnippet(s.first, s.second);
+		}
+		loadShader(m_shaders[shaderName]);
 	}
+}
 
-	// (override snippets even if already defined)
-	for (const auto& s : snippets) {
-		m_shaders[shaderName]->setSnippet(s.first, s.second);
+std::shared_ptr<ShaderProgram> ShaderPool::getShader(const std::string & shaderName)
+{
+	auto shader = findShader(shaderName);
+	if (shader && shader->isLoading()) {
+		shader->finishLoading();
+		m_loadingShaders.erase(std::remove(m_loadingShaders.begin(), m_loadingShaders.end(), shader), m_loadingShaders.end());
 	}
+	return shader;
 }
 
-std::shared_ptr<ShaderProgram> ShaderPool::getShader(const std::string & shaderName)
+std::shared_ptr<ShaderProgram> ShaderPool::findShader(const std::string & shaderName)
 {
 	if (m_shaders.count(shaderName) > 0) {
 		return m_shaders.at(shaderName);
@@ -201,13 +277,59 @@ std::shared_ptr<ShaderProgram> ShaderPool::getShader(const std::string & shaderN
 	}
 }
 
+void ShaderPool::loadShader(const std::shared_ptr<ShaderProgram> & shader)
+{
+	if (m_deferredLoading) {
+		shader->loadAsync();
+		if (shader->isLoading()) {
+			m_loadingShaders.push_back(shader);
+		}
+	} else {
+		shader->load();
+	}
+}
+
+bool ShaderPool::setDeferredLoading(bool deferred)
+{
+	if (deferred && !GLAD_GL_KHR_parallel_shader_compile) {
+		DEBUG_LOG << "KHR_parallel_shader_compile is not supported, shaders are loaded synchronously";
+		deferred = false;
+	}
+	if (deferred) {
+		// Let the driver choose how many threads it uses
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+	m_deferredLoading = deferred;
+	return m_deferredLoading;
+}
+
+void ShaderPool::pollLoadingShaders()
+{
+	if (m_loadingShaders.empty()) return;
+	auto it = std::remove_if(m_loadingShaders.begin(), m_loadingShaders.end(), [](const std::shared_ptr<ShaderProgram>& shader) {
+		if (!shader->isReady()) return false;
+		shader->finishLoading();
+		return true;
+	});
+	m_loadingShaders.erase(it, m_loadingShaders.end());
+	if (m_loadingShaders.empty()) {
+		LOG << "All shaders compiled";
+	}
+}
+
 void ShaderPool::reloadShaders()
 {
 	LOG << "Reloading shaders...";
+	int reloadCount = 0;
 	for (auto const& e : m_shaders)
 	{
-		e.second->load();
+		// (variants sharing the same program are up to date once reloaded)
+		if (!e.second->isUpToDate()) {
+			e.second->load();
+			++reloadCount;
+		}
 	}
+	LOG << "Reloaded " << reloadCount << " shaders out of " << m_shaders.size();
 }
 
 bool ShaderPool::deserialize(const rapidjson::Value & json)
@@ -280,4 +402,5 @@ bool ShaderPool::deserialize(const rapidjson::Value & json)
 void ShaderPool::clear()
 {
 	m_shaders.clear();
+	m_loadingShaders.clear();
 }
@@ -34,6 +34,7 @@
 #include <rapidjson/document.h>
 
 #include <map>
+#include <vector>
 #include <string>
 #include <memory>
 
@@ -57,6 +58,11 @@ public:
 		const std::string & baseShaderName,
 		const std::string & define);
 
+	/**
+	 * Same with several defines and snippets, which override those of the
+	 * base shader. The variant is an alias only if the base shader already
+	 * has all of them.
+	 */
 	static void AddShaderVariant(
 		const std::string& shaderName,
 		const std::string& baseShaderName,
@@ -64,10 +70,39 @@ public:
 		const std::map<std::string, std::string>& snippets = {});
 
 	/**
-	 * Get a shader from the pool by its name.
+	 * Get a shader from the pool by its name. If it is still being compiled in
+	 * the background, this waits for it.
 	 */
 	static std::shared_ptr<ShaderProgram> GetShader(const std::string & shaderName);
 
+	/**
+	 * Same as GetShader(), but does not wait for the shader if its loading
+	 * is deferred (see SetDeferredLoading()).
+	 */
+	static void PrecompileShader(const std::string & shaderName);
+
+	/**
+	 * While deferred, shaders added to the pool (including default shaders
+	 * used as variant bases) are only submitted to the driver, and finished
+	 * either by GetShader() or by PollLoadingShaders() once the driver is
+	 * done. This is ignored when KHR_parallel_shader_compile is not
+	 * supported, since there would be no way to tell whether finishing a
+	 * shader blocks.
+	 * @return whether loading is actually deferred
+	 */
+	static bool SetDeferredLoading(bool deferred);
+
+	/**
+	 * Finish shaders whose background compilation is over, never blocking.
+	 * Meant to be called once per frame.
+	 */
+	static void PollLoadingShaders();
+
+	/**
+	 * Number of shaders still compiling in the background
+	 */
+	static int LoadingShaderCount();
+
 	static void ReloadShaders();
 
 	/**
@@ -99,6 +134,10 @@ private:
 		const std::map<std::string, std::string>& snippets = {});
 
 	std::shared_ptr<ShaderProgram> getShader(const std::string & shaderName);
+	std::shared_ptr<ShaderProgram> findShader(const std::string & shaderName); // may still be loading
+	void loadShader(const std::shared_ptr<ShaderProgram> & shader);
+	bool setDeferredLoading(bool deferred);
+	void pollLoadingShaders();
 
 	void reloadShaders();
 	bool deserialize(const rapidjson::Value & json);
@@ -115,4 +154,6 @@ private:
 	static ShaderPool s_instance;
 	std::map<std::string, std::shared_ptr<ShaderProgram>> m_shaders;
 	std::map<std::string, ShaderInfo> m_defaultShaders;
+	bool m_deferredLoading = false;
+	std::vector<std::shared_ptr<ShaderProgram>> m_loadingShaders;
 };
@@ -34,27 +34,75 @@
 
 #include <fstream>
 #include <map>
+#include <sstream>
 
 using namespace std;
+namespace fs = std::filesystem;
 
 constexpr const char* BEGIN_INCLUDE_TOKEN = "// _AUGEN_BEGIN_INCLUDE";
 constexpr const char* END_INCLUDE_TOKEN = "// _AUGEN_END_INCLUDE";
 
+unordered_map<string, shared_ptr<const ShaderPreprocessor::SourceFile>> ShaderPreprocessor::s_sourceFiles;
+
+// Directive of a line, in lower case, if it starts with '#' (e.g. "#include")
+static string directive(const string & line) {
+	if (line.empty() || line[0] != '#') return "";
+	size_t end = line.find_first_of(" \t\"", 1);
+	return toLower(line.substr(0, end));
+}
+
+/**
+ * Detect include guards, i.e. files whose first directive is an #ifndef
+ * immediately followed by the #define of the same macro, and whose last
+ * directive is the #endif matching it.
+ */
+static bool hasIncludeGuard(const vector<string> & lines) {
+	vector<string> directives;
+	for (const auto & line : lines) {
+		string l = line;
+		trim(l);
+		if (l.empty() || startsWith(l, "//")) continue;
+		if (l[0] != '#') {
+			if (directives.size() < 2) return false; // code before the guard
+			directives.push_back("");
+			continue;
+		}
+		directives.push_back(l);
+	}
+	if (directives.size() < 3) return false;
+
+	istringstream first(directives[0]), second(directives[1]);
+	string ifndef, define, macro, definedMacro;
+	first >> ifndef >> macro;
+	second >> define >> definedMacro;
+	if (ifndef != "#ifndef" || define != "#define" || macro.empty() || macro != definedMacro) return false;
+
+	// The #ifndef must only be closed by the very last directive
+	int depth = 0;
+	for (size_t i = 0; i < directives.size(); ++i) {
+		string d = directive(directives[i]);
+		if (d == "#if" || d == "#ifdef" || d == "#ifndef") ++depth;
+		else if (d == "#endif") --depth;
+		if (depth == 0 && i + 1 < directives.size()) return false;
+	}
+	return depth == 0 && directive(directives.back()) == "#endif";
+}
+
 bool ShaderPreprocessor::load(const string & filename, const vector<string> & defines, const std::map<std::string, std::string> & snippets) {
-	return loadShaderSourceAux(filename, defines, snippets, m_lines);
+	m_source.clear();
+	m_dependencies.clear();
+	set<string> includedOnce;
+	return loadShaderSourceAux(filename, defines, snippets, includedOnce);
 }
 
-void ShaderPreprocessor::source(vector<GLchar> & buf) const {
-	size_t length = 0;
-	for (string s : m_lines) {
-		length += s.size() + 1;
-		buf.reserve(length);
-		for (char& c : s) {
-			buf.push_back(c);
+bool ShaderPreprocessor::isUpToDate(const vector<Dependency> & dependencies) {
+	for (const auto & dep : dependencies) {
+		error_code err;
+		if (fs::last_write_time(dep.filename, err) != dep.lastWriteTime || err) {
+			return false;
 		}
-		buf.push_back('\n');
 	}
-	buf.push_back(0);
+	return true;
 }
 
 void ShaderPreprocessor::logTraceback(size_t line) const {
@@ -63,7 +111,9 @@ void ShaderPreprocessor::logTraceback(size_t line) const {
 	string filename = "";
 	vector<pair<string, size_t>> stack;
 	size_t ignore = 0;
-	for (auto l : m_lines) {
+	istringstream lines(m_source);
+	string l;
+	while (getline(lines, l)) {
 		if (startsWith(l, BEGIN_INCLUDE_TOKEN)) {
 			// Stack context
 			stack.push_back(make_pair(filename, localOffset));
@@ -99,66 +149,121 @@ void ShaderPreprocessor::logTraceback(size_t line) const {
 	}
 }
 
+shared_ptr<const ShaderPreprocessor::SourceFile> ShaderPreprocessor::loadSourceFile(const string & filename) {
+	error_code err;
+	fs::file_time_type lastWriteTime = fs::last_write_time(filename, err);
+	if (err) {
+		WARN_LOG << "Unable to open file: " << filename;
+		return nullptr;
+	}
+
+	auto it = s_sourceFiles.find(filename);
+	if (it != s_sourceFiles.end() && it->second->lastWriteTime == lastWriteTime) {
+		return it->second;
+	}
+
+	ifstream in(filename);
+	if (!in.is_open()) {
+		WARN_LOG << "Unable to open file: " << filename;
+		return nullptr;
+	}
 
-// Note: no include loop check is done, beware of infinite loops
-bool ShaderPreprocessor::loadShaderSourceAux(const string & filename, const vector<string> & defines, const std::map<std::string, std::string> & snippets, vector<string> & lines_accumulator) {
 	static const string includeKeywordLower = "#include";
+	static const string pragmaKeywordLower = "#pragma";
+
+	auto file = make_shared<SourceFile>();
+	file->lastWriteTime = lastWriteTime;
+	string line;
+	while (getline(in, line)) {
+		// Poor man's #include directive parser
+		string d = directive(line);
+		string includeFilename;
+		if (d == includeKeywordLower) {
+			includeFilename = line.substr(includeKeywordLower.size());
+			trim(includeFilename);
+			if (includeFilename.size() < 2 || includeFilename[0] != '"' || includeFilename[includeFilename.size() - 1] != '"') {
+				ERR_LOG << "Syntax error in #include directive at line " << (file->lines.size() + 1) << " in file " << filename;
+				ERR_LOG << "  filename is expected to be enclosed in double quotes (\")";
+				return nullptr;
+			}
+			includeFilename = includeFilename.substr(1, includeFilename.size() - 2);
+			includeFilename = fs::path(joinPath(baseDir(filename), includeFilename)).lexically_normal().string();
+		}
+		else if (d == pragmaKeywordLower) {
+			istringstream pragma(line);
+			string keyword, value;
+			pragma >> keyword >> value;
+			if (value == "once") {
+				file->includeOnce = true;
+				line = "// " + line; // not GLSL, but keep the line for tracebacks
+			}
+		}
+		file->lines.push_back(line);
+		file->includes.push_back(includeFilename);
+	}
+	file->includeOnce = file->includeOnce || hasIncludeGuard(file->lines);
+
+	s_sourceFiles[filename] = file;
+	return file;
+}
+
+void ShaderPreprocessor::appendLine(const string & line) {
+	m_source += line;
+	m_source += '\n';
+}
+
+// Note: no include loop check is done, beware of infinite loops (unless included files use #pragma once)
+bool ShaderPreprocessor::loadShaderSourceAux(const string & filename, const vector<string> & defines, const std::map<std::string, std::string> & snippets, set<string> & includedOnce) {
 	static const string defineKeywordLower = "#define";
 	static const string systemPrefix = "sys:";
 	static const string sysDefinesFilename = "defines";
 
 	string shortName = shortFileName(filename);
 	if (startsWith(shortName, systemPrefix)) {
-		lines_accumulator.push_back(string() + BEGIN_INCLUDE_TOKEN + " " + shortName);
+		appendLine(string() + BEGIN_INCLUDE_TOKEN + " " + shortName);
 
 		const string key = shortName.substr(systemPrefix.length());
 		if (key == sysDefinesFilename) {
 			for (auto def : defines) {
-				lines_accumulator.push_back(defineKeywordLower + " " + def);
+				appendLine(defineKeywordLower + " " + def);
 			}
 		} else {
 			if (snippets.count(key) > 0) {
-				lines_accumulator.push_back(snippets.at(key));
+				appendLine(snippets.at(key));
 			}
 		}
 
-		lines_accumulator.push_back(string() + END_INCLUDE_TOKEN + " " + shortName);
+		appendLine(string() + END_INCLUDE_TOKEN + " " + shortName);
 		return true;
 	}
 
-	lines_accumulator.push_back(string() + BEGIN_INCLUDE_TOKEN + " " + filename);
+	if (includedOnce.count(filename) > 0) {
+		return true;
+	}
 
-	ifstream in(filename);
-	if (!in.is_open()) {
-		WARN_LOG << "Unable to open file: " << filename;
+	auto file = loadSourceFile(filename);
+	if (!file) {
+		// Recorded as never up to date, so that the shader is reloaded once the file is fixed
+		m_dependencies.push_back(Dependency{ filename, fs::file_time_type::min() });
 		return false;
 	}
+	m_dependencies.push_back(Dependency{ filename, file->lastWriteTime });
+	if (file->includeOnce) {
+		includedOnce.insert(filename);
+	}
 
-	string line;
-
-	size_t i = 0;
-	while (getline(in, line)) {
-		++i;
-		// Poor man's #include directive parser
-		if (startsWith(toLower(line), includeKeywordLower)) {
-			string includeFilename = line.substr(includeKeywordLower.size());
-			trim(includeFilename);
-			if (includeFilename[0] != '"' || includeFilename[includeFilename.size() - 1] != '"') {
-				ERR_LOG << "Syntax error in #include directive at line " << i << " in file " << filename;
-				ERR_LOG << "  filename is expected to be enclosed in double quotes (\")";
-				return false;
-			}
-			includeFilename = includeFilename.substr(1, includeFilename.size() - 2);
-			string fullIncludeFilename = joinPath(baseDir(filename), includeFilename);
-			if (!loadShaderSourceAux(fullIncludeFilename, defines, snippets, lines_accumulator)) {
-				ERR_LOG << "Include error at line " << i << " in file " << filename;
+	appendLine(string() + BEGIN_INCLUDE_TOKEN + " " + filename);
+	for (size_t i = 0; i < file->lines.size(); ++i) {
+		if (!file->includes[i].empty()) {
+			if (!loadShaderSourceAux(file->includes[i], defines, snippets, includedOnce)) {
+				ERR_LOG << "Include error at line " << (i + 1) << " in file " << filename;
 				return false;
 			}
 		}
 		else {
-			lines_accumulator.push_back(line);
+			appendLine(file->lines[i]);
 		}
 	}
-	lines_accumulator.push_back(END_INCLUDE_TOKEN);
+	appendLine(END_INCLUDE_TOKEN);
 	return true;
 }
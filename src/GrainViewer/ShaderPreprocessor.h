@@ -31,34 +31,71 @@
 
 #include <OpenGL>
 
+#include <filesystem>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <map>
 
 class ShaderPreprocessor {
+public:
+	/**
+	 * A file a preprocessed source was built from, with its modification time
+	 */
+	struct Dependency {
+		std::string filename;
+		std::filesystem::file_time_type lastWriteTime;
+	};
+
 public:
 	/**
 	 * Load a shader from a file, and reccursively include #include'd files
 	 * You can specity a list of defines to #define where ever
 	 * `#include "sys:defines"` is found in the shader.
+	 * Files are parsed once and kept in memory until they are modified, and
+	 * files using `#pragma once` or an include guard are only included once.
 	 */
 	bool load(const std::string & filename, const std::vector<std::string> & defines = {}, const std::map<std::string, std::string> & snippets = {});
 
 	/**
-	 * Return a buffer to the pure GLSL source, post-preprocessing, to be fed into
-	 * glShaderSource.
+	 * Pure GLSL source, post-preprocessing, to be fed into glShaderSource.
+	 */
+	const std::string & source() const { return m_source; }
+
+	/**
+	 * All the files included by the last call to load(), including itself
 	 */
-	void source(std::vector<GLchar> & buf) const;
+	const std::vector<Dependency> & dependencies() const { return m_dependencies; }
 
 	/**
 	 * Log a traceback corresponding to the line `line` in the processed source.
 	 */
 	void logTraceback(size_t line) const;
 
+	/**
+	 * Tell whether none of the dependencies has been modified since loaded
+	 */
+	static bool isUpToDate(const std::vector<Dependency> & dependencies);
+
 private:
-	std::vector<std::string> m_lines;
+	// A source file as parsed once, shared by all the shaders including it
+	struct SourceFile {
+		std::filesystem::file_time_type lastWriteTime;
+		std::vector<std::string> lines;
+		std::vector<std::string> includes; // for each line, full path of the file it includes, if any
+		bool includeOnce = false; // #pragma once or include guard spanning the whole file
+	};
+
+	static std::shared_ptr<const SourceFile> loadSourceFile(const std::string & filename);
+
+	bool loadShaderSourceAux(const std::string & filename, const std::vector<std::string> & defines, const std::map<std::string, std::string> & snippets, std::set<std::string> & includedOnce);
+	void appendLine(const std::string & line);
 
 private:
-	static bool loadShaderSourceAux(const std::string & filename, const std::vector<std::string> & defines, const std::map<std::string, std::string> & snippets, std::vector<std::string> & lines_accumulator);
-};
+	std::string m_source;
+	std::vector<Dependency> m_dependencies;
 
+	static std::unordered_map<std::string, std::shared_ptr<const SourceFile>> s_sourceFiles;
+};
@@ -31,64 +31,142 @@
 #include "Logger.h"
 #include "ResourceManager.h"
 #include "ShaderProgram.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderBinaryCache.h"
+#include "utils/hashutils.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <filesystem>
 namespace fs = std::filesystem;
 
+static const char* stageName(GLenum stageType) {
+	switch (stageType) {
+	case GL_VERTEX_SHADER: return "vertex shader";
+	case GL_GEOMETRY_SHADER: return "geometry shader";
+	case GL_FRAGMENT_SHADER: return "fragment shader";
+	case GL_COMPUTE_SHADER: return "compute shader";
+	default: return "shader";
+	}
+}
+
 ShaderProgram::ShaderProgram(const std::string& shaderName)
 	: m_shaderName(shaderName)
 	, m_type(RenderShader)
 	, m_isValid(false)
+	, m_isLoading(false)
+	, m_isDirty(true)
+	, m_hasGeometryStage(false)
 	, m_programId(0)
 {}
 
 ShaderProgram::~ShaderProgram()
 {
-	if (m_isValid) {
+	if (m_isValid || m_isLoading) {
 		glDeleteProgram(m_programId);
 	}
 	m_isValid = false;
 }
 
 void ShaderProgram::load() {
+	loadAsync();
+	finishLoading();
+}
+
+void ShaderProgram::loadAsync() {
 	m_programId = glCreateProgram();
+	m_isValid = false;
+	m_isDirty = false;
+	m_hasGeometryStage = false;
+	m_pendingShaders.clear();
+	m_dependencies.clear();
+	m_uniformLocations.clear();
+	m_uniformBlocks.clear();
 
 	std::vector<std::string> defines(m_defines.begin(), m_defines.end());
 
+	// Preprocess all stages first, their sources being the key of the binary cache
+	std::vector<std::pair<GLenum, ShaderPreprocessor>> stages;
+	auto addStage = [&](GLenum stageType) {
+		stages.emplace_back(stageType, ShaderPreprocessor());
+		stages.back().second.load(ResourceManager::shaderFullPath(m_shaderName, stageType), defines, m_snippets);
+		const auto& dependencies = stages.back().second.dependencies();
+		m_dependencies.insert(m_dependencies.end(), dependencies.begin(), dependencies.end());
+	};
 	if (type() == RenderShader) {
-		Shader vertexShader(GL_VERTEX_SHADER);
-		vertexShader.load(ResourceManager::shaderFullPath(m_shaderName, GL_VERTEX_SHADER), defines, m_snippets);
-		vertexShader.compile();
-		vertexShader.check("vertex shader");
-		glAttachShader(m_programId, vertexShader.shaderId());
-
-		Shader geometryShader(GL_GEOMETRY_SHADER);
-		std::string geometryShaderPath = ResourceManager::shaderFullPath(m_shaderName, GL_GEOMETRY_SHADER);
-		if (fs::is_regular_file(geometryShaderPath)) {
-			geometryShader.load(geometryShaderPath, defines, m_snippets);
-			geometryShader.compile();
-			geometryShader.check("geometry shader");
-			glAttachShader(m_programId, geometryShader.shaderId());
+		addStage(GL_VERTEX_SHADER);
+		if (fs::is_regular_file(ResourceManager::shaderFullPath(m_shaderName, GL_GEOMETRY_SHADER))) {
+			addStage(GL_GEOMETRY_SHADER);
+			m_hasGeometryStage = true;
 		}
-
-		Shader fragmentShader(GL_FRAGMENT_SHADER);
-		fragmentShader.load(ResourceManager::shaderFullPath(m_shaderName, GL_FRAGMENT_SHADER), defines, m_snippets);
-		fragmentShader.compile();
-		fragmentShader.check("fragment shader");
-		glAttachShader(m_programId, fragmentShader.shaderId());
+		addStage(GL_FRAGMENT_SHADER);
 	}
 	else {
-		Shader computeShader(GL_COMPUTE_SHADER);
-		computeShader.load(ResourceManager::shaderFullPath(m_shaderName, GL_COMPUTE_SHADER), defines, m_snippets);
-		computeShader.compile();
-		computeShader.check("compute shader");
-		glAttachShader(m_programId, computeShader.shaderId());
+		addStage(GL_COMPUTE_SHADER);
+	}
+
+	// The key names the cache entry, and the full identity is stored in it
+	// to rule out hash collisions
+	m_cacheIdentity = ShaderBinaryCache::driverId();
+	for (const auto& stage : stages) {
+		m_cacheIdentity += std::to_string(stage.first) + "\n" + stage.second.source() + '\0';
+	}
+	m_cacheKey = Fnv1a().add(m_cacheIdentity).hex();
+
+	if (ShaderBinaryCache::load(m_programId, m_cacheKey, m_cacheIdentity)) {
+		m_cacheIdentity.clear();
+		m_isValid = true;
+		cacheUniformLocations();
+		return;
+	}
+
+	// Status queries are left to finishLoading(), so that drivers supporting
+	// KHR_parallel_shader_compile can build the program in the background.
+	for (const auto& stage : stages) {
+		auto shader = std::make_unique<Shader>(stage.first);
+		shader->load(stage.second);
+		shader->compile();
+		glAttachShader(m_programId, shader->shaderId());
+		m_pendingShaders.emplace_back(stage.first, std::move(shader));
 	}
 
+	glProgramParameteri(m_programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(m_programId);
+	m_isLoading = true;
+}
+
+bool ShaderProgram::isReady() const {
+	if (!m_isLoading) return true;
+	if (!GLAD_GL_KHR_parallel_shader_compile) return false;
+	GLint completed = GL_FALSE;
+	glGetProgramiv(m_programId, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed == GL_TRUE;
+}
+
+void ShaderProgram::finishLoading() {
+	if (!m_isLoading) return;
+	m_isLoading = false;
+
+	for (const auto& stage : m_pendingShaders) {
+		stage.second->check(stageName(stage.first));
+	}
+	m_pendingShaders.clear();
+
 	m_isValid = check();
+	if (m_isValid) {
+		cacheUniformLocations();
+		ShaderBinaryCache::save(m_programId, m_cacheKey, m_cacheIdentity);
+	}
+	m_cacheIdentity.clear();
+}
+
+bool ShaderProgram::isUpToDate() const {
+	if (m_isDirty) return false;
+	if (type() == RenderShader && fs::is_regular_file(ResourceManager::shaderFullPath(m_shaderName, GL_GEOMETRY_SHADER)) != m_hasGeometryStage) {
+		return false;
+	}
+	return ShaderPreprocessor::isUpToDate(m_dependencies);
 }
 
 bool ShaderProgram::check(const std::string& name) const {
@@ -109,6 +187,52 @@ bool ShaderProgram::check(const std::string& name) const {
 	return ok;
 }
 
+void ShaderProgram::cacheUniformLocations() {
+	m_uniformLocations.clear();
+	m_uniformBlocks.clear();
+
+	GLint count = 0;
+	GLint bufSize = 0;
+	glGetProgramInterfaceiv(m_programId, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(m_programId, GL_UNIFORM, GL_MAX_NAME_LENGTH, &bufSize);
+	std::vector<GLchar> name(std::max(bufSize, 1));
+
+	const GLenum prop = GL_LOCATION;
+	for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+		GLint location = -1;
+		glGetProgramResourceiv(m_programId, GL_UNIFORM, i, 1, &prop, 1, nullptr, &location);
+		if (location == -1) continue; // member of a uniform block
+		GLsizei length = 0;
+		glGetProgramResourceName(m_programId, GL_UNIFORM, i, bufSize, &length, name.data());
+		std::string uniformName(name.data(), length);
+		m_uniformLocations[uniformName] = location;
+
+		// Arrays are listed as "foo[0]" but also addressed as "foo". Other
+		// elements are resolved on first use.
+		const std::string suffix = "[0]";
+		if (uniformName.size() > suffix.size() && uniformName.compare(uniformName.size() - suffix.size(), suffix.size(), suffix) == 0) {
+			m_uniformLocations[uniformName.substr(0, uniformName.size() - suffix.size())] = location;
+		}
+	}
+}
+
+GLint ShaderProgram::uniformLocation(const std::string& name) const {
+	if (!m_isValid) return GL_INVALID_INDEX;
+	auto it = m_uniformLocations.find(name);
+	if (it == m_uniformLocations.end()) {
+		it = m_uniformLocations.emplace(name, glGetUniformLocation(m_programId, name.c_str())).first;
+	}
+	return it->second;
+}
+
+ShaderProgram::UniformBlock& ShaderProgram::uniformBlock(const std::string& name) const {
+	auto it = m_uniformBlocks.find(name);
+	if (it == m_uniformBlocks.end()) {
+		GLuint index = m_isValid ? glGetUniformBlockIndex(m_programId, name.c_str()) : GL_INVALID_INDEX;
+		it = m_uniformBlocks.emplace(name, UniformBlock{ index, GL_INVALID_INDEX }).first;
+	}
+	return it->second;
+}
 
 void ShaderProgram::setUniform(const std::string& name, GLint value) const {
 	GLint loc = uniformLocation(name);
@@ -185,15 +309,37 @@ void ShaderProgram::setUniform(const std::string& name, const glm::mat4& value)
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
+void ShaderProgram::setUniform(const std::string& name, const GLint* values, GLsizei count) const {
+	GLint loc = uniformLocation(name);
+	if (loc != GL_INVALID_INDEX) {
+		glProgramUniform1iv(m_programId, loc, count, values);
+	}
+}
+void ShaderProgram::setUniform(const std::string& name, const glm::vec2* values, GLsizei count) const {
+	GLint loc = uniformLocation(name);
+	if (loc != GL_INVALID_INDEX) {
+		glProgramUniform2fv(m_programId, loc, count, glm::value_ptr(values[0]));
+	}
+}
+void ShaderProgram::setUniform(const std::string& name, const glm::mat4* values, GLsizei count) const {
+	GLint loc = uniformLocation(name);
+	if (loc != GL_INVALID_INDEX) {
+		glProgramUniformMatrix4fv(m_programId, loc, count, GL_FALSE, glm::value_ptr(values[0]));
+	}
+}
 
 bool ShaderProgram::bindUniformBlock(const std::string& uniformBlockName, GLuint buffer, GLuint uniformBlockBinding) const {
-	GLuint index = uniformBlockIndex(uniformBlockName);
-	if (index == GL_INVALID_INDEX) {
+	if (!m_isValid) return false;
+	UniformBlock& block = uniformBlock(uniformBlockName);
+	if (block.index == GL_INVALID_INDEX) {
 		// WARN_LOG << "Uniform Block not found with name " << uniformBlockName; // pb: this warning is repeated at each frame, enable verbosity onl right after loading
 		return false;
 	}
 	glBindBufferBase(GL_UNIFORM_BUFFER, uniformBlockBinding, buffer);
-	glUniformBlockBinding(m_programId, index, uniformBlockBinding);
+	if (block.binding != uniformBlockBinding) {
+		glUniformBlockBinding(m_programId, block.index, uniformBlockBinding);
+		block.binding = uniformBlockBinding;
+	}
 	return true;
 }
 
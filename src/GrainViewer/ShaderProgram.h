@@ -30,6 +30,9 @@
 #pragma once
 
 #include "Shader.h"
+#include "ShaderPreprocessor.h"
+
+#include <unordered_map>
 
 /**
  * Utility class providing an OO API to OpenGL shader program
@@ -51,24 +54,53 @@ public:
 	/**
 	 * NB: Changing shader name does not reload it. You may want to call load() then.
 	 */
-	inline void setShaderName(const std::string& shaderName) { m_shaderName = shaderName; }
+	inline void setShaderName(const std::string& shaderName) { m_shaderName = shaderName; m_isDirty = true; }
 	inline const std::string& shaderName() const { return m_shaderName; }
 
-	inline void setType(ShaderProgramType type) { m_type = type; }
+	inline void setType(ShaderProgramType type) { m_type = type; m_isDirty = true; }
 	inline ShaderProgramType type() const { return m_type; }
 
-	inline void define(const std::string& def) { m_defines.insert(def); }
-	inline void undefine(const std::string& def) { m_defines.erase(def); }
+	inline void define(const std::string& def) { m_defines.insert(def); m_isDirty = true; }
+	inline void undefine(const std::string& def) { m_defines.erase(def); m_isDirty = true; }
 
 	inline const std::set<std::string> & getDefines() const { return m_defines; }
 
-	inline void setSnippet(const std::string& key, const std::string& value) { m_snippets[key] = value; }
+	inline void setSnippet(const std::string& key, const std::string& value) { m_snippets[key] = value; m_isDirty = true; }
+	inline const std::map<std::string, std::string>& getSnippets() const { return m_snippets; }
 
 	/**
 	 * Load and check shaders
 	 */
 	void load();
 
+	/**
+	 * Submit shaders for compilation and linking without waiting for the
+	 * driver, which may then build the program in the background if it
+	 * supports KHR_parallel_shader_compile. The program is not valid until
+	 * finishLoading() is called.
+	 */
+	void loadAsync();
+
+	/**
+	 * True when a program submitted by loadAsync() is done building, so that
+	 * finishLoading() will not block. Without KHR_parallel_shader_compile,
+	 * this is only known once finishLoading() has been called.
+	 */
+	bool isReady() const;
+	inline bool isLoading() const { return m_isLoading; }
+
+	/**
+	 * Check the result of loadAsync(), waiting for the driver if needed.
+	 * Does nothing if the program is not loading.
+	 */
+	void finishLoading();
+
+	/**
+	 * Tell whether the last load() used the current settings and source
+	 * files, i.e. reloading would give the same program.
+	 */
+	bool isUpToDate() const;
+
 	/**
 	 * Check that the shader program has been successfully compiled
 	 * @param name Name displayed in error message
@@ -87,6 +119,10 @@ public:
 	void setUniform(const std::string& name, const glm::vec3& value) const;
 	void setUniform(const std::string& name, const glm::mat3& value) const;
 	void setUniform(const std::string& name, const glm::mat4& value) const;
+	// Arrays, uploaded in a single call from the location of element 0
+	void setUniform(const std::string& name, const GLint* values, GLsizei count) const;
+	void setUniform(const std::string& name, const glm::vec2* values, GLsizei count) const;
+	void setUniform(const std::string& name, const glm::mat4* values, GLsizei count) const;
 
 	bool bindUniformBlock(const std::string& uniformBlockName, GLuint buffer, GLuint uniformBlockBinding = 1) const;
 
@@ -96,6 +132,9 @@ public:
 
 	GLuint raw() const { return m_programId; }
 
+	// Hash of the preprocessed sources of the last load (and of the driver)
+	const std::string& sourceKey() const { return m_cacheKey; }
+
 private:
 	std::string m_shaderName;
 	ShaderProgramType m_type;
@@ -103,10 +142,31 @@ private:
 	std::map<std::string, std::string> m_snippets;
 	GLuint m_programId;
 	bool m_isValid;
+	bool m_isLoading;
+	bool m_isDirty; // settings changed since last load
+	bool m_hasGeometryStage;
+	std::vector<ShaderPreprocessor::Dependency> m_dependencies; // of the last load
+	std::string m_cacheKey; // key in the ShaderBinaryCache of the last loaded sources
+	std::string m_cacheIdentity; // driver and sources hashed in m_cacheKey, while loading
+	std::vector<std::pair<GLenum, std::unique_ptr<Shader>>> m_pendingShaders; // while loading
+
+	struct UniformBlock {
+		GLuint index;
+		GLuint binding; // last one given to glUniformBlockBinding, GL_INVALID_INDEX if none
+	};
+	// Filled when the program gets linked, then on demand for names that are
+	// not listed by GL_ACTIVE_UNIFORMS (e.g. "foo[2]") or not used at all.
+	mutable std::unordered_map<std::string, GLint> m_uniformLocations;
+	mutable std::unordered_map<std::string, UniformBlock> m_uniformBlocks;
 
 private:
-	inline GLint uniformLocation(const std::string& name) const { return m_isValid ? glGetUniformLocation(m_programId, name.c_str()) : GL_INVALID_INDEX; }
-	inline GLuint uniformBlockIndex(const std::string& name) const { return m_isValid ? glGetUniformBlockIndex(m_programId, name.c_str()) : GL_INVALID_INDEX; }
+	/**
+	 * Reset the location caches from the active uniforms of the newly
+	 * linked program.
+	 */
+	void cacheUniformLocations();
+	GLint uniformLocation(const std::string& name) const;
+	UniformBlock& uniformBlock(const std::string& name) const;
 	inline GLuint storageBlockIndex(const std::string& name) const { return m_isValid ? glGetProgramResourceIndex(m_programId, GL_SHADER_STORAGE_BLOCK, name.c_str()) : GL_INVALID_INDEX; }
 };
 
@@ -0,0 +1,257 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include "ShaderPool.h"
+#include "Logger.h"
+#include "utils/hashutils.h"
+
+#include <magic_enum.hpp>
+
+#include <array>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Combination of shader options, i.e. a subset of the values of the enum E.
+ * Values of E must be consecutive from 0 and named after the define they
+ * enable in the shader, since magic_enum is used to get this define.
+ * Usage:
+ *   enum ShaderOption { SHELL_CULLING, NO_DISCARD };
+ *   ShaderVariantFlags<ShaderOption> flags = { SHELL_CULLING };
+ *   if (noDiscard) flags |= NO_DISCARD;
+ */
+template <typename E>
+class ShaderVariantFlags {
+	static_assert(std::is_enum_v<E>, "Shader variant flags must be enum values");
+public:
+	static constexpr size_t FlagCount = magic_enum::enum_count<E>();
+
+	constexpr ShaderVariantFlags() {}
+	constexpr ShaderVariantFlags(E flag) : m_bits(bit(flag)) {}
+	constexpr ShaderVariantFlags(std::initializer_list<E> flags) {
+		for (E flag : flags) m_bits |= bit(flag);
+	}
+
+	constexpr bool test(E flag) const { return (m_bits & bit(flag)) != 0; }
+	constexpr ShaderVariantFlags& set(E flag, bool value = true) {
+		m_bits = value ? (m_bits | bit(flag)) : (m_bits & ~bit(flag));
+		return *this;
+	}
+
+	constexpr ShaderVariantFlags operator|(ShaderVariantFlags other) const { return fromBits(m_bits | other.m_bits); }
+	constexpr ShaderVariantFlags& operator|=(ShaderVariantFlags other) { m_bits |= other.m_bits; return *this; }
+
+	constexpr size_t bits() const { return m_bits; }
+	static constexpr ShaderVariantFlags fromBits(size_t bits) {
+		ShaderVariantFlags flags;
+		flags.m_bits = bits;
+		return flags;
+	}
+
+private:
+	static constexpr size_t bit(E flag) { return static_cast<size_t>(1) << static_cast<size_t>(flag); }
+
+private:
+	size_t m_bits = 0;
+};
+
+/**
+ * Describes how the values of an axis of a ShaderVariantTable are numbered
+ * and turned into defines. An enum axis takes exactly one of its values,
+ * defining its name, and a ShaderVariantFlags axis any subset of its flags.
+ */
+template <typename T, typename = void>
+struct ShaderVariantAxis;
+
+template <typename E>
+struct ShaderVariantAxis<E, std::enable_if_t<std::is_enum_v<E>>> {
+	static constexpr size_t size = magic_enum::enum_count<E>();
+	static constexpr size_t index(E value) { return magic_enum::enum_index(value).value(); }
+	static constexpr E value(size_t index) { return magic_enum::enum_value<E>(index); }
+	static void appendDefines(E value, std::vector<std::string>& defines) {
+		defines.emplace_back(magic_enum::enum_name(value));
+	}
+};
+
+template <typename E>
+struct ShaderVariantAxis<ShaderVariantFlags<E>> {
+	static constexpr size_t size = static_cast<size_t>(1) << ShaderVariantFlags<E>::FlagCount;
+	static constexpr size_t index(ShaderVariantFlags<E> value) { return value.bits(); }
+	static constexpr ShaderVariantFlags<E> value(size_t index) { return ShaderVariantFlags<E>::fromBits(index); }
+	static void appendDefines(ShaderVariantFlags<E> value, std::vector<std::string>& defines) {
+		for (E flag : magic_enum::enum_values<E>()) {
+			if (value.test(flag)) defines.emplace_back(magic_enum::enum_name(flag));
+		}
+	}
+};
+
+/**
+ * Lazily loaded variants of a shader of the ShaderPool, one for each
+ * combination of values of the axes, which are known at compile time. This
+ * replaces hand written flag to define tables and the per behavior lazy
+ * loading that used to come with them.
+ * Usage:
+ *   ShaderVariantTable<RenderPass, ShaderVariantFlags<ShaderOption>> m_shaders;
+ *   m_shaders.setBaseShader("FarGrain");
+ *   const ShaderProgram& shader = *m_shaders.get(PASS_DEPTH, { SHELL_CULLING });
+ *   m_shaders.precompile(); // all variants, e.g. in Behavior::precompileShaders()
+ */
+template <typename... Axes>
+class ShaderVariantTable {
+public:
+	using Variant = std::tuple<Axes...>;
+	static constexpr size_t Size = (static_cast<size_t>(1) * ... * ShaderVariantAxis<Axes>::size);
+
+	/**
+	 * Dense index of a variant, in [0, Size[, the first axis varying fastest
+	 */
+	static constexpr size_t Index(Axes... values) {
+		size_t index = 0;
+		size_t stride = 1;
+		((index += ShaderVariantAxis<Axes>::index(values) * stride, stride *= ShaderVariantAxis<Axes>::size), ...);
+		(void)stride; // when there is no axis
+		return index;
+	}
+
+	/**
+	 * Inverse of Index()
+	 */
+	static constexpr Variant VariantAt(size_t index) {
+		return variantAt(index, std::index_sequence_for<Axes...>{});
+	}
+
+	static std::vector<std::string> Defines(Axes... values) {
+		std::vector<std::string> defines;
+		(ShaderVariantAxis<Axes>::appendDefines(values, defines), ...);
+		return defines;
+	}
+
+public:
+	/**
+	 * Set the name in the ShaderPool of the shader that variants derive from,
+	 * and snippets shared by all variants. This forgets variants loaded so far.
+	 */
+	void setBaseShader(const std::string& baseShaderName, const std::map<std::string, std::string>& snippets = {}) {
+		m_baseShaderName = baseShaderName;
+		m_snippets = snippets;
+		m_snippetsHash.clear();
+		if (!snippets.empty()) {
+			Fnv1a hash;
+			for (const auto& s : snippets) {
+				hash.add(s.first).add(s.second);
+			}
+			m_snippetsHash = hash.hex();
+		}
+		clear();
+	}
+	const std::string& baseShaderName() const { return m_baseShaderName; }
+
+	/**
+	 * Add a variant to the ShaderPool if it is not there yet, and return
+	 * its name in the pool.
+	 */
+	std::string addVariant(Axes... values) const {
+		std::vector<std::string> defines = Defines(values...);
+		if (defines.empty() && m_snippets.empty()) return m_baseShaderName;
+		std::string variantName = m_baseShaderName;
+		for (const auto& def : defines) {
+			variantName += "_" + def;
+		}
+		if (!m_snippetsHash.empty()) {
+			variantName += "_" + m_snippetsHash;
+		}
+		DEBUG_LOG << "loading variant " << variantName;
+		ShaderPool::AddShaderVariant(variantName, m_baseShaderName, defines, m_snippets);
+		return variantName;
+	}
+
+	/**
+	 * Get a variant, loading it on first use
+	 */
+	std::shared_ptr<ShaderProgram> get(Axes... values) const {
+		std::shared_ptr<ShaderProgram>& shader = m_shaders[Index(values...)];
+		if (!shader) {
+			shader = ShaderPool::GetShader(addVariant(values...));
+		}
+		return shader;
+	}
+
+	/**
+	 * Add the variants accepted by the filter, called with the values of
+	 * each axis, to the ShaderPool without waiting for them to be compiled
+	 * (see ShaderPool::PrecompileShader()).
+	 */
+	template <typename Filter>
+	void precompile(Filter filter) const {
+		for (size_t i = 0; i < Size; ++i) {
+			Variant variant = VariantAt(i);
+			if (!std::apply(filter, variant)) continue;
+			std::string name = std::apply([this](Axes... values) { return addVariant(values...); }, variant);
+			ShaderPool::PrecompileShader(name);
+		}
+	}
+	void precompile() const {
+		precompile([](Axes...) { return true; });
+	}
+
+	/**
+	 * Forget loaded variants (they remain in the ShaderPool)
+	 */
+	void clear() {
+		for (auto& shader : m_shaders) shader.reset();
+	}
+
+private:
+	template <size_t... I>
+	static constexpr Variant variantAt(size_t index, std::index_sequence<I...>) {
+		(void)index; // when there is no axis
+		constexpr std::array<size_t, sizeof...(Axes)> sizes = { ShaderVariantAxis<Axes>::size... };
+		std::array<size_t, sizeof...(Axes)> strides = {};
+		size_t stride = 1;
+		for (size_t k = 0; k < sizeof...(Axes); ++k) {
+			strides[k] = stride;
+			stride *= sizes[k];
+		}
+		return Variant{ ShaderVariantAxis<Axes>::value((index / strides[I]) % ShaderVariantAxis<Axes>::size)... };
+	}
+
+private:
+	std::string m_baseShaderName;
+	std::map<std::string, std::string> m_snippets;
+	std::string m_snippetsHash; // distinguishes variants of the same base shader with different snippets
+	mutable std::array<std::shared_ptr<ShaderProgram>, Size> m_shaders;
+};
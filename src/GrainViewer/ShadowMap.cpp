@@ -60,6 +60,13 @@ void ShadowMap::setProjection(float fov, float nearDistance, float farDistance)
 	updateProjectionMatrix();
 }
 
+void ShadowMap::setSize(size_t size)
+{
+	setResolution(size, size);
+	m_camera.setResolution(static_cast<int>(size), static_cast<int>(size));
+	updateProjectionMatrix();
+}
+
 void ShadowMap::updateProjectionMatrix()
 {
 	m_camera.setProjectionMatrix(glm::perspective<float>(glm::radians(m_fov), 1.f, m_near, m_far));
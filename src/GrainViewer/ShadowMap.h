@@ -50,6 +50,8 @@ public:
 
 	void setLookAt(const glm::vec3 & position, const glm::vec3 & lookAt);
 	void setProjection(float fov, float nearDistance, float farDistance);
+	// Reallocate the shadow map (previous content is lost)
+	void setSize(size_t size);
 
 	const Camera & camera() const { return m_camera; }
 
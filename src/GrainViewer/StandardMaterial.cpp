@@ -36,6 +36,34 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <tiny_obj_loader.h>
 
+#include <deque>
+
+StandardMaterial::UniformNames::UniformNames(const std::string& prefix)
+	: baseColorMap(prefix + "baseColorMap")
+	, hasBaseColorMap(prefix + "hasBaseColorMap")
+	, normalMap(prefix + "normalMap")
+	, hasNormalMap(prefix + "hasNormalMap")
+	, metallicRoughnessMap(prefix + "metallicRoughnessMap")
+	, hasMetallicRoughnessMap(prefix + "hasMetallicRoughnessMap")
+	, metallicMap(prefix + "metallicMap")
+	, hasMetallicMap(prefix + "hasMetallicMap")
+	, roughnessMap(prefix + "roughnessMap")
+	, hasRoughnessMap(prefix + "hasRoughnessMap")
+	, baseColor(prefix + "baseColor")
+	, metallic(prefix + "metallic")
+	, roughness(prefix + "roughness")
+{}
+
+const StandardMaterial::UniformNames& StandardMaterial::UniformNames::materialArray(size_t index)
+{
+	// A deque, so that growing it does not move names already handed out
+	static std::deque<UniformNames> names;
+	while (names.size() <= index) {
+		names.emplace_back("uMaterial[" + std::to_string(names.size()) + "].");
+	}
+	return names[index];
+}
+
 bool StandardMaterial::deserialize(const rapidjson::Value& json)
 {
 #define readAtlas(name) \
@@ -85,43 +113,43 @@ void StandardMaterial::fromTinyObj(const tinyobj::material_t& mat, const std::st
 	}
 }
 
-GLuint StandardMaterial::setUniforms(const ShaderProgram& shader, const std::string& prefix, GLuint nextTextureUnit) const
+GLuint StandardMaterial::setUniforms(const ShaderProgram& shader, const UniformNames& names, GLuint nextTextureUnit) const
 {
 	GLint o = nextTextureUnit;
 
 	if (baseColorMap) {
 		baseColorMap->bind(o);
-		shader.setUniform(prefix + "baseColorMap", o++);
+		shader.setUniform(names.baseColorMap, o++);
 	}
-	shader.setUniform(prefix + "hasBaseColorMap", static_cast<bool>(baseColorMap));
+	shader.setUniform(names.hasBaseColorMap, static_cast<bool>(baseColorMap));
 	
 	if (normalMap) {
 		normalMap->bind(o);
-		shader.setUniform(prefix + "normalMap", o++);
+		shader.setUniform(names.normalMap, o++);
 	}
-	shader.setUniform(prefix + "hasNormalMap", static_cast<bool>(normalMap));
+	shader.setUniform(names.hasNormalMap, static_cast<bool>(normalMap));
 
 	if (metallicRoughnessMap) {
 		metallicRoughnessMap->bind(o);
-		shader.setUniform(prefix + "metallicRoughnessMap", o++);
+		shader.setUniform(names.metallicRoughnessMap, o++);
 	}
-	shader.setUniform(prefix + "hasMetallicRoughnessMap", static_cast<bool>(metallicRoughnessMap));
+	shader.setUniform(names.hasMetallicRoughnessMap, static_cast<bool>(metallicRoughnessMap));
 
 	if (metallicMap) {
 		metallicMap->bind(o);
-		shader.setUniform(prefix + "metallicMap", o++);
+		shader.setUniform(names.metallicMap, o++);
 	}
-	shader.setUniform(prefix + "hasMetallicMap", static_cast<bool>(metallicMap));
+	shader.setUniform(names.hasMetallicMap, static_cast<bool>(metallicMap));
 
 	if (roughnessMap) {
 		roughnessMap->bind(o);
-		shader.setUniform(prefix + "roughnessMap", o++);
+		shader.setUniform(names.roughnessMap, o++);
 	}
-	shader.setUniform(prefix + "hasRoughnessMap", static_cast<bool>(roughnessMap));
+	shader.setUniform(names.hasRoughnessMap, static_cast<bool>(roughnessMap));
 
-	shader.setUniform(prefix + "baseColor", baseColor);
-	shader.setUniform(prefix + "metallic", metallic);
-	shader.setUniform(prefix + "roughness", roughness);
+	shader.setUniform(names.baseColor, baseColor);
+	shader.setUniform(names.metallic, metallic);
+	shader.setUniform(names.roughness, roughness);
 
 	return o;
 }
@@ -38,6 +38,7 @@
 
 #include <string>
 #include <memory>
+#include <cstddef>
 
 class ShaderProgram;
 
@@ -55,8 +56,32 @@ struct StandardMaterial
 	std::unique_ptr<GlTexture> metallicMap;
 	std::unique_ptr<GlTexture> roughnessMap;
 
+	/**
+	 * Full names of the uniforms of a material, built once rather than at
+	 * each draw.
+	 */
+	struct UniformNames {
+		std::string baseColorMap;
+		std::string hasBaseColorMap;
+		std::string normalMap;
+		std::string hasNormalMap;
+		std::string metallicRoughnessMap;
+		std::string hasMetallicRoughnessMap;
+		std::string metallicMap;
+		std::string hasMetallicMap;
+		std::string roughnessMap;
+		std::string hasRoughnessMap;
+		std::string baseColor;
+		std::string metallic;
+		std::string roughness;
+
+		explicit UniformNames(const std::string& prefix);
+		// Names of the material at the given index of the uMaterial array
+		static const UniformNames& materialArray(size_t index);
+	};
+
 	bool deserialize(const rapidjson::Value& json);
 	void fromTinyObj(const tinyobj::material_t & mat, const std::string& textureRoot);
 	// return the next available texture unit
-	GLuint setUniforms(const ShaderProgram& shader, const std::string & prefix, GLuint nextTextureUnit) const;
+	GLuint setUniforms(const ShaderProgram& shader, const UniformNames& names, GLuint nextTextureUnit) const;
 };
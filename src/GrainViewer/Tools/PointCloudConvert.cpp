@@ -28,13 +28,27 @@
  */
 
 #include "PointCloud.h"
+#include "CpuSplitter.h"
 #include "filterPointToPointDistance.h"
+#include "Mesh.h"
+#include "bufferFillers.h"
 
 #include "utils/strutils.h"
+#include "utils/fileutils.h"
+#include "utils/jsonutils.h"
+#include "utils/MappedFile.h"
+#include "utils/parallel.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 #define XMIN -151
 #define XMAX 151
@@ -43,6 +57,297 @@
 #define ZMIN -151
 #define ZMAX 151
 
+static void printUsage() {
+	ERR_LOG
+		<< "Usage: PointCloudConvert <inputFilename> <outputFilename> [mode] [options]" << std::endl
+		<< "       PointCloudConvert --benchmark-xyz <inputFilename>" << std::endl
+		<< "       PointCloudConvert --benchmark-mesh <inputFilename.obj>" << std::endl
+		<< "       PointCloudConvert --check-split-stats <reference.json>" << std::endl
+		<< "Modes:" << std::endl
+		<< "  point-to-point-filter" << std::endl
+		<< "  bbox-filter" << std::endl
+		<< "  split-stats           Write per model counts of the CPU splitter for each view of --views to <outputFilename>" << std::endl
+		<< "Options:" << std::endl
+		<< "  --chunk-size <n>      Number of points per chunk (default: " << PointCloud::s_defaultChunkSize << ")" << std::endl
+		<< "  --format-version <v>  Version of the output .bin format (default: " << PointCloud::s_binVersion << ")" << std::endl
+		<< "  --sort-morton         Reorder points along a Morton curve before splitting them into chunks" << std::endl
+		<< "Options of split-stats:" << std::endl
+		<< "  --views <filename>    One view per line: frame, width, height, view matrix and projection matrix (column major)" << std::endl
+		<< "  --grain-radius <r>, --grain-inner-radius-ratio <r>, --instance-limit <d>, --impostor-limit <d>" << std::endl
+		<< "  --no-occlusion-culling, --no-frustum-culling";
+}
+
+// Option values must be numbers as a whole, otherwise these throw std::invalid_argument
+static unsigned long long parseUnsigned(const std::string & str) {
+	size_t end = 0;
+	if (!str.empty() && str[0] == '-') throw std::invalid_argument(str);
+	unsigned long long value = std::stoull(str, &end);
+	if (end != str.size()) throw std::invalid_argument(str);
+	return value;
+}
+
+static float parseFloat(const std::string & str) {
+	size_t end = 0;
+	float value = std::stof(str, &end);
+	if (end != str.size()) throw std::invalid_argument(str);
+	return value;
+}
+
+struct SplitView {
+	size_t frame;
+	CpuSplitter::View view;
+};
+
+/**
+ * Read views from a text file with one view per line, as 35 numbers
+ * separated by spaces: animation frame, width, height, then the 16
+ * coefficients of the view matrix and the 16 of the projection matrix, in
+ * column major order. Empty lines and lines starting with '#' are ignored.
+ */
+static bool loadSplitViews(const std::string & filename, std::vector<SplitView> & views) {
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		ERR_LOG << "Could not open views file: " << filename;
+		return false;
+	}
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line)) {
+		++lineNumber;
+		trim(line);
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream ss(line);
+		SplitView v;
+		ss >> v.frame >> v.view.resolution.x >> v.view.resolution.y;
+		for (int i = 0; i < 16; ++i) ss >> v.view.viewMatrix[i / 4][i % 4];
+		for (int i = 0; i < 16; ++i) ss >> v.view.projectionMatrix[i / 4][i % 4];
+		if (ss.fail() || v.view.resolution.x <= 0 || v.view.resolution.y <= 0) {
+			ERR_LOG << "Invalid view at line " << lineNumber << " of " << filename;
+			return false;
+		}
+		views.push_back(v);
+	}
+	return true;
+}
+
+/**
+ * Run the CPU reference of PointCloudSplitter for each view and return the
+ * count of each model, ordered like PointCloudSplitter::RenderModel.
+ */
+static std::vector<std::vector<uint32_t>> computeSplitCounts(const PointCloud & pointCloud, const std::vector<SplitView> & views, const CpuSplitter::Properties & properties) {
+	std::vector<std::vector<uint32_t>> counts;
+	counts.reserve(views.size());
+
+	size_t frameCount = std::max<size_t>(1, pointCloud.frameCount());
+	size_t pointsPerFrame = pointCloud.pointCount() / frameCount;
+	CpuSplitter splitter;
+	splitter.properties() = properties;
+	using clock = std::chrono::high_resolution_clock;
+	for (size_t k = 0; k < views.size(); ++k) {
+		const glm::vec3 *points = pointCloud.points() + (views[k].frame % frameCount) * pointsPerFrame;
+		auto start = clock::now();
+		splitter.split(points, pointsPerFrame, views[k].view);
+		double time = std::chrono::duration<double>(clock::now() - start).count();
+		DEBUG_LOG << "View #" << k << " split in " << time * 1000.0 << " ms";
+
+		counts.emplace_back();
+		for (const auto & counter : splitter.counters()) {
+			counts.back().push_back(counter.count);
+		}
+	}
+	return counts;
+}
+
+/**
+ * Write split counts in the same format as the "outputStats" of PointCloudSplitter.
+ */
+static bool writeSplitStats(const PointCloud & pointCloud, const std::vector<SplitView> & views, const CpuSplitter::Properties & properties, const std::string & outputFilename) {
+	std::ofstream out(outputFilename);
+	if (!out.is_open()) {
+		ERR_LOG << "Could not open output file: " << outputFilename;
+		return false;
+	}
+	out << "frame;instanceCount;impostorCount;pointCount;noneCount\n";
+
+	std::vector<std::vector<uint32_t>> counts = computeSplitCounts(pointCloud, views, properties);
+	for (size_t k = 0; k < counts.size(); ++k) {
+		// Like PointCloudSplitter, the frame column is the index of the split,
+		// not the animation frame, which several views may share
+		out << k;
+		for (uint32_t count : counts[k]) {
+			out << ";" << count;
+		}
+		out << "\n";
+	}
+	LOG << "Wrote split stats of " << views.size() << " views to " << outputFilename;
+	return true;
+}
+
+/**
+ * Compare split counts with the golden counts listed in a JSON file such as
+ * Tools/split-stats-reference.json. Each entry of its "references" array
+ * gives a point cloud, a views file (both relative to the JSON file), the
+ * splitter properties that differ from CpuSplitter's defaults and the
+ * expected counts of each view, in the column order of split-stats.
+ * Return false if any count differs.
+ */
+static bool checkSplitStats(const std::string & referenceFilename) {
+	std::ifstream in(referenceFilename);
+	if (!in.is_open()) {
+		ERR_LOG << "Could not open reference file: " << referenceFilename;
+		return false;
+	}
+	rapidjson::IStreamWrapper wrapper(in);
+	rapidjson::Document d;
+	if (d.ParseStream(wrapper).HasParseError() || !d.IsObject() || !d.HasMember("references") || !d["references"].IsArray()) {
+		ERR_LOG << "Reference file must contain a 'references' array: " << referenceFilename;
+		return false;
+	}
+
+	std::string dir = baseDir(referenceFilename);
+	auto resolve = [&dir](const std::string & path) {
+		return isAbsolutePath(path) || dir.empty() ? path : joinPath(dir, path);
+	};
+
+	bool success = true;
+	const rapidjson::Value & references = d["references"];
+	for (rapidjson::SizeType i = 0; i < references.Size(); ++i) {
+		const rapidjson::Value & json = references[i];
+		std::string pointCloudFilename, viewsFilename;
+		if (!json.IsObject() || !jrOption(json, "pointCloud", pointCloudFilename) || !jrOption(json, "views", viewsFilename)) {
+			ERR_LOG << "Reference #" << i << " must contain 'pointCloud' and 'views' strings";
+			success = false;
+			continue;
+		}
+
+		CpuSplitter::Properties properties;
+		jrOption(json, "enableOcclusionCulling", properties.enableOcclusionCulling, properties.enableOcclusionCulling);
+		jrOption(json, "enableFrustumCulling", properties.enableFrustumCulling, properties.enableFrustumCulling);
+		jrOption(json, "instanceLimit", properties.instanceLimit, properties.instanceLimit);
+		jrOption(json, "impostorLimit", properties.impostorLimit, properties.impostorLimit);
+		jrOption(json, "grainRadius", properties.grainRadius, properties.grainRadius);
+		jrOption(json, "grainInnerRadiusRatio", properties.grainInnerRadiusRatio, properties.grainInnerRadiusRatio);
+		std::vector<std::vector<int>> expectedCounts;
+		jrArray(json, "counts", expectedCounts);
+
+		std::vector<SplitView> views;
+		PointCloud pointCloud;
+		if (!loadSplitViews(resolve(viewsFilename), views) || !pointCloud.load(resolve(pointCloudFilename))) {
+			success = false;
+			continue;
+		}
+		if (expectedCounts.size() != views.size()) {
+			ERR_LOG << "Reference #" << i << " has " << expectedCounts.size() << " rows of counts for " << views.size() << " views";
+			success = false;
+			continue;
+		}
+
+		std::vector<std::vector<uint32_t>> counts = computeSplitCounts(pointCloud, views, properties);
+		for (size_t k = 0; k < counts.size(); ++k) {
+			if (std::vector<uint32_t>(expectedCounts[k].begin(), expectedCounts[k].end()) != counts[k]) {
+				std::ostringstream expected, actual;
+				for (int count : expectedCounts[k]) expected << " " << count;
+				for (uint32_t count : counts[k]) actual << " " << count;
+				ERR_LOG << "Reference #" << i << ", view #" << k << ": expected counts" << expected.str() << ", got" << actual.str();
+				success = false;
+			}
+		}
+	}
+
+	if (success) {
+		LOG << "Split counts match the " << references.Size() << " references of " << referenceFilename;
+	}
+	return success;
+}
+
+/**
+ * Measure the throughput of both XYZ readers and check that their outputs
+ * are identical.
+ */
+static bool benchmarkXyzLoading(const std::string & filename) {
+	// Read the file once so that both readers run with a warm disk cache
+	MappedFile file;
+	if (!file.open(filename)) return false;
+	// Touch every page, and use the result so that this is not optimized away
+	size_t checksum = 0;
+	for (size_t i = 0; i < file.size(); i += 4096) checksum += file.data()[i];
+	DEBUG_LOG << "Warmed up disk cache for " << filename << " (checksum " << checksum << ")";
+	double megabytes = static_cast<double>(file.size()) / (1024.0 * 1024.0);
+	file.close();
+
+	using clock = std::chrono::high_resolution_clock;
+	PointCloud sequentialPointCloud, parallelPointCloud;
+
+	auto start = clock::now();
+	if (!sequentialPointCloud.loadXYZSequential(filename)) return false;
+	double sequentialTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	start = clock::now();
+	if (!parallelPointCloud.loadXYZ(filename)) return false;
+	double parallelTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	LOG << "Sequential reader: " << sequentialTime * 1000.0 << " ms (" << megabytes / sequentialTime << " MB/s)";
+	LOG << "Parallel reader (" << workerCount() << " threads): " << parallelTime * 1000.0 << " ms (" << megabytes / parallelTime << " MB/s)";
+	LOG << "Speedup: x" << sequentialTime / parallelTime;
+
+	const auto & a = sequentialPointCloud.data();
+	const auto & b = parallelPointCloud.data();
+	if (a.size() != b.size() || memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) != 0) {
+		ERR_LOG << "Outputs of the sequential and parallel readers differ!";
+		return false;
+	}
+	LOG << "Outputs are identical (" << a.size() << " points)";
+	return true;
+}
+
+/**
+ * Measure the time spent by MeshDataBehavior to load an OBJ mesh, comparing
+ * the parallel fill of the vertex buffer with a single threaded one, and
+ * check that both give the same attributes.
+ */
+static bool benchmarkMeshLoading(const std::string & filename) {
+	using clock = std::chrono::high_resolution_clock;
+
+	auto start = clock::now();
+	Mesh mesh(filename);
+	double parseTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	size_t cornerCount = 0;
+	for (const auto & s : mesh.shapes()) {
+		cornerCount += s.mesh.indices.size();
+	}
+	double megabytes = static_cast<double>(cornerCount * sizeof(PointAttributes)) / (1024.0 * 1024.0);
+
+	std::vector<PointAttributes> sequentialAttributes(cornerCount), parallelAttributes(cornerCount);
+
+	start = clock::now();
+	BufferFiller::Fill(sequentialAttributes.data(), cornerCount, mesh, glm::vec3(0.0f), 1);
+	double sequentialTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	start = clock::now();
+	BufferFiller::Fill(parallelAttributes.data(), cornerCount, mesh, glm::vec3(0.0f));
+	double parallelTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	std::vector<PointAttributes> vertices;
+	std::vector<GLuint> indices;
+	start = clock::now();
+	BufferFiller::FillIndexed(vertices, indices, mesh, glm::vec3(0.0f));
+	double indexedTime = std::chrono::duration<double>(clock::now() - start).count();
+
+	LOG << "OBJ parsing: " << parseTime * 1000.0 << " ms (" << cornerCount / 3 << " triangles)";
+	LOG << "Sequential fill: " << sequentialTime * 1000.0 << " ms (" << megabytes / sequentialTime << " MB/s)";
+	LOG << "Parallel fill (" << BufferFiller::FillRangeCount(cornerCount / 3) << " threads): " << parallelTime * 1000.0 << " ms (" << megabytes / parallelTime << " MB/s)";
+	LOG << "Speedup: x" << sequentialTime / parallelTime;
+	LOG << "Indexed fill: " << indexedTime * 1000.0 << " ms (" << vertices.size() << " vertices, " << indices.size() << " indices)";
+
+	if (memcmp(sequentialAttributes.data(), parallelAttributes.data(), cornerCount * sizeof(PointAttributes)) != 0) {
+		ERR_LOG << "Outputs of the sequential and parallel fills differ!";
+		return false;
+	}
+	LOG << "Outputs are identical (" << cornerCount << " face corners)";
+	return true;
+}
+
 /**
  * Convert .xyz point cloud to .bin ad-hoc file for faster loading
  */
@@ -51,20 +356,110 @@ int main(int argc, char *argv[]) {
 
 	std::string inputFilename;
 	std::string outputFilename;
-	if (argc >= 3) {
+	if (argc >= 3 && std::string(argv[1]) == "--benchmark-xyz") {
+		bool success = benchmarkXyzLoading(argv[2]);
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	else if (argc >= 3 && std::string(argv[1]) == "--benchmark-mesh") {
+		bool success = benchmarkMeshLoading(argv[2]);
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	else if (argc >= 3 && std::string(argv[1]) == "--check-split-stats") {
+		bool success = checkSplitStats(argv[2]);
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	else if (argc >= 3) {
 		inputFilename = std::string(argv[1]);
 		outputFilename = std::string(argv[2]);
 	}
 	else {
-		ERR_LOG << "Usage: PointCloudConvert <inputFilename> <outputFilename>";
+		printUsage();
 		return EXIT_FAILURE;
 	}
 
-	if (argc >= 4 && std::string(argv[3]) == "point-to-point-filter") {
+	std::string mode;
+	size_t chunkSize = PointCloud::s_defaultChunkSize;
+	uint32_t formatVersion = PointCloud::s_binVersion;
+	bool sortMorton = false;
+	std::string viewsFilename;
+	CpuSplitter::Properties splitProperties;
+	for (int i = 3; i < argc; ++i) {
+		std::string arg = argv[i];
+		try {
+			if (arg == "--chunk-size" && i + 1 < argc) {
+				chunkSize = static_cast<size_t>(parseUnsigned(argv[++i]));
+			}
+			else if (arg == "--format-version" && i + 1 < argc) {
+				formatVersion = static_cast<uint32_t>(std::min<unsigned long long>(parseUnsigned(argv[++i]), UINT32_MAX));
+			}
+			else if (arg == "--sort-morton") {
+				sortMorton = true;
+			}
+			else if (arg == "--views" && i + 1 < argc) {
+				viewsFilename = argv[++i];
+			}
+			else if (arg == "--grain-radius" && i + 1 < argc) {
+				splitProperties.grainRadius = parseFloat(argv[++i]);
+			}
+			else if (arg == "--grain-inner-radius-ratio" && i + 1 < argc) {
+				splitProperties.grainInnerRadiusRatio = parseFloat(argv[++i]);
+			}
+			else if (arg == "--instance-limit" && i + 1 < argc) {
+				splitProperties.instanceLimit = parseFloat(argv[++i]);
+			}
+			else if (arg == "--impostor-limit" && i + 1 < argc) {
+				splitProperties.impostorLimit = parseFloat(argv[++i]);
+			}
+			else if (arg == "--no-occlusion-culling") {
+				splitProperties.enableOcclusionCulling = false;
+			}
+			else if (arg == "--no-frustum-culling") {
+				splitProperties.enableFrustumCulling = false;
+			}
+			else if (mode.empty() && arg.substr(0, 2) != "--") {
+				mode = arg;
+			}
+			else {
+				printUsage();
+				return EXIT_FAILURE;
+			}
+		}
+		catch (const std::exception &) { // std::invalid_argument or std::out_of_range
+			ERR_LOG << "Invalid value for option " << arg << ": " << argv[i];
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (chunkSize == 0) {
+		ERR_LOG << "Chunk size must be at least 1";
+		return EXIT_FAILURE;
+	}
+
+	if (formatVersion < 1 || formatVersion > PointCloud::s_binVersion) {
+		ERR_LOG << "Unsupported format version: " << formatVersion;
+		return EXIT_FAILURE;
+	}
+
+	if (mode == "point-to-point-filter") {
 		bool success = filterPointToPointDistance(inputFilename, outputFilename);
 		return success ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
+	if (mode == "split-stats") {
+		std::vector<SplitView> views;
+		if (viewsFilename.empty()) {
+			ERR_LOG << "Mode split-stats requires --views";
+			return EXIT_FAILURE;
+		}
+		PointCloud pointCloud;
+		bool success =
+			loadSplitViews(viewsFilename, views)
+			&& pointCloud.load(inputFilename)
+			&& writeSplitStats(pointCloud, views, splitProperties, outputFilename);
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	if (!endsWith(outputFilename, ".bin")) {
 		outputFilename += ".bin";
 	}
@@ -73,7 +468,7 @@ int main(int argc, char *argv[]) {
 
 	pointCloud.load(inputFilename);
 
-	if (argc >= 4 && std::string(argv[3]) == "bbox-filter") {
+	if (mode == "bbox-filter") {
 		PointCloud filteredPointCloud;
 		filteredPointCloud.data().reserve(pointCloud.data().size());
 		for (const auto& p : pointCloud.data()) {
@@ -82,10 +477,19 @@ int main(int argc, char *argv[]) {
 			}
 		}
 		LOG << "Filtered point cloud down to " << filteredPointCloud.data().size() << " points";
-		filteredPointCloud.saveBin(outputFilename);
+		if (sortMorton) filteredPointCloud.sortMorton();
+		filteredPointCloud.computeChunks(chunkSize);
+		filteredPointCloud.saveBin(outputFilename, formatVersion);
+	}
+	else if (mode.empty()) {
+		if (sortMorton) pointCloud.sortMorton();
+		pointCloud.computeChunks(chunkSize);
+		pointCloud.saveBin(outputFilename, formatVersion);
 	}
 	else {
-		pointCloud.saveBin(outputFilename);
+		ERR_LOG << "Unknown mode: " << mode;
+		printUsage();
+		return EXIT_FAILURE;
 	}
 
 	return EXIT_SUCCESS;
@@ -61,6 +61,7 @@ using namespace std;
 #include "GrainBehaviorDialog.h"
 #include "MeshRendererDialog.h"
 #include "QuadMeshDataDialog.h"
+#include "QualityGovernorDialog.h"
 static std::shared_ptr<Dialog> makeComponentDialog(std::string type, std::shared_ptr<Behavior> component) {
 #define handleBehavior(T) \
 	if (type == BehaviorRegistryEntry<T>::Name()) { \
@@ -77,6 +78,7 @@ static std::shared_ptr<Dialog> makeComponentDialog(std::string type, std::shared
 	handleBehavior(GrainBehavior);
 	handleBehavior(MeshRenderer);
 	handleBehavior(QuadMeshData);
+	handleBehavior(QualityGovernor);
 	return nullptr;
 #undef handleType
 }
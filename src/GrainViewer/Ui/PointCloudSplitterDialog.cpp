@@ -52,6 +52,12 @@ void PointCloudSplitterDialog::draw()
 			for (int i = 0; i < counters.size(); ++i) {
 				ImGui::Text(MAKE_STR(" - " << names[i] << ": " << counters[i].count << "(@" << counters[i].offset << ")").c_str());
 			}
+			if (cont->batchedViewCount() > 0) {
+				ImGui::Text(MAKE_STR(" - Batched views: " << cont->batchedViewCount() << " (algorithm and chunk culling not used)").c_str());
+			}
+			if (cont->properties().lodMode == PointCloudSplitter::LodMode::ScreenSize && cont->properties().enableFrameTimeBudget) {
+				ImGui::Text(MAKE_STR(" - Pixel radius scale: " << cont->lodScale()).c_str());
+			}
 		}
 	}
 }
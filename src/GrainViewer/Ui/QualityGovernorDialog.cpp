@@ -0,0 +1,57 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "QualityGovernorDialog.h"
+#include "utils/guiutils.h"
+#include "utils/behaviorutils.h"
+#include "utils/strutils.h"
+
+#include <imgui.h>
+
+void QualityGovernorDialog::draw()
+{
+	if (auto cont = m_cont.lock()) {
+		if (ImGui::CollapsingHeader("QualityGovernor", ImGuiTreeNodeFlags_DefaultOpen)) {
+			bool enabled = cont->isEnabled();
+			ImGui::Checkbox("Enabled", &enabled);
+			cont->setEnabled(enabled);
+
+			BeginDisable(!enabled);
+			autoUi(cont->properties());
+			EndDisable(!enabled);
+
+			ImGui::Text("\nInfo");
+			ImGui::Text(MAKE_STR(" - Smoothed GPU time: " << cont->smoothedGpuTime() << " ms").c_str());
+			ImGui::Text(MAKE_STR(" - Step: " << cont->step() << "/" << cont->stepCount()).c_str());
+			for (int i = 0; i < cont->knobCount(); ++i) {
+				ImGui::Text(MAKE_STR(" - " << cont->knobName(i) << ": level " << cont->knobLevel(i)).c_str());
+			}
+		}
+	}
+}
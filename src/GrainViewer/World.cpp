@@ -39,9 +39,18 @@
 #include "RuntimeObject.h"
 #include "RenderType.h"
 
+#include <algorithm>
+
 World::World()
 {}
 
+World::~World()
+{
+	if (m_lightsUbo) {
+		glDeleteBuffers(1, &m_lightsUbo);
+	}
+}
+
 bool World::deserialize(const rapidjson::Value & json)
 {
 	bool valid;
@@ -120,6 +129,10 @@ bool World::deserialize(const rapidjson::Value & json)
 			float shadowMapFar;
 			jrOption(l, "shadowMapFar", shadowMapFar, 20.0f);
 
+			if (m_lights.size() >= s_maxLights) {
+				WARN_LOG << "Only the first " << s_maxLights << " lights are taken into account for shading";
+			}
+
 			// Add light
 			auto light = std::make_shared<Light>(pos, col, shadowMapSize, isShadowMapRich, hasShadowMap);
 			light->shadowMap().setProjection(shadowMapFov, shadowMapNear, shadowMapFar);
@@ -134,6 +147,12 @@ void World::start()
 {
 	initVao();
 	m_shader = ShaderPool::GetShader(m_shaderName);
+
+	if (!m_lightsUbo) {
+		glCreateBuffers(1, &m_lightsUbo);
+		glNamedBufferStorage(m_lightsUbo, static_cast<GLsizeiptr>(sizeof(LightsUbo)), NULL, GL_DYNAMIC_STORAGE_BIT);
+	}
+	updateLightsUbo();
 }
 
 void World::update(float time)
@@ -141,6 +160,20 @@ void World::update(float time)
 	for (auto light : lights()) {
 		light->update(time);
 	}
+	updateLightsUbo();
+}
+
+void World::bindLights(const ShaderProgram & shader) const
+{
+	shader.bindUniformBlock("Lights", m_lightsUbo, s_lightsUboBinding);
+	size_t n = std::min(m_lights.size(), s_maxLights);
+	for (size_t k = 0; k < n; ++k) {
+		const ShadowMap& shadowMap = m_lights[k]->shadowMap();
+		glBindTextureUnit(s_shadowMapUnit + static_cast<GLuint>(k), shadowMap.depthTexture());
+		if (m_lights[k]->isRich()) {
+			glBindTextureUnit(s_richShadowMapUnit + static_cast<GLuint>(k), shadowMap.colorTexture(0));
+		}
+	}
 }
 
 void World::reloadShaders()
@@ -199,6 +232,18 @@ void World::renderShadowMaps(const std::vector<std::shared_ptr<RuntimeObject>> &
 
 }
 
+void World::appendShadowMapViews(std::vector<PreRenderView> & views) const
+{
+	if (!isShadowMapEnabled()) {
+		return;
+	}
+	for (const auto& light : m_lights) {
+		if (light->hasShadowMap()) {
+			views.push_back(PreRenderView{ &light->shadowMap().camera(), RenderType::ShadowMap });
+		}
+	}
+}
+
 void World::clear()
 {
 	m_lights.clear();
@@ -208,6 +253,23 @@ void World::clear()
 // Private methods
 ///////////////////////////////////////////////////////////////////////////////
 
+void World::updateLightsUbo() {
+	if (!m_lightsUbo) return;
+	LightsUbo uniforms = {}; // missing lights are black and cast no shadow
+	size_t n = std::min(m_lights.size(), s_maxLights);
+	for (size_t k = 0; k < n; ++k) {
+		const Light& light = *m_lights[k];
+		const Camera& lightCamera = light.shadowMap().camera();
+		LightUbo& u = uniforms.light[k];
+		u.matrix = lightCamera.projectionMatrix() * lightCamera.viewMatrix();
+		u.position_ws = light.position();
+		u.isRich = light.isRich() ? 1 : 0;
+		u.color = light.color();
+		u.hasShadowMap = light.hasShadowMap() ? 1 : 0;
+	}
+	glNamedBufferSubData(m_lightsUbo, 0, static_cast<GLsizeiptr>(sizeof(LightsUbo)), &uniforms);
+}
+
 void World::initVao() {
 	GLfloat attributes[] = {
 		-1.0f,  1.0f, -1.0f,
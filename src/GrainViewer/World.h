@@ -32,8 +32,10 @@
 #include <OpenGL>
 
 #include "Camera.h"
+#include "RenderType.h"
 
 #include <rapidjson/document.h>
+#include <glm/glm.hpp>
 
 #include <vector>
 #include <memory>
@@ -46,8 +48,17 @@ class RuntimeObject;
  * Contains all lighting information for a render
  */
 class World {
+public:
+	// Must match the size of the light array in shaders/include/uniform/lights.inc.glsl
+	static constexpr size_t s_maxLights = 3;
+	// Uniform buffer binding and first texture units used by bindLights()
+	static constexpr GLuint s_lightsUboBinding = 2;
+	static constexpr GLuint s_shadowMapUnit = 10;
+	static constexpr GLuint s_richShadowMapUnit = s_shadowMapUnit + s_maxLights;
+
 public:
 	World();
+	~World();
 	bool deserialize(const rapidjson::Value & json);
 	void start();
 	void update(float time);
@@ -55,9 +66,18 @@ public:
 	void onPreRender(const Camera & camera) const;
 	void render(const Camera & camera) const;
 	void renderShadowMaps(const std::vector<std::shared_ptr<RuntimeObject>> & objects) const;
+	// Views that renderShadowMaps() pre-renders objects for
+	void appendShadowMapViews(std::vector<PreRenderView> & views) const;
 
 	const std::vector<std::shared_ptr<Light>> & lights() const { return m_lights; }
 
+	/**
+	 * Bind the "Lights" uniform block, updated once per frame by update(),
+	 * and the shadow maps of the lights to the fixed texture units expected
+	 * by shaders/include/uniform/lights.inc.glsl.
+	 */
+	void bindLights(const ShaderProgram & shader) const;
+
 	void clear();
 
 	bool isShadowMapEnabled() const { return m_isShadowMapEnabled; }
@@ -65,6 +85,20 @@ public:
 
 private:
 	void initVao();
+	void updateLightsUbo();
+
+private:
+	// Memory layout on GPU, matches shaders/include/uniform/lights.inc.glsl
+	struct LightUbo {
+		glm::mat4 matrix;
+		glm::vec3 position_ws;
+		GLint isRich;
+		glm::vec3 color;
+		GLint hasShadowMap;
+	};
+	struct LightsUbo {
+		LightUbo light[s_maxLights];
+	};
 
 private:
 	std::string m_shaderName = "World";
@@ -72,5 +106,6 @@ private:
 	std::shared_ptr<ShaderProgram> m_shader;
 	GLuint m_vbo; // TODO: use GlBuffer here!
 	GLuint m_vao;
+	GLuint m_lightsUbo = 0;
 	bool m_isShadowMapEnabled = true;
 };
@@ -32,6 +32,9 @@
 #include <OpenGL>
 
 #include "Mesh.h"
+#include "utils/parallel.h"
+
+#include <vector>
 
 struct PointAttributes {
 	GLfloat position[3];
@@ -66,15 +69,41 @@ public:
 
 	void fill(PointAttributes* attributes, size_t nbElements) const;
 
+	/**
+	 * Indexed alternative to fill(): face corners sharing their position,
+	 * normal, uv and material are welded into a single vertex, whose tangent
+	 * is the average of the ones of its faces. Triangles are then reordered
+	 * for the post-transform vertex cache, and vertices in order of use.
+	 */
+	void fillIndexed(std::vector<PointAttributes>& vertices, std::vector<GLuint>& indices) const;
+
 public:
+	/**
+	 * Triangles are filled in parallel by threadCount threads (fewer for
+	 * small meshes), each writing its own range of attributes.
+	 */
 	static void Fill(
 		PointAttributes* attributes,
 		size_t nbElements,
 		const Mesh& scene,
+		glm::vec3 globalOffset,
+		size_t threadCount = workerCount()
+	);
+
+	/**
+	 * Number of ranges, hence of threads, actually used by Fill() for a given
+	 * number of triangles.
+	 */
+	static size_t FillRangeCount(size_t triangleCount, size_t threadCount = workerCount());
+
+	static void FillIndexed(
+		std::vector<PointAttributes>& vertices,
+		std::vector<GLuint>& indices,
+		const Mesh& scene,
 		glm::vec3 globalOffset
 	);
 
 private:
 	const Mesh & m_mesh;
-	glm::vec3 m_globalOffset;
+	glm::vec3 m_globalOffset = glm::vec3(0.0f);
 };
@@ -0,0 +1,200 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "MappedFile.h"
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else // _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#endif // _WIN32
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string & filename)
+{
+	close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		ERR_LOG << "Could not open file: " << filename;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		ERR_LOG << "Could not get size of file: " << filename;
+		CloseHandle(file);
+		return false;
+	}
+
+	m_filename = filename;
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0) {
+		// Empty files cannot be mapped, but this is not an error
+		CloseHandle(file);
+		m_data = "";
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		ERR_LOG << "Could not map file: " << filename;
+		CloseHandle(file);
+		return false;
+	}
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		ERR_LOG << "Could not map file: " << filename;
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_fileHandle = file;
+	m_mappingHandle = mapping;
+	m_data = static_cast<const char*>(view);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_mappingHandle) {
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mappingHandle);
+		CloseHandle(m_fileHandle);
+		m_mappingHandle = nullptr;
+		m_fileHandle = nullptr;
+	}
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void MappedFile::adviseSequential(size_t offset, size_t size) const
+{
+	// Already requested by FILE_FLAG_SEQUENTIAL_SCAN
+}
+
+void MappedFile::discard(size_t offset, size_t size) const
+{
+	if (!m_mappingHandle || size == 0) return;
+	// Unlocking pages that are not locked removes them from the working set
+	VirtualUnlock(const_cast<char*>(m_data + offset), size);
+}
+
+#else // _WIN32
+
+bool MappedFile::open(const std::string & filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		ERR_LOG << "Could not open file: " << filename;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		ERR_LOG << "Could not get size of file: " << filename;
+		::close(fd);
+		return false;
+	}
+
+	m_filename = filename;
+	m_size = static_cast<size_t>(st.st_size);
+	if (m_size == 0) {
+		// Empty files cannot be mapped, but this is not an error
+		::close(fd);
+		m_data = "";
+		return true;
+	}
+
+	void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping remains valid after the file descriptor is closed
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		ERR_LOG << "Could not map file: " << filename;
+		m_size = 0;
+		return false;
+	}
+
+	m_data = static_cast<const char*>(addr);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data && m_size > 0) {
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+	m_data = nullptr;
+	m_size = 0;
+}
+
+// madvise requires page aligned addresses
+static void alignedAdvise(const char *base, size_t fileSize, size_t offset, size_t size, int advice)
+{
+	if (size == 0 || offset >= fileSize) return;
+	size = std::min(size, fileSize - offset);
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t begin = offset - offset % pageSize;
+	madvise(const_cast<char*>(base + begin), size + (offset - begin), advice);
+}
+
+void MappedFile::adviseSequential(size_t offset, size_t size) const
+{
+	if (!m_data) return;
+	alignedAdvise(m_data, m_size, offset, size, MADV_SEQUENTIAL);
+}
+
+void MappedFile::discard(size_t offset, size_t size) const
+{
+	if (!m_data) return;
+	// Only discard whole pages, so that neighbor data remains resident
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+	size_t end = (offset + size) / pageSize * pageSize;
+	if (end <= begin) return;
+	// Mapping is read-only and private, so pages can be dropped and reloaded
+	alignedAdvise(m_data, m_size, begin, end - begin, MADV_DONTNEED);
+}
+
+#endif // _WIN32
@@ -0,0 +1,82 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Read-only memory mapping of a whole file. Pages are loaded lazily by the
+ * OS when they are first accessed, so mapping a file is cheap and reading it
+ * does not require any intermediate copy in client memory.
+ * Usage:
+ *   MappedFile file;
+ *   if (!file.open(filename)) return false;
+ *   const char *bytes = file.data();
+ */
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	/// Map the file, return false if it could not be opened
+	bool open(const std::string & filename);
+	/// Unmap the file (automatically called upon destruction)
+	void close();
+
+	/**
+	 * Hint the OS that the range will be accessed sequentially, in the order
+	 * of increasing addresses (enables aggressive readahead).
+	 */
+	void adviseSequential(size_t offset, size_t size) const;
+
+	/**
+	 * Hint the OS that a range will not be accessed any more, so that its
+	 * pages can be released from the resident memory of the process. The
+	 * content remains valid and will be paged in again if it is accessed.
+	 */
+	void discard(size_t offset, size_t size) const;
+
+	inline bool isOpen() const { return m_data != nullptr; }
+	inline const char *data() const { return m_data; }
+	inline size_t size() const { return m_size; }
+	inline const std::string & filename() const { return m_filename; }
+
+private:
+	const char *m_data = nullptr;
+	size_t m_size = 0;
+	std::string m_filename;
+#ifdef _WIN32
+	void *m_fileHandle = nullptr;
+	void *m_mappingHandle = nullptr;
+#endif // _WIN32
+};
@@ -188,6 +188,47 @@ void autoUi(T& properties) {
 	});
 }
 
+/**
+ * Tell whether reflected properties have a member of the given name.
+ * The type T must have reflection enabled (see refl-cpp)
+ */
+template<typename T>
+bool hasProperty(const T& properties, const std::string& name) {
+	bool found = false;
+	for_each(refl::reflect(properties).members, [&](auto member) {
+		found = found || std::string(member.name) == name;
+	});
+	return found;
+}
+
+/**
+ * Copy a single member, given by name, from a set of properties to another.
+ * The type T must have reflection enabled (see refl-cpp)
+ */
+template<typename T>
+void copyProperty(const T& source, T& destination, const std::string& name) {
+	for_each(refl::reflect(destination).members, [&](auto member) {
+		if (std::string(member.name) == name) {
+			member(destination) = member(source);
+		}
+	});
+}
+
+/**
+ * Tell whether a single member, given by name, is equal in two sets of
+ * properties. The type T must have reflection enabled (see refl-cpp)
+ */
+template<typename T>
+bool isPropertyEqual(const T& a, const T& b, const std::string& name) {
+	bool isEqual = true;
+	for_each(refl::reflect(a).members, [&](auto member) {
+		if (std::string(member.name) == name) {
+			isEqual = member(a) == member(b);
+		}
+	});
+	return isEqual;
+}
+
 // Misc utils (should end up somewhere else)
 template <typename Enum>
 constexpr Enum lastValue() {
@@ -203,7 +244,7 @@ constexpr Enum lastValue() {
 	bool Type::Properties::operator==(const Properties& other) { \
 		bool isEqual = true; \
 		for_each(refl::reflect(*this).members, [&](auto member) { \
-			isEqual = isEqual && (member(*this) != member(other)); \
+			isEqual = isEqual && (member(*this) == member(other)); \
 		}); \
 		return isEqual; \
 	} \
@@ -0,0 +1,155 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "discriminate.glsl.h"
+
+// Extracted from grain/discriminate.inc.glsl and the include files it depends on
+namespace glsl {
+	using namespace glm;
+
+	bool isOrthographic(const mat4& projectionMatrix) {
+		return abs(projectionMatrix[3][3]) > 0.01f;
+	}
+
+	/**
+	 * Parameter 'planes' contains coefficients (a, b, c, d) such that (x,y,z) is a point of the plane iff ax+by+cz+d=0
+	 * There are six frustum planes, in this order: left, right, top, bottom, near, far
+	 */
+	static void ExtractFrustumPlanes(const mat4& projectionMatrix, vec4 planes[6]) {
+		mat4 m = transpose(projectionMatrix);
+		planes[0] = m[3] + m[0];
+		planes[1] = m[3] - m[0];
+		planes[2] = m[3] + m[1];
+		planes[3] = m[3] - m[1];
+		planes[4] = m[3] + m[2];
+		planes[5] = m[3] - m[2];
+	}
+
+	/**
+	 * Frustum culling of a sphere at position p of radius r
+	 */
+	bool SphereFrustumCulling(const mat4& projectionMatrix, vec3 p, float radius) {
+		vec4 planes[6];
+		ExtractFrustumPlanes(projectionMatrix, planes);
+		for (int i = 0; i < 5; i++) {
+			float dist = dot(vec4(p, 1.0f), planes[i]);
+			if (dist < -radius) return true; // sphere culled
+		}
+		return false;
+	}
+
+	/**
+	 * Estimate projection of sphere on screen to determine sprite size (diameter).
+	 */
+	float SpriteSize(const mat4& projectionMatrix, vec2 resolution, float radius, vec4 position_clipspace) {
+		if (isOrthographic(projectionMatrix)) {
+			float a = projectionMatrix[0][0] * resolution.x;
+			float c = projectionMatrix[1][1] * resolution.y;
+			return max(a, c) * radius;
+		} else {
+			return max(resolution.x, resolution.y) * projectionMatrix[1][1] * radius / position_clipspace.w;
+		}
+	}
+
+	static bool isInOcclusionCone(vec3 position_cs, vec3 otherGrain_cs, float innerRadius, float outerOverInnerRadius) {
+		vec3 closestCone_cs = otherGrain_cs * outerOverInnerRadius;
+		if (closestCone_cs == vec3(0.0f)) return false; // normalize() would return NaNs
+		float cosAlpha = dot(normalize(closestCone_cs), normalize(position_cs - closestCone_cs));
+		if (cosAlpha >= 0) {
+			float sinBeta = innerRadius / length(otherGrain_cs);
+			float sin2Alpha = 1.0f - cosAlpha * cosAlpha;
+			float sin2Beta = sinBeta * sinBeta;
+			if (sin2Alpha < sin2Beta) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Choses the most appropriate model to render the point at model position
+	 * 'position', which may be no model at all if culling tests don't pass.
+	 * return one of cRenderModel* constants
+	 */
+	uint discriminate(
+		const DiscriminateUniforms& uniforms,
+		vec3 position,
+		float outerRadius,
+		float innerRadius,
+		float outerOverInnerRadius,
+		const OcclusionMap& occlusionMap)
+	{
+		vec4 position_cs = uniforms.viewModelMatrix * vec4(position, 1.0f);
+
+		float instanceLimit2 = uniforms.instanceLimit * uniforms.instanceLimit;
+		float impostorLimit2 = uniforms.impostorLimit * uniforms.impostorLimit;
+
+		// Distance-based discrimination
+		// (w = 1, so limits are compared with d^2 + 1, see PointCloudSplitter::lodDistanceLimits())
+		uint model = cRenderModelNone;
+		float l2 = dot(position_cs, position_cs);
+		if (l2 < impostorLimit2) {
+			model = l2 < instanceLimit2 ? cRenderModelInstance : cRenderModelImpostor;
+		} else {
+			model = cRenderModelPoint;
+		}
+
+		// Frustum culling, with the same unexplained multiplication factor
+		float fac = 4.0f;
+		if (uniforms.enableFrustumCulling && SphereFrustumCulling(uniforms.projectionMatrix, vec3(position_cs), fac * outerRadius)) {
+			return cRenderModelNone;
+		}
+
+		// Extra bounding-box culling
+		if (uniforms.useBbox) {
+			if (
+				position.x < uniforms.bboxMin.x || position.x > uniforms.bboxMax.x ||
+				position.y < uniforms.bboxMin.y || position.y > uniforms.bboxMax.y ||
+				position.z < uniforms.bboxMin.z || position.z > uniforms.bboxMax.z
+			) {
+				return cRenderModelNone;
+			}
+		}
+
+		// Occlusion culling
+		if (uniforms.enableOcclusionCulling && !occlusionMap.empty()) {
+			vec4 position_ps = uniforms.projectionMatrix * vec4(vec3(position_cs), 1.0f);
+			vec2 fragCoord = uniforms.resolution * (vec2(position_ps) / position_ps.w * 0.5f + 0.5f);
+
+			fragCoord = clamp(fragCoord, vec2(0.5f), uniforms.resolution - vec2(0.5f));
+			ivec2 texel = ivec2(fragCoord);
+			vec3 otherGrain_cs = vec3(occlusionMap[texel.y * static_cast<int>(uniforms.resolution.x) + texel.x]);
+			if (isInOcclusionCone(vec3(position_cs), otherGrain_cs, innerRadius, outerOverInnerRadius)) {
+				return cRenderModelNone;
+			}
+		}
+
+		return model;
+	}
+}
@@ -0,0 +1,77 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// (almost) mutant code replicated from grain/discriminate.inc.glsl
+// comments are in the cpp
+
+namespace glsl {
+	using namespace glm;
+
+	// Must match grain/discriminate.inc.glsl
+	constexpr uint cRenderModelInstance = 0;
+	constexpr uint cRenderModelImpostor = 1;
+	constexpr uint cRenderModelPoint = 2;
+	constexpr uint cRenderModelNone = 3;
+	constexpr uint cRenderModelCount = 4;
+
+	// Uniforms read by discriminate(), including the ones of camera.inc.glsl
+	struct DiscriminateUniforms {
+		mat4 viewModelMatrix = mat4(1.0f);
+		mat4 projectionMatrix = mat4(1.0f);
+		vec2 resolution = vec2(1.0f);
+		bool enableOcclusionCulling = true;
+		bool enableFrustumCulling = true;
+		float instanceLimit = 1.05f;
+		float impostorLimit = 10.0f;
+		bool useBbox = false;
+		vec3 bboxMin = vec3(0.0f);
+		vec3 bboxMax = vec3(0.0f);
+	};
+
+	// Texels of the occlusion map, row by row, of size uniforms.resolution
+	typedef std::vector<vec4> OcclusionMap;
+
+	bool isOrthographic(const mat4& projectionMatrix);
+	bool SphereFrustumCulling(const mat4& projectionMatrix, vec3 p, float radius);
+	float SpriteSize(const mat4& projectionMatrix, vec2 resolution, float radius, vec4 position_clipspace);
+
+	uint discriminate(
+		const DiscriminateUniforms& uniforms,
+		vec3 position,
+		float outerRadius,
+		float innerRadius,
+		float outerOverInnerRadius,
+		const OcclusionMap& occlusionMap);
+}
@@ -0,0 +1,75 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * Incremental 64-bit FNV-1a hash, used to name cache files after the content
+ * they were built from. It is not meant to resist collisions on purpose.
+ */
+class Fnv1a {
+public:
+	Fnv1a& add(const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			m_hash ^= static_cast<uint64_t>(bytes[i]);
+			m_hash *= s_prime;
+		}
+		return *this;
+	}
+
+	Fnv1a& add(const std::string& str) {
+		return add(str.data(), str.size() + 1); // with the terminating null, so that "a"+"b" != "ab"
+	}
+
+	template <typename T>
+	Fnv1a& addValue(const T& value) {
+		return add(&value, sizeof(T));
+	}
+
+	uint64_t value() const { return m_hash; }
+
+	// 16 digits hexadecimal representation of the hash
+	std::string hex() const {
+		static const char* digits = "0123456789abcdef";
+		std::string str(16, '0');
+		for (int i = 0; i < 16; ++i) {
+			str[15 - i] = digits[(m_hash >> (4 * i)) & 0xf];
+		}
+		return str;
+	}
+
+private:
+	static constexpr uint64_t s_prime = 0x100000001b3ull;
+	uint64_t m_hash = 0xcbf29ce484222325ull;
+};
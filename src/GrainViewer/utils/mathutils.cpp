@@ -37,6 +37,21 @@ int ilog2(int x) {
 	return log;
 }
 
+// Insert two zero bits between each of the 21 lowest bits of x
+static uint64_t spreadBits3(uint32_t x) {
+	uint64_t v = x & 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+	return spreadBits3(x) | (spreadBits3(y) << 1) | (spreadBits3(z) << 2);
+}
+
 // From J. Dupuy's dj_brdf.h
 using float_t = float;
 #ifndef __GNUC__ // a bug in gcc makes it not declaring logf in the std namespace
@@ -29,8 +29,16 @@
 
 #pragma once
 
+#include <cstdint>
+
 // Assuming x > 0
 int ilog2(int x);
 
+/**
+ * Interleave the 21 lowest bits of x, y and z (x being the least
+ * significant), so that sorting codes sorts points along a Morton curve.
+ */
+uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z);
+
 float djerf(float x);
 float djerfinv(float u);
@@ -0,0 +1,168 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "utils/meshutils.h"
+
+#include <limits>
+
+namespace {
+
+/**
+ * Triangles around each vertex, as a compressed list: the triangles of
+ * vertex v are triangles[offsets[v]] to triangles[offsets[v + 1] - 1].
+ */
+struct VertexTriangleAdjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+
+	VertexTriangleAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+		: offsets(vertexCount + 1, 0)
+		, triangles(indices.size())
+	{
+		for (uint32_t i : indices) {
+			++offsets[i + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			offsets[v + 1] += offsets[v];
+		}
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i) {
+			triangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+};
+
+} // namespace
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+{
+	constexpr int none = -1;
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	VertexTriangleAdjacency adjacency(indices, vertexCount);
+	std::vector<int> liveTriangles(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		liveTriangles[v] = static_cast<int>(adjacency.offsets[v + 1] - adjacency.offsets[v]);
+	}
+	std::vector<int> cacheTime(vertexCount, 0);
+	std::vector<bool> isEmitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd; // recently used vertices, as a stack
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	int time = cacheSize + 1;
+	size_t nextVertex = 0; // cursor for restarts when the dead end stack is empty
+	int fanningVertex = 0;
+	while (fanningVertex != none) {
+		// 1. Emit all the remaining triangles around the fanning vertex
+		candidates.clear();
+		uint32_t f = static_cast<uint32_t>(fanningVertex);
+		for (uint32_t k = adjacency.offsets[f]; k < adjacency.offsets[f + 1]; ++k) {
+			uint32_t t = adjacency.triangles[k];
+			if (isEmitted[t]) continue;
+			for (int j = 0; j < 3; ++j) {
+				uint32_t v = indices[3 * t + j];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--liveTriangles[v];
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+			isEmitted[t] = true;
+		}
+
+		// 2. Next fanning vertex: the oldest candidate that will still be in
+		// cache once its remaining triangles are emitted
+		fanningVertex = none;
+		int bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (liveTriangles[v] <= 0) continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = time - cacheTime[v];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanningVertex = static_cast<int>(v);
+			}
+		}
+
+		// 3. Otherwise, a recently used vertex, or any vertex left
+		while (fanningVertex == none && !deadEnd.empty()) {
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) {
+				fanningVertex = static_cast<int>(v);
+			}
+		}
+		while (fanningVertex == none && nextVertex < vertexCount) {
+			if (liveTriangles[nextVertex] > 0) {
+				fanningVertex = static_cast<int>(nextVertex);
+			}
+			++nextVertex;
+		}
+	}
+
+	indices.swap(output);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	std::vector<uint32_t> remap(vertexCount, std::numeric_limits<uint32_t>::max());
+	uint32_t nextVertex = 0;
+	for (uint32_t& i : indices) {
+		if (remap[i] == std::numeric_limits<uint32_t>::max()) {
+			remap[i] = nextVertex++;
+		}
+		i = remap[i];
+	}
+	return remap;
+}
+
+float averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return 0.0f;
+
+	// A vertex is in the FIFO cache if less than cacheSize vertices were loaded after it
+	std::vector<int> loadTime(vertexCount, -cacheSize - 1);
+	int time = 0;
+	size_t missCount = 0;
+	for (uint32_t i : indices) {
+		if (time - loadTime[i] >= cacheSize) {
+			loadTime[i] = ++time;
+			++missCount;
+		}
+	}
+	return static_cast<float>(missCount) / static_cast<float>(triangleCount);
+}
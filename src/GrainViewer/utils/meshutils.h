@@ -0,0 +1,56 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Reorder the triangles of an indexed triangle list for the post-transform
+ * vertex cache, with the Tipsify algorithm (Sander, Nehab and Barczak 2007,
+ * "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+ * cacheSize is the number of vertices the cache is assumed to hold.
+ */
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
+
+/**
+ * Renumber vertices in the order in which indices first use them, so that
+ * vertex fetches are as sequential as possible. Indices are updated in place
+ * and the returned remap gives the new index of each old vertex (or
+ * UINT32_MAX for vertices that no triangle uses).
+ */
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount);
+
+/**
+ * Average number of vertex shader invocations per triangle (ACMR) with a
+ * FIFO cache of cacheSize vertices, between 0.5 and 3.
+ */
+float averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
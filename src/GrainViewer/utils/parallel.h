@@ -0,0 +1,128 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Number of threads used by parallelFor()
+ */
+inline size_t workerCount() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Split [0, count[ into rangeCount contiguous ranges of (almost) equal size
+ * and call fn(begin, end, rangeIndex) on each of them from a different
+ * thread. Return when all ranges have been processed.
+ */
+template <typename Fn>
+void parallelFor(size_t count, Fn fn, size_t rangeCount = workerCount()) {
+	rangeCount = std::max<size_t>(1, std::min(rangeCount, count));
+	if (rangeCount == 1) {
+		fn(size_t(0), count, size_t(0));
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(rangeCount - 1);
+	for (size_t r = 1; r < rangeCount; ++r) {
+		threads.emplace_back([&fn, r, count, rangeCount]() {
+			fn(r * count / rangeCount, (r + 1) * count / rangeCount, r);
+		});
+	}
+	fn(size_t(0), count / rangeCount, size_t(0));
+	for (auto & thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * Stable LSD radix sort of values by their integer keys, 8 bits at a time,
+ * both arrays being permuted. Only the keyBits lowest bits of keys are
+ * considered. Each pass builds per thread histograms of its range of keys,
+ * then each thread scatters its range at offsets given by the prefix sum
+ * of histograms in (digit, thread) order, which keeps the sort stable.
+ */
+template <typename Key, typename Value>
+void parallelRadixSort(std::vector<Key> & keys, std::vector<Value> & values, int keyBits = 8 * sizeof(Key)) {
+	constexpr int digitBits = 8;
+	constexpr size_t bucketCount = size_t(1) << digitBits;
+	size_t count = keys.size();
+	size_t rangeCount = std::max<size_t>(1, std::min(workerCount(), count / 65536));
+
+	std::vector<Key> keysBuffer(count);
+	std::vector<Value> valuesBuffer(count);
+	std::vector<size_t> histograms(rangeCount * bucketCount);
+
+	for (int shift = 0; shift < keyBits; shift += digitBits) {
+		std::fill(histograms.begin(), histograms.end(), 0);
+		parallelFor(count, [&](size_t begin, size_t end, size_t r) {
+			size_t *histogram = histograms.data() + r * bucketCount;
+			for (size_t i = begin; i < end; ++i) {
+				++histogram[(keys[i] >> shift) & (bucketCount - 1)];
+			}
+		}, rangeCount);
+
+		// Skip passes where all keys share the same digit
+		bool isTrivial = false;
+		for (size_t b = 0; b < bucketCount && !isTrivial; ++b) {
+			size_t bucketSize = 0;
+			for (size_t r = 0; r < rangeCount; ++r) bucketSize += histograms[r * bucketCount + b];
+			isTrivial = bucketSize == count;
+		}
+		if (isTrivial) continue;
+
+		// Exclusive prefix sum, turning histograms into scatter offsets
+		size_t offset = 0;
+		for (size_t b = 0; b < bucketCount; ++b) {
+			for (size_t r = 0; r < rangeCount; ++r) {
+				size_t bucketSize = histograms[r * bucketCount + b];
+				histograms[r * bucketCount + b] = offset;
+				offset += bucketSize;
+			}
+		}
+
+		parallelFor(count, [&](size_t begin, size_t end, size_t r) {
+			size_t *offsets = histograms.data() + r * bucketCount;
+			for (size_t i = begin; i < end; ++i) {
+				size_t j = offsets[(keys[i] >> shift) & (bucketCount - 1)]++;
+				keysBuffer[j] = keys[i];
+				valuesBuffer[j] = values[i];
+			}
+		}, rangeCount);
+
+		keys.swap(keysBuffer);
+		values.swap(valuesBuffer);
+	}
+}
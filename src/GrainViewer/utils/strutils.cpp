@@ -33,6 +33,9 @@
 #include <algorithm>
 #include <functional>
 #include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <locale>
 
 // trim from start (in place)
 void ltrim(std::string& s) {
@@ -88,3 +91,98 @@ std::string bitname(int flags, int flagCount)
 	}
 	return text;
 }
+
+// Fallback used when the fast path of parseFloat() cannot guarantee an exact result
+static bool parseFloatUsingStream(const char *begin, const char *end, float & value) {
+	std::istringstream ss(std::string(begin, end));
+	ss.imbue(std::locale::classic());
+	ss >> value;
+	return !ss.fail() && ss.peek() == std::char_traits<char>::eof();
+}
+
+bool parseFloat(const char *begin, const char *end, float & value) {
+	constexpr int maxDigits = 19; // so that mantissa fits in 64 bits
+	const char *c = begin;
+	bool negative = false;
+	if (c < end && (*c == '+' || *c == '-')) {
+		negative = *c == '-';
+		++c;
+	}
+
+	uint64_t mantissa = 0;
+	int digitCount = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	bool truncated = false;
+	for (; c < end && *c >= '0' && *c <= '9'; ++c) {
+		hasDigits = true;
+		if (mantissa == 0 && *c == '0') continue;
+		if (digitCount < maxDigits) {
+			mantissa = mantissa * 10 + (*c - '0');
+			++digitCount;
+		} else {
+			truncated = true;
+			++exponent;
+		}
+	}
+	if (c < end && *c == '.') {
+		++c;
+		for (; c < end && *c >= '0' && *c <= '9'; ++c) {
+			hasDigits = true;
+			if (mantissa == 0 && *c == '0') {
+				--exponent;
+			} else if (digitCount < maxDigits) {
+				mantissa = mantissa * 10 + (*c - '0');
+				++digitCount;
+				--exponent;
+			} else {
+				truncated = true;
+			}
+		}
+	}
+	if (!hasDigits) return false;
+
+	if (c < end && (*c == 'e' || *c == 'E')) {
+		++c;
+		bool negativeExponent = false;
+		if (c < end && (*c == '+' || *c == '-')) {
+			negativeExponent = *c == '-';
+			++c;
+		}
+		if (c == end || *c < '0' || *c > '9') return false;
+		int e = 0;
+		for (; c < end && *c >= '0' && *c <= '9'; ++c) {
+			if (e < 100000) e = e * 10 + (*c - '0');
+		}
+		exponent += negativeExponent ? -e : e;
+	}
+	if (c != end) return false;
+
+	if (mantissa == 0) {
+		value = negative ? -0.0f : 0.0f;
+		return true;
+	}
+
+	// Clinger's fast path: both the mantissa and the power of ten are exactly
+	// represented as doubles, so a single operation gives the correctly rounded
+	// double. Rounding it again to float is exact unless it falls exactly
+	// half way between two floats, in which case we use the slow path.
+	static const double powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+		double d = static_cast<double>(mantissa);
+		d = exponent < 0 ? d / powersOfTen[-exponent] : d * powersOfTen[exponent];
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		constexpr uint64_t lowBitsMask = (uint64_t(1) << 29) - 1; // bits dropped when rounding to float
+		constexpr uint64_t halfWay = uint64_t(1) << 28;
+		if ((bits & lowBitsMask) != halfWay) {
+			value = static_cast<float>(negative ? -d : d);
+			return true;
+		}
+	}
+
+	return parseFloatUsingStream(begin, end, value);
+}
@@ -62,6 +62,21 @@ std::string replaceAll(std::string str, const std::string& search, const std::st
 
 std::string bitname(int flags, int flagCount);
 
+/**
+ * Locale independent parsing of a decimal number spanning exactly the range
+ * [begin, end[. The result is the same as when reading it with operator>>
+ * from a stream using the classic locale, but much faster in the common case
+ * of numbers with up to 19 significant digits and small exponents.
+ * Return false if the range is not a plain decimal number (e.g. it contains
+ * trailing characters, or is inf, nan or out of range).
+ */
+bool parseFloat(const char *begin, const char *end, float & value);
+
+// Whitespace as defined by std::isspace in the classic locale
+inline bool isClassicSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
 // from https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf
 template<typename ... Args>
 std::string string_format(const std::string& format, Args ... args)